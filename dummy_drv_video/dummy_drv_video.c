@@ -824,9 +824,10 @@ VAStatus dummy_BufferSetNumElements(
     return vaStatus;
 }
 
-VAStatus dummy_MapBuffer(
+VAStatus dummy_MapBuffer2(
 		VADriverContextP ctx,
 		VABufferID buf_id,	/* in */
+		unsigned int flags,	/* in */
 		void **pbuf         /* out */
 	)
 {
@@ -840,6 +841,14 @@ VAStatus dummy_MapBuffer(
         return vaStatus;
     }
 
+    /*
+     * The data store lives in system memory, so there is never anything
+     * to copy in (or to flush): a write-only or write-combined map gets
+     * the store as it is, the client is going to overwrite it anyway.
+     * A driver with device memory would only read back the buffer here
+     * when VA_MAPBUFFER_FLAG_READ (or no flag) is given.
+     */
+
     if (NULL != obj_buffer->buffer_data)
     {
         *pbuf = obj_buffer->buffer_data;
@@ -848,6 +857,15 @@ VAStatus dummy_MapBuffer(
     return vaStatus;
 }
 
+VAStatus dummy_MapBuffer(
+		VADriverContextP ctx,
+		VABufferID buf_id,	/* in */
+		void **pbuf         /* out */
+	)
+{
+    return dummy_MapBuffer2(ctx, buf_id, VA_MAPBUFFER_FLAG_DEFAULT, pbuf);
+}
+
 VAStatus dummy_UnmapBuffer(
 		VADriverContextP ctx,
 		VABufferID buf_id	/* in */
@@ -875,7 +893,10 @@ VAStatus dummy_DestroyBuffer(
 {
     INIT_DRIVER_DATA
     object_buffer_p obj_buffer = BUFFER(buffer_id);
-    ASSERT(obj_buffer);
+
+    /* dummy_RenderPicture already destroyed the buffers it was given */
+    if (NULL == obj_buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
 
     dummy__destroy_buffer(driver_data, obj_buffer);
     return VA_STATUS_SUCCESS;
@@ -968,6 +989,77 @@ VAStatus dummy_EndPicture(
 }
 
 
+VAStatus dummy_SubmitPictures(
+		VADriverContextP ctx,
+		VAPictureJob *jobs,
+		int num_jobs
+	)
+{
+    INIT_DRIVER_DATA
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    int i, j;
+
+    /* each heap is locked once for the whole batch rather than for every object */
+    object_heap_lock( &driver_data->context_heap );
+    object_heap_lock( &driver_data->surface_heap );
+    object_heap_lock( &driver_data->buffer_heap );
+
+    for (i = 0; i < num_jobs; i++)
+    {
+        VAPictureJob *job = &jobs[i];
+        object_context_p obj_context;
+        object_surface_p obj_surface;
+
+        obj_context = (object_context_p) object_heap_lookup_unlocked( &driver_data->context_heap, job->context );
+        obj_surface = (object_surface_p) object_heap_lookup_unlocked( &driver_data->surface_heap, job->render_target );
+
+        job->status = VA_STATUS_SUCCESS;
+        if (NULL == obj_context)
+        {
+            job->status = VA_STATUS_ERROR_INVALID_CONTEXT;
+        }
+        else if (NULL == obj_surface)
+        {
+            job->status = VA_STATUS_ERROR_INVALID_SURFACE;
+        }
+
+        /* Release buffers, as dummy_RenderPicture does */
+        for (j = 0; j < job->num_buffers; j++)
+        {
+            object_buffer_p obj_buffer = (object_buffer_p) object_heap_lookup_unlocked( &driver_data->buffer_heap, job->buffers[j] );
+            if (NULL == obj_buffer)
+            {
+                if (VA_STATUS_SUCCESS == job->status)
+                {
+                    job->status = VA_STATUS_ERROR_INVALID_BUFFER;
+                }
+                continue;
+            }
+            free(obj_buffer->buffer_data);
+            obj_buffer->buffer_data = NULL;
+            object_heap_free_unlocked( &driver_data->buffer_heap, (object_base_p) obj_buffer );
+        }
+
+        // Done with rendering right away, as in dummy_EndPicture
+        if (obj_context)
+        {
+            obj_context->current_render_target = -1;
+        }
+
+        if ((VA_STATUS_SUCCESS != job->status) && (VA_STATUS_SUCCESS == vaStatus))
+        {
+            vaStatus = job->status;
+        }
+    }
+
+    object_heap_unlock( &driver_data->buffer_heap );
+    object_heap_unlock( &driver_data->surface_heap );
+    object_heap_unlock( &driver_data->context_heap );
+
+    return vaStatus;
+}
+
+
 VAStatus dummy_SyncSurface(
 		VADriverContextP ctx,
 		VASurfaceID render_target
@@ -1181,6 +1273,8 @@ VAStatus VA_DRIVER_INIT_FUNC(  VADriverContextP ctx )
     vtable->vaCreateBuffer = dummy_CreateBuffer;
     vtable->vaBufferSetNumElements = dummy_BufferSetNumElements;
     vtable->vaMapBuffer = dummy_MapBuffer;
+    vtable->vaMapBuffer2 = dummy_MapBuffer2;
+    vtable->vaSubmitPictures = dummy_SubmitPictures;
     vtable->vaUnmapBuffer = dummy_UnmapBuffer;
     vtable->vaDestroyBuffer = dummy_DestroyBuffer;
     vtable->vaBeginPicture = dummy_BeginPicture;
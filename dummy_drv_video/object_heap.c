@@ -129,11 +129,23 @@ object_heap_allocate(object_heap_p heap)
     return ret;
 }
 
+void
+object_heap_lock(object_heap_p heap)
+{
+    pthread_mutex_lock(&heap->mutex);
+}
+
+void
+object_heap_unlock(object_heap_p heap)
+{
+    pthread_mutex_unlock(&heap->mutex);
+}
+
 /*
  * Lookup an object by object ID
  * Returns a pointer to the object on success, returns NULL on error
  */
-static object_base_p
+object_base_p
 object_heap_lookup_unlocked(object_heap_p heap, int id)
 {
     object_base_p obj;
@@ -216,7 +228,7 @@ object_heap_next(object_heap_p heap, object_heap_iterator *iter)
 /*
  * Frees an object
  */
-static void
+void
 object_heap_free_unlocked(object_heap_p heap, object_base_p obj)
 {
     /* Check if the object has in fact been allocated */
@@ -71,6 +71,21 @@ object_heap_allocate(object_heap_p heap);
 object_base_p
 object_heap_lookup(object_heap_p heap, int id);
 
+/*
+ * Take the heap lock for a series of the _unlocked operations below
+ */
+void
+object_heap_lock(object_heap_p heap);
+
+void
+object_heap_unlock(object_heap_p heap);
+
+/*
+ * Same as object_heap_lookup, with the heap lock held
+ */
+object_base_p
+object_heap_lookup_unlocked(object_heap_p heap, int id);
+
 /*
  * Iterate over all objects in the heap.
  * Returns a pointer to the first object on the heap, returns NULL if heap is empty.
@@ -91,6 +106,12 @@ object_heap_next(object_heap_p heap, object_heap_iterator *iter);
 void
 object_heap_free(object_heap_p heap, object_base_p obj);
 
+/*
+ * Same as object_heap_free, with the heap lock held
+ */
+void
+object_heap_free_unlocked(object_heap_p heap, object_base_p obj);
+
 /*
  * Destroys a heap, the heap must be empty.
  */
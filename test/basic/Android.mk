@@ -232,3 +232,65 @@ LOCAL_SHARED_LIBRARIES := libva-android libva libdl libdrm libcutils libutils li
 
 include $(BUILD_EXECUTABLE)
 
+# For test_12
+# =====================================================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+  test_12.c	
+
+LOCAL_CFLAGS += \
+    -DANDROID
+
+LOCAL_C_INCLUDES += \
+  $(TARGET_OUT_HEADERS)/libva	\
+  $(TOPDIR)/hardware/intel/libva/va/
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE :=	test_12_android
+
+LOCAL_SHARED_LIBRARIES := libva-android libva libdl libdrm libcutils libutils libui libsurfaceflinger_client
+
+include $(BUILD_EXECUTABLE)
+
+# For test_13
+# =====================================================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+  test_13.c	
+
+LOCAL_CFLAGS += \
+    -DANDROID
+
+LOCAL_C_INCLUDES += \
+  $(TARGET_OUT_HEADERS)/libva	\
+  $(TOPDIR)/hardware/intel/libva/va/
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE :=	test_13_android
+
+LOCAL_SHARED_LIBRARIES := libva-android libva libdl libdrm libcutils libutils libui libsurfaceflinger_client
+
+include $(BUILD_EXECUTABLE)
+
+# For test_14
+# =====================================================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+  test_14.c	
+
+LOCAL_CFLAGS += \
+    -DANDROID
+
+LOCAL_C_INCLUDES += \
+  $(TARGET_OUT_HEADERS)/libva	\
+  $(TOPDIR)/hardware/intel/libva/va/
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE :=	test_14_android
+
+LOCAL_SHARED_LIBRARIES := libva-android libva libdl libdrm libcutils libutils libui libsurfaceflinger_client
+
+include $(BUILD_EXECUTABLE)
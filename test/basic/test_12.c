@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2007 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define TEST_DESCRIPTION	"Acquire and release surfaces from a surface pool"
+
+#include "test_common.c"
+#include <pthread.h>
+#include <sched.h>
+
+#define MIN_SURFACES	2
+#define MAX_SURFACES	4
+#define NUM_THREADS	8
+#define NUM_LOOPS	1000
+
+VASurfacePool pool;
+VASurfaceID pool_surfaces[MAX_SURFACES];
+int surface_busy[MAX_SURFACES];
+int num_acquired[NUM_THREADS];
+
+void pre()
+{
+    test_init();
+
+    va_status = vaCreateSurfacePool(va_dpy, 352, 288, VA_RT_FORMAT_YUV420, MIN_SURFACES, MAX_SURFACES, &pool);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+}
+
+int surface_index(VASurfaceID surface)
+{
+    int i;
+
+    for (i = 0; i < MAX_SURFACES; i++)
+        if (pool_surfaces[i] == surface)
+            return i;
+
+    return -1;
+}
+
+void *acquire_release_thread(void *arg)
+{
+    int thread = (int)(long)arg;
+    VASurfaceID surface;
+    VAStatus status;
+    int i, index;
+
+    for (i = 0; i < NUM_LOOPS; i++)
+    {
+        status = vaAcquireSurfaceFromPool(va_dpy, pool, 0, &surface);
+        ASSERT( VA_STATUS_SUCCESS == status );
+
+        /* no other thread holds the surface */
+        index = surface_index(surface);
+        ASSERT( index >= 0 );
+        ASSERT( 0 == __sync_lock_test_and_set(&surface_busy[index], 1) );
+        num_acquired[thread]++;
+        sched_yield();
+        __sync_lock_release(&surface_busy[index]);
+
+        status = vaReleaseSurfaceToPool(va_dpy, pool, surface);
+        ASSERT( VA_STATUS_SUCCESS == status );
+    }
+
+    return NULL;
+}
+
+void test()
+{
+    VASurfaceID surfaces[MAX_SURFACES];
+    VASurfaceID acquired[MAX_SURFACES];
+    VASurfaceID surface;
+    pthread_t threads[NUM_THREADS];
+    int num_surfaces;
+    int i, j;
+
+    va_status = vaQuerySurfacePool(va_dpy, pool, surfaces, &num_surfaces);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    status("vaQuerySurfacePool reports %d surfaces\n", num_surfaces);
+    ASSERT( MIN_SURFACES == num_surfaces );
+
+    /* the pool grows up to MAX_SURFACES, with unique surfaces */
+    for (i = 0; i < MAX_SURFACES; i++)
+    {
+        va_status = vaAcquireSurfaceFromPool(va_dpy, pool, VA_SURFACE_POOL_NO_WAIT, &acquired[i]);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+        status("vaAcquireSurfaceFromPool returns %08x\n", acquired[i]);
+        for (j = 0; j < i; j++)
+            ASSERT( acquired[i] != acquired[j] );
+    }
+
+    va_status = vaQuerySurfacePool(va_dpy, pool, surfaces, &num_surfaces);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    ASSERT( MAX_SURFACES == num_surfaces );
+
+    va_status = vaAcquireSurfaceFromPool(va_dpy, pool, VA_SURFACE_POOL_NO_WAIT, &surface);
+    ASSERT( VA_STATUS_ERROR_SURFACE_BUSY == va_status );
+
+    /* released surfaces come back oldest first */
+    va_status = vaReleaseSurfaceToPool(va_dpy, pool, acquired[2]);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    va_status = vaReleaseSurfaceToPool(va_dpy, pool, acquired[0]);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    va_status = vaReleaseSurfaceToPool(va_dpy, pool, acquired[0]);
+    ASSERT( VA_STATUS_ERROR_INVALID_PARAMETER == va_status );
+    va_status = vaReleaseSurfaceToPool(va_dpy, pool, VA_INVALID_SURFACE);
+    ASSERT( VA_STATUS_ERROR_INVALID_SURFACE == va_status );
+
+    va_status = vaAcquireSurfaceFromPool(va_dpy, pool, 0, &surface);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    ASSERT( acquired[2] == surface );
+    va_status = vaAcquireSurfaceFromPool(va_dpy, pool, 0, &surface);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    ASSERT( acquired[0] == surface );
+
+    for (i = 0; i < MAX_SURFACES; i++)
+    {
+        va_status = vaReleaseSurfaceToPool(va_dpy, pool, acquired[i]);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+    }
+
+    /* a full round returns every surface once, in the release order */
+    for (i = 0; i < MAX_SURFACES; i++)
+    {
+        va_status = vaAcquireSurfaceFromPool(va_dpy, pool, VA_SURFACE_POOL_NO_WAIT, &surface);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+        ASSERT( acquired[i] == surface );
+    }
+    for (i = 0; i < MAX_SURFACES; i++)
+    {
+        va_status = vaReleaseSurfaceToPool(va_dpy, pool, acquired[i]);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+    }
+
+    va_status = vaQuerySurfacePool(va_dpy, pool, pool_surfaces, &num_surfaces);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    /* more threads than surfaces, some of them have to wait */
+    status("Acquire/release from %d threads with %d surfaces\n", NUM_THREADS, MAX_SURFACES);
+    for (i = 0; i < NUM_THREADS; i++)
+        ASSERT( 0 == pthread_create(&threads[i], NULL, acquire_release_thread, (void *)(long)i) );
+    for (i = 0; i < NUM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    /* every thread got a surface each time it asked */
+    for (i = 0; i < NUM_THREADS; i++)
+        ASSERT( NUM_LOOPS == num_acquired[i] );
+
+    va_status = vaQuerySurfacePool(va_dpy, pool, NULL, &num_surfaces);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    ASSERT( MAX_SURFACES == num_surfaces );
+}
+
+void post()
+{
+    va_status = vaDestroySurfacePool(va_dpy, pool);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    test_terminate();
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2007 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define TEST_DESCRIPTION	"Decode from several displays and contexts at the same time"
+
+#include "test_common.c"
+#include <pthread.h>
+
+#define NUM_DISPLAYS	4	/* threads with a display of their own */
+#define NUM_CONTEXTS	4	/* threads sharing va_dpy, one context each */
+#define NUM_SURFACES	4
+#define NUM_FRAMES	200
+#define WIDTH		352
+#define HEIGHT		288
+#define BUFFER_SIZE	64
+
+VAProfile profile;
+VAEntrypoint entrypoint = VAEntrypointVLD;
+
+/*
+ * the state kept by the library for the trace, the fool and the profile is
+ * what the threads share, turn them on unless they are already set, and
+ * configure with --enable-thread-sanitizer to check it for data races
+ */
+void pre()
+{
+    setenv("LIBVA_TRACE", "/tmp/test_13.trace", 0);
+    setenv("LIBVA_FOOL_DECODE", "1", 0);
+    setenv("LIBVA_PROFILE", "/tmp/test_13.profile", 0);
+
+    test_init_threads();
+    test_init();
+    test_profiles();
+}
+
+/* run NUM_FRAMES frames through a context of its own */
+void decode_frames(VADisplay display)
+{
+    VAConfigID config;
+    VAContextID context;
+    VASurfaceID surfaces[NUM_SURFACES];
+    VASurfaceStatus surface_status;
+    VABufferID buffer;
+    VAStatus ret;
+    void *data;
+    int i;
+
+    ret = vaCreateConfig(display, profile, entrypoint, NULL, 0, &config);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+
+    ret = vaCreateSurfaces(display, WIDTH, HEIGHT, VA_RT_FORMAT_YUV420, NUM_SURFACES, surfaces);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+
+    ret = vaCreateContext(display, config, WIDTH, HEIGHT, 0, surfaces, NUM_SURFACES, &context);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+
+    for (i = 0; i < NUM_FRAMES; i++)
+    {
+        VASurfaceID target = surfaces[i % NUM_SURFACES];
+
+        ret = vaBeginPicture(display, context, target);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+
+        ret = vaCreateBuffer(display, context, VAPictureParameterBufferType, BUFFER_SIZE, 1, NULL, &buffer);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+
+        ret = vaMapBuffer(display, buffer, &data);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+        memset(data, i, BUFFER_SIZE);
+        ret = vaUnmapBuffer(display, buffer);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+
+        /* the buffer is destroyed by vaRenderPicture */
+        ret = vaRenderPicture(display, context, &buffer, 1);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+
+        ret = vaEndPicture(display, context);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+
+        ret = vaSyncSurface(display, target);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+
+        ret = vaQuerySurfaceStatus(display, target, &surface_status);
+        ASSERT( VA_STATUS_SUCCESS == ret );
+    }
+
+    ret = vaDestroyContext(display, context);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+
+    ret = vaDestroySurfaces(display, surfaces, NUM_SURFACES);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+
+    ret = vaDestroyConfig(display, config);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+}
+
+void *display_thread(void *arg)
+{
+    void *native_dpy;
+    VADisplay display;
+    int major, minor;
+    VAStatus ret;
+
+    display = test_open_display(&native_dpy);
+
+    ret = vaInitialize(display, &major, &minor);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+
+    decode_frames(display);
+
+    ret = vaTerminate(display);
+    ASSERT( VA_STATUS_SUCCESS == ret );
+
+    test_close_display(native_dpy);
+
+    return NULL;
+}
+
+void *context_thread(void *arg)
+{
+    decode_frames(va_dpy);
+
+    return NULL;
+}
+
+void test()
+{
+    pthread_t threads[NUM_DISPLAYS + NUM_CONTEXTS];
+    VAEntrypoint *entrypoints;
+    int num_entrypoints;
+    int i, j;
+
+    entrypoints = malloc(vaMaxNumEntrypoints(va_dpy) * sizeof(VAEntrypoint));
+    ASSERT( entrypoints );
+
+    /* any profile which can be decoded */
+    for (i = 0; i < num_profiles; i++)
+    {
+        va_status = vaQueryConfigEntrypoints(va_dpy, profiles[i], entrypoints, &num_entrypoints);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+
+        for (j = 0; j < num_entrypoints; j++)
+            if (entrypoints[j] == VAEntrypointVLD)
+                break;
+        if (j < num_entrypoints)
+            break;
+    }
+    ASSERT( i < num_profiles );
+    profile = profiles[i];
+    free(entrypoints);
+
+    status("Decode %d frames with %s from %d displays and %d contexts\n",
+           NUM_FRAMES, profile2string(profile), NUM_DISPLAYS, NUM_CONTEXTS);
+
+    for (i = 0; i < NUM_DISPLAYS; i++)
+        ASSERT( 0 == pthread_create(&threads[i], NULL, display_thread, NULL) );
+    for (i = 0; i < NUM_CONTEXTS; i++)
+        ASSERT( 0 == pthread_create(&threads[NUM_DISPLAYS + i], NULL, context_thread, NULL) );
+
+    for (i = 0; i < NUM_DISPLAYS + NUM_CONTEXTS; i++)
+        pthread_join(threads[i], NULL);
+}
+
+void post()
+{
+    test_terminate();
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2007 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define TEST_DESCRIPTION	"Submit pictures of several contexts in one call"
+
+#include "test_common.c"
+
+#define NUM_CONTEXTS	8
+#define NUM_FRAMES	16
+#define WIDTH		176
+#define HEIGHT		144
+#define BUFFER_SIZE	64
+
+VAConfigID config;
+VASurfaceID surfaces[NUM_CONTEXTS];
+VAContextID contexts[NUM_CONTEXTS];
+
+void pre()
+{
+    VAEntrypoint *entrypoints;
+    int num_entrypoints;
+    int i, j;
+
+    test_init();
+    test_profiles();
+
+    entrypoints = malloc(vaMaxNumEntrypoints(va_dpy) * sizeof(VAEntrypoint));
+    ASSERT( entrypoints );
+
+    /* any profile which can be decoded */
+    for (i = 0; i < num_profiles; i++)
+    {
+        va_status = vaQueryConfigEntrypoints(va_dpy, profiles[i], entrypoints, &num_entrypoints);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+
+        for (j = 0; j < num_entrypoints; j++)
+            if (entrypoints[j] == VAEntrypointVLD)
+                break;
+        if (j < num_entrypoints)
+            break;
+    }
+    ASSERT( i < num_profiles );
+    free(entrypoints);
+
+    va_status = vaCreateConfig(va_dpy, profiles[i], VAEntrypointVLD, NULL, 0, &config);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    va_status = vaCreateSurfaces(va_dpy, WIDTH, HEIGHT, VA_RT_FORMAT_YUV420, NUM_CONTEXTS, surfaces);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    for (i = 0; i < NUM_CONTEXTS; i++)
+    {
+        va_status = vaCreateContext(va_dpy, config, WIDTH, HEIGHT, 0, &surfaces[i], 1, &contexts[i]);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+    }
+}
+
+void create_buffer(VAContextID context, VABufferID *buffer)
+{
+    void *data;
+
+    va_status = vaCreateBuffer(va_dpy, context, VAPictureParameterBufferType, BUFFER_SIZE, 1, NULL, buffer);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    va_status = vaMapBuffer(va_dpy, *buffer, &data);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    memset(data, 0, BUFFER_SIZE);
+    va_status = vaUnmapBuffer(va_dpy, *buffer);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+}
+
+void test()
+{
+    VAPictureJob jobs[NUM_CONTEXTS];
+    VABufferID buffers[NUM_CONTEXTS];
+    int i, frame;
+
+    va_status = vaSubmitPictures(va_dpy, NULL, 0);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+    va_status = vaSubmitPictures(va_dpy, jobs, -1);
+    ASSERT( VA_STATUS_ERROR_INVALID_PARAMETER == va_status );
+
+    status("Submit %d frames of %d contexts\n", NUM_FRAMES, NUM_CONTEXTS);
+    for (frame = 0; frame < NUM_FRAMES; frame++)
+    {
+        for (i = 0; i < NUM_CONTEXTS; i++)
+        {
+            create_buffer(contexts[i], &buffers[i]);
+
+            jobs[i].context = contexts[i];
+            jobs[i].render_target = surfaces[i];
+            jobs[i].buffers = &buffers[i];
+            jobs[i].num_buffers = 1;
+            jobs[i].status = VA_STATUS_ERROR_UNKNOWN;
+        }
+
+        va_status = vaSubmitPictures(va_dpy, jobs, NUM_CONTEXTS);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+
+        for (i = 0; i < NUM_CONTEXTS; i++)
+        {
+            ASSERT( VA_STATUS_SUCCESS == jobs[i].status );
+
+            va_status = vaSyncSurface(va_dpy, surfaces[i]);
+            ASSERT( VA_STATUS_SUCCESS == va_status );
+        }
+    }
+
+    /* a bad picture doesn't stop the others */
+    for (i = 0; i < 2; i++)
+    {
+        create_buffer(contexts[i], &buffers[i]);
+
+        jobs[i].context = contexts[i];
+        jobs[i].render_target = surfaces[i];
+        jobs[i].buffers = &buffers[i];
+        jobs[i].num_buffers = 1;
+    }
+    jobs[0].context = VA_INVALID_ID;
+
+    va_status = vaSubmitPictures(va_dpy, jobs, 2);
+    status("vaSubmitPictures with an invalid context returns %d (%s)\n", va_status, vaErrorStr(va_status));
+    ASSERT( VA_STATUS_SUCCESS != va_status );
+    ASSERT( va_status == jobs[0].status );
+    ASSERT( VA_STATUS_SUCCESS == jobs[1].status );
+}
+
+void post()
+{
+    int i;
+
+    for (i = 0; i < NUM_CONTEXTS; i++)
+    {
+        va_status = vaDestroyContext(va_dpy, contexts[i]);
+        ASSERT( VA_STATUS_SUCCESS == va_status );
+    }
+
+    va_status = vaDestroySurfaces(va_dpy, surfaces, NUM_CONTEXTS);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    va_status = vaDestroyConfig(va_dpy, config);
+    ASSERT( VA_STATUS_SUCCESS == va_status );
+
+    test_terminate();
+}
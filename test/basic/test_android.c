@@ -60,3 +60,28 @@ void test_terminate()
     }
 }
 
+void test_init_threads()
+{
+}
+
+/* one more display, e.g. for a thread of its own */
+VADisplay test_open_display(void **native_dpy)
+{
+    Display *android_dpy;
+    VADisplay va_android_dpy;
+
+    android_dpy = (Display*)malloc(sizeof(Display));
+    ASSERT( android_dpy );
+    *(android_dpy) = 0x18c34078;
+
+    va_android_dpy = vaGetDisplay(android_dpy);
+    ASSERT( va_android_dpy );
+
+    *native_dpy = android_dpy;
+    return va_android_dpy;
+}
+
+void test_close_display(void *native_dpy)
+{
+    free(native_dpy);
+}
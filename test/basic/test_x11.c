@@ -59,3 +59,29 @@ void test_terminate()
   }
 }
 
+/* must come before any other Xlib call to use displays from several threads */
+void test_init_threads()
+{
+  ASSERT( XInitThreads() );
+}
+
+/* one more display, e.g. for a thread of its own */
+VADisplay test_open_display(void **native_dpy)
+{
+  Display *x11_dpy;
+  VADisplay va_x11_dpy;
+
+  x11_dpy = XOpenDisplay(NULL);
+  ASSERT( x11_dpy );
+
+  va_x11_dpy = vaGetDisplay(x11_dpy);
+  ASSERT( va_x11_dpy );
+
+  *native_dpy = x11_dpy;
+  return va_x11_dpy;
+}
+
+void test_close_display(void *native_dpy)
+{
+  XCloseDisplay((Display *)native_dpy);
+}
@@ -25,7 +25,13 @@
  * Simple AVC encoder based on libVA.
  *
  * Usage:
- * ./avcenc <width> <height> <input file> <output file> [qp]
+ * ./avcenc [-d depth] <width> <height> <input file> <output file> [qp]
+ * ./avcenc -b <count> <width> <height>
+ *
+ * Up to depth frames are in flight: the next frame is uploaded and
+ * submitted while a writer thread waits for and packs the coded
+ * output of the previous ones. -b only times the writing of the
+ * packed headers.
  */  
 
 #include "sysdeps.h"
@@ -37,12 +43,16 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <assert.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <va/va.h>
 #include "va_display.h"
+#include "bitstream.h"
+#include "../yuv_row.h"
 
 #define NAL_REF_IDC_NONE        0
 #define NAL_REF_IDC_LOW         1
@@ -78,7 +88,6 @@ static VAConfigID config_id;
 static int picture_width, picture_width_in_mbs;
 static int picture_height, picture_height_in_mbs;
 static int frame_size;
-static unsigned char *newImageBuffer = 0;
 static int codedbuf_size;
 
 static int qp_value = 26;
@@ -165,19 +174,32 @@ static VABufferID seq_parameter = VA_INVALID_ID;                /*Sequence level
 static VABufferID pic_parameter = VA_INVALID_ID;                /*Picture level parameter*/
 static VABufferID slice_parameter = VA_INVALID_ID;              /*Slice level parameter, multil slices*/
 
-static VABufferID coded_buf;                                    /*Output buffer, compressed data*/
+#define PIPELINE_DEPTH                          4
+#define PIPELINE_DEPTH_MAX                      16
+static int pipeline_depth = PIPELINE_DEPTH;
+
+/* a frame in flight, frame f uses slot f % pipeline_depth */
+struct encode_slot {
+    VABufferID coded_buf;                                       /*Output buffer, compressed data*/
+    int frame_num;
+    int is_intra;
+    int is_idr;
+    double start_time;
+};
+static struct encode_slot slots[PIPELINE_DEPTH_MAX];
 
-#define SID_NUMBER                              3
-#define SID_INPUT_PICTURE                       0
-#define SID_REFERENCE_PICTURE                   1
-#define SID_RECON_PICTURE                       2
-static  VASurfaceID surface_ids[SID_NUMBER];
+#define SID_REFERENCE_PICTURE                   0
+#define SID_RECON_PICTURE                       1
+#define SID_INPUT_PICTURE                       2               /* one per slot */
+#define SID_NUMBER                              (SID_INPUT_PICTURE + pipeline_depth)
+static  VASurfaceID surface_ids[SID_INPUT_PICTURE + PIPELINE_DEPTH_MAX];
 
 /***************************************************/
 
 static void alloc_encode_resource()
 {
     VAStatus va_status;
+    int i;
 
     seq_parameter = VA_INVALID_ID;		
     pic_parameter = VA_INVALID_ID;
@@ -207,22 +229,21 @@ static void alloc_encode_resource()
     CHECK_VASTATUS(va_status, "vaCreateSurfaces");
 
     //3. Create coded buffer
-    {
+    for (i = 0; i < pipeline_depth; i++) {
         va_status = vaCreateBuffer(va_dpy,context_id,VAEncCodedBufferType,
-                                   codedbuf_size, 1, NULL, &coded_buf);
+                                   codedbuf_size, 1, NULL, &slots[i].coded_buf);
 
         CHECK_VASTATUS(va_status,"vaBeginPicture");
     }
-
-    newImageBuffer = (unsigned char *)malloc(frame_size);
 }
 
 static void release_encode_resource()
 {
-    free(newImageBuffer);
+    int i;
 
     //-3 Relese coded buffer
-    vaDestroyBuffer(va_dpy, coded_buf);
+    for (i = 0; i < pipeline_depth; i++)
+        vaDestroyBuffer(va_dpy, slots[i].coded_buf);
 
     //-2 Release all the surfaces resource
     vaDestroySurfaces(va_dpy, &surface_ids[0], SID_NUMBER);	
@@ -231,72 +252,209 @@ static void release_encode_resource()
     vaDestroyBuffer(va_dpy, seq_parameter);
 }
 
-static void begin_picture()
+static void begin_picture(int slot)
 {
     VAStatus va_status;
-    va_status = vaBeginPicture(va_dpy, context_id, surface_ids[SID_INPUT_PICTURE]);
+    va_status = vaBeginPicture(va_dpy, context_id, surface_ids[SID_INPUT_PICTURE + slot]);
     CHECK_VASTATUS(va_status,"vaBeginPicture");
 }
 
-static void upload_yuv_to_surface(FILE *yuv_fp, VASurfaceID surface_id)
+/*
+ * The input YUV file is mapped, a frame is read straight from the
+ * mapping. The prefetch thread stays YUV_PREFETCH_FRAMES frames ahead
+ * of the encoder and faults them in, so the upload doesn't wait on
+ * the disk.
+ */
+#define YUV_PREFETCH_FRAMES     4
+
+static struct {
+    const unsigned char *map;
+    size_t map_size;
+    int frame_number;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int next;           /* the first frame the encoder hasn't taken */
+    int stop;
+    int started;
+} yuv_input = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *yuv_prefetch_thread(void *data)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    volatile unsigned char sum = 0;
+    int fetched = 0;
+
+    pthread_mutex_lock(&yuv_input.mutex);
+    while (!yuv_input.stop && fetched < yuv_input.frame_number) {
+        const unsigned char *frame, *p;
+
+        if (fetched >= yuv_input.next + YUV_PREFETCH_FRAMES) {
+            pthread_cond_wait(&yuv_input.cond, &yuv_input.mutex);
+            continue;
+        }
+
+        if (fetched < yuv_input.next)
+            fetched = yuv_input.next;
+        pthread_mutex_unlock(&yuv_input.mutex);
+
+        frame = yuv_input.map + (size_t)fetched * frame_size;
+        for (p = frame; p < frame + frame_size; p += page_size)
+            sum += *p;
+
+        pthread_mutex_lock(&yuv_input.mutex);
+        fetched++;
+    }
+    pthread_mutex_unlock(&yuv_input.mutex);
+
+    return NULL;
+}
+
+static int yuv_input_open(const char *filename)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        printf("Can't open input YUV file\n");
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1 ||
+        st.st_size < frame_size || st.st_size % frame_size) {
+        printf("The YUV file's size is not correct\n");
+        close(fd);
+        return -1;
+    }
+
+    yuv_input.map_size = st.st_size;
+    yuv_input.map = mmap(NULL, yuv_input.map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (yuv_input.map == MAP_FAILED) {
+        printf("Can't map input YUV file\n");
+        return -1;
+    }
+    madvise((void *)yuv_input.map, yuv_input.map_size, MADV_SEQUENTIAL);
+
+    yuv_input.frame_number = st.st_size / frame_size;
+    yuv_input.next = 0;
+    yuv_input.stop = 0;
+    yuv_input.started = pthread_create(&yuv_input.thread, NULL,
+                                       yuv_prefetch_thread, NULL) == 0;
+
+    return 0;
+}
+
+static const unsigned char *yuv_input_frame(int f)
+{
+    pthread_mutex_lock(&yuv_input.mutex);
+    yuv_input.next = f + 1;
+    pthread_cond_signal(&yuv_input.cond);
+    pthread_mutex_unlock(&yuv_input.mutex);
+
+    return yuv_input.map + (size_t)f * frame_size;
+}
+
+static void yuv_input_close(void)
+{
+    if (yuv_input.started) {
+        pthread_mutex_lock(&yuv_input.mutex);
+        yuv_input.stop = 1;
+        pthread_cond_signal(&yuv_input.cond);
+        pthread_mutex_unlock(&yuv_input.mutex);
+        pthread_join(yuv_input.thread, NULL);
+    }
+
+    munmap((void *)yuv_input.map, yuv_input.map_size);
+}
+
+static void copy_plane(unsigned char *dst, int dst_pitch,
+                       const unsigned char *src, int src_pitch,
+                       int width, int height)
+{
+    int row;
+
+    for (row = 0; row < height; row++) {
+        memcpy(dst, src, width);
+        dst += dst_pitch;
+        src += src_pitch;
+    }
+}
+
+/* yuv is an I420 frame of the input file */
+static void upload_yuv_to_surface(const unsigned char *yuv, VASurfaceID surface_id)
 {
     VAImage surface_image;
     VAStatus va_status;
     void *surface_p = NULL;
-    unsigned char *y_src, *u_src, *v_src;
+    const unsigned char *y_src, *u_src, *v_src;
     unsigned char *y_dst, *u_dst, *v_dst;
     int y_size = picture_width * picture_height;
     int u_size = (picture_width >> 1) * (picture_height >> 1);
-    int row, col;
-    size_t n_items;
-
-    do {
-        n_items = fread(newImageBuffer, frame_size, 1, yuv_fp);
-    } while (n_items != 1);
+    int row;
 
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
     CHECK_VASTATUS(va_status,"vaDeriveImage");
 
-    vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
-    assert(VA_STATUS_SUCCESS == va_status);
-        
-    y_src = newImageBuffer;
-    u_src = newImageBuffer + y_size; /* UV offset for NV12 */
-    v_src = newImageBuffer + y_size + u_size;
+    va_status = vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
+    CHECK_VASTATUS(va_status,"vaMapBuffer");
+
+    y_src = yuv;
+    u_src = yuv + y_size;
+    v_src = yuv + y_size + u_size;
 
-    y_dst = surface_p + surface_image.offsets[0];
-    u_dst = surface_p + surface_image.offsets[1]; /* UV offset for NV12 */
-    v_dst = surface_p + surface_image.offsets[2];
+    y_dst = (unsigned char *)surface_p + surface_image.offsets[0];
+    u_dst = (unsigned char *)surface_p + surface_image.offsets[1];
+    v_dst = (unsigned char *)surface_p + surface_image.offsets[2];
 
     /* Y plane */
-    for (row = 0; row < surface_image.height; row++) {
-        memcpy(y_dst, y_src, surface_image.width);
-        y_dst += surface_image.pitches[0];
-        y_src += picture_width;
-    }
+    copy_plane(y_dst, surface_image.pitches[0], y_src, picture_width,
+               picture_width, picture_height);
 
-    if (surface_image.format.fourcc == VA_FOURCC_NV12) { /* UV plane */
-        for (row = 0; row < surface_image.height / 2; row++) {
-            for (col = 0; col < surface_image.width / 2; col++) {
-                u_dst[col * 2] = u_src[col];
-                u_dst[col * 2 + 1] = v_src[col];
-            }
+    switch (surface_image.format.fourcc) {
+    case VA_FOURCC_NV12: /* UV plane */
+        for (row = 0; row < picture_height / 2; row++) {
+            YUV_interleave_row(u_dst, u_src, v_src, picture_width / 2);
 
             u_dst += surface_image.pitches[1];
             u_src += (picture_width / 2);
             v_src += (picture_width / 2);
         }
-    } else {
-        /* FIXME: fix this later */
-        assert(0);
+        break;
+    case VA_FOURCC_IYUV:
+    case VA_FOURCC('I', '4', '2', '0'):
+        copy_plane(u_dst, surface_image.pitches[1], u_src, picture_width / 2,
+                   picture_width / 2, picture_height / 2);
+        copy_plane(v_dst, surface_image.pitches[2], v_src, picture_width / 2,
+                   picture_width / 2, picture_height / 2);
+        break;
+    case VA_FOURCC_YV12: /* V plane first */
+        copy_plane(u_dst, surface_image.pitches[1], v_src, picture_width / 2,
+                   picture_width / 2, picture_height / 2);
+        copy_plane(v_dst, surface_image.pitches[2], u_src, picture_width / 2,
+                   picture_width / 2, picture_height / 2);
+        break;
+    default:
+        fprintf(stderr, "Unsupported surface fourcc %c%c%c%c\n",
+                surface_image.format.fourcc & 0xff,
+                (surface_image.format.fourcc >> 8) & 0xff,
+                (surface_image.format.fourcc >> 16) & 0xff,
+                (surface_image.format.fourcc >> 24) & 0xff);
+        exit(1);
     }
 
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 }
 
-static void prepare_input(FILE * yuv_fp, int intra_slice)
+static void prepare_input(const unsigned char *yuv, int slot)
 {
+    VABufferID coded_buf = slots[slot].coded_buf;
     static VAEncPictureParameterBufferH264 pic_h264;
     static VAEncSliceParameterBuffer slice_h264;
     VAStatus va_status;
@@ -309,7 +467,7 @@ static void prepare_input(FILE * yuv_fp, int intra_slice)
     CHECK_VASTATUS(va_status,"vaRenderPicture");;
 
     // Copy Image to target surface according input YUV data.
-    upload_yuv_to_surface(yuv_fp, surface_ids[SID_INPUT_PICTURE]);
+    upload_yuv_to_surface(yuv, surface_ids[SID_INPUT_PICTURE + slot]);
 
     // Picture level
     pic_h264.reference_picture = surface_ids[SID_REFERENCE_PICTURE];
@@ -337,7 +495,7 @@ static void prepare_input(FILE * yuv_fp, int intra_slice)
     // Slice level	
     slice_h264.start_row_number = 0;
     slice_h264.slice_height = picture_height/16; /* Measured by MB */
-    slice_h264.slice_flags.bits.is_intra = intra_slice;
+    slice_h264.slice_flags.bits.is_intra = slots[slot].is_intra;
     slice_h264.slice_flags.bits.disable_deblocking_filter_idc = 0;
     if ( slice_parameter != VA_INVALID_ID){
         vaDestroyBuffer(va_dpy, slice_parameter);
@@ -362,16 +520,6 @@ static void end_picture()
     CHECK_VASTATUS(va_status,"vaRenderPicture");
 }
 
-#define BITSTREAM_ALLOCATE_STEPPING     4096
-
-struct __bitstream {
-    unsigned int *buffer;
-    int bit_offset;
-    int max_size_in_dword;
-};
-
-typedef struct __bitstream bitstream;
-
 static int 
 get_coded_bitsteam_length(unsigned char *buffer, int buffer_length)
 {
@@ -385,131 +533,24 @@ get_coded_bitsteam_length(unsigned char *buffer, int buffer_length)
     return i + 1;
 }
 
-static unsigned int 
-va_swap32(unsigned int val)
-{
-    unsigned char *pval = (unsigned char *)&val;
-
-    return ((pval[0] << 24)     |
-            (pval[1] << 16)     |
-            (pval[2] << 8)      |
-            (pval[3] << 0));
-}
-
+/* the NAL in bs to the output file */
 static void
-bitstream_start(bitstream *bs)
+bitstream_write(bitstream *bs, FILE *avc_fp)
 {
-    bs->max_size_in_dword = BITSTREAM_ALLOCATE_STEPPING;
-    bs->buffer = calloc(bs->max_size_in_dword * sizeof(int), 1);
-    bs->bit_offset = 0;
-}
-
-static void
-bitstream_end(bitstream *bs, FILE *avc_fp)
-{
-    int pos = (bs->bit_offset >> 5);
-    int bit_offset = (bs->bit_offset & 0x1f);
-    int bit_left = 32 - bit_offset;
-    int length = (bs->bit_offset + 7) >> 3;
     size_t w_items;
 
-    if (bit_offset) {
-        bs->buffer[pos] = va_swap32((bs->buffer[pos] << bit_left));
-    }
+    bitstream_end(bs);
 
     do {
-        w_items = fwrite(bs->buffer, length, 1, avc_fp);
+        w_items = fwrite(bs->buffer, bs->size, 1, avc_fp);
     } while (w_items != 1);
 
-    free(bs->buffer);
-}
- 
-static void
-bitstream_put_ui(bitstream *bs, unsigned int val, int size_in_bits)
-{
-    int pos = (bs->bit_offset >> 5);
-    int bit_offset = (bs->bit_offset & 0x1f);
-    int bit_left = 32 - bit_offset;
-
-    if (!size_in_bits)
-        return;
-
-    bs->bit_offset += size_in_bits;
-
-    if (bit_left > size_in_bits) {
-        bs->buffer[pos] = (bs->buffer[pos] << size_in_bits | val);
-    } else {
-        size_in_bits -= bit_left;
-        bs->buffer[pos] = (bs->buffer[pos] << bit_left) | (val >> size_in_bits);
-        bs->buffer[pos] = va_swap32(bs->buffer[pos]);
-
-        if (pos + 1 == bs->max_size_in_dword) {
-            bs->max_size_in_dword += BITSTREAM_ALLOCATE_STEPPING;
-            bs->buffer = realloc(bs->buffer, bs->max_size_in_dword * sizeof(unsigned int));
-        }
-
-        bs->buffer[pos + 1] = val;
-    }
-}
-
-static void
-bitstream_put_ue(bitstream *bs, unsigned int val)
-{
-    int size_in_bits = 0;
-    int tmp_val = ++val;
-
-    while (tmp_val) {
-        tmp_val >>= 1;
-        size_in_bits++;
-    }
-
-    bitstream_put_ui(bs, 0, size_in_bits - 1); // leading zero
-    bitstream_put_ui(bs, val, size_in_bits);
-}
-
-static void
-bitstream_put_se(bitstream *bs, int val)
-{
-    unsigned int new_val;
-
-    if (val <= 0)
-        new_val = -2 * val;
-    else
-        new_val = 2 * val - 1;
-
-    bitstream_put_ue(bs, new_val);
-}
-
-static void
-bitstream_byte_aligning(bitstream *bs, int bit)
-{
-    int bit_offset = (bs->bit_offset & 0x7);
-    int bit_left = 8 - bit_offset;
-    int new_val;
-
-    if (!bit_offset)
-        return;
-
-    assert(bit == 0 || bit == 1);
-
-    if (bit)
-        new_val = (1 << bit_left) - 1;
-    else
-        new_val = 0;
-
-    bitstream_put_ui(bs, new_val, bit_left);
-}
-
-static void 
-rbsp_trailing_bits(bitstream *bs)
-{
-    bitstream_put_ui(bs, 1, 1);
-    bitstream_byte_aligning(bs, 0);
+    bitstream_free(bs);
 }
 
 static void nal_start_code_prefix(bitstream *bs)
 {
-    bitstream_put_ui(bs, 0x00000001, 32);
+    bitstream_put_start_code(bs);
 }
 
 static void nal_header(bitstream *bs, int nal_ref_idc, int nal_unit_type)
@@ -591,7 +632,7 @@ static void build_nal_sps(FILE *avc_fp)
     nal_start_code_prefix(&bs);
     nal_header(&bs, NAL_REF_IDC_HIGH, NAL_SPS);
     sps_rbsp(&bs);
-    bitstream_end(&bs, avc_fp);
+    bitstream_write(&bs, avc_fp);
 }
 
 static void pps_rbsp(bitstream *bs)
@@ -630,7 +671,7 @@ static void build_nal_pps(FILE *avc_fp)
     nal_start_code_prefix(&bs);
     nal_header(&bs, NAL_REF_IDC_HIGH, NAL_PPS);
     pps_rbsp(&bs);
-    bitstream_end(&bs, avc_fp);
+    bitstream_write(&bs, avc_fp);
 }
 
 static void 
@@ -703,20 +744,21 @@ slice_header(bitstream *bs, int frame_num, int slice_type, int is_idr)
 }
 
 static void 
-slice_data(bitstream *bs)
+slice_data(bitstream *bs, int slot)
 {
+    VABufferID coded_buf = slots[slot].coded_buf;
     VACodedBufferSegment *coded_buffer_segment;
     unsigned char *coded_mem;
-    int i, slice_data_length;
+    int slice_data_length;
     VAStatus va_status;
     VASurfaceStatus surface_status;
     int is_cabac = (entropy_coding_mode_flag == ENTROPY_MODE_CABAC);
 
-    va_status = vaSyncSurface(va_dpy, surface_ids[SID_INPUT_PICTURE]);
+    va_status = vaSyncSurface(va_dpy, surface_ids[SID_INPUT_PICTURE + slot]);
     CHECK_VASTATUS(va_status,"vaSyncSurface");
 
     surface_status = 0;
-    va_status = vaQuerySurfaceStatus(va_dpy, surface_ids[SID_INPUT_PICTURE], &surface_status);
+    va_status = vaQuerySurfaceStatus(va_dpy, surface_ids[SID_INPUT_PICTURE + slot], &surface_status);
     CHECK_VASTATUS(va_status,"vaQuerySurfaceStatus");
 
     va_status = vaMapBuffer(va_dpy, coded_buf, (void **)(&coded_buffer_segment));
@@ -726,11 +768,7 @@ slice_data(bitstream *bs)
     if (is_cabac) {
         bitstream_byte_aligning(bs, 1);
         slice_data_length = get_coded_bitsteam_length(coded_mem, codedbuf_size);
-
-	for (i = 0; i < slice_data_length; i++) {
-            bitstream_put_ui(bs, *coded_mem, 8);
-            coded_mem++;
-	}
+        bitstream_put_bytes(bs, coded_mem, slice_data_length);
     } else {
         /* FIXME */
         assert(0);
@@ -740,7 +778,7 @@ slice_data(bitstream *bs)
 }
 
 static void 
-build_nal_slice(FILE *avc_fp, int frame_num, int slice_type, int is_idr)
+build_nal_slice(FILE *avc_fp, int slot, int frame_num, int slice_type, int is_idr)
 {
     bitstream bs;
 
@@ -748,30 +786,194 @@ build_nal_slice(FILE *avc_fp, int frame_num, int slice_type, int is_idr)
     nal_start_code_prefix(&bs);
     nal_header(&bs, NAL_REF_IDC_HIGH, is_idr ? NAL_IDR : NAL_NON_IDR);
     slice_header(&bs, frame_num, slice_type, is_idr);
-    slice_data(&bs);
-    bitstream_end(&bs, avc_fp);
+    slice_data(&bs, slot);
+    bitstream_write(&bs, avc_fp);
 }
 
 static void 
-store_coded_buffer(FILE *avc_fp, int frame_num, int is_intra, int is_idr)
+store_coded_buffer(FILE *avc_fp, int slot)
 {
-    build_nal_slice(avc_fp, frame_num, is_intra ? SLICE_TYPE_I : SLICE_TYPE_P, is_idr);
+    struct encode_slot *es = &slots[slot];
+
+    build_nal_slice(avc_fp, slot, es->frame_num,
+                    es->is_intra ? SLICE_TYPE_I : SLICE_TYPE_P, es->is_idr);
 }
 
-int main(int argc, char *argv[])
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The main thread submits the frames, the writer thread stores them in
+ * order. A slot is reused once its frame is written.
+ */
+static struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int submitted;
+    int written;
+    int frame_number;
+    FILE *avc_fp;
+    double *latency;    /* from the upload to the write, per frame */
+} pipeline = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *writer_thread(void *data)
 {
     int f;
-    FILE *yuv_fp;
+
+    for (f = 0; f < pipeline.frame_number; f++) {
+        int slot = f % pipeline_depth;
+
+        pthread_mutex_lock(&pipeline.mutex);
+        while (pipeline.submitted <= f)
+            pthread_cond_wait(&pipeline.cond, &pipeline.mutex);
+        pthread_mutex_unlock(&pipeline.mutex);
+
+        store_coded_buffer(pipeline.avc_fp, slot);
+        pipeline.latency[f] = get_time() - slots[slot].start_time;
+
+        pthread_mutex_lock(&pipeline.mutex);
+        pipeline.written = f + 1;
+        pthread_cond_broadcast(&pipeline.cond);
+        pthread_mutex_unlock(&pipeline.mutex);
+
+        printf("\r %d/%d ...", f+1, pipeline.frame_number);
+        fflush(stdout);
+    }
+
+    return NULL;
+}
+
+static void submit_frame(int f)
+{
+    int slot = f % pipeline_depth;
+
+    /* wait for the writer to be done with the frame in this slot */
+    pthread_mutex_lock(&pipeline.mutex);
+    while (pipeline.written <= f - pipeline_depth)
+        pthread_cond_wait(&pipeline.cond, &pipeline.mutex);
+    pthread_mutex_unlock(&pipeline.mutex);
+
+    slots[slot].frame_num = f;
+    slots[slot].is_intra = (f % 30 == 0);
+    slots[slot].is_idr = (f == 0);
+    slots[slot].start_time = get_time();
+
+    begin_picture(slot);
+    prepare_input(yuv_input_frame(f), slot);
+    end_picture();
+
+    pthread_mutex_lock(&pipeline.mutex);
+    pipeline.submitted = f + 1;
+    pthread_cond_broadcast(&pipeline.cond);
+    pthread_mutex_unlock(&pipeline.mutex);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Pack SPS, PPS and a slice header count times into memory, no VA,
+ * how fast the packed headers are written
+ */
+static void bench_headers(int count)
+{
+    bitstream bs;
+    double start_time, t;
+    size_t bytes = 0;
+    int i;
+
+    start_time = get_time();
+
+    for (i = 0; i < count; i++) {
+        bitstream_start(&bs);
+        nal_start_code_prefix(&bs);
+        nal_header(&bs, NAL_REF_IDC_HIGH, NAL_SPS);
+        sps_rbsp(&bs);
+        bitstream_end(&bs);
+        nal_start_code_prefix(&bs);
+        nal_header(&bs, NAL_REF_IDC_HIGH, NAL_PPS);
+        pps_rbsp(&bs);
+        bitstream_end(&bs);
+        nal_start_code_prefix(&bs);
+        nal_header(&bs, NAL_REF_IDC_HIGH, (i % 30 == 0) ? NAL_IDR : NAL_NON_IDR);
+        slice_header(&bs, i, (i % 30 == 0) ? SLICE_TYPE_I : SLICE_TYPE_P, i % 30 == 0);
+        bitstream_byte_aligning(&bs, 1);
+        bitstream_end(&bs);
+        bytes += bs.size;
+        bitstream_free(&bs);
+    }
+
+    t = get_time() - start_time;
+    printf("%d SPS/PPS/slice header sets (%.1f bytes each) in %f secondes, %.0f headers/s\n",
+           count, (double)bytes / count, t, 3 * count / t);
+}
+
+static void print_latency(double *latency, int n)
+{
+    qsort(latency, n, sizeof(double), compare_double);
+    printf("latency (ms): p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+           latency[n * 50 / 100] * 1000,
+           latency[n * 90 / 100] * 1000,
+           latency[n * 99 / 100] * 1000,
+           latency[n - 1] * 1000);
+}
+
+int main(int argc, char *argv[])
+{
+    int f, c, bench = 0;
+    const char *prog = argv[0];
     FILE *avc_fp;
     int frame_number;
-    long file_size;
-    clock_t start_clock, end_clock;
-    float encoding_time;
+    double start_time, encoding_time;
 
     va_init_display_args(&argc, argv);
 
-    if(argc != 5 && argc != 6) {
-        printf("Usage: %s <width> <height> <input_yuvfile> <output_avcfile> [qp]\n", argv[0]);
+    while ((c = getopt(argc, argv, "d:b:")) != -1) {
+        switch (c) {
+        case 'd':
+            pipeline_depth = atoi(optarg);
+            break;
+        case 'b':
+            bench = atoi(optarg);
+            break;
+        default:
+            argc = 0;
+            break;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (bench > 0 && argc == 3) {
+        picture_width = atoi(argv[1]);
+        picture_height = atoi(argv[2]);
+        picture_width_in_mbs = (picture_width + 15) / 16;
+        picture_height_in_mbs = (picture_height + 15) / 16;
+        bench_headers(bench);
+        return 0;
+    }
+
+    if((argc != 5 && argc != 6) ||
+       pipeline_depth < 1 || pipeline_depth > PIPELINE_DEPTH_MAX) {
+        printf("Usage: %s [-d depth] <width> <height> <input_yuvfile> <output_avcfile> [qp]\n", prog);
+        printf("       %s -b count <width> <height>\n", prog);
+        printf("       depth: frames in flight, 1 to %d, %d by default\n",
+               PIPELINE_DEPTH_MAX, PIPELINE_DEPTH);
+        printf("       -b: write count sets of packed headers, no encoding\n");
         return -1;
     }
 
@@ -785,54 +987,49 @@ int main(int argc, char *argv[])
     else
         qp_value = 26;
 
-    yuv_fp = fopen(argv[3],"rb");
-    if ( yuv_fp == NULL){
-        printf("Can't open input YUV file\n");
-        return -1;
-    }
-    fseek(yuv_fp,0l, SEEK_END);
-    file_size = ftell(yuv_fp);
     frame_size = picture_width * picture_height +  ((picture_width * picture_height) >> 1) ;
     codedbuf_size = picture_width * picture_height * 1.5;
 
-    if ( (file_size < frame_size) || (file_size % frame_size) ) {
-        printf("The YUV file's size is not correct\n");
+    if (yuv_input_open(argv[3]))
         return -1;
-    }
-    frame_number = file_size / frame_size;
-    fseek(yuv_fp, 0l, SEEK_SET);
+    frame_number = yuv_input.frame_number;
 
     avc_fp = fopen(argv[4], "wb");	
     if ( avc_fp == NULL) {
         printf("Can't open output avc file\n");
         return -1;
     }	
-    start_clock = clock();
+    start_time = get_time();
     build_header(avc_fp);
 
     create_encode_pipe();
     alloc_encode_resource();
 
-    for ( f = 0; f < frame_number; f++ ) {		//picture level loop
-        int is_intra = (f % 30 == 0);
-        int is_idr = (f == 0);
+    pipeline.frame_number = frame_number;
+    pipeline.avc_fp = avc_fp;
+    pipeline.latency = (double *)malloc(frame_number * sizeof(double));
+    if (pipeline.latency == NULL ||
+        pthread_create(&pipeline.thread, NULL, writer_thread, NULL)) {
+        printf("Can't start the writer thread\n");
+        return -1;
+    }
 
-        begin_picture();
-        prepare_input(yuv_fp, is_intra);
-        end_picture();
-        store_coded_buffer(avc_fp, f, is_intra, is_idr);
+    for ( f = 0; f < frame_number; f++ )		//picture level loop
+        submit_frame(f);
 
-        printf("\r %d/%d ...", f+1, frame_number);
-        fflush(stdout);
-    }
+    pthread_join(pipeline.thread, NULL);
 
-    end_clock = clock();
+    encoding_time = get_time() - start_time;
     printf("\ndone!\n");
-    encoding_time = (float)(end_clock-start_clock)/CLOCKS_PER_SEC;
-    printf("encode %d frames in %f secondes, FPS is %.1f\n",frame_number, encoding_time, frame_number/encoding_time);
+    printf("encode %d frames in %f secondes, FPS is %.1f, %d frames in flight\n",
+           frame_number, encoding_time, frame_number/encoding_time, pipeline_depth);
+    print_latency(pipeline.latency, frame_number);
+    free(pipeline.latency);
+    fclose(avc_fp);
 
     release_encode_resource();
     destory_encode_pipe();
+    yuv_input_close();
 
     return 0;
 }
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2012 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Bit writer for the packed headers (SPS, PPS, slice header) of the
+ * encode tests.
+ *
+ * The bits gather MSB first in a 64-bit accumulator and go out a byte
+ * at a time once more than 32 are pending, a 0x03 is inserted after
+ * two zero bytes when the next byte is 0x00..0x03 (emulation
+ * prevention), except in the start code. The buffer doubles when it
+ * is full.
+ *
+ *     bitstream bs;
+ *
+ *     bitstream_start(&bs);
+ *     bitstream_put_start_code(&bs);
+ *     bitstream_put_ui(&bs, ..., 8);
+ *     bitstream_put_ue(&bs, ...);
+ *     bitstream_end(&bs);
+ *     fwrite(bs.buffer, bs.size, 1, fp);
+ *     bitstream_free(&bs);
+ */
+#ifndef _BITSTREAM_H_
+#define _BITSTREAM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define BITSTREAM_ALLOCATE_STEPPING     4096
+
+struct __bitstream {
+    unsigned char *buffer;
+    size_t size;                /* bytes in buffer */
+    size_t max_size;
+    uint64_t acc;               /* the bits not in buffer yet, right aligned */
+    int acc_bits;
+    int zero_bytes;             /* zero bytes at the end of buffer */
+};
+
+typedef struct __bitstream bitstream;
+
+static inline int
+bitstream_clz32(uint32_t val)
+{
+#if defined(__GNUC__)
+    return __builtin_clz(val);
+#else
+    int n = 0;
+
+    while (!(val & 0x80000000)) {
+        val <<= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+static inline void
+bitstream_start(bitstream *bs)
+{
+    bs->max_size = BITSTREAM_ALLOCATE_STEPPING;
+    bs->buffer = (unsigned char *)malloc(bs->max_size);
+    assert(bs->buffer);
+    bs->size = 0;
+    bs->acc = 0;
+    bs->acc_bits = 0;
+    bs->zero_bytes = 0;
+}
+
+static inline void
+bitstream_free(bitstream *bs)
+{
+    free(bs->buffer);
+    bs->buffer = NULL;
+    bs->size = bs->max_size = 0;
+}
+
+/* room for n more bytes, plus the emulation prevention bytes of them */
+static inline void
+bitstream_reserve(bitstream *bs, size_t n)
+{
+    n += n / 2 + 1;
+
+    if (bs->size + n <= bs->max_size)
+        return;
+
+    while (bs->size + n > bs->max_size)
+        bs->max_size *= 2;
+
+    bs->buffer = (unsigned char *)realloc(bs->buffer, bs->max_size);
+    assert(bs->buffer);
+}
+
+static inline void
+bitstream_put_byte(bitstream *bs, unsigned char byte)
+{
+    if (bs->zero_bytes >= 2 && byte <= 0x03) {
+        bs->buffer[bs->size++] = 0x03;
+        bs->zero_bytes = 0;
+    }
+
+    bs->buffer[bs->size++] = byte;
+    bs->zero_bytes = byte ? 0 : bs->zero_bytes + 1;
+}
+
+/* move the whole bytes of the accumulator to the buffer */
+static inline void
+bitstream_flush(bitstream *bs)
+{
+    bitstream_reserve(bs, 8);
+
+    while (bs->acc_bits >= 8) {
+        bs->acc_bits -= 8;
+        bitstream_put_byte(bs, (unsigned char)(bs->acc >> bs->acc_bits));
+    }
+}
+
+static inline void
+bitstream_put_ui(bitstream *bs, unsigned int val, int size_in_bits)
+{
+    assert(size_in_bits >= 0 && size_in_bits <= 32);
+
+    if (!size_in_bits)
+        return;
+
+    if (size_in_bits < 32)
+        val &= (1u << size_in_bits) - 1;
+
+    if (bs->acc_bits + size_in_bits > 64)
+        bitstream_flush(bs);
+
+    bs->acc = (bs->acc << size_in_bits) | val;
+    bs->acc_bits += size_in_bits;
+
+    if (bs->acc_bits > 32)
+        bitstream_flush(bs);
+}
+
+/* ue(v): the length of val + 1 in zeros, then val + 1 */
+static inline void
+bitstream_put_ue(bitstream *bs, unsigned int val)
+{
+    int size_in_bits;
+
+    if (val == 0xffffffff) {
+        bitstream_put_ui(bs, 0, 32);
+        bitstream_put_ui(bs, 1, 1);
+        bitstream_put_ui(bs, 0, 32);
+        return;
+    }
+
+    val++;
+    size_in_bits = 32 - bitstream_clz32(val);
+
+    if (size_in_bits <= 16) {
+        bitstream_put_ui(bs, val, 2 * size_in_bits - 1);
+    } else {
+        bitstream_put_ui(bs, 0, size_in_bits - 1);
+        bitstream_put_ui(bs, val, size_in_bits);
+    }
+}
+
+static inline void
+bitstream_put_se(bitstream *bs, int val)
+{
+    unsigned int new_val;
+
+    if (val <= 0)
+        new_val = -2 * (unsigned int)val;
+    else
+        new_val = 2 * (unsigned int)val - 1;
+
+    bitstream_put_ue(bs, new_val);
+}
+
+static inline int
+bitstream_is_byte_aligned(bitstream *bs)
+{
+    return !(bs->acc_bits & 0x7);
+}
+
+static inline void
+bitstream_byte_aligning(bitstream *bs, int bit)
+{
+    int bit_left = 8 - (bs->acc_bits & 0x7);
+
+    if (bit_left == 8)
+        return;
+
+    assert(bit == 0 || bit == 1);
+
+    bitstream_put_ui(bs, bit ? (1 << bit_left) - 1 : 0, bit_left);
+}
+
+static inline void
+rbsp_trailing_bits(bitstream *bs)
+{
+    bitstream_put_ui(bs, 1, 1);
+    bitstream_byte_aligning(bs, 0);
+}
+
+/* 0x00000001, not subject to the emulation prevention */
+static inline void
+bitstream_put_start_code(bitstream *bs)
+{
+    assert(bitstream_is_byte_aligned(bs));
+
+    bitstream_flush(bs);
+    bitstream_reserve(bs, 4);
+    bs->buffer[bs->size++] = 0x00;
+    bs->buffer[bs->size++] = 0x00;
+    bs->buffer[bs->size++] = 0x00;
+    bs->buffer[bs->size++] = 0x01;
+    bs->zero_bytes = 0;
+}
+
+/*
+ * n bytes that already are a NAL payload, e.g. the slice data of the
+ * driver, copied as they are
+ */
+static inline void
+bitstream_put_bytes(bitstream *bs, const unsigned char *data, size_t n)
+{
+    assert(bitstream_is_byte_aligned(bs));
+
+    if (!n)
+        return;
+
+    bitstream_flush(bs);
+    bitstream_reserve(bs, n);
+    memcpy(bs->buffer + bs->size, data, n);
+    bs->size += n;
+
+    for (bs->zero_bytes = 0;
+         bs->zero_bytes < 2 && (size_t)bs->zero_bytes < n && !data[n - 1 - bs->zero_bytes];
+         bs->zero_bytes++)
+        ;
+}
+
+/* the last bits to the buffer, padded with zeros to a byte */
+static inline void
+bitstream_end(bitstream *bs)
+{
+    bitstream_byte_aligning(bs, 0);
+    bitstream_flush(bs);
+}
+
+#endif /* _BITSTREAM_H_ */
@@ -28,6 +28,7 @@
  *
  * gcc -o  h264encode  h264encode -lva -lva-x11
  * ./h264encode -w <width> -h <height> -n <frame_num>
+ * ./h264encode -w <width> -h <height> -n <frame_num> --bench[=json]
  *
  */  
 #include <stdio.h>
@@ -39,6 +40,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <time.h>
 #include <va/va.h>
 #ifdef ANDROID
 #include <va/va_android.h>
@@ -73,6 +75,19 @@ static  int frame_bitrate = 8000000; /* 8M */
 static  int initial_qp = 15;
 static  int minimal_qp = 0;
 
+/*
+ * --bench: no per frame output, CODEDBUF_NUM frames in flight, the
+ * fps, the bitrate and the submit (vaBeginPicture) to vaSyncSurface
+ * latency percentiles as one CSV line, or JSON with --bench=json
+ */
+#define BENCH_CSV  1
+#define BENCH_JSON 2
+static  int bench = 0;
+static  int frames_in_flight = 1;
+static  int frame_skipped = 0;  /* of the last frame synced */
+static  double *frame_latency;
+static  unsigned long long coded_bytes;
+
 static int display_surface(int frame_id, int *exit_encode);
 
 static int upload_source_YUV_once_for_all()
@@ -84,13 +99,15 @@ static int upload_source_YUV_once_for_all()
     int i;
     
     for (i=0; i<SURFACE_NUM-2; i++) {
-        printf("\rLoading data into surface %d.....", i);
+        if (!bench)
+            printf("\rLoading data into surface %d.....", i);
         upload_surface(va_dpy, surface_id[i], box_width, row_shift, 0);
         
         row_shift++;
         if (row_shift==(2*box_width)) row_shift= 0;
     }
-    printf("\n");
+    if (!bench)
+        printf("\n");
 
     return 0;
 }
@@ -106,12 +123,17 @@ static int save_coded_buf(VABufferID coded_buf, int current_frame, int frame_ski
     va_status = vaMapBuffer(va_dpy,coded_buf,(void **)(&buf_list));
     CHECK_VASTATUS(va_status,"vaMapBuffer");
     while (buf_list != NULL) {
-        printf("Write %d bytes", buf_list->size);
+        if (!bench)
+            printf("Write %d bytes", buf_list->size);
         coded_size += write(coded_fd, buf_list->buf, buf_list->size);
         buf_list = (VACodedBufferSegment *) buf_list->next;
     }
     vaUnmapBuffer(va_dpy,coded_buf);
 
+    coded_bytes += coded_size;
+    if (bench)
+        return 0;
+
     printf("\r      "); /* return back to startpoint */
     switch (current_frame % 4) {
         case 0:
@@ -153,6 +175,77 @@ enum {
     SH_LEVEL_5=50
 };
 
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* frame i uses the source surface i % (SURFACE_NUM - 2) and coded_buf[i % CODEDBUF_NUM] */
+static void sync_frame(int i, double submit_time)
+{
+    int src_surface = i % (SURFACE_NUM - 2);
+    VASurfaceStatus surface_status;
+    VAStatus va_status;
+
+    va_status = vaSyncSurface(va_dpy, surface_id[src_surface]);
+    CHECK_VASTATUS(va_status,"vaSyncSurface");
+
+    if (frame_latency)
+        frame_latency[i] = get_time() - submit_time;
+
+    surface_status = (VASurfaceStatus) 0;
+    va_status = vaQuerySurfaceStatus(va_dpy, surface_id[src_surface],&surface_status);
+    frame_skipped = (surface_status & VASurfaceSkipped);
+
+    save_coded_buf(coded_buf[i % CODEDBUF_NUM], i, frame_skipped);
+
+    /* should display reconstructed frame, but just diplay source frame */
+    if (frame_display) {
+        int exit_encode = 0;
+
+        display_surface(src_surface, &exit_encode);
+        if (exit_encode)
+            frame_count = i;
+    }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_bench(double encoding_time)
+{
+    double fps = frame_count / encoding_time;
+    double kbps = coded_bytes * 8.0 * frame_rate / frame_count / 1000;
+    double p50, p95, p99;
+
+    qsort(frame_latency, frame_count, sizeof(double), compare_double);
+    p50 = frame_latency[frame_count * 50 / 100] * 1000;
+    p95 = frame_latency[frame_count * 95 / 100] * 1000;
+    p99 = frame_latency[frame_count * 99 / 100] * 1000;
+
+    if (bench == BENCH_JSON) {
+        printf("{\"width\": %d, \"height\": %d, \"frames\": %d, \"in_flight\": %d, "
+               "\"seconds\": %.6f, \"fps\": %.2f, \"bitrate_kbps\": %.1f, "
+               "\"latency_ms\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f}}\n",
+               frame_width, frame_height, frame_count, frames_in_flight,
+               encoding_time, fps, kbps, p50, p95, p99);
+    } else {
+        printf("width,height,frames,in_flight,seconds,fps,bitrate_kbps,"
+               "latency_p50_ms,latency_p95_ms,latency_p99_ms\n");
+        printf("%d,%d,%d,%d,%.6f,%.2f,%.1f,%.3f,%.3f,%.3f\n",
+               frame_width, frame_height, frame_count, frames_in_flight,
+               encoding_time, fps, kbps, p50, p95, p99);
+    }
+}
+
 static int do_h264_encoding(void)
 {
     VAEncPictureParameterBufferH264 pic_h264;
@@ -160,10 +253,8 @@ static int do_h264_encoding(void)
     VAStatus va_status;
     VABufferID seq_param_buf, pic_param_buf, slice_param_buf;
     int codedbuf_size;
-    VASurfaceStatus surface_status;
     int src_surface, dst_surface, ref_surface;
-    int codedbuf_idx = 0;
-    int frame_skipped = 0;
+    double submit_time[CODEDBUF_NUM], start_time;
     int i;
 
 
@@ -188,12 +279,27 @@ static int do_h264_encoding(void)
         CHECK_VASTATUS(va_status,"vaBeginPicture");
     }
 
-    src_surface = 0;
+    if (bench) {
+        frames_in_flight = CODEDBUF_NUM;
+        frame_latency = (double *)malloc(frame_count * sizeof(double));
+        assert(frame_latency);
+    }
+
     /* the last two frames are reference/reconstructed frame */
     dst_surface = SURFACE_NUM - 1;
     ref_surface = SURFACE_NUM - 2;
     
+    start_time = get_time();
+
     for (i = 0; i < frame_count; i++) {
+        src_surface = i % (SURFACE_NUM - 2);
+
+        /* the oldest frame in flight is done before its coded buffer is reused */
+        if (frames_in_flight > 1 && i >= frames_in_flight)
+            sync_frame(i - frames_in_flight, submit_time[(i - frames_in_flight) % CODEDBUF_NUM]);
+
+        submit_time[i % CODEDBUF_NUM] = get_time();
+
         va_status = vaBeginPicture(va_dpy, context_id, surface_id[src_surface]);
         CHECK_VASTATUS(va_status,"vaBeginPicture");
 
@@ -223,7 +329,7 @@ static int do_h264_encoding(void)
 
         pic_h264.reference_picture = surface_id[ref_surface];
         pic_h264.reconstructed_picture= surface_id[dst_surface];
-        pic_h264.coded_buf = coded_buf[codedbuf_idx];
+        pic_h264.coded_buf = coded_buf[i % CODEDBUF_NUM];
         pic_h264.picture_width = frame_width;
         pic_h264.picture_height = frame_height;
         pic_h264.last_picture = (i==frame_count);
@@ -250,36 +356,14 @@ static int do_h264_encoding(void)
         va_status = vaEndPicture(va_dpy,context_id);
         CHECK_VASTATUS(va_status,"vaEndPicture");;
 
-        va_status = vaSyncSurface(va_dpy, surface_id[src_surface]);
-        CHECK_VASTATUS(va_status,"vaSyncSurface");
-
-        surface_status = (VASurfaceStatus) 0;
-        va_status = vaQuerySurfaceStatus(va_dpy, surface_id[src_surface],&surface_status);
-        frame_skipped = (surface_status & VASurfaceSkipped);
-
-        save_coded_buf(coded_buf[codedbuf_idx], i, frame_skipped);
-        
-        /* should display reconstructed frame, but just diplay source frame */
-        if (frame_display) {
-            int exit_encode = 0;
+        if (frames_in_flight == 1)
+            sync_frame(i, submit_time[i % CODEDBUF_NUM]);
 
-            display_surface(src_surface, &exit_encode);
-            if (exit_encode)
-                frame_count = i;
-        }
-        
-        /* use next surface */
-        src_surface++;
-        if (src_surface == (SURFACE_NUM - 2))
-            src_surface = 0;
-
-        /* use next codedbuf */
-        codedbuf_idx++;
-        if (codedbuf_idx == (CODEDBUF_NUM - 1))
-            codedbuf_idx = 0;
-        
-        /* if a frame is skipped, current frame still use last reference frame */
-        if (frame_skipped == 0) {
+        /*
+         * if a frame is skipped, current frame still use last reference
+         * frame, with frames in flight it isn't known yet
+         */
+        if (frame_skipped == 0 || frames_in_flight > 1) {
             /* swap ref/dst */
             int tmp = dst_surface;
             dst_surface = ref_surface;
@@ -287,6 +371,18 @@ static int do_h264_encoding(void)
         } 
     }
 
+    if (frames_in_flight > 1) {
+        for (i = (frame_count > frames_in_flight) ? frame_count - frames_in_flight : 0;
+             i < frame_count; i++)
+            sync_frame(i, submit_time[i % CODEDBUF_NUM]);
+    }
+
+    if (bench && frame_count > 0) {
+        print_bench(get_time() - start_time);
+        free(frame_latency);
+        frame_latency = NULL;
+    }
+
     return 0;
 }
 
@@ -299,6 +395,21 @@ int main(int argc,char **argv)
     int major_ver, minor_ver;
     VAStatus va_status;
     char c;
+    int i;
+
+    /* --bench is long, take it out before getopt */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0 || strcmp(argv[i], "--bench=csv") == 0)
+            bench = BENCH_CSV;
+        else if (strcmp(argv[i], "--bench=json") == 0)
+            bench = BENCH_JSON;
+        else
+            continue;
+
+        memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(argv[0]));
+        argc--;
+        i--;
+    }
 
     strcpy(coded_file, "/tmp/demo.264");
     while ((c =getopt(argc,argv,"w:h:n:p:f:r:q:s:o:d?") ) != EOF) {
@@ -345,6 +456,8 @@ int main(int argc,char **argv)
                     printf("   -q initial QP\n");
                     printf("   -s maximum QP\n");
                     printf("   -o coded file\n");
+                    printf("   --bench[=csv|json] no per frame output, %d frames in flight,\n", CODEDBUF_NUM);
+                    printf("       print fps, bitrate and submit to sync latency\n");
                     exit(0);
         }
     }
@@ -410,11 +523,15 @@ int main(int argc,char **argv)
         exit(1);
     }
 
-    printf("Coded %d frames, %dx%d, save the coded file into %s\n",
-           frame_count, frame_width, frame_height, coded_file);
+    if (bench)
+        frame_display = 0;
+    else
+        printf("Coded %d frames, %dx%d, save the coded file into %s\n",
+               frame_count, frame_width, frame_height, coded_file);
     do_h264_encoding();
 
-    printf("\n\n");
+    if (!bench)
+        printf("\n\n");
     
     vaDestroySurfaces(va_dpy,&surface_id[0],SURFACE_NUM);
     vaDestroyContext(va_dpy,context_id);
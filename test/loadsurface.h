@@ -21,22 +21,363 @@
  * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * the 640x480 I420 test picture, yuvga_get_pic() gives it.
+ *
+ * LOADSURFACE_YUV_BLOB is the path of loadsurface_yuv.z, the picture
+ * compressed, the assembler links it in and it is inflated once at the
+ * first use. Otherwise (--enable-embedded-test-image, Android) it is
+ * the yuvga_pic array of loadsurface_yuv.h.
+ *
+ * loadsurface_yuv.z is a zlib stream of the Y, U and V planes of
+ * loadsurface_yuv.h, each sample minus its prediction: left + up -
+ * up left clamped to 0..255, left on the first row, up on the first
+ * column, 0 for the first one. loadsurface_yuv_gen.c makes it, see
+ * loadsurface.am
+ */
+#ifdef LOADSURFACE_YUV_BLOB
+#include <zlib.h>
+
+__asm__(
+    "    .section .rodata\n"
+    "loadsurface_yuv_z:\n"
+    "    .incbin \"" LOADSURFACE_YUV_BLOB "\"\n"
+    "loadsurface_yuv_z_end:\n"
+    "    .previous\n");
+
+extern const unsigned char loadsurface_yuv_z[] __attribute__((visibility("hidden")));
+extern const unsigned char loadsurface_yuv_z_end[] __attribute__((visibility("hidden")));
+
+static unsigned char *yuvga_pic = NULL;
+static pthread_once_t yuvga_pic_once = PTHREAD_ONCE_INIT;
+
+static void yuvga_unpredict(unsigned char *p, int w, int h)
+{
+    int x, y, pred;
+
+    for (x = 1; x < w; x++)
+        p[x] += p[x - 1];
+    for (y = 1; y < h; y++) {
+        unsigned char *row = p + y * w, *up = row - w;
+
+        row[0] += up[0];
+        for (x = 1; x < w; x++) {
+            pred = row[x - 1] + up[x] - up[x - 1];
+            row[x] += (pred < 0) ? 0 : (pred > 255) ? 255 : pred;
+        }
+    }
+}
+
+static void yuvga_inflate(void)
+{
+    uLongf size = 640*480*3/2;
+
+    yuvga_pic = (unsigned char *)malloc(size);
+    if (yuvga_pic == NULL ||
+        uncompress(yuvga_pic, &size, loadsurface_yuv_z,
+                   loadsurface_yuv_z_end - loadsurface_yuv_z) != Z_OK ||
+        size != 640*480*3/2) {
+        fprintf(stderr, "Can't inflate the test picture\n");
+        exit(1);
+    }
+
+    yuvga_unpredict(yuvga_pic, 640, 480);
+    yuvga_unpredict(yuvga_pic + 640*480, 320, 240);
+    yuvga_unpredict(yuvga_pic + 640*480 + 640*480/4, 320, 240);
+}
+
+static unsigned char *yuvga_get_pic(void)
+{
+    pthread_once(&yuvga_pic_once, yuvga_inflate);
+
+    return yuvga_pic;
+}
+#else
 #include "loadsurface_yuv.h"
 
+static unsigned char *yuvga_get_pic(void)
+{
+    return yuvga_pic;
+}
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "yuv_row.h"
+
+/*
+ * p = (p * (256 - w) + q * w + 128) >> 8 for n bytes, w is the alpha of
+ * q in 1/256, the widest vectors the compiler targets, the tail in C
+ */
+static void YUV_blend_row(unsigned char *p, const unsigned char *q, int n, int w)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i wp = _mm256_set1_epi16(256 - w), wq = _mm256_set1_epi16(w);
+    const __m256i round = _mm256_set1_epi16(128), zero = _mm256_setzero_si256();
+
+    /* unpack and pack are both per 128 bits lane, the order is kept */
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(q + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), wp),
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), wq));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), wp),
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), wq));
+
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_packus_epi16(lo, hi));
+    }
+#elif defined(__SSE2__)
+    const __m128i wp = _mm_set1_epi16(256 - w), wq = _mm_set1_epi16(w);
+    const __m128i round = _mm_set1_epi16(128), zero = _mm_setzero_si128();
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(q + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), wp),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wq));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), wp),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wq));
+
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128((__m128i *)(p + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const uint16x8_t wp = vdupq_n_u16(256 - w), wq = vdupq_n_u16(w);
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8(p + i), b = vld1q_u8(q + i);
+        uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(a)), wp),
+                                  vmovl_u8(vget_low_u8(b)), wq);
+        uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(a)), wp),
+                                  vmovl_u8(vget_high_u8(b)), wq);
+
+        vst1q_u8(p + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+#endif
+
+    for (; i < n; i++)
+        p[i] = (p[i] * (256 - w) + q[i] * w + 128) >> 8;
+}
+
+/*
+ * separable bilinear scaling in 1/256 fixed point: each source row is
+ * scaled horizontally once into hrows, then each destination row is
+ * the blend of two of them. The rows are split among the CPUs
+ */
+struct scale_2dimage_job {
+    const unsigned char *src_img;
+    int src_imgw, src_imgh;
+    unsigned char *dst_img;
+    int dst_imgw, dst_imgh;
+    const int *x0, *x1, *wx; /* per destination column */
+    const int *y0, *y1, *wy; /* per destination row */
+    unsigned char *hrows; /* src_imgh rows of dst_imgw */
+    int vertical; /* the pass of the job */
+    int first, last; /* its rows, of the source for the horizontal pass */
+};
+
+static void *scale_2dimage_rows(void *data)
+{
+    struct scale_2dimage_job *job = (struct scale_2dimage_job *)data;
+    int row, col;
+
+    for (row = job->first; row < job->last; row++) {
+        if (job->vertical) {
+            unsigned char *dst = job->dst_img + row * job->dst_imgw;
+
+            memcpy(dst, job->hrows + job->y0[row] * job->dst_imgw, job->dst_imgw);
+            if (job->wy[row])
+                YUV_blend_row(dst, job->hrows + job->y1[row] * job->dst_imgw,
+                              job->dst_imgw, job->wy[row]);
+        } else {
+            const unsigned char *src = job->src_img + row * job->src_imgw;
+            unsigned char *dst = job->hrows + row * job->dst_imgw;
+
+            for (col = 0; col < job->dst_imgw; col++)
+                dst[col] = (src[job->x0[col]] * (256 - job->wx[col]) +
+                            src[job->x1[col]] * job->wx[col] + 128) >> 8;
+        }
+    }
+
+    return NULL;
+}
+
+/* the source position of the destination centers, dst_len entries */
+static void scale_2dimage_taps(int src_len, int dst_len, int *i0, int *i1, int *w)
+{
+    int i, pos;
+
+    for (i = 0; i < dst_len; i++) {
+        /* ((i + 0.5) * src_len / dst_len - 0.5) in 1/256 */
+        pos = (int)(((2LL * i + 1) * src_len * 256) / (2 * dst_len)) - 128;
+        if (pos < 0)
+            pos = 0;
+        i0[i] = pos >> 8;
+        w[i] = pos & 0xff;
+        i1[i] = (i0[i] + 1 < src_len) ? i0[i] + 1 : i0[i];
+        if (i0[i] >= src_len - 1) {
+            i0[i] = src_len - 1;
+            w[i] = 0;
+        }
+    }
+}
+
+static void scale_2dimage_pass(struct scale_2dimage_job *job, int vertical, int rows)
+{
+    struct scale_2dimage_job jobs[16];
+    pthread_t threads[16];
+    int started[16];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_jobs, i;
+
+    /* small pictures aren't worth the threads */
+    num_jobs = (job->dst_imgw * rows >= 256 * 1024 && cpus > 1) ? (int)cpus : 1;
+    if (num_jobs > 16)
+        num_jobs = 16;
+
+    for (i = 0; i < num_jobs; i++) {
+        jobs[i] = *job;
+        jobs[i].vertical = vertical;
+        jobs[i].first = rows * i / num_jobs;
+        jobs[i].last = rows * (i + 1) / num_jobs;
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, scale_2dimage_rows, &jobs[i]) == 0;
+        if (i > 0 && !started[i])
+            scale_2dimage_rows(&jobs[i]);
+    }
+    scale_2dimage_rows(&jobs[0]);
+    for (i = 1; i < num_jobs; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+}
+
 static int scale_2dimage(unsigned char *src_img, int src_imgw, int src_imgh,
                   unsigned char *dst_img, int dst_imgw, int dst_imgh)
 {
-    int row=0, col=0;
+    struct scale_2dimage_job job;
+    int *taps;
 
-    for (row=0; row<dst_imgh; row++) {
-        for (col=0; col<dst_imgw; col++) {
-            *(dst_img + row * dst_imgw + col) = *(src_img + (row * src_imgh/dst_imgh) * src_imgw + col * src_imgw/dst_imgw);
-        }
+    taps = (int *)malloc((dst_imgw + dst_imgh) * 3 * sizeof(int));
+    job.hrows = (unsigned char *)malloc(src_imgh * dst_imgw);
+    if (taps == NULL || job.hrows == NULL) {
+        free(taps);
+        free(job.hrows);
+        return -1;
     }
 
+    job.src_img = src_img;
+    job.src_imgw = src_imgw;
+    job.src_imgh = src_imgh;
+    job.dst_img = dst_img;
+    job.dst_imgw = dst_imgw;
+    job.dst_imgh = dst_imgh;
+    job.x0 = taps;
+    job.x1 = taps + dst_imgw;
+    job.wx = taps + dst_imgw * 2;
+    job.y0 = taps + dst_imgw * 3;
+    job.y1 = job.y0 + dst_imgh;
+    job.wy = job.y0 + dst_imgh * 2;
+    scale_2dimage_taps(src_imgw, dst_imgw, (int *)job.x0, (int *)job.x1, (int *)job.wx);
+    scale_2dimage_taps(src_imgh, dst_imgh, (int *)job.y0, (int *)job.y1, (int *)job.wy);
+
+    scale_2dimage_pass(&job, 0, src_imgh);
+    scale_2dimage_pass(&job, 1, dst_imgh);
+
+    free(taps);
+    free(job.hrows);
+
     return 0;
 }
 
+/*
+ * yuvga_pic scaled to the surface sizes, made once for each size and
+ * kept until exit, the entries never change once in the list. NULL if
+ * the planes can't be allocated, the size is tried again next time
+ */
+struct yuvga_scaled {
+    int width, height;
+    unsigned char *pic_y, *pic_u, *pic_v;
+    struct yuvga_scaled *next;
+};
+
+static struct yuvga_scaled *yuvga_scaled_list = NULL;
+static pthread_mutex_t yuvga_scaled_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void yuvga_scaled_free(struct yuvga_scaled *scaled)
+{
+    free(scaled->pic_y);
+    free(scaled->pic_u);
+    free(scaled->pic_v);
+    free(scaled);
+}
+
+static struct yuvga_scaled *yuvga_scale(int width, int height)
+{
+    unsigned char *pic_y_old = yuvga_get_pic();
+    unsigned char *pic_u_old = pic_y_old + 640*480;
+    unsigned char *pic_v_old = pic_u_old + 640*480/4;
+    struct yuvga_scaled *scaled;
+
+    scaled = (struct yuvga_scaled *)calloc(1, sizeof(*scaled));
+    if (scaled == NULL)
+        return NULL;
+
+    scaled->width = width;
+    scaled->height = height;
+    scaled->pic_y = (unsigned char *)malloc(width * height);
+    scaled->pic_u = (unsigned char *)malloc((width/2) * (height/2));
+    scaled->pic_v = (unsigned char *)malloc((width/2) * (height/2));
+    if (scaled->pic_y == NULL || scaled->pic_u == NULL || scaled->pic_v == NULL ||
+        scale_2dimage(pic_y_old, 640, 480,
+                      scaled->pic_y, width, height) != 0 ||
+        scale_2dimage(pic_u_old, 320, 240,
+                      scaled->pic_u, width/2, height/2) != 0 ||
+        scale_2dimage(pic_v_old, 320, 240,
+                      scaled->pic_v, width/2, height/2) != 0) {
+        yuvga_scaled_free(scaled);
+        return NULL;
+    }
+
+    return scaled;
+}
+
+static struct yuvga_scaled *yuvga_get_scaled(int width, int height)
+{
+    struct yuvga_scaled *scaled;
+
+    pthread_mutex_lock(&yuvga_scaled_mutex);
+
+    for (scaled = yuvga_scaled_list; scaled; scaled = scaled->next) {
+        if (scaled->width == width && scaled->height == height)
+            break;
+    }
+
+    if (scaled == NULL) {
+        scaled = yuvga_scale(width, height);
+        if (scaled) {
+            scaled->next = yuvga_scaled_list;
+            yuvga_scaled_list = scaled;
+        }
+    }
+
+    pthread_mutex_unlock(&yuvga_scaled_mutex);
+
+    return scaled;
+}
 
 static int YUV_blend_with_pic(int width, int height,
                   unsigned char *Y_start, int Y_pitch,
@@ -45,18 +386,18 @@ static int YUV_blend_with_pic(int width, int height,
 		  int UV_interleave, int fixed_alpha)
 {
     /* PIC YUV format */
-    unsigned char *pic_y_old = yuvga_pic;
+    unsigned char *pic_y_old = yuvga_get_pic();
     unsigned char *pic_u_old = pic_y_old + 640*480;
     unsigned char *pic_v_old = pic_u_old + 640*480/4;
-    unsigned char *pic_y, *pic_u, *pic_v;
+    unsigned char *pic_y, *pic_u, *pic_v, *pic_uv = NULL;
+    struct yuvga_scaled *scaled;
 
     int alpha_values[] = {100,90,80,70,60,50,40,30,20,30,40,50,60,70,80,90};
     
     static int alpha_idx = 0;
-    int alpha;
-    int allocated = 0;
+    int alpha, w;
     
-    int row, col;
+    int row;
 
     if (fixed_alpha == 0) {
         alpha = alpha_values[alpha_idx % 16 ];
@@ -64,72 +405,46 @@ static int YUV_blend_with_pic(int width, int height,
     } else
         alpha = fixed_alpha;
 
-    //alpha = 0;
+    /* the percent in 1/256 */
+    w = (alpha * 256 + 50) / 100;
     
     pic_y = pic_y_old;
     pic_u = pic_u_old;
     pic_v = pic_v_old;
     
     if (width != 640 || height != 480) { /* need to scale the pic */
-        pic_y = (unsigned char *)malloc(width * height);
-        pic_u = (unsigned char *)malloc(width * height/4);
-        pic_v = (unsigned char *)malloc(width * height/4);
+        scaled = yuvga_get_scaled(width, height);
+        if (scaled == NULL)
+            return -1;
 
-        allocated = 1;
-        
-        scale_2dimage(pic_y_old, 640, 480,
-                      pic_y, width, height);
-        scale_2dimage(pic_u_old, 320, 240,
-                      pic_u, width/2, height/2);
-        scale_2dimage(pic_v_old, 320, 240,
-                      pic_v, width/2, height/2);
+        pic_y = scaled->pic_y;
+        pic_u = scaled->pic_u;
+        pic_v = scaled->pic_v;
     }
 
     /* begin blend */
 
     /* Y plane */
     for (row=0; row<height; row++) 
-        for (col=0; col<width; col++) {
-            unsigned char *p = Y_start + row * Y_pitch + col;
-            unsigned char *q = pic_y + row * width + col;
-            
-            *p  = *p * (100 - alpha) / 100 + *q * alpha/100;
-        }
+        YUV_blend_row(Y_start + row * Y_pitch, pic_y + row * width, width, w);
 
     if (UV_interleave == 0) {
         for (row=0; row<height/2; row++) 
-            for (col=0; col<width/2; col++) {
-                unsigned char *p = U_start + row * U_pitch + col;
-                unsigned char *q = pic_u + row * width/2 + col;
-            
-                *p  = *p * (100 - alpha) / 100 + *q * alpha/100;
-            }
+            YUV_blend_row(U_start + row * U_pitch, pic_u + row * (width/2), width/2, w);
     
         for (row=0; row<height/2; row++) 
-            for (col=0; col<width/2; col++) {
-                unsigned char *p = V_start + row * V_pitch + col;
-                unsigned char *q = pic_v + row * width/2 + col;
-            
-                *p  = *p * (100 - alpha) / 100 + *q * alpha/100;
-            }
+            YUV_blend_row(V_start + row * V_pitch, pic_v + row * (width/2), width/2, w);
     }  else { /* NV12 */
-        for (row=0; row<height/2; row++) 
-            for (col=0; col<width/2; col++) {
-                unsigned char *pU = U_start + row * U_pitch + col*2;
-                unsigned char *qU = pic_u + row * width/2 + col;
-                unsigned char *pV = pU + 1;
-                unsigned char *qV = pic_v + row * width/2 + col;
-            
-                *pU  = *pU * (100 - alpha) / 100 + *qU * alpha/100;
-                *pV  = *pV * (100 - alpha) / 100 + *qV * alpha/100;
-            }
-    }
-        
-    
-    if (allocated) {
-        free(pic_y);
-        free(pic_u);
-        free(pic_v);
+        pic_uv = (unsigned char *)malloc(width);
+        if (pic_uv == NULL)
+            return -1;
+
+        for (row=0; row<height/2; row++) {
+            YUV_interleave_row(pic_uv, pic_u + row * (width/2), pic_v + row * (width/2), width/2);
+            YUV_blend_row(U_start + row * U_pitch, pic_uv, width/2 * 2, w);
+        }
+
+        free(pic_uv);
     }
     
     return 0;
@@ -143,11 +458,29 @@ static int yuvgen_planar(int width, int height,
                          int field)
 {
     int row, alpha;
+    unsigned char *Y_box_rows;
+    int jj, run, xpos, ypos;
+
+    /*
+     * the rows of a box row are all the same, build the two kinds once
+     * with memset over the runs of a box, then copy them to the surface
+     */
+    Y_box_rows = (unsigned char *)malloc(2 * width);
+    if (Y_box_rows == NULL)
+        return -1;
+    for (jj=0; jj<width; jj+=run) {
+        run = box_width - (row_shift + jj) % box_width;
+        if (run > width - jj)
+            run = width - jj;
+        xpos = ((row_shift + jj) / box_width) & 0x1;
+
+        memset(Y_box_rows + jj, xpos ? 0x10 : 0xeb, run);
+        memset(Y_box_rows + width + jj, xpos ? 0xeb : 0x10, run);
+    }
 
     /* copy Y plane */
     for (row=0;row<height;row++) {
         unsigned char *Y_row = Y_start + row * Y_pitch;
-        int jj, xpos, ypos;
 
         ypos = (row / box_width) & 0x1;
 
@@ -158,20 +491,9 @@ static int yuvgen_planar(int width, int height,
             continue;
         }
         
-        for (jj=0; jj<width; jj++) {
-            xpos = ((row_shift + jj) / box_width) & 0x1;
-                        
-            if ((xpos == 0) && (ypos == 0))
-                Y_row[jj] = 0xeb;
-            if ((xpos == 1) && (ypos == 1))
-                Y_row[jj] = 0xeb;
-                        
-            if ((xpos == 1) && (ypos == 0))
-                Y_row[jj] = 0x10;
-            if ((xpos == 0) && (ypos == 1))
-                Y_row[jj] = 0x10;
-        }
+        memcpy(Y_row, Y_box_rows + ypos * width, width);
     }
+    free(Y_box_rows);
   
     /* copy UV data */
     for( row =0; row < height/2; row++) {
@@ -220,6 +542,7 @@ static int upload_surface(VADisplay va_dpy, VASurfaceID surface_id,
     VAImage surface_image;
     void *surface_p=NULL, *U_start,*V_start;
     VAStatus va_status;
+    int ret;
     
     va_status = vaDeriveImage(va_dpy,surface_id,&surface_image);
     CHECK_VASTATUS(va_status,"vaDeriveImage");
@@ -231,16 +554,16 @@ static int upload_surface(VADisplay va_dpy, VASurfaceID surface_id,
     V_start = (char *)surface_p + surface_image.offsets[2];
 
     /* assume surface is planar format */
-    yuvgen_planar(surface_image.width, surface_image.height,
-                  (unsigned char *)surface_p, surface_image.pitches[0],
-                  (unsigned char *)U_start, surface_image.pitches[1],
-                  (unsigned char *)V_start, surface_image.pitches[2],
-                  (surface_image.format.fourcc==VA_FOURCC_NV12),
-                  box_width, row_shift, field);
+    ret = yuvgen_planar(surface_image.width, surface_image.height,
+                        (unsigned char *)surface_p, surface_image.pitches[0],
+                        (unsigned char *)U_start, surface_image.pitches[1],
+                        (unsigned char *)V_start, surface_image.pitches[2],
+                        (surface_image.format.fourcc==VA_FOURCC_NV12),
+                        box_width, row_shift, field);
         
     vaUnmapBuffer(va_dpy,surface_image.buf);
 
     vaDestroyImage(va_dpy,surface_image.image_id);
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * loadsurface_yuv_gen file: write into file the picture of
+ * loadsurface_yuv.h the way loadsurface.h inflates it, see
+ * yuvga_unpredict() there. Run by test/loadsurface.am when
+ * loadsurface_yuv.h changes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "loadsurface_yuv.h"
+
+/* each sample minus its prediction, from the last one as it uses the ones before */
+static void yuvga_predict(unsigned char *p, const unsigned char *pic, int w, int h)
+{
+    int x, y, pred;
+
+    for (y = h - 1; y > 0; y--) {
+        const unsigned char *row = pic + y * w, *up = row - w;
+
+        for (x = w - 1; x > 0; x--) {
+            pred = row[x - 1] + up[x] - up[x - 1];
+            p[y * w + x] = row[x] - ((pred < 0) ? 0 : (pred > 255) ? 255 : pred);
+        }
+        p[y * w] = row[0] - up[0];
+    }
+    for (x = w - 1; x > 0; x--)
+        p[x] = pic[x] - pic[x - 1];
+    p[0] = pic[0];
+}
+
+int main(int argc, char *argv[])
+{
+    uLong pic_size = 640*480*3/2;
+    uLongf size = compressBound(pic_size);
+    unsigned char *residual, *blob;
+    FILE *fp;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s loadsurface_yuv.z\n", argv[0]);
+        return 1;
+    }
+    if (sizeof(yuvga_pic) != pic_size) {
+        fprintf(stderr, "The picture of loadsurface_yuv.h isn't 640x480 I420\n");
+        return 1;
+    }
+
+    residual = malloc(pic_size);
+    blob = malloc(size);
+    if (residual == NULL || blob == NULL) {
+        fprintf(stderr, "Can't allocate the picture\n");
+        return 1;
+    }
+
+    yuvga_predict(residual, yuvga_pic, 640, 480);
+    yuvga_predict(residual + 640*480, yuvga_pic + 640*480, 320, 240);
+    yuvga_predict(residual + 640*480 + 640*480/4, yuvga_pic + 640*480 + 640*480/4, 320, 240);
+
+    if (compress2(blob, &size, residual, pic_size, Z_BEST_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "Can't deflate the picture\n");
+        return 1;
+    }
+
+    fp = fopen(argv[1], "wb");
+    if (fp == NULL || fwrite(blob, size, 1, fp) != 1 || fclose(fp) != 0) {
+        fprintf(stderr, "Can't write %s\n", argv[1]);
+        return 1;
+    }
+
+    free(blob);
+    free(residual);
+    return 0;
+}
@@ -60,7 +60,7 @@ if (va_status != VA_STATUS_SUCCESS) {                                   \
 static  void *win_display;
 static  VADisplay va_dpy;
 static  VASurfaceID surface_id[SURFACE_NUM];
-static  pthread_mutex_t surface_mutex[SURFACE_NUM];
+static  VASurfacePool surface_pool;
 
 static  void *drawable_thread0, *drawable_thread1;
 static  int surface_width = 352, surface_height = 288;
@@ -76,42 +76,7 @@ static  pthread_mutex_t gmutex;
 static  int box_width = 32;
 static  int multi_thread = 0;
 static  int verbose = 0;
-
-static VASurfaceID get_next_free_surface(int *index)
-{
-    VASurfaceStatus surface_status;
-    int i;
-
-    assert(index);
-
-    if (multi_thread == 0) {
-        i = *index;
-        i++;
-        if (i == SURFACE_NUM)
-            i = 0;
-        *index = i;
-
-        return surface_id[i];
-    }
-    
-    for (i=0; i<SURFACE_NUM; i++) {
-        surface_status = (VASurfaceStatus)0;
-        vaQuerySurfaceStatus(va_dpy, surface_id[i], &surface_status);
-        if (surface_status == VASurfaceReady)
-        {
-            if (0 == pthread_mutex_trylock(&surface_mutex[i]))
-            {
-                *index = i;
-                break;
-            }
-        }
-    }
-
-    if (i==SURFACE_NUM)
-        return VA_INVALID_SURFACE;
-    else
-        return surface_id[i];
-}
+static  int bench = 0;
 
 static int upload_source_YUV_once_for_all()
 {
@@ -145,6 +110,49 @@ static unsigned long get_tick_count(void)
     return tv.tv_usec/1000+tv.tv_sec*1000;
 }
 
+/*
+ * -bench: the surface content generation alone, into memory laid out
+ * as NV12 and I420, no VA display needed
+ */
+static void bench_surface_content(void)
+{
+    int frames = (frame_num_total == ~0ULL) ? 300 : frame_num_total;
+    int uv_interleave, row_shift, i;
+    unsigned char *buf, *U_start, *V_start;
+    struct timeval start, end;
+    double seconds;
+
+    buf = (unsigned char *)malloc(surface_width * surface_height * 3 / 2 + surface_width);
+    if (buf == NULL)
+        exit(1);
+
+    for (uv_interleave = 1; uv_interleave >= 0; uv_interleave--) {
+        U_start = buf + surface_width * surface_height;
+        V_start = U_start + (surface_width / 2) * (surface_height / 2);
+
+        row_shift = 0;
+        gettimeofday(&start, NULL);
+        for (i = 0; i < frames; i++) {
+            yuvgen_planar(surface_width, surface_height,
+                          buf, surface_width,
+                          U_start, uv_interleave ? surface_width : surface_width / 2,
+                          V_start, surface_width / 2,
+                          uv_interleave, box_width, row_shift, display_field);
+
+            row_shift++;
+            if (row_shift==(2*box_width)) row_shift= 0;
+        }
+        gettimeofday(&end, NULL);
+
+        seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+        printf("%s: %d frames of %dx%d in %.3f s, %.1f Mpixels/s\n",
+               uv_interleave ? "NV12" : "I420", frames, surface_width, surface_height, seconds,
+               (double)frames * surface_width * surface_height / seconds / 1000000.0);
+    }
+
+    free(buf);
+}
+
 static void update_clipbox(VARectangle *cliprects, int width, int height)
 {
     if (test_clip == 0)
@@ -173,7 +181,6 @@ static void* putsurface_thread(void *data)
     int quit = 0;
     VAStatus vaStatus;
     int row_shift = 0;
-    int index = 0;
     unsigned int frame_num=0, start_time, putsurface_time;
     VARectangle cliprects[2]; /* client supplied clip list */
     int continue_display = 0;
@@ -187,8 +194,9 @@ static void* putsurface_thread(void *data)
     while (!quit) {
         VASurfaceID surface_id = VA_INVALID_SURFACE;
         
-        while (surface_id == VA_INVALID_SURFACE)
-            surface_id = get_next_free_surface(&index);
+        /* wait for the oldest displayed surface to be idle */
+        vaStatus = vaAcquireSurfaceFromPool(va_dpy, surface_pool, 0, &surface_id);
+        CHECK_VASTATUS(vaStatus,"vaAcquireSurfaceFromPool");
 
         if (verbose) printf("Thread: %p Display surface 0x%x,\n", drawable, surface_id);
 
@@ -218,7 +226,7 @@ static void* putsurface_thread(void *data)
         if (check_event)
             pthread_mutex_unlock(&gmutex);
         
-        pthread_mutex_unlock(&surface_mutex[index]); /* locked in get_next_free_surface */
+        vaReleaseSurfaceToPool(va_dpy, surface_pool, surface_id);
         
         if ((frame_num % 0xff) == 0) {
             fprintf(stderr, "%.2f FPS             \r", 256000.0 / (float)putsurface_time);
@@ -258,6 +266,16 @@ int main(int argc,char **argv)
     char c;
     int i;
 
+    /* -bench is long, take it out before getopt */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-bench") == 0) {
+            bench = 1;
+            memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(argv[0]));
+            argc--;
+            i--;
+        }
+    }
+
     while ((c =getopt(argc,argv,"w:h:g:r:d:f:tcep?n:v") ) != EOF) {
         switch (c) {
             case '?':
@@ -270,6 +288,7 @@ int main(int argc,char **argv)
                 printf("           -c test clipbox\n");
                 printf("           -f <1/2> top field, or bottom field\n");
                 printf("           -v verbose output\n");
+                printf("           -bench report the Mpixels/s of the surface content generation, -n frames\n");
                 exit(0);
                 break;
             case 'g':
@@ -326,6 +345,11 @@ int main(int argc,char **argv)
         }
     }
 
+    if (bench) {
+        bench_surface_content();
+        return 0;
+    }
+
     win_display = (void *)open_display();
     if (win_display == NULL) {
         fprintf(stderr, "Can't open the connection of display!\n");
@@ -337,18 +361,17 @@ int main(int argc,char **argv)
     va_status = vaInitialize(va_dpy, &major_ver, &minor_ver);
     CHECK_VASTATUS(va_status, "vaInitialize");
 
-    va_status = vaCreateSurfaces(va_dpy,surface_width, surface_height,
-                                VA_RT_FORMAT_YUV420, SURFACE_NUM, &surface_id[0]);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces");
+    va_status = vaCreateSurfacePool(va_dpy, surface_width, surface_height,
+                                    VA_RT_FORMAT_YUV420, SURFACE_NUM, SURFACE_NUM, &surface_pool);
+    CHECK_VASTATUS(va_status, "vaCreateSurfacePool");
+    va_status = vaQuerySurfacePool(va_dpy, surface_pool, &surface_id[0], &i);
+    CHECK_VASTATUS(va_status, "vaQuerySurfacePool");
     if (multi_thread == 0) /* upload the content for all surfaces */
         upload_source_YUV_once_for_all();
     
     if (check_event)
         pthread_mutex_init(&gmutex, NULL);
-   
-    for(i = 0; i< SURFACE_NUM; i++)
-        pthread_mutex_init(&surface_mutex[i], NULL);
-    
+
     if (multi_thread == 1) 
         ret = pthread_create(&thread1, NULL, putsurface_thread, (void*)drawable_thread1);
 
@@ -358,7 +381,7 @@ int main(int argc,char **argv)
         pthread_join(thread1, (void **)&ret);
     printf("thread1 is free\n");
     
-    vaDestroySurfaces(va_dpy,&surface_id[0],SURFACE_NUM);    
+    vaDestroySurfacePool(va_dpy, surface_pool);
     vaTerminate(va_dpy);
 
     close_display(win_display);
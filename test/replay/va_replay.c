@@ -0,0 +1,658 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Submit the decode recorded with LIBVA_TRACE and LIBVA_TRACE_CAPTURE
+ * again, to any driver, and report the frame rate and the latency from
+ * vaBeginPicture to the end of vaSyncSurface of each frame
+ */
+
+#include "sysdeps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <va/va.h>
+#include "va_display.h"
+#include "va_trace_format.h"
+#include "va_hash.h"
+
+#define NSEC_PER_SEC    1000000000ULL
+
+/* a surface or a buffer, by its ID in the capture */
+struct replay_id {
+    struct va_hash_entry entry; /* key is the captured ID */
+    uint32_t id;                /* the ID of the replay */
+};
+
+struct replay_context {
+    struct va_hash_entry entry; /* key is the captured VAContextID */
+    VAContextID id;
+    VAProfile profile;
+    VASurfaceID render_target;
+    VABufferID *buffers;        /* for the vaRenderPicture, it destroys them */
+    unsigned int num_buffers;
+    unsigned int max_buffers;
+    unsigned int render_left;   /* TRACE_CALL_Buffer records of the RenderPicture to come */
+    uint64_t begin;             /* vaBeginPicture of the picture */
+};
+
+struct replay_config {
+    struct va_hash_entry entry; /* key is the captured VAConfigID */
+    VAConfigID id;
+    VAProfile profile;
+    VAEntrypoint entrypoint;
+};
+
+/* decoded and not synchronized yet */
+struct replay_frame {
+    VASurfaceID surface;
+    uint64_t begin;
+};
+
+static VADisplay va_dpy;
+
+static struct va_hash configs;          /* struct replay_config */
+static struct va_hash contexts;         /* struct replay_context */
+static struct va_hash surfaces;         /* struct replay_id */
+static struct va_hash buffers;          /* struct replay_id, created for a vaRenderPicture */
+
+static struct replay_frame *pending;
+static unsigned int num_pending, max_pending;
+
+static uint64_t *latencies;             /* of each frame, in ns */
+static unsigned int num_frames, max_frames;
+
+static unsigned int skipped_buffers;
+
+static int realtime;                    /* -r, the pace of the capture */
+static double pace_fps;                 /* -f fps */
+static uint64_t start_time, first_timestamp;
+static unsigned int num_begun;          /* pictures */
+
+#define CHECK_VASTATUS(va_status, func)                                 \
+    if (va_status != VA_STATUS_SUCCESS) {                               \
+        fprintf(stderr, "%s:%s (%d) failed (%s), exit\n", __func__, func, __LINE__, \
+                vaErrorStr(va_status));                                 \
+        exit(1);                                                        \
+    }
+
+static uint64_t time_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void time_wait(uint64_t t)
+{
+    struct timespec ts;
+
+    ts.tv_sec = t / NSEC_PER_SEC;
+    ts.tv_nsec = t % NSEC_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/* grow an array of *max elements of size bytes to hold num of them */
+static void *array_grow(void *array, unsigned int *max, unsigned int num, size_t size)
+{
+    unsigned int new_max = *max ? *max : 16;
+
+    if (num <= *max)
+        return array;
+
+    while (new_max < num)
+        new_max *= 2;
+    array = realloc(array, new_max * size);
+    if (array == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    memset((char *)array + *max * size, 0, (new_max - *max) * size);
+    *max = new_max;
+
+    return array;
+}
+
+static void *replay_alloc(size_t size)
+{
+    void *p = calloc(1, size);
+
+    if (p == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static void replay_free(struct va_hash_entry *entry)
+{
+    free(entry);
+}
+
+static void replay_context_free(struct va_hash_entry *entry)
+{
+    free(((struct replay_context *)entry)->buffers);
+    free(entry);
+}
+
+/* the captured IDs are reused, a destroy record may be missing */
+static void replay_add(struct va_hash *table, struct va_hash_entry *entry, uint32_t captured,
+                       void (*free_entry)(struct va_hash_entry *entry))
+{
+    struct va_hash_entry *old = va_HashRemove(table, captured);
+
+    if (old)
+        free_entry(old);
+    entry->key = captured;
+    va_HashInsert(table, entry);
+}
+
+static void replay_id_add(struct va_hash *table, uint32_t captured, uint32_t replayed)
+{
+    struct replay_id *id = replay_alloc(sizeof(struct replay_id));
+
+    id->id = replayed;
+    replay_add(table, &id->entry, captured, replay_free);
+}
+
+/* VA_INVALID_SURFACE and the like are kept */
+static uint32_t replay_id_get(struct va_hash *table, uint32_t captured)
+{
+    struct replay_id *id = (struct replay_id *)va_HashLookup(table, captured);
+
+    return id ? id->id : captured;
+}
+
+static struct replay_context *context_get(uint32_t captured)
+{
+    return (struct replay_context *)va_HashLookup(&contexts, captured);
+}
+
+static void frame_sync(unsigned int i)
+{
+    VAStatus va_status;
+
+    va_status = vaSyncSurface(va_dpy, pending[i].surface);
+    CHECK_VASTATUS(va_status, "vaSyncSurface");
+
+    latencies = array_grow(latencies, &max_frames, num_frames + 1, sizeof(uint64_t));
+    latencies[num_frames++] = time_now() - pending[i].begin;
+
+    pending[i] = pending[--num_pending];
+}
+
+static void surface_sync(VASurfaceID surface)
+{
+    unsigned int i;
+
+    for (i = 0; i < num_pending; i++)
+        if (pending[i].surface == surface) {
+            frame_sync(i);
+            return;
+        }
+}
+
+/* surface IDs inside the buffers of the decode */
+static void buffer_remap(struct replay_context *ctx, VABufferType type,
+                         unsigned char *data, unsigned int size, unsigned int num_elements)
+{
+    unsigned int i, j;
+
+    for (i = 0; i < num_elements; i++, data += size) {
+        switch (ctx->profile) {
+        case VAProfileMPEG2Simple:
+        case VAProfileMPEG2Main:
+            if (type == VAPictureParameterBufferType &&
+                size >= sizeof(VAPictureParameterBufferMPEG2)) {
+                VAPictureParameterBufferMPEG2 *p = (VAPictureParameterBufferMPEG2 *)data;
+
+                p->forward_reference_picture = replay_id_get(&surfaces, p->forward_reference_picture);
+                p->backward_reference_picture = replay_id_get(&surfaces, p->backward_reference_picture);
+            }
+            break;
+        case VAProfileMPEG4Simple:
+        case VAProfileMPEG4AdvancedSimple:
+        case VAProfileMPEG4Main:
+        case VAProfileH263Baseline:
+            if (type == VAPictureParameterBufferType &&
+                size >= sizeof(VAPictureParameterBufferMPEG4)) {
+                VAPictureParameterBufferMPEG4 *p = (VAPictureParameterBufferMPEG4 *)data;
+
+                p->forward_reference_picture = replay_id_get(&surfaces, p->forward_reference_picture);
+                p->backward_reference_picture = replay_id_get(&surfaces, p->backward_reference_picture);
+            }
+            break;
+        case VAProfileVC1Simple:
+        case VAProfileVC1Main:
+        case VAProfileVC1Advanced:
+            if (type == VAPictureParameterBufferType &&
+                size >= sizeof(VAPictureParameterBufferVC1)) {
+                VAPictureParameterBufferVC1 *p = (VAPictureParameterBufferVC1 *)data;
+
+                p->forward_reference_picture = replay_id_get(&surfaces, p->forward_reference_picture);
+                p->backward_reference_picture = replay_id_get(&surfaces, p->backward_reference_picture);
+                p->inloop_decoded_picture = replay_id_get(&surfaces, p->inloop_decoded_picture);
+            }
+            break;
+        case VAProfileH264Baseline:
+        case VAProfileH264Main:
+        case VAProfileH264High:
+        case VAProfileH264ConstrainedBaseline:
+            if (type == VAPictureParameterBufferType &&
+                size >= sizeof(VAPictureParameterBufferH264)) {
+                VAPictureParameterBufferH264 *p = (VAPictureParameterBufferH264 *)data;
+
+                p->CurrPic.picture_id = replay_id_get(&surfaces, p->CurrPic.picture_id);
+                for (j = 0; j < 16; j++)
+                    p->ReferenceFrames[j].picture_id =
+                        replay_id_get(&surfaces, p->ReferenceFrames[j].picture_id);
+            } else if (type == VASliceParameterBufferType &&
+                       size >= sizeof(VASliceParameterBufferH264)) {
+                VASliceParameterBufferH264 *p = (VASliceParameterBufferH264 *)data;
+
+                for (j = 0; j < 32; j++) {
+                    p->RefPicList0[j].picture_id = replay_id_get(&surfaces, p->RefPicList0[j].picture_id);
+                    p->RefPicList1[j].picture_id = replay_id_get(&surfaces, p->RefPicList1[j].picture_id);
+                }
+            }
+            break;
+        default:
+            /* JPEG has no reference */
+            break;
+        }
+    }
+}
+
+static void replay_render(struct replay_context *ctx)
+{
+    VAStatus va_status;
+
+    if (ctx->num_buffers) {
+        va_status = vaRenderPicture(va_dpy, ctx->id, ctx->buffers, ctx->num_buffers);
+        CHECK_VASTATUS(va_status, "vaRenderPicture");
+    }
+    ctx->num_buffers = 0;
+}
+
+static void replay_record(const struct trace_record *record, unsigned char *data)
+{
+    const uint32_t *args = record->args;
+    struct replay_context *ctx;
+    VAStatus va_status;
+    unsigned int i;
+
+    switch (record->call) {
+    case TRACE_CALL_CreateConfig: {
+        struct replay_config *config;
+        int num_attribs = args[2];
+
+        if (record->data_size < num_attribs * sizeof(VAConfigAttrib))
+            num_attribs = 0;
+        config = replay_alloc(sizeof(struct replay_config));
+        va_status = vaCreateConfig(va_dpy, args[0], args[1], (VAConfigAttrib *)data,
+                                   num_attribs, &config->id);
+        CHECK_VASTATUS(va_status, "vaCreateConfig");
+
+        config->profile = args[0];
+        config->entrypoint = args[1];
+        replay_add(&configs, &config->entry, args[3], replay_free);
+        if (args[1] != VAEntrypointVLD)
+            fprintf(stderr, "Warning: only the decode is replayed, profile %d entrypoint %d isn't\n",
+                    args[0], args[1]);
+        break;
+    }
+    case TRACE_CALL_CreateSurface: {
+        VASurfaceID *surface_list;
+        unsigned int num_surfaces = args[3];
+
+        if (record->data_size < num_surfaces * sizeof(VASurfaceID))
+            break;
+        surface_list = malloc(num_surfaces * sizeof(VASurfaceID));
+        if (surface_list == NULL)
+            break;
+        va_status = vaCreateSurfaces(va_dpy, args[0], args[1], args[2], num_surfaces, surface_list);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces");
+        for (i = 0; i < num_surfaces; i++)
+            replay_id_add(&surfaces, ((VASurfaceID *)data)[i], surface_list[i]);
+        free(surface_list);
+        break;
+    }
+    case TRACE_CALL_CreateContext: {
+        struct replay_config *config = (struct replay_config *)va_HashLookup(&configs, args[0]);
+        unsigned int num_render_targets = args[4];
+        VASurfaceID *render_targets = (VASurfaceID *)data;
+
+        if (config == NULL || config->entrypoint != VAEntrypointVLD ||
+            record->data_size < num_render_targets * sizeof(VASurfaceID))
+            break;
+        for (i = 0; i < num_render_targets; i++)
+            render_targets[i] = replay_id_get(&surfaces, render_targets[i]);
+        ctx = replay_alloc(sizeof(struct replay_context));
+        va_status = vaCreateContext(va_dpy, config->id, args[1], args[2],
+                                    args[3], render_targets, num_render_targets, &ctx->id);
+        CHECK_VASTATUS(va_status, "vaCreateContext");
+
+        ctx->profile = config->profile;
+        replay_add(&contexts, &ctx->entry, args[5], replay_context_free);
+        break;
+    }
+    case TRACE_CALL_BeginPicture:
+        ctx = context_get(args[0]);
+        if (ctx == NULL)
+            break;
+
+        if (num_begun++ == 0) {
+            start_time = time_now();
+            first_timestamp = record->timestamp;
+        } else if (pace_fps > 0)
+            time_wait(start_time + (num_begun - 1) * NSEC_PER_SEC / pace_fps);
+        else if (realtime)
+            time_wait(start_time + (record->timestamp - first_timestamp));
+
+        ctx->render_target = replay_id_get(&surfaces, args[1]);
+        /* decode into it again */
+        surface_sync(ctx->render_target);
+        ctx->begin = time_now();
+        va_status = vaBeginPicture(va_dpy, ctx->id, ctx->render_target);
+        CHECK_VASTATUS(va_status, "vaBeginPicture");
+        break;
+    case TRACE_CALL_RenderPicture:
+        ctx = context_get(args[0]);
+        if (ctx == NULL)
+            break;
+        ctx->render_left = args[1];
+        if (ctx->render_left == 0)
+            replay_render(ctx);
+        break;
+    case TRACE_CALL_Buffer: {
+        VABufferID buffer;
+
+        ctx = context_get(args[0]);
+        if (ctx == NULL || ctx->render_left == 0)
+            break;
+
+        if ((record->flags & (TRACE_RECORD_NO_INFO | TRACE_RECORD_NO_DATA | TRACE_RECORD_TRUNCATED)) ||
+            record->data_size < (uint64_t)args[4] * args[5]) {
+            skipped_buffers++;
+        } else {
+            buffer_remap(ctx, args[3], data, args[4], args[5]);
+            va_status = vaCreateBuffer(va_dpy, ctx->id, args[3], args[4], args[5], data, &buffer);
+            CHECK_VASTATUS(va_status, "vaCreateBuffer");
+            replay_id_add(&buffers, args[2], buffer);
+            ctx->buffers = array_grow(ctx->buffers, &ctx->max_buffers, ctx->num_buffers + 1,
+                                      sizeof(VABufferID));
+            ctx->buffers[ctx->num_buffers++] = buffer;
+        }
+
+        /* all the buffers of the vaRenderPicture */
+        if (--ctx->render_left == 0)
+            replay_render(ctx);
+        break;
+    }
+    case TRACE_CALL_EndPicture:
+        ctx = context_get(args[0]);
+        /* the record before the call */
+        if (ctx == NULL || args[1] != 0)
+            break;
+
+        if (ctx->render_left)
+            replay_render(ctx);
+        ctx->render_left = 0;
+        va_status = vaEndPicture(va_dpy, ctx->id);
+        CHECK_VASTATUS(va_status, "vaEndPicture");
+
+        pending = array_grow(pending, &max_pending, num_pending + 1, sizeof(struct replay_frame));
+        pending[num_pending].surface = ctx->render_target;
+        pending[num_pending].begin = ctx->begin;
+        num_pending++;
+        break;
+    case TRACE_CALL_SyncSurface:
+        surface_sync(replay_id_get(&surfaces, args[0]));
+        break;
+    case TRACE_CALL_DestroyBuffer: {
+        struct replay_id *id = (struct replay_id *)va_HashRemove(&buffers, args[0]);
+
+        /* as the application did, its status isn't checked as drivers may destroy it at render */
+        if (id)
+            vaDestroyBuffer(va_dpy, id->id);
+        free(id);
+        break;
+    }
+    case TRACE_CALL_DestroyContext:
+        ctx = (struct replay_context *)va_HashRemove(&contexts, args[0]);
+        if (ctx == NULL)
+            break;
+        va_status = vaDestroyContext(va_dpy, ctx->id);
+        CHECK_VASTATUS(va_status, "vaDestroyContext");
+        replay_context_free(&ctx->entry);
+        break;
+    case TRACE_CALL_DestroySurfaces: {
+        VASurfaceID *surface_list = (VASurfaceID *)data;
+        unsigned int num_surfaces = args[0];
+        struct replay_id *id;
+
+        if (record->data_size < num_surfaces * sizeof(VASurfaceID))
+            break;
+        for (i = 0; i < num_surfaces; i++) {
+            id = (struct replay_id *)va_HashRemove(&surfaces, surface_list[i]);
+            if (id == NULL)
+                continue;
+            /* the latency of its last frame */
+            surface_sync(id->id);
+            va_status = vaDestroySurfaces(va_dpy, &id->id, 1);
+            CHECK_VASTATUS(va_status, "vaDestroySurfaces");
+            free(id);
+        }
+        break;
+    }
+    case TRACE_CALL_DestroyConfig: {
+        struct replay_config *config = (struct replay_config *)va_HashRemove(&configs, args[0]);
+
+        if (config == NULL)
+            break;
+        va_status = vaDestroyConfig(va_dpy, config->id);
+        CHECK_VASTATUS(va_status, "vaDestroyConfig");
+        free(config);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/* the objects the capture didn't destroy, the buffers are left to the driver */
+static void replay_destroy_all(void)
+{
+    struct va_hash_entry *entry;
+    unsigned int i;
+
+    for (i = 0; i < contexts.num_buckets; i++)
+        for (entry = contexts.buckets[i]; entry; entry = entry->next)
+            vaDestroyContext(va_dpy, ((struct replay_context *)entry)->id);
+    for (i = 0; i < surfaces.num_buckets; i++)
+        for (entry = surfaces.buckets[i]; entry; entry = entry->next)
+            vaDestroySurfaces(va_dpy, &((struct replay_id *)entry)->id, 1);
+    for (i = 0; i < configs.num_buckets; i++)
+        for (entry = configs.buckets[i]; entry; entry = entry->next)
+            vaDestroyConfig(va_dpy, ((struct replay_config *)entry)->id);
+
+    va_HashFini(&contexts, replay_context_free);
+    va_HashFini(&surfaces, replay_free);
+    va_HashFini(&configs, replay_free);
+    va_HashFini(&buffers, replay_free);
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t la = *(const uint64_t *)a, lb = *(const uint64_t *)b;
+
+    return la < lb ? -1 : la > lb;
+}
+
+static double latency_ms(double percent)
+{
+    unsigned int i = (unsigned int)(percent / 100.0 * (num_frames - 1) + 0.5);
+
+    return latencies[i] / 1e6;
+}
+
+static void replay_report(uint64_t elapsed)
+{
+    uint64_t total = 0;
+    unsigned int i;
+
+    printf("%u frames in %.3f s, %.2f fps\n", num_frames, elapsed / 1e9,
+           elapsed ? num_frames * 1e9 / elapsed : 0.0);
+    if (num_frames == 0)
+        return;
+
+    qsort(latencies, num_frames, sizeof(uint64_t), compare_latency);
+    for (i = 0; i < num_frames; i++)
+        total += latencies[i];
+    printf("latency (ms): avg %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+           total / 1e6 / num_frames, latency_ms(50), latency_ms(90), latency_ms(99),
+           latencies[num_frames - 1] / 1e6);
+    if (skipped_buffers)
+        printf("%u buffers without their content weren't replayed\n", skipped_buffers);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--display display] [-r | -f fps] capture_file\n", name);
+    fprintf(stderr, "\t-r: submit the frames at the pace of the capture\n");
+    fprintf(stderr, "\t-f: submit the frames at fps frames per second\n");
+    fprintf(stderr, "without -r or -f the frames are submitted as fast as possible\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct trace_ring_header *header;
+    unsigned char *records;
+    struct stat buf;
+    uint64_t offset, end, elapsed;
+    VAStatus va_status;
+    int major_ver, minor_ver;
+    void *map;
+    int fd, c;
+
+    va_init_display_args(&argc, argv);
+
+    while ((c = getopt(argc, argv, "rf:h")) != -1) {
+        switch (c) {
+        case 'r':
+            realtime = 1;
+            break;
+        case 'f':
+            pace_fps = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &buf) != 0) {
+        fprintf(stderr, "Open file %s failed (%s)\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    /* private and writable, the IDs in the buffers are replaced */
+    map = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf.st_size < sizeof(*header) || map == MAP_FAILED) {
+        fprintf(stderr, "Map file %s failed\n", argv[optind]);
+        return 1;
+    }
+
+    header = map;
+    if (memcmp(header->magic, TRACE_CAPTURE_MAGIC, sizeof(TRACE_CAPTURE_MAGIC)) != 0 ||
+        header->version != TRACE_RING_VERSION || header->header_size > (uint64_t)buf.st_size) {
+        fprintf(stderr, "%s isn't recorded with LIBVA_TRACE_CAPTURE\n", argv[optind]);
+        return 1;
+    }
+    if (header->overwritten)
+        fprintf(stderr, "Warning: %llu records were lost by the capture\n",
+                (unsigned long long)header->overwritten);
+    records = (unsigned char *)map + header->header_size;
+    end = buf.st_size - header->header_size;
+
+    va_dpy = va_open_display();
+    if (va_dpy == NULL) {
+        fprintf(stderr, "vaGetDisplay() failed\n");
+        return 1;
+    }
+    va_status = vaInitialize(va_dpy, &major_ver, &minor_ver);
+    CHECK_VASTATUS(va_status, "vaInitialize");
+
+    if (va_HashInit(&configs) != 0 || va_HashInit(&contexts) != 0 ||
+        va_HashInit(&surfaces) != 0 || va_HashInit(&buffers) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (offset = 0; offset + sizeof(struct trace_record) <= end; ) {
+        struct trace_record *record = (struct trace_record *)(records + offset);
+
+        if (record->size < sizeof(*record) || (record->size & 7) || offset + record->size > end ||
+            sizeof(*record) + record->data_size > record->size) {
+            fprintf(stderr, "Warning: bad record at offset %llu, stop\n",
+                    (unsigned long long)(header->header_size + offset));
+            break;
+        }
+        replay_record(record, (unsigned char *)(record + 1));
+        offset += record->size;
+    }
+
+    while (num_pending)
+        frame_sync(num_pending - 1);
+    elapsed = num_begun ? time_now() - start_time : 0;
+
+    replay_report(elapsed);
+
+    replay_destroy_all();
+
+    vaTerminate(va_dpy);
+    va_close_display(va_dpy);
+
+    free(pending);
+    free(latencies);
+    munmap(map, buf.st_size);
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+# For va_trace_decode
+# =====================================================
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	va_trace_decode.c
+
+LOCAL_CFLAGS += \
+  -DANDROID
+
+LOCAL_C_INCLUDES += \
+  $(LOCAL_PATH)/../../va \
+  $(LOCAL_PATH)/../.. \
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := va_trace_decode
+
+LOCAL_SHARED_LIBRARIES := libva
+
+include $(BUILD_EXECUTABLE)
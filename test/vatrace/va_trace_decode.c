@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2007 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Turn a log recorded with LIBVA_TRACE and LIBVA_TRACE_BINARY into the
+ * text LIBVA_TRACE writes without LIBVA_TRACE_BINARY
+ */
+
+#include "sysdeps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <va/va.h>
+#include "va_trace.h"
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-b] [-o text_file] binary_log\n", name);
+    fprintf(stderr, "\t-b: dump the buffer data, as LIBVA_TRACE_BUFDATA\n");
+    fprintf(stderr, "\t-o: write the text into text_file instead of stdout\n");
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *out = stdout;
+    int flags = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "bo:h")) != -1) {
+        switch (c) {
+        case 'b':
+            flags |= VA_TRACE_FLAG_BUFDATA;
+            break;
+        case 'o':
+            out = fopen(optarg, "w");
+            if (out == NULL) {
+                fprintf(stderr, "Open file %s failed (%s)\n", optarg, strerror(errno));
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (va_TraceDecode(argv[optind], out, flags) != 0) {
+        fprintf(stderr, "Decode %s failed (%s)\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Row helpers of the tests which fill surfaces (loadsurface.h, avcenc),
+ * SSE2 or NEON when the compiler targets them, the tail in C
+ */
+#ifndef _YUV_ROW_H_
+#define _YUV_ROW_H_
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* dst = u0 v0 u1 v1 ... for the NV12 chroma rows */
+static void YUV_interleave_row(unsigned char *dst, const unsigned char *u,
+                               const unsigned char *v, int n)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(u + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(v + i));
+
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv;
+
+        uv.val[0] = vld1q_u8(u + i);
+        uv.val[1] = vld1q_u8(v + i);
+        vst2q_u8(dst + 2 * i, uv);
+    }
+#endif
+
+    for (; i < n; i++) {
+        dst[2 * i] = u[i];
+        dst[2 * i + 1] = v[i];
+    }
+}
+
+#endif /* _YUV_ROW_H_ */
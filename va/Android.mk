@@ -40,7 +40,11 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
 	va.c \
 	va_trace.c \
-	va_fool.c
+	va_fool.c \
+	va_crc.c \
+	va_hash.c \
+	va_latency.c \
+	va_surface_pool.c
 
 LOCAL_CFLAGS += \
 	-DANDROID \
@@ -68,6 +68,29 @@
     } while (0)
 #endif
 
+/*
+ * Process-wide flags (trace_flag, fool_codec, ...) are the union of the
+ * settings of all the displays, they are set while a display is being
+ * initialized and read by every entry-point of every display.
+ * The acquire/release variants order the accesses to the data published
+ * through the variable, e.g. the positions of a single-producer queue.
+ */
+#if defined __ATOMIC_RELAXED
+# define va_atomic_load(ptr)        __atomic_load_n((ptr), __ATOMIC_RELAXED)
+# define va_atomic_store(ptr, val)  __atomic_store_n((ptr), (val), __ATOMIC_RELAXED)
+# define va_atomic_load_acquire(ptr)        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+# define va_atomic_store_release(ptr, val)  __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+# define va_atomic_fence()          __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+# define va_atomic_load(ptr)        (*(volatile __typeof__(*(ptr)) *)(ptr))
+# define va_atomic_store(ptr, val)  (*(volatile __typeof__(*(ptr)) *)(ptr) = (val))
+# define va_atomic_load_acquire(ptr)        ({ __typeof__(*(ptr)) v_ = va_atomic_load(ptr); __sync_synchronize(); v_; })
+# define va_atomic_store_release(ptr, val)  do { __sync_synchronize(); va_atomic_store(ptr, val); } while (0)
+# define va_atomic_fence()          __sync_synchronize()
+#endif
+#define va_atomic_or(ptr, val)      __sync_fetch_and_or((ptr), (val))
+#define va_atomic_add(ptr, val)     __sync_fetch_and_add((ptr), (val))
+
 #if defined __GNUC__ && defined HAVE_GNUC_VISIBILITY_ATTRIBUTE
 # define DLL_HIDDEN __attribute__((visibility("hidden")))
 # define DLL_EXPORT __attribute__((visibility("default")))
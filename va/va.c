@@ -28,6 +28,8 @@
 #include "va_backend.h"
 #include "va_trace.h"
 #include "va_fool.h"
+#include "va_latency.h"
+#include "va_probe.h"
 
 #include <assert.h>
 #include <stdarg.h>
@@ -41,12 +43,28 @@
 
 #define CTX(dpy) (((VADisplayContextP)dpy)->pDriverContext)
 #define CHECK_DISPLAY(dpy) if( !vaDisplayIsValid(dpy) ) { return VA_STATUS_ERROR_INVALID_DISPLAY; }
+/* CHECK_DISPLAY after the func_entry probe, the func_return probe gets the other arguments */
+#define CHECK_DISPLAY_PROBE(dpy, func, ...)                             \
+    if (!vaDisplayIsValid(dpy)) {                                       \
+        VA_PROBE(func##_return, dpy, VA_STATUS_ERROR_INVALID_DISPLAY, ##__VA_ARGS__); \
+        return VA_STATUS_ERROR_INVALID_DISPLAY;                         \
+    }
 
 #define ASSERT		assert
 #define CHECK_VTABLE(s, ctx, func) if (!va_checkVtable(ctx->vtable->va##func, #func)) s = VA_STATUS_ERROR_UNKNOWN;
 #define CHECK_MAXIMUM(s, ctx, var) if (!va_checkMaximum(ctx->max_##var, #var)) s = VA_STATUS_ERROR_UNKNOWN;
 #define CHECK_STRING(s, ctx, var) if (!va_checkString(ctx->str_##var, #var)) s = VA_STATUS_ERROR_UNKNOWN;
 
+/* call the entry-point func of the driver, between the driver_entry/return probes */
+#define VA_DRIVER_CALL(s, func, ...)                                    \
+    do {                                                                \
+        VA_PROBE(driver_entry, dpy, (const char *)#func);               \
+        s = ctx->vtable->va##func(ctx, __VA_ARGS__);                    \
+        VA_PROBE(driver_return, dpy, (const char *)#func, s);           \
+    } while (0)
+/* an ID created by the call, for its _return probe */
+#define VA_PROBE_ID(s, id) ((s) == VA_STATUS_SUCCESS ? (id) : VA_INVALID_ID)
+
 /*
  * read a config "env" for libva.conf or from environment setting
  * liva.conf has higher priority
@@ -200,6 +218,7 @@ static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
     char *saveptr;
     char *driver_dir;
     
+    VA_PROBE(open_driver_entry, dpy, driver_name);
     if (geteuid() == getuid())
         /* don't allow setuid apps to use LIBVA_DRIVERS_PATH */
         search_path = getenv("LIBVA_DRIVERS_PATH");
@@ -219,6 +238,7 @@ static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
         strncat( driver_path, DRIVER_EXTENSION, strlen(DRIVER_EXTENSION) );
         
         va_infoMessage("Trying to open %s\n", driver_path);
+        VA_PROBE(open_driver_try, dpy, driver_path);
 #ifndef ANDROID
         handle = dlopen( driver_path, RTLD_NOW | RTLD_GLOBAL | RTLD_NODELETE );
 #else
@@ -238,6 +258,7 @@ static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
                 int minor;
             } compatible_versions[] = {
                 { VA_MAJOR_VERSION, VA_MINOR_VERSION },
+                { 0, 33 },
                 { 0, 32 },
                 { -1, }
             };
@@ -338,6 +359,7 @@ static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
     
     free(search_path);    
     
+    VA_PROBE(open_driver_return, dpy, vaStatus);
     return vaStatus;
 }
 
@@ -422,8 +444,14 @@ VAStatus vaInitialize (
     const char *driver_name_env = NULL;
     char *driver_name = NULL;
     VAStatus vaStatus;
+    uint64_t va_latency_start;
 
-    CHECK_DISPLAY(dpy);
+    VA_PROBE(Initialize_entry, dpy);
+    CHECK_DISPLAY_PROBE(dpy, Initialize);
+
+    /* set up profiling first, so that vaInitialize itself gets timed */
+    va_LatencyInit(dpy);
+    va_latency_start = va_atomic_load(&latency_flag) ? va_LatencyTime() : 0;
 
     va_TraceInit(dpy);
 
@@ -455,6 +483,9 @@ VAStatus vaInitialize (
     
     VA_TRACE_LOG(va_TraceInitialize, dpy, major_version, minor_version);
 
+    VA_PROBE(Initialize_return, dpy, vaStatus);
+    VA_LATENCY_RECORD(dpy, VA_INVALID_ID, Initialize);
+
     return vaStatus;
 }
 
@@ -469,27 +500,36 @@ VAStatus vaTerminate (
   VAStatus vaStatus = VA_STATUS_SUCCESS;
   VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
   VADriverContextP old_ctx;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(Terminate_entry, dpy);
+  CHECK_DISPLAY_PROBE(dpy, Terminate);
   old_ctx = CTX(dpy);
 
   if (old_ctx->handle) {
+      VA_PROBE(driver_entry, dpy, (const char *)"Terminate");
       vaStatus = old_ctx->vtable->vaTerminate(old_ctx);
+      VA_PROBE(driver_return, dpy, (const char *)"Terminate", vaStatus);
       dlclose(old_ctx->handle);
       old_ctx->handle = NULL;
   }
   free(old_ctx->vtable);
   old_ctx->vtable = NULL;
 
-  if (VA_STATUS_SUCCESS == vaStatus)
-      pDisplayContext->vaDestroy(pDisplayContext);
-
   VA_TRACE_LOG(va_TraceTerminate, dpy);
 
+  /* the per display states live in the display context, release them before it goes */
   va_TraceEnd(dpy);
 
   va_FoolEnd(dpy);
 
+  VA_PROBE(Terminate_return, dpy, vaStatus);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, Terminate);
+  va_LatencyEnd(dpy);
+
+  if (VA_STATUS_SUCCESS == vaStatus)
+      pDisplayContext->vaDestroy(pDisplayContext);
+
   return vaStatus;
 }
 
@@ -554,10 +594,18 @@ VAStatus vaQueryConfigEntrypoints (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(QueryConfigEntrypoints_entry, dpy, profile);
+  CHECK_DISPLAY_PROBE(dpy, QueryConfigEntrypoints);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaQueryConfigEntrypoints ( ctx, profile, entrypoints, num_entrypoints);
+  VA_DRIVER_CALL(va_status, QueryConfigEntrypoints, profile, entrypoints, num_entrypoints);
+
+  VA_PROBE(QueryConfigEntrypoints_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QueryConfigEntrypoints);
+
+  return va_status;
 }
 
 VAStatus vaGetConfigAttributes (
@@ -569,10 +617,18 @@ VAStatus vaGetConfigAttributes (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(GetConfigAttributes_entry, dpy, profile, entrypoint, num_attribs);
+  CHECK_DISPLAY_PROBE(dpy, GetConfigAttributes);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaGetConfigAttributes ( ctx, profile, entrypoint, attrib_list, num_attribs );
+  VA_DRIVER_CALL(va_status, GetConfigAttributes, profile, entrypoint, attrib_list, num_attribs);
+
+  VA_PROBE(GetConfigAttributes_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, GetConfigAttributes);
+
+  return va_status;
 }
 
 VAStatus vaQueryConfigProfiles (
@@ -582,10 +638,18 @@ VAStatus vaQueryConfigProfiles (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(QueryConfigProfiles_entry, dpy);
+  CHECK_DISPLAY_PROBE(dpy, QueryConfigProfiles);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaQueryConfigProfiles ( ctx, profile_list, num_profiles );
+  VA_DRIVER_CALL(va_status, QueryConfigProfiles, profile_list, num_profiles);
+
+  VA_PROBE(QueryConfigProfiles_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QueryConfigProfiles);
+
+  return va_status;
 }
 
 VAStatus vaCreateConfig (
@@ -600,16 +664,23 @@ VAStatus vaCreateConfig (
   VADriverContextP ctx;
   VAStatus vaStatus = VA_STATUS_SUCCESS;
   int ret = 0;
+  VA_LATENCY_START();
   
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(CreateConfig_entry, dpy, profile, entrypoint, num_attribs);
+  CHECK_DISPLAY_PROBE(dpy, CreateConfig, VA_INVALID_ID);
   ctx = CTX(dpy);
 
-  vaStatus = ctx->vtable->vaCreateConfig ( ctx, profile, entrypoint, attrib_list, num_attribs, config_id );
+  VA_DRIVER_CALL(vaStatus, CreateConfig, profile, entrypoint, attrib_list, num_attribs, config_id);
 
   /* record the current entrypoint for further trace/fool determination */
-  VA_TRACE_FUNC(va_TraceCreateConfig, dpy, profile, entrypoint, attrib_list, num_attribs, config_id);
-  VA_FOOL_FUNC(va_FoolCreateConfig, dpy, profile, entrypoint, attrib_list, num_attribs, config_id);
-  
+  if (vaStatus == VA_STATUS_SUCCESS) {
+      VA_TRACE_FUNC(va_TraceCreateConfig, dpy, profile, entrypoint, attrib_list, num_attribs, config_id);
+      VA_FOOL_FUNC(va_FoolCreateConfig, dpy, profile, entrypoint, attrib_list, num_attribs, config_id);
+  }
+
+  VA_PROBE(CreateConfig_return, dpy, vaStatus, VA_PROBE_ID(vaStatus, *config_id));
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, CreateConfig);
+
   return vaStatus;
 }
 
@@ -619,10 +690,21 @@ VAStatus vaDestroyConfig (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(DestroyConfig_entry, dpy, config_id);
+  CHECK_DISPLAY_PROBE(dpy, DestroyConfig);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaDestroyConfig ( ctx, config_id );
+  VA_DRIVER_CALL(va_status, DestroyConfig, config_id);
+
+  VA_TRACE_FUNC(va_TraceDestroyConfig, dpy, config_id);
+  VA_FOOL_HOOK(va_FoolDestroyConfig, dpy, config_id);
+
+  VA_PROBE(DestroyConfig_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, DestroyConfig);
+
+  return va_status;
 }
 
 VAStatus vaQueryConfigAttributes (
@@ -635,10 +717,18 @@ VAStatus vaQueryConfigAttributes (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(QueryConfigAttributes_entry, dpy, config_id);
+  CHECK_DISPLAY_PROBE(dpy, QueryConfigAttributes);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaQueryConfigAttributes( ctx, config_id, profile, entrypoint, attrib_list, num_attribs);
+  VA_DRIVER_CALL(va_status, QueryConfigAttributes, config_id, profile, entrypoint, attrib_list, num_attribs);
+
+  VA_PROBE(QueryConfigAttributes_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QueryConfigAttributes);
+
+  return va_status;
 }
 
 VAStatus vaCreateSurfaces (
@@ -652,14 +742,19 @@ VAStatus vaCreateSurfaces (
 {
   VADriverContextP ctx;
   VAStatus vaStatus;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(CreateSurfaces_entry, dpy, width, height, format, num_surfaces);
+  CHECK_DISPLAY_PROBE(dpy, CreateSurfaces, surfaces, num_surfaces);
   ctx = CTX(dpy);
 
-  vaStatus = ctx->vtable->vaCreateSurfaces( ctx, width, height, format, num_surfaces, surfaces );
+  VA_DRIVER_CALL(vaStatus, CreateSurfaces, width, height, format, num_surfaces, surfaces);
 
   VA_TRACE_LOG(va_TraceCreateSurface, dpy, width, height, format, num_surfaces, surfaces);
-  
+
+  VA_PROBE(CreateSurfaces_return, dpy, vaStatus, surfaces, num_surfaces);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, CreateSurfaces);
+
   return vaStatus;
 }
 
@@ -671,10 +766,21 @@ VAStatus vaDestroySurfaces (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(DestroySurfaces_entry, dpy, surface_list, num_surfaces);
+  CHECK_DISPLAY_PROBE(dpy, DestroySurfaces);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaDestroySurfaces( ctx, surface_list, num_surfaces );
+  VA_DRIVER_CALL(va_status, DestroySurfaces, surface_list, num_surfaces);
+
+  VA_TRACE_FUNC(va_TraceDestroySurfaces, dpy, surface_list, num_surfaces);
+  VA_FOOL_HOOK(va_FoolDestroySurfaces, dpy, surface_list, num_surfaces);
+
+  VA_PROBE(DestroySurfaces_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, DestroySurfaces);
+
+  return va_status;
 }
 
 VAStatus vaCreateContext (
@@ -690,15 +796,22 @@ VAStatus vaCreateContext (
 {
   VADriverContextP ctx;
   VAStatus vaStatus;
+  VA_LATENCY_START();
   
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(CreateContext_entry, dpy, config_id, picture_width, picture_height, flag, num_render_targets);
+  CHECK_DISPLAY_PROBE(dpy, CreateContext, VA_INVALID_ID);
   ctx = CTX(dpy);
 
-  vaStatus = ctx->vtable->vaCreateContext( ctx, config_id, picture_width, picture_height,
-                                      flag, render_targets, num_render_targets, context );
+  VA_DRIVER_CALL(vaStatus, CreateContext, config_id, picture_width, picture_height, flag, render_targets, num_render_targets, context);
 
   /* keep current encode/decode resoluton */
-  VA_TRACE_FUNC(va_TraceCreateContext, dpy, config_id, picture_width, picture_height, flag, render_targets, num_render_targets, context);
+  if (vaStatus == VA_STATUS_SUCCESS) {
+      VA_TRACE_FUNC(va_TraceCreateContext, dpy, config_id, picture_width, picture_height, flag, render_targets, num_render_targets, context);
+      VA_FOOL_HOOK(va_FoolCreateContext, dpy, config_id, picture_width, picture_height, context);
+  }
+
+  VA_PROBE(CreateContext_return, dpy, vaStatus, VA_PROBE_ID(vaStatus, *context));
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, CreateContext);
 
   return vaStatus;
 }
@@ -709,10 +822,23 @@ VAStatus vaDestroyContext (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(DestroyContext_entry, dpy, context);
+  CHECK_DISPLAY_PROBE(dpy, DestroyContext);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaDestroyContext( ctx, context );
+  VA_DRIVER_CALL(va_status, DestroyContext, context);
+
+  VA_TRACE_FUNC(va_TraceDestroyContext, dpy, context);
+  VA_FOOL_HOOK(va_FoolDestroyContext, dpy, context);
+
+  VA_PROBE(DestroyContext_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, context, DestroyContext);
+  if (va_status == VA_STATUS_SUCCESS)
+      va_LatencyDestroyContext(dpy, context);
+
+  return va_status;
 }
 
 VAStatus vaCreateBuffer (
@@ -726,15 +852,21 @@ VAStatus vaCreateBuffer (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(CreateBuffer_entry, dpy, context, type, size, num_elements);
+  CHECK_DISPLAY_PROBE(dpy, CreateBuffer, VA_INVALID_ID);
   ctx = CTX(dpy);
   int ret = 0;
 
-  VA_FOOL_FUNC(va_FoolCreateBuffer, dpy, context, type, size, num_elements, data, buf_id);
-  if (ret)
-      return VA_STATUS_SUCCESS;
+  VA_FOOL_FUNC(va_FoolCreateBuffer, dpy, context, type, size, num_elements, data, buf_id, &va_status);
+  if (!ret)
+      VA_DRIVER_CALL(va_status, CreateBuffer, context, type, size, num_elements, data, buf_id);
+
+  VA_PROBE(CreateBuffer_return, dpy, va_status, VA_PROBE_ID(va_status, *buf_id));
+  VA_LATENCY_RECORD(dpy, context, CreateBuffer);
 
-  return ctx->vtable->vaCreateBuffer( ctx, context, type, size, num_elements, data, buf_id);
+  return va_status;
 }
 
 VAStatus vaBufferSetNumElements (
@@ -744,12 +876,21 @@ VAStatus vaBufferSetNumElements (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  int ret = 0;
+  VA_LATENCY_START();
+  VA_PROBE(BufferSetNumElements_entry, dpy, buf_id, num_elements);
+  CHECK_DISPLAY_PROBE(dpy, BufferSetNumElements);
   ctx = CTX(dpy);
   
-  VA_FOOL_RETURN();
-  
-  return ctx->vtable->vaBufferSetNumElements( ctx, buf_id, num_elements );
+  VA_FOOL_FUNC(va_FoolBufferSetNumElements, dpy, buf_id, num_elements, &va_status);
+  if (!ret)
+      VA_DRIVER_CALL(va_status, BufferSetNumElements, buf_id, num_elements);
+
+  VA_PROBE(BufferSetNumElements_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, BufferSetNumElements);
+
+  return va_status;
 }
 
 
@@ -762,18 +903,61 @@ VAStatus vaMapBuffer (
   VADriverContextP ctx;
   VAStatus va_status;
   int ret = 0;
+  VA_LATENCY_START();
   
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(MapBuffer_entry, dpy, buf_id);
+  CHECK_DISPLAY_PROBE(dpy, MapBuffer, NULL);
   ctx = CTX(dpy);
 
-  VA_FOOL_FUNC(va_FoolMapBuffer, dpy, buf_id, pbuf);
-  if (ret)
-      return VA_STATUS_SUCCESS;
-  
-  va_status = ctx->vtable->vaMapBuffer( ctx, buf_id, pbuf );
+  VA_FOOL_FUNC(va_FoolMapBuffer, dpy, buf_id, VA_MAPBUFFER_FLAG_DEFAULT, pbuf, &va_status);
+  if (!ret) {
+      VA_DRIVER_CALL(va_status, MapBuffer, buf_id, pbuf);
+
+      VA_TRACE_LOG(va_TraceMapBuffer, dpy, buf_id, pbuf);
+  }
+
+  VA_PROBE(MapBuffer_return, dpy, va_status, va_status == VA_STATUS_SUCCESS ? *pbuf : NULL);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, MapBuffer);
+
+  return va_status;
+}
+
+VAStatus vaMapBuffer2 (
+    VADisplay dpy,
+    VABufferID buf_id,	/* in */
+    unsigned int flags,	/* in */
+    void **pbuf 	/* out */
+)
+{
+  VADriverContextP ctx;
+  VAStatus va_status;
+  int ret = 0;
+  VA_LATENCY_START();
+
+  VA_PROBE(MapBuffer2_entry, dpy, buf_id, flags);
+  CHECK_DISPLAY_PROBE(dpy, MapBuffer2, NULL);
+  ctx = CTX(dpy);
+
+  if (flags & ~(VA_MAPBUFFER_FLAG_READ | VA_MAPBUFFER_FLAG_WRITE | VA_MAPBUFFER_FLAG_WRITE_COMBINE))
+      va_status = VA_STATUS_ERROR_FLAG_NOT_SUPPORTED;
+  else if ((flags & VA_MAPBUFFER_FLAG_READ) && (flags & VA_MAPBUFFER_FLAG_WRITE_COMBINE))
+      va_status = VA_STATUS_ERROR_INVALID_PARAMETER;
+  else {
+      VA_FOOL_FUNC(va_FoolMapBuffer, dpy, buf_id, flags, pbuf, &va_status);
+      if (!ret) {
+          /* the hints are optional for the driver */
+          if (ctx->vtable->vaMapBuffer2)
+              VA_DRIVER_CALL(va_status, MapBuffer2, buf_id, flags, pbuf);
+          else
+              VA_DRIVER_CALL(va_status, MapBuffer, buf_id, pbuf);
+
+          VA_TRACE_LOG(va_TraceMapBuffer, dpy, buf_id, pbuf);
+      }
+  }
+
+  VA_PROBE(MapBuffer2_return, dpy, va_status, va_status == VA_STATUS_SUCCESS ? *pbuf : NULL);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, MapBuffer2);
 
-  VA_TRACE_LOG(va_TraceMapBuffer, dpy, buf_id, pbuf);
-  
   return va_status;
 }
 
@@ -783,15 +967,21 @@ VAStatus vaUnmapBuffer (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(UnmapBuffer_entry, dpy, buf_id);
+  CHECK_DISPLAY_PROBE(dpy, UnmapBuffer);
   ctx = CTX(dpy);
   int ret = 0;
 
-  VA_FOOL_FUNC(va_FoolUnmapBuffer, dpy, buf_id);
-  if (ret)
-      return VA_STATUS_SUCCESS;
+  VA_FOOL_FUNC(va_FoolUnmapBuffer, dpy, buf_id, &va_status);
+  if (!ret)
+      VA_DRIVER_CALL(va_status, UnmapBuffer, buf_id);
 
-  return ctx->vtable->vaUnmapBuffer( ctx, buf_id );
+  VA_PROBE(UnmapBuffer_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, UnmapBuffer);
+
+  return va_status;
 }
 
 VAStatus vaDestroyBuffer (
@@ -800,12 +990,23 @@ VAStatus vaDestroyBuffer (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  int ret = 0;
+  VA_LATENCY_START();
+  VA_PROBE(DestroyBuffer_entry, dpy, buffer_id);
+  CHECK_DISPLAY_PROBE(dpy, DestroyBuffer);
   ctx = CTX(dpy);
 
-  VA_FOOL_RETURN();
-  
-  return ctx->vtable->vaDestroyBuffer( ctx, buffer_id );
+  VA_FOOL_FUNC(va_FoolDestroyBuffer, dpy, buffer_id, &va_status);
+  if (!ret)
+      VA_DRIVER_CALL(va_status, DestroyBuffer, buffer_id);
+
+  VA_TRACE_FUNC(va_TraceDestroyBuffer, dpy, buffer_id);
+
+  VA_PROBE(DestroyBuffer_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, DestroyBuffer);
+
+  return va_status;
 }
 
 VAStatus vaBufferInfo (
@@ -819,15 +1020,21 @@ VAStatus vaBufferInfo (
 {
   VADriverContextP ctx;
   int ret = 0;
+  VAStatus va_status;
+  VA_LATENCY_START();
   
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(BufferInfo_entry, dpy, context, buf_id);
+  CHECK_DISPLAY_PROBE(dpy, BufferInfo);
   ctx = CTX(dpy);
 
-  VA_FOOL_FUNC(va_FoolBufferInfo, dpy, buf_id, type, size, num_elements);
-  if (ret)
-      return VA_STATUS_SUCCESS;
-  
-  return ctx->vtable->vaBufferInfo( ctx, buf_id, type, size, num_elements );
+  VA_FOOL_FUNC(va_FoolBufferInfo, dpy, buf_id, type, size, num_elements, &va_status);
+  if (!ret)
+      VA_DRIVER_CALL(va_status, BufferInfo, buf_id, type, size, num_elements);
+
+  VA_PROBE(BufferInfo_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, context, BufferInfo);
+
+  return va_status;
 }
 
 VAStatus vaBeginPicture (
@@ -838,15 +1045,23 @@ VAStatus vaBeginPicture (
 {
   VADriverContextP ctx;
   VAStatus va_status;
+  int ret = 0;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(BeginPicture_entry, dpy, context, render_target);
+  CHECK_DISPLAY_PROBE(dpy, BeginPicture);
   ctx = CTX(dpy);
 
   VA_TRACE_FUNC(va_TraceBeginPicture, dpy, context, render_target);
-  VA_FOOL_RETURN();
-  
-  va_status = ctx->vtable->vaBeginPicture( ctx, context, render_target );
-  
+  VA_FOOL_FUNC(va_FoolBeginPicture, dpy, context, render_target);
+  if (ret)
+      va_status = VA_STATUS_SUCCESS;
+  else
+      VA_DRIVER_CALL(va_status, BeginPicture, context, render_target);
+
+  VA_PROBE(BeginPicture_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, context, BeginPicture);
+
   return va_status;
 }
 
@@ -858,14 +1073,23 @@ VAStatus vaRenderPicture (
 )
 {
   VADriverContextP ctx;
+  VAStatus va_status;
+  int ret = 0;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(RenderPicture_entry, dpy, context, buffers, num_buffers);
+  CHECK_DISPLAY_PROBE(dpy, RenderPicture);
   ctx = CTX(dpy);
 
   VA_TRACE_LOG(va_TraceRenderPicture, dpy, context, buffers, num_buffers);
-  VA_FOOL_RETURN();
+  VA_FOOL_FUNC(va_FoolRenderPicture, dpy, context, buffers, num_buffers, &va_status);
+  if (!ret)
+      VA_DRIVER_CALL(va_status, RenderPicture, context, buffers, num_buffers);
 
-  return ctx->vtable->vaRenderPicture( ctx, context, buffers, num_buffers );
+  VA_PROBE(RenderPicture_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, context, RenderPicture);
+
+  return va_status;
 }
 
 VAStatus vaEndPicture (
@@ -875,18 +1099,95 @@ VAStatus vaEndPicture (
 {
   VAStatus va_status;
   VADriverContextP ctx;
+  int ret = 0;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(EndPicture_entry, dpy, context);
+  CHECK_DISPLAY_PROBE(dpy, EndPicture);
   ctx = CTX(dpy);
 
   /* dump encode source surface */
-  VA_TRACE_SURFACE(va_TraceEndPicture, dpy, context, 0);
-  /* return directly if do dummy operation */
-  VA_FOOL_RETURN();
-  
-  va_status = ctx->vtable->vaEndPicture( ctx, context );
-  /* dump decode dest surface */
-  VA_TRACE_SURFACE(va_TraceEndPicture, dpy, context, 1);
+  VA_TRACE_FUNC(va_TraceEndPicture, dpy, context, 0);
+  /* skip the driver if do dummy operation */
+  VA_FOOL_FUNC(va_FoolEndPicture, dpy, context);
+  if (ret)
+      va_status = VA_STATUS_SUCCESS;
+  else {
+      VA_DRIVER_CALL(va_status, EndPicture, context);
+      /* dump decode dest surface */
+      VA_TRACE_FUNC(va_TraceEndPicture, dpy, context, 1);
+  }
+
+  VA_PROBE(EndPicture_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, context, EndPicture);
+
+  return va_status;
+}
+
+/* one picture of vaSubmitPictures, through the entry-points when hooked */
+static VAStatus va_submitPicture (
+    VADisplay dpy,
+    VAPictureJob *job,
+    int hooked
+)
+{
+  VADriverContextP ctx = CTX(dpy);
+  VAStatus va_status, end_status;
+
+  if (hooked)
+      va_status = vaBeginPicture(dpy, job->context, job->render_target);
+  else
+      VA_DRIVER_CALL(va_status, BeginPicture, job->context, job->render_target);
+  if (va_status != VA_STATUS_SUCCESS)
+      return va_status;
+
+  if (hooked)
+      va_status = vaRenderPicture(dpy, job->context, job->buffers, job->num_buffers);
+  else
+      VA_DRIVER_CALL(va_status, RenderPicture, job->context, job->buffers, job->num_buffers);
+
+  /* end the picture anyway, the context can't be left in between */
+  if (hooked)
+      end_status = vaEndPicture(dpy, job->context);
+  else
+      VA_DRIVER_CALL(end_status, EndPicture, job->context);
+
+  return (va_status != VA_STATUS_SUCCESS) ? va_status : end_status;
+}
+
+VAStatus vaSubmitPictures (
+    VADisplay dpy,
+    VAPictureJob *jobs,
+    int num_jobs
+)
+{
+  VAStatus va_status = VA_STATUS_SUCCESS;
+  VADriverContextP ctx;
+  int hooked;
+  int i;
+  VA_LATENCY_START();
+
+  VA_PROBE(SubmitPictures_entry, dpy, jobs, num_jobs);
+  CHECK_DISPLAY_PROBE(dpy, SubmitPictures);
+  ctx = CTX(dpy);
+
+  /* the trace and fool hooks work picture by picture */
+  hooked = va_atomic_load(&trace_flag) || va_atomic_load(&fool_codec);
+
+  if (num_jobs < 0 || (num_jobs > 0 && jobs == NULL))
+      va_status = VA_STATUS_ERROR_INVALID_PARAMETER;
+  else if (ctx->vtable->vaSubmitPictures && !hooked)
+      VA_DRIVER_CALL(va_status, SubmitPictures, jobs, num_jobs);
+  else {
+      for (i = 0; i < num_jobs; i++) {
+          jobs[i].status = va_submitPicture(dpy, &jobs[i], hooked);
+          if (jobs[i].status != VA_STATUS_SUCCESS && va_status == VA_STATUS_SUCCESS)
+              va_status = jobs[i].status;
+      }
+  }
+
+  VA_PROBE(SubmitPictures_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, SubmitPictures);
 
   return va_status;
 }
@@ -898,12 +1199,20 @@ VAStatus vaSyncSurface (
 {
   VAStatus va_status;
   VADriverContextP ctx;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(SyncSurface_entry, dpy, render_target);
+  CHECK_DISPLAY_PROBE(dpy, SyncSurface);
   ctx = CTX(dpy);
 
-  va_status = ctx->vtable->vaSyncSurface( ctx, render_target );
-  VA_TRACE_LOG(va_TraceSyncSurface, dpy, render_target);
+  /* wait for the end of the fool decode, then the driver */
+  VA_FOOL_HOOK(va_FoolSyncSurface, dpy, render_target);
+
+  VA_DRIVER_CALL(va_status, SyncSurface, render_target);
+  VA_TRACE_FUNC(va_TraceSyncSurface, dpy, render_target);
+
+  VA_PROBE(SyncSurface_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, SyncSurface);
 
   return va_status;
 }
@@ -916,12 +1225,23 @@ VAStatus vaQuerySurfaceStatus (
 {
   VAStatus va_status;
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  int ret = 0;
+  VA_LATENCY_START();
+  VA_PROBE(QuerySurfaceStatus_entry, dpy, render_target);
+  CHECK_DISPLAY_PROBE(dpy, QuerySurfaceStatus, 0);
   ctx = CTX(dpy);
 
-  va_status = ctx->vtable->vaQuerySurfaceStatus( ctx, render_target, status );
+  VA_FOOL_FUNC(va_FoolQuerySurfaceStatus, dpy, render_target, status);
+  if (ret)
+      va_status = VA_STATUS_SUCCESS;
+  else {
+      VA_DRIVER_CALL(va_status, QuerySurfaceStatus, render_target, status);
+
+      VA_TRACE_LOG(va_TraceQuerySurfaceStatus, dpy, render_target, status);
+  }
 
-  VA_TRACE_LOG(va_TraceQuerySurfaceStatus, dpy, render_target, status);
+  VA_PROBE(QuerySurfaceStatus_return, dpy, va_status, va_status == VA_STATUS_SUCCESS ? *status : 0);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QuerySurfaceStatus);
 
   return va_status;
 }
@@ -935,13 +1255,18 @@ VAStatus vaQuerySurfaceError (
 {
   VAStatus va_status;
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VA_LATENCY_START();
+  VA_PROBE(QuerySurfaceError_entry, dpy, surface, error_status);
+  CHECK_DISPLAY_PROBE(dpy, QuerySurfaceError);
   ctx = CTX(dpy);
 
-  va_status = ctx->vtable->vaQuerySurfaceError( ctx, surface, error_status, error_info );
+  VA_DRIVER_CALL(va_status, QuerySurfaceError, surface, error_status, error_info);
 
   VA_TRACE_LOG(va_TraceQuerySurfaceError, dpy, surface, error_status, error_info);
 
+  VA_PROBE(QuerySurfaceError_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QuerySurfaceError);
+
   return va_status;
 }
 
@@ -963,10 +1288,18 @@ VAStatus vaQueryImageFormats (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(QueryImageFormats_entry, dpy);
+  CHECK_DISPLAY_PROBE(dpy, QueryImageFormats);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaQueryImageFormats ( ctx, format_list, num_formats);
+  VA_DRIVER_CALL(va_status, QueryImageFormats, format_list, num_formats);
+
+  VA_PROBE(QueryImageFormats_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QueryImageFormats);
+
+  return va_status;
 }
 
 /* 
@@ -986,10 +1319,18 @@ VAStatus vaCreateImage (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(CreateImage_entry, dpy, format, width, height);
+  CHECK_DISPLAY_PROBE(dpy, CreateImage, VA_INVALID_ID);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaCreateImage ( ctx, format, width, height, image);
+  VA_DRIVER_CALL(va_status, CreateImage, format, width, height, image);
+
+  VA_PROBE(CreateImage_return, dpy, va_status, VA_PROBE_ID(va_status, image->image_id));
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, CreateImage);
+
+  return va_status;
 }
 
 /*
@@ -1001,10 +1342,18 @@ VAStatus vaDestroyImage (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(DestroyImage_entry, dpy, image);
+  CHECK_DISPLAY_PROBE(dpy, DestroyImage);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaDestroyImage ( ctx, image);
+  VA_DRIVER_CALL(va_status, DestroyImage, image);
+
+  VA_PROBE(DestroyImage_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, DestroyImage);
+
+  return va_status;
 }
 
 VAStatus vaSetImagePalette (
@@ -1014,10 +1363,18 @@ VAStatus vaSetImagePalette (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(SetImagePalette_entry, dpy, image);
+  CHECK_DISPLAY_PROBE(dpy, SetImagePalette);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaSetImagePalette ( ctx, image, palette);
+  VA_DRIVER_CALL(va_status, SetImagePalette, image, palette);
+
+  VA_PROBE(SetImagePalette_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, SetImagePalette);
+
+  return va_status;
 }
 
 /*
@@ -1035,10 +1392,18 @@ VAStatus vaGetImage (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(GetImage_entry, dpy, surface, x, y, width, height, image);
+  CHECK_DISPLAY_PROBE(dpy, GetImage);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaGetImage ( ctx, surface, x, y, width, height, image);
+  VA_DRIVER_CALL(va_status, GetImage, surface, x, y, width, height, image);
+
+  VA_PROBE(GetImage_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, GetImage);
+
+  return va_status;
 }
 
 /*
@@ -1060,10 +1425,18 @@ VAStatus vaPutImage (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(PutImage_entry, dpy, surface, image, src_x, src_y, dest_x, dest_y);
+  CHECK_DISPLAY_PROBE(dpy, PutImage);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaPutImage ( ctx, surface, image, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height );
+  VA_DRIVER_CALL(va_status, PutImage, surface, image, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height);
+
+  VA_PROBE(PutImage_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, PutImage);
+
+  return va_status;
 }
 
 /*
@@ -1104,10 +1477,18 @@ VAStatus vaDeriveImage (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(DeriveImage_entry, dpy, surface);
+  CHECK_DISPLAY_PROBE(dpy, DeriveImage, VA_INVALID_ID);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaDeriveImage ( ctx, surface, image );
+  VA_DRIVER_CALL(va_status, DeriveImage, surface, image);
+
+  VA_PROBE(DeriveImage_return, dpy, va_status, VA_PROBE_ID(va_status, image->image_id));
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, DeriveImage);
+
+  return va_status;
 }
 
 
@@ -1137,11 +1518,19 @@ VAStatus vaQuerySubpictureFormats (
 )
 {
   VADriverContextP ctx;
+  VAStatus va_status;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(QuerySubpictureFormats_entry, dpy);
+  CHECK_DISPLAY_PROBE(dpy, QuerySubpictureFormats);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaQuerySubpictureFormats ( ctx, format_list, flags, num_formats);
+  VA_DRIVER_CALL(va_status, QuerySubpictureFormats, format_list, flags, num_formats);
+
+  VA_PROBE(QuerySubpictureFormats_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QuerySubpictureFormats);
+
+  return va_status;
 }
 
 /* 
@@ -1154,10 +1543,18 @@ VAStatus vaCreateSubpicture (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(CreateSubpicture_entry, dpy, image);
+  CHECK_DISPLAY_PROBE(dpy, CreateSubpicture, VA_INVALID_ID);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaCreateSubpicture ( ctx, image, subpicture );
+  VA_DRIVER_CALL(va_status, CreateSubpicture, image, subpicture);
+
+  VA_PROBE(CreateSubpicture_return, dpy, va_status, VA_PROBE_ID(va_status, *subpicture));
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, CreateSubpicture);
+
+  return va_status;
 }
 
 /*
@@ -1169,10 +1566,18 @@ VAStatus vaDestroySubpicture (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(DestroySubpicture_entry, dpy, subpicture);
+  CHECK_DISPLAY_PROBE(dpy, DestroySubpicture);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaDestroySubpicture ( ctx, subpicture);
+  VA_DRIVER_CALL(va_status, DestroySubpicture, subpicture);
+
+  VA_PROBE(DestroySubpicture_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, DestroySubpicture);
+
+  return va_status;
 }
 
 VAStatus vaSetSubpictureImage (
@@ -1182,10 +1587,18 @@ VAStatus vaSetSubpictureImage (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(SetSubpictureImage_entry, dpy, subpicture, image);
+  CHECK_DISPLAY_PROBE(dpy, SetSubpictureImage);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaSetSubpictureImage ( ctx, subpicture, image);
+  VA_DRIVER_CALL(va_status, SetSubpictureImage, subpicture, image);
+
+  VA_PROBE(SetSubpictureImage_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, SetSubpictureImage);
+
+  return va_status;
 }
 
 
@@ -1202,10 +1615,18 @@ VAStatus vaSetSubpictureChromakey (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(SetSubpictureChromakey_entry, dpy, subpicture);
+  CHECK_DISPLAY_PROBE(dpy, SetSubpictureChromakey);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaSetSubpictureChromakey ( ctx, subpicture, chromakey_min, chromakey_max, chromakey_mask );
+  VA_DRIVER_CALL(va_status, SetSubpictureChromakey, subpicture, chromakey_min, chromakey_max, chromakey_mask);
+
+  VA_PROBE(SetSubpictureChromakey_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, SetSubpictureChromakey);
+
+  return va_status;
 }
 
 
@@ -1221,10 +1642,18 @@ VAStatus vaSetSubpictureGlobalAlpha (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(SetSubpictureGlobalAlpha_entry, dpy, subpicture);
+  CHECK_DISPLAY_PROBE(dpy, SetSubpictureGlobalAlpha);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaSetSubpictureGlobalAlpha ( ctx, subpicture, global_alpha );
+  VA_DRIVER_CALL(va_status, SetSubpictureGlobalAlpha, subpicture, global_alpha);
+
+  VA_PROBE(SetSubpictureGlobalAlpha_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, SetSubpictureGlobalAlpha);
+
+  return va_status;
 }
 
 /*
@@ -1255,10 +1684,18 @@ VAStatus vaAssociateSubpicture (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(AssociateSubpicture_entry, dpy, subpicture, target_surfaces, num_surfaces, flags);
+  CHECK_DISPLAY_PROBE(dpy, AssociateSubpicture);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaAssociateSubpicture ( ctx, subpicture, target_surfaces, num_surfaces, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height, flags );
+  VA_DRIVER_CALL(va_status, AssociateSubpicture, subpicture, target_surfaces, num_surfaces, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height, flags);
+
+  VA_PROBE(AssociateSubpicture_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, AssociateSubpicture);
+
+  return va_status;
 }
 
 /*
@@ -1272,10 +1709,18 @@ VAStatus vaDeassociateSubpicture (
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(DeassociateSubpicture_entry, dpy, subpicture, target_surfaces, num_surfaces);
+  CHECK_DISPLAY_PROBE(dpy, DeassociateSubpicture);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaDeassociateSubpicture ( ctx, subpicture, target_surfaces, num_surfaces );
+  VA_DRIVER_CALL(va_status, DeassociateSubpicture, subpicture, target_surfaces, num_surfaces);
+
+  VA_PROBE(DeassociateSubpicture_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, DeassociateSubpicture);
+
+  return va_status;
 }
 
 
@@ -1310,15 +1755,19 @@ VAStatus vaQueryDisplayAttributes (
 {
   VADriverContextP ctx;
   VAStatus va_status;
+  VA_LATENCY_START();
   
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(QueryDisplayAttributes_entry, dpy);
+  CHECK_DISPLAY_PROBE(dpy, QueryDisplayAttributes);
   ctx = CTX(dpy);
-  va_status = ctx->vtable->vaQueryDisplayAttributes ( ctx, attr_list, num_attributes );
+  VA_DRIVER_CALL(va_status, QueryDisplayAttributes, attr_list, num_attributes);
 
   VA_TRACE_LOG(va_TraceQueryDisplayAttributes, dpy, attr_list, num_attributes);
 
+  VA_PROBE(QueryDisplayAttributes_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, QueryDisplayAttributes);
+
   return va_status;
-  
 }
 
 /* 
@@ -1335,13 +1784,18 @@ VAStatus vaGetDisplayAttributes (
 {
   VADriverContextP ctx;
   VAStatus va_status;
+  VA_LATENCY_START();
 
-  CHECK_DISPLAY(dpy);
+  VA_PROBE(GetDisplayAttributes_entry, dpy, num_attributes);
+  CHECK_DISPLAY_PROBE(dpy, GetDisplayAttributes);
   ctx = CTX(dpy);
-  va_status = ctx->vtable->vaGetDisplayAttributes ( ctx, attr_list, num_attributes );
+  VA_DRIVER_CALL(va_status, GetDisplayAttributes, attr_list, num_attributes);
 
   VA_TRACE_LOG(va_TraceGetDisplayAttributes, dpy, attr_list, num_attributes);
-  
+
+  VA_PROBE(GetDisplayAttributes_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, GetDisplayAttributes);
+
   return va_status;
 }
 
@@ -1359,12 +1813,17 @@ VAStatus vaSetDisplayAttributes (
 {
   VADriverContextP ctx;
   VAStatus va_status;
-  CHECK_DISPLAY(dpy);
+  VA_LATENCY_START();
+  VA_PROBE(SetDisplayAttributes_entry, dpy, num_attributes);
+  CHECK_DISPLAY_PROBE(dpy, SetDisplayAttributes);
   ctx = CTX(dpy);
 
-  va_status = ctx->vtable->vaSetDisplayAttributes ( ctx, attr_list, num_attributes );
+  VA_DRIVER_CALL(va_status, SetDisplayAttributes, attr_list, num_attributes);
   VA_TRACE_LOG(va_TraceSetDisplayAttributes, dpy, attr_list, num_attributes);
-  
+
+  VA_PROBE(SetDisplayAttributes_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, SetDisplayAttributes);
+
   return va_status;
 }
 
@@ -1382,10 +1841,18 @@ VAStatus vaLockSurface(VADisplay dpy,
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(LockSurface_entry, dpy, surface);
+  CHECK_DISPLAY_PROBE(dpy, LockSurface);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaLockSurface( ctx, surface, fourcc, luma_stride, chroma_u_stride, chroma_v_stride, luma_offset, chroma_u_offset, chroma_v_offset, buffer_name, buffer);
+  VA_DRIVER_CALL(va_status, LockSurface, surface, fourcc, luma_stride, chroma_u_stride, chroma_v_stride, luma_offset, chroma_u_offset, chroma_v_offset, buffer_name, buffer);
+
+  VA_PROBE(LockSurface_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, LockSurface);
+
+  return va_status;
 }
 
 
@@ -1394,8 +1861,34 @@ VAStatus vaUnlockSurface(VADisplay dpy,
 )
 {
   VADriverContextP ctx;
-  CHECK_DISPLAY(dpy);
+  VAStatus va_status;
+  VA_LATENCY_START();
+  VA_PROBE(UnlockSurface_entry, dpy, surface);
+  CHECK_DISPLAY_PROBE(dpy, UnlockSurface);
   ctx = CTX(dpy);
 
-  return ctx->vtable->vaUnlockSurface( ctx, surface );
+  VA_DRIVER_CALL(va_status, UnlockSurface, surface);
+
+  VA_PROBE(UnlockSurface_return, dpy, va_status);
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, UnlockSurface);
+
+  return va_status;
+}
+
+VAStatus vaQueryLatencyStats (
+    VADisplay dpy,
+    VAContextID context,
+    VALatencyStats *stats_list,	/* out */
+    int *num_stats		/* in/out */
+)
+{
+  VAStatus va_status;
+
+  VA_PROBE(QueryLatencyStats_entry, dpy, context);
+  CHECK_DISPLAY_PROBE(dpy, QueryLatencyStats);
+
+  va_status = va_LatencyQuery(dpy, context, stats_list, num_stats);
+
+  VA_PROBE(QueryLatencyStats_return, dpy, va_status);
+  return va_status;
 }
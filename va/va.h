@@ -61,6 +61,7 @@
  *                                        screen relative rather than source video relative.
  * rev 0.32.0 (01/13/2011 Xiang Haihao) - Add profile into VAPictureParameterBufferVC1
  *                                        update VAAPI to 0.32.0
+ * rev 0.34.0                           - Add vaMapBuffer2 and vaSubmitPictures
  *
  * Acknowledgements:
  *  Some concepts borrowed from XvMC and XvImage.
@@ -103,6 +104,19 @@ Initialization & Configuration Management
 - Find out configuration attributes for a given profile/entrypoint pair
 - Create a configuration for use by the decoder
 
+Threading Model
+
+- Different VADisplays are independent: they can be initialized, used and
+  terminated from different threads at the same time
+- All the other functions may be called concurrently on the same VADisplay,
+  e.g. one thread per context, as long as vaInitialize() returned before and
+  vaTerminate() is called after all of them completed
+- The library state kept for LIBVA_TRACE, LIBVA_FOOL and LIBVA_PROFILE is per
+  VADisplay and locked as needed; the driver is responsible for the locking of
+  its own objects (contexts, surfaces, buffers)
+- Objects are not reference counted: destroying a context, surface or buffer
+  while another thread still uses it is undefined
+
 */
 
 typedef void* VADisplay;	/* window system dependent */
@@ -1370,6 +1384,30 @@ VAStatus vaMapBuffer (
     void **pbuf 	/* out */
 );
 
+/* access flags for vaMapBuffer2 */
+#define VA_MAPBUFFER_FLAG_DEFAULT	0x0000	/* read and write, same as vaMapBuffer */
+#define VA_MAPBUFFER_FLAG_READ		0x0001	/* the client reads the data store */
+#define VA_MAPBUFFER_FLAG_WRITE		0x0002	/* the client writes the data store */
+#define VA_MAPBUFFER_FLAG_WRITE_COMBINE	0x0004	/* usage hint: the data store is only
+						 * written, sequentially, so it can be
+						 * mapped write-combined. Can't be used
+						 * with VA_MAPBUFFER_FLAG_READ */
+
+/*
+ * Same as vaMapBuffer, with hints about how the client will access the
+ * data store. A driver doesn't need to copy back (or invalidate caches
+ * for) a buffer which is mapped write-only, and doesn't need to flush a
+ * buffer which is mapped read-only, e.g. a coded buffer being read back.
+ * Reading a write-only mapping, or writing a read-only one, is undefined.
+ * Since VA-API 0.34.
+ */
+VAStatus vaMapBuffer2 (
+    VADisplay dpy,
+    VABufferID buf_id,	/* in */
+    unsigned int flags,	/* in */
+    void **pbuf 	/* out */
+);
+
 /*
  * After client making changes to a mapped data store, it needs to
  * "Unmap" it to let the server know that the data is ready to be
@@ -1428,6 +1466,36 @@ VAStatus vaEndPicture (
     VAContextID context
 );
 
+/*
+ * One picture of a batch for vaSubmitPictures(), the equivalent of
+ * vaBeginPicture(context, render_target), vaRenderPicture(context,
+ * buffers, num_buffers) and vaEndPicture(context)
+ */
+typedef struct _VAPictureJob
+{
+    VAContextID context;
+    VASurfaceID render_target;
+    VABufferID *buffers;
+    int num_buffers;
+    VAStatus status;		/* out: the result of this picture */
+} VAPictureJob;
+
+/*
+ * Submit several pictures at once, possibly for different contexts,
+ * e.g. to decode many small streams. The pictures are submitted in the
+ * order of the array, a failing picture doesn't stop the following ones.
+ * As with vaRenderPicture, the buffers are destroyed afterwards.
+ * Returns VA_STATUS_SUCCESS if all the pictures were submitted, the status
+ * of the first failing picture otherwise; the status of each picture is
+ * in jobs[i].status.
+ * Since VA-API 0.34.
+ */
+VAStatus vaSubmitPictures (
+    VADisplay dpy,
+    VAPictureJob *jobs,
+    int num_jobs
+);
+
 /*
 
 Synchronization 
@@ -1496,6 +1564,76 @@ VAStatus vaQuerySurfaceError(
     void **error_info
 );
 
+/*
+ * Surface pools:
+ * A pool recycles surfaces of the same size and format. Surfaces are
+ * acquired, used as render targets (or uploaded and displayed), and
+ * released as soon as the work on them is submitted; acquire only hands
+ * them out again once the driver reports them idle.
+ * The pool starts with "min_surfaces" surfaces and grows up to
+ * "max_surfaces" when all of them are busy. When decoding, create the pool
+ * with min_surfaces == max_surfaces and pass the surfaces returned by
+ * vaQuerySurfacePool to vaCreateContext.
+ * All functions are thread-safe.
+ */
+typedef struct _VASurfacePool *VASurfacePool;
+
+/* flags for vaAcquireSurfaceFromPool */
+#define VA_SURFACE_POOL_NO_WAIT		0x0001	/* return VA_STATUS_ERROR_SURFACE_BUSY
+						 * instead of waiting for a surface */
+
+VAStatus vaCreateSurfacePool (
+    VADisplay dpy,
+    int width,
+    int height,
+    int format,
+    int min_surfaces,
+    int max_surfaces,
+    VASurfacePool *pool		/* out */
+);
+
+/*
+ * Destroys all the surfaces of the pool, the acquired ones too
+ */
+VAStatus vaDestroySurfacePool (
+    VADisplay dpy,
+    VASurfacePool pool
+);
+
+/*
+ * Returns the surfaces created so far. "surfaces" can be NULL to only get
+ * their number, otherwise it must hold "max_surfaces" entries.
+ */
+VAStatus vaQuerySurfacePool (
+    VADisplay dpy,
+    VASurfacePool pool,
+    VASurfaceID *surfaces,	/* out */
+    int *num_surfaces		/* out */
+);
+
+/*
+ * Get an idle surface, released surfaces are reused oldest first.
+ * Without VA_SURFACE_POOL_NO_WAIT, the call waits for a surface to be
+ * released if all of them are acquired, and for the driver to complete the
+ * pending work on it.
+ */
+VAStatus vaAcquireSurfaceFromPool (
+    VADisplay dpy,
+    VASurfacePool pool,
+    unsigned int flags,
+    VASurfaceID *surface	/* out */
+);
+
+/*
+ * Give back an acquired surface. Pending work on it doesn't need to be
+ * complete.
+ */
+VAStatus vaReleaseSurfaceToPool (
+    VADisplay dpy,
+    VASurfacePool pool,
+    VASurfaceID surface
+);
+
 /*
  * Images and Subpictures
  * VAImage is used to either get the surface data to client memory, or 
@@ -2008,6 +2146,37 @@ VAStatus vaSetDisplayAttributes (
     int num_attributes
 );
 
+/*
+ * Latency statistics of one entry-point, collected when LIBVA_PROFILE
+ * is set. All times are in nanoseconds, percentiles come from a log-linear
+ * histogram and are accurate to about 6%.
+ */
+typedef struct _VALatencyStats
+{
+    const char *function;	/* name of the entry-point, e.g. "vaEndPicture" */
+    unsigned long long count;	/* number of calls */
+    unsigned long long total_ns;
+    unsigned long long min_ns;
+    unsigned long long max_ns;
+    unsigned long long p50_ns;
+    unsigned long long p90_ns;
+    unsigned long long p99_ns;
+} VALatencyStats;
+
+/*
+ * Query the latency statistics of the display (context == VA_INVALID_ID)
+ * or of one context. On input "num_stats" is the number of entries
+ * "stats_list" can hold, on output the number of entry-points returned;
+ * entry-points which were never called are skipped.
+ * Returns VA_STATUS_ERROR_UNIMPLEMENTED if LIBVA_PROFILE is not set.
+ */
+VAStatus vaQueryLatencyStats (
+    VADisplay dpy,
+    VAContextID context,
+    VALatencyStats *stats_list,	/* out */
+    int *num_stats		/* in/out */
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -391,6 +391,29 @@ struct VADriverVTable
 		VADriverContextP ctx,
                 VASurfaceID surface
         );
+
+        /*
+         * 0.34+ only, a 0.33 driver leaves the members below NULL
+         */
+
+        /* optional, vaMapBuffer is used instead if it is NULL */
+        VAStatus (*vaMapBuffer2) (
+		VADriverContextP ctx,
+		VABufferID buf_id,	/* in */
+		unsigned int flags,	/* in: VA_MAPBUFFER_FLAG_xxx */
+		void **pbuf		/* out */
+        );
+
+        /*
+         * 0.34, as vaMapBuffer2. Optional, libva loops over
+         * vaBeginPicture/vaRenderPicture/vaEndPicture if it is NULL.
+         * Must fill jobs[i].status.
+         */
+        VAStatus (*vaSubmitPictures) (
+		VADriverContextP ctx,
+		VAPictureJob *jobs,	/* in/out */
+		int num_jobs
+        );
 };
 
 struct VADriverContext
@@ -498,6 +521,10 @@ struct VADisplayContext
     );
 
     void *opaque; /* opaque for display extensions (e.g. GLX) */
+
+    void *valatency; /* opaque for LIBVA_PROFILE statistics */
+    void *vatrace; /* opaque for LIBVA_TRACE state */
+    void *vafool; /* opaque for LIBVA_FOOL state */
 };
 
 typedef VAStatus (*VADriverInit) (
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "va_crc.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VA_CRC_SSE42 1
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#define VA_CRC_ARM 1
+#include <arm_acle.h>
+#endif
+
+#define VA_CRC32C_POLY          0x82f63b78 /* reflected */
+
+/* slicing-by-8 tables, for the CPUs without a crc32 instruction */
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static uint32_t (*crc_update)(uint32_t crc, const unsigned char *p, size_t size);
+
+static void va_CrcInitTables(void)
+{
+    uint32_t crc;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ ((crc & 1) ? VA_CRC32C_POLY : 0);
+        crc_table[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        crc = crc_table[0][i];
+        for (j = 1; j < 8; j++) {
+            crc = crc_table[0][crc & 0xff] ^ (crc >> 8);
+            crc_table[j][i] = crc;
+        }
+    }
+}
+
+static uint32_t va_CrcUpdateTable(uint32_t crc, const unsigned char *p, size_t size)
+{
+    uint32_t lo, hi;
+
+    while (size && ((uintptr_t)p & 7)) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        size--;
+    }
+
+    /* little endian loads, as the table is reflected */
+    while (size >= 8) {
+        lo = (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24)) ^ crc;
+        hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+        crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+            crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+            crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+            crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+#if VA_CRC_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t va_CrcUpdateSSE42(uint32_t crc, const unsigned char *p, size_t size)
+{
+    while (size && ((uintptr_t)p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        size--;
+    }
+
+#ifdef __x86_64__
+    {
+        uint64_t crc64 = crc, v;
+
+        while (size >= 8) {
+            memcpy(&v, p, 8);
+            crc64 = _mm_crc32_u64(crc64, v);
+            p += 8;
+            size -= 8;
+        }
+        crc = (uint32_t)crc64;
+    }
+#endif
+    while (size >= 4) {
+        uint32_t v;
+
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+        p += 4;
+        size -= 4;
+    }
+
+    while (size--)
+        crc = _mm_crc32_u8(crc, *p++);
+
+    return crc;
+}
+#endif
+
+#if VA_CRC_ARM
+static uint32_t va_CrcUpdateARM(uint32_t crc, const unsigned char *p, size_t size)
+{
+    uint64_t v;
+
+    while (size && ((uintptr_t)p & 7)) {
+        crc = __crc32cb(crc, *p++);
+        size--;
+    }
+
+    while (size >= 8) {
+        memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = __crc32cb(crc, *p++);
+
+    return crc;
+}
+#endif
+
+static void va_CrcInit(void)
+{
+#if VA_CRC_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_update = va_CrcUpdateSSE42;
+        return;
+    }
+#elif VA_CRC_ARM
+    crc_update = va_CrcUpdateARM;
+    return;
+#endif
+    va_CrcInitTables();
+    crc_update = va_CrcUpdateTable;
+}
+
+uint32_t va_Crc32c(uint32_t crc, const void *data, size_t size)
+{
+    pthread_once(&crc_once, va_CrcInit);
+
+    return ~crc_update(~crc, data, size);
+}
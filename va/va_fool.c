@@ -23,13 +23,18 @@
  */
 
 #define _GNU_SOURCE 1
+#include "sysdeps.h"
 #include "va.h"
 #include "va_backend.h"
 #include "va_trace.h"
 #include "va_fool.h"
+#include "va_hash.h"
+#include "va_latency.h"
 
 #include <assert.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,9 +42,11 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <time.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 /*
  * Do dummy decode/encode, ignore the input data
@@ -48,56 +55,160 @@
  *
  * LIBVA_FOOL_DECODE:
  * . if set, decode does nothing
+ * LIBVA_FOOL_DECODE_PATTERN:
+ * . if set with LIBVA_FOOL_DECODE, vaEndPicture fills the render target with a checkerboard
+ *   moving with the frames, the frame number is in the 32 cells of the first 8 rows
+ * LIBVA_FOOL_DECODE_DELAY=<microseconds>:
+ * . if set with LIBVA_FOOL_DECODE, the decode of a 1920x1080 frame takes that long, the other
+ *   sizes in proportion to their area, the frames of a context one after the other.
+ *   vaSyncSurface waits for it and vaQuerySurfaceStatus reports VASurfaceRendering until then
  * LIBVA_FOOL_ENCODE=<framename>:
  * . if set, encode does nothing, but fill in the coded buffer from the content of files with
  *   name framename.0,framename.1,framename.2, ..., framename.N, framename.N,framename.N,...
+ * . if framename itself is a file, it is one stream split into the frames instead,
+ *   an IVF file on its frame headers, otherwise H.264 Annex-B on the access units
+ * . the files are mapped once, the coded buffer points into the mapping
  * LIBVA_FOOL_JPEG=<framename>:fill the content of filename to codedbuf for jpeg encoding
+ * LIBVA_FOOL_BUFFER_LIMIT=<bytes>:
+ * . vaCreateBuffer of the fooled contexts fails with VA_STATUS_ERROR_ALLOCATION_FAILED when the
+ *   fool buffers would hold more than that
  * LIBVA_FOOL_POSTP:
  * . if set, do nothing for vaPutSurface
  */
 
 
-/* global settings */
+/* global settings, the union of the settings of all the displays */
 int fool_codec = 0;
 int fool_postp  = 0;
 
-#define FOOL_CONTEXT_MAX 4
+/* bufferID = magic | slot in fool_context.buffers */
+#define FOOL_BUFID_MAGIC   0x12300000
+#define FOOL_BUFID_MASK    0xfff00000
+#define FOOL_BUFID_SLOTS   0x100000
 
-#define FOOL_BUFID_MAGIC   0x12345600
-#define FOOL_BUFID_MASK    0xffffff00
-/* per context settings */
-static struct _fool_context {
-    VADisplay dpy; /* should use context as the key */
+/* a fool buffer, data is NULL when the slot is free */
+struct fool_buffer {
+    char *data;
+    unsigned int size;
+    unsigned int num_elements;
+    unsigned int max_num_elements; /* of vaCreateBuffer */
+    VABufferType type;
+    VAEntrypoint entrypoint; /* of the creating context, the coded buffer is filled according to it */
+    int size_class; /* of the arena */
+    int next_free;
+};
+
+/*
+ * the buffer memory comes from power of two size classes, 64 bytes up
+ * to 2G, a destroyed buffer goes back to the free list of its class
+ * and stays there until vaTerminate
+ */
+#define FOOL_ARENA_MIN_SHIFT 6
+#define FOOL_ARENA_CLASSES   26
+
+struct fool_arena {
+    void *free_list[FOOL_ARENA_CLASSES]; /* the first pointer of a block links the next one */
+    size_t allocated; /* malloc-ed bytes, in use or in the free lists */
+};
+
+/* a coded frame, in one of the mappings */
+struct fool_frame {
+    unsigned char *buf;
+    unsigned int size;
+};
+
+/* mapped coded frames, handed out in order, the last one repeats */
+struct fool_frames {
+    void **map; /* mmap-ed files */
+    size_t *map_size;
+    int map_count;
+
+    struct fool_frame *frame;
+    int frame_count;
+    int frame_next; /* the frame of the next fill */
+};
+/* per display settings */
+struct fool_context {
+    /*
+     * vaMapBuffer/vaBufferInfo only look the buffers up, take it for
+     * read; config/buffer creation and the coded buffer refill for write
+     */
+    pthread_rwlock_t lock;
+
+    int fool_codec; /* VA_FOOL_FLAG_xxx */
 
     char *fn_enc;/* file pattern with codedbuf content for encode */
-    char *segbuf_enc; /* the segment buffer of coded buffer, load frome fn_enc */
-    int file_count;
+    struct fool_frames frames_enc; /* the frames of fn_enc */
 
     char *fn_jpg;/* file name of JPEG fool with codedbuf content */
-    char *segbuf_jpg; /* the segment buffer of coded buffer, load frome fn_jpg */
+    struct fool_frames frames_jpg; /* the whole fn_jpg as one frame */
 
-    VAEntrypoint entrypoint; /* current entrypoint */
-    
-    /* all buffers with same type share one malloc-ed memory
-     * bufferID = (buffer numbers with the same type << 8) || type
-     * the malloc-ed memory can be find by fool_buf[bufferID & 0xff]
-     * the size is ignored here
+    /*
+     * the buffers of the fooled contexts, the free slots are reused
+     * oldest first so that a stale ID is likely to be caught
      */
-    char *fool_buf[VABufferTypeMax]; /* memory of fool buffers */
-    unsigned int fool_buf_size[VABufferTypeMax]; /* size of memory of fool buffers */
-    unsigned int fool_buf_element[VABufferTypeMax]; /* element count of created buffers */
-    unsigned int fool_buf_count[VABufferTypeMax]; /* count of created buffers */
-    VAContextID context;
-} fool_context[FOOL_CONTEXT_MAX]; /* trace five context at the same time */
-
-#define DPY2INDEX(dpy)                                  \
-    int idx;                                            \
-                                                        \
-    for (idx = 0; idx < FOOL_CONTEXT_MAX; idx++)        \
-        if (fool_context[idx].dpy == dpy)               \
-            break;                                      \
-                                                        \
-    if (idx == FOOL_CONTEXT_MAX)                        \
+    struct fool_buffer *buffers;
+    int buffer_slots; /* allocated slots */
+    int free_head, free_tail; /* -1 if no free slot */
+    struct fool_arena arena;
+
+    size_t buffer_limit; /* LIBVA_FOOL_BUFFER_LIMIT, 0 if not set */
+    unsigned long long buffer_created;
+    unsigned int buffer_live, buffer_peak;
+    size_t bytes_live, bytes_peak; /* requested sizes */
+
+    /*
+     * only the configs/contexts whose entrypoint is fooled are in the
+     * tables, the other ones go to the driver, e.g. fool_codec = decode
+     * doesn't fool the encode contexts of the display
+     */
+    struct va_hash configs; /* struct fool_va_state by VAConfigID */
+    struct va_hash contexts; /* struct fool_va_state by VAContextID */
+
+    int decode_pattern; /* LIBVA_FOOL_DECODE_PATTERN */
+    uint64_t decode_delay; /* LIBVA_FOOL_DECODE_DELAY, ns of a 1920x1080 frame */
+    struct va_hash surfaces; /* struct fool_surface by VASurfaceID, of the fool decode */
+};
+
+struct fool_va_state {
+    struct va_hash_entry entry;
+    VAEntrypoint entrypoint;
+
+    /* contexts only */
+    int width, height;
+    VASurfaceID render_target;
+    unsigned int frame_num;
+    uint64_t busy_until; /* end of its last fool decode */
+};
+
+struct fool_surface {
+    struct va_hash_entry entry;
+    uint64_t ready; /* end of the fool decode into it */
+};
+
+VAStatus vaLockSurface(VADisplay dpy,
+                       VASurfaceID surface,
+                       unsigned int *fourcc, /* following are output argument */
+                       unsigned int *luma_stride,
+                       unsigned int *chroma_u_stride,
+                       unsigned int *chroma_v_stride,
+                       unsigned int *luma_offset,
+                       unsigned int *chroma_u_offset,
+                       unsigned int *chroma_v_offset,
+                       unsigned int *buffer_name,
+                       void **buffer 
+                       );
+
+VAStatus vaUnlockSurface(VADisplay dpy,
+                         VASurfaceID surface
+                         );
+
+#define FOOL_CTX(dpy) ((struct fool_context *)((VADisplayContextP)dpy)->vafool)
+
+#define DPY2FOOLCTX(dpy)                                        \
+    struct fool_context *fool_ctx = FOOL_CTX(dpy);              \
+                                                                \
+    if (fool_ctx == NULL)                                       \
         return 0;  /* let driver go */
 
 /* Prototype declarations (functions defined in va.c) */
@@ -107,70 +218,432 @@ void va_infoMessage(const char *msg, ...);
 
 int  va_parseConfig(char *env, char *env_value);
 
-void va_FoolInit(VADisplay dpy)
+/* the size class of size, -1 if it is too big */
+static int va_FoolArenaClass(size_t size)
 {
-    char env_value[1024];
-    int fool_index = 0;
+    int size_class = 0;
+
+    while (((size_t)1 << (size_class + FOOL_ARENA_MIN_SHIFT)) < size) {
+        if (++size_class == FOOL_ARENA_CLASSES)
+            return -1;
+    }
+
+    return size_class;
+}
+
+static void *va_FoolArenaAlloc(struct fool_arena *arena, int size_class)
+{
+    size_t size = (size_t)1 << (size_class + FOOL_ARENA_MIN_SHIFT);
+    void *block = arena->free_list[size_class];
+
+    if (block) {
+        arena->free_list[size_class] = *(void **)block;
+        return block;
+    }
+
+    block = malloc(size);
+    if (block)
+        arena->allocated += size;
+
+    return block;
+}
+
+static void va_FoolArenaFree(struct fool_arena *arena, void *block, int size_class)
+{
+    *(void **)block = arena->free_list[size_class];
+    arena->free_list[size_class] = block;
+}
+
+static void va_FoolArenaFini(struct fool_arena *arena)
+{
+    void *block;
+    int i;
+
+    for (i = 0; i < FOOL_ARENA_CLASSES; i++) {
+        while ((block = arena->free_list[i]) != NULL) {
+            arena->free_list[i] = *(void **)block;
+            free(block);
+        }
+    }
+    arena->allocated = 0;
+}
+
+static void va_FoolFreeFrames(struct fool_frames *frames)
+{
+    int i;
+
+    for (i = 0; i < frames->map_count; i++)
+        munmap(frames->map[i], frames->map_size[i]);
+    free(frames->map);
+    free(frames->map_size);
+    free(frames->frame);
+    memset(frames, 0, sizeof(*frames));
+}
+
+static int va_FoolAddFrame(struct fool_frames *frames, unsigned char *buf, size_t size)
+{
+    struct fool_frame *frame;
+
+    if ((frames->frame_count & 63) == 0) {
+        frame = realloc(frames->frame, (frames->frame_count + 64) * sizeof(*frame));
+        if (frame == NULL)
+            return -1;
+        frames->frame = frame;
+    }
+    frame = &frames->frame[frames->frame_count++];
+    frame->buf = buf;
+    frame->size = size;
+
+    return 0;
+}
+
+/* map the whole file, an empty one is a NULL mapping of size 0 */
+static int va_FoolMapFile(struct fool_frames *frames, const char *fn,
+                          unsigned char **buf, size_t *size)
+{
+    struct stat file_stat;
+    void **map;
+    size_t *map_size;
+    void *addr = NULL;
+    int fd;
+
+    if ((fd = open(fn, O_RDONLY)) == -1)
+        return -1;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    /* read-only, every coded buffer returning a frame shares its pages */
+    if (file_stat.st_size > 0) {
+        addr = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+
+    map = realloc(frames->map, (frames->map_count + 1) * sizeof(*map));
+    if (map)
+        frames->map = map;
+    map_size = realloc(frames->map_size, (frames->map_count + 1) * sizeof(*map_size));
+    if (map_size)
+        frames->map_size = map_size;
+    if (map == NULL || map_size == NULL) {
+        if (addr)
+            munmap(addr, file_stat.st_size);
+        return -1;
+    }
+    if (addr) {
+        frames->map[frames->map_count] = addr;
+        frames->map_size[frames->map_count] = file_stat.st_size;
+        frames->map_count++;
+    }
+
+    *buf = addr;
+    *size = file_stat.st_size;
+
+    return 0;
+}
+
+static unsigned int va_FoolGetLE32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/*
+ * IVF: 32 bytes file header with its own length at 6,
+ * then each frame is 4 bytes size, 8 bytes pts and the data,
+ * the coded buffer gets the frame data only
+ */
+static int va_FoolSplitIVF(struct fool_frames *frames, unsigned char *buf, size_t size)
+{
+    size_t offset = buf[6] | (buf[7] << 8);
+    unsigned int frame_size;
+
+    while (offset + 12 <= size) {
+        frame_size = va_FoolGetLE32(buf + offset);
+        offset += 12;
+        if (frame_size > size - offset)
+            frame_size = size - offset; /* truncated file */
+        if (va_FoolAddFrame(frames, buf + offset, frame_size))
+            return -1;
+        offset += frame_size;
+    }
+
+    return 0;
+}
+
+/* the offset of the next 00 00 01 from offset, or size */
+static size_t va_FoolNextStartCode(const unsigned char *buf, size_t size, size_t offset)
+{
+    const unsigned char *p;
 
-    for (fool_index = 0; fool_index < FOOL_CONTEXT_MAX; fool_index++)
-        if (fool_context[fool_index].dpy == 0)
+    while (offset + 3 <= size) {
+        p = memchr(buf + offset + 2, 1, size - offset - 2);
+        if (p == NULL)
             break;
+        offset = p - buf - 2;
+        if (p[-1] == 0 && p[-2] == 0)
+            return offset;
+        offset++;
+    }
+
+    return size;
+}
+
+/*
+ * H.264 Annex-B: an access unit starts at an AUD/SPS/PPS/SEI or at a
+ * slice with first_mb_in_slice = 0 which follows the slices of the
+ * previous one, a frame keeps its leading zero_byte of the start code
+ */
+static int va_FoolSplitAnnexB(struct fool_frames *frames, unsigned char *buf, size_t size)
+{
+    size_t offset, start = 0, nal;
+    int nal_type, header, first_mb, seen_slice = 0;
 
-    if (fool_index == FOOL_CONTEXT_MAX)
+    offset = va_FoolNextStartCode(buf, size, 0);
+    while (offset < size) {
+        nal = offset;
+        if (nal > 0 && buf[nal - 1] == 0)
+            nal--; /* 4 bytes start code */
+        offset += 3;
+        if (offset >= size)
+            break;
+
+        nal_type = buf[offset] & 0x1f;
+        /* the prefix and MVC slice NALs have a 3 bytes header extension */
+        header = (nal_type == 14 || nal_type == 20) ? 4 : 1;
+        first_mb = (offset + header < size) && (buf[offset + header] & 0x80);
+        if (seen_slice &&
+            ((nal_type >= 6 && nal_type <= 9) || nal_type == 14 || nal_type == 15 ||
+             ((nal_type == 1 || nal_type == 5 || nal_type == 20) && first_mb))) {
+            if (va_FoolAddFrame(frames, buf + start, nal - start))
+                return -1;
+            start = nal;
+            seen_slice = 0;
+        }
+        if (nal_type == 1 || nal_type == 5 || nal_type == 20)
+            seen_slice = 1;
+
+        offset = va_FoolNextStartCode(buf, size, offset);
+    }
+
+    return va_FoolAddFrame(frames, buf + start, size - start);
+}
+
+/*
+ * fn is one stream file, split it into frames, otherwise
+ * fn.0, fn.1, ... are the frames up to the first missing one
+ */
+static void va_FoolLoadFrames(struct fool_frames *frames, const char *fn)
+{
+    char file_name[1024];
+    unsigned char *buf;
+    size_t size;
+    int ret = 0;
+
+    if (va_FoolMapFile(frames, fn, &buf, &size) == 0) {
+        if (size >= 32 && memcmp(buf, "DKIF", 4) == 0)
+            ret = va_FoolSplitIVF(frames, buf, size);
+        else if (size > 0)
+            ret = va_FoolSplitAnnexB(frames, buf, size);
+        else
+            ret = va_FoolAddFrame(frames, buf, size);
+    } else {
+        for (;;) {
+            snprintf(file_name, sizeof(file_name), "%s.%d", fn, frames->frame_count);
+            if (va_FoolMapFile(frames, file_name, &buf, &size) != 0)
+                break;
+            if ((ret = va_FoolAddFrame(frames, buf, size)) != 0)
+                break;
+        }
+    }
+    if (ret != 0)
+        va_errorMessage("LIBVA_FOOL: out of memory when indexing %s\n", fn);
+    if (frames->frame_count == 0)
+        va_errorMessage("LIBVA_FOOL: no coded frame in %s\n", fn);
+    else
+        va_infoMessage("LIBVA_FOOL: %d coded frames in %s\n", frames->frame_count, fn);
+}
+
+/* the next frame, stays at the last one, a zero sized one if there is none */
+static void va_FoolFillCodedBufFrames(struct fool_buffer *buffer,
+                                      struct fool_frames *frames)
+{
+    VACodedBufferSegment *codedbuf;
+    struct fool_frame *frame = NULL;
+
+    if (frames->frame_count > 0) {
+        frame = &frames->frame[frames->frame_next];
+        if (frames->frame_next < frames->frame_count - 1)
+            frames->frame_next++;
+    }
+
+    codedbuf = (VACodedBufferSegment *)buffer->data;
+    codedbuf->size = frame ? frame->size : 0;
+    codedbuf->bit_offset = 0;
+    codedbuf->status = 0;
+    codedbuf->reserved = 0;
+    codedbuf->buf = frame ? frame->buf : NULL;
+    codedbuf->next = NULL;
+}
+
+void va_FoolInit(VADisplay dpy)
+{
+    char env_value[1024];
+    struct fool_context *fool_ctx;
+    pthread_rwlockattr_t attr;
+    unsigned char *buf;
+    size_t size;
+
+    fool_ctx = calloc(1, sizeof(struct fool_context));
+    if (fool_ctx == NULL)
         return;
 
-    memset(&fool_context[fool_index], 0, sizeof(struct _fool_context));
     if (va_parseConfig("LIBVA_FOOL_POSTP", NULL) == 0) {
-        fool_postp = 1;
+        va_atomic_or(&fool_postp, 1);
         va_infoMessage("LIBVA_FOOL_POSTP is on, dummy vaPutSurface\n");
     }
     
     if (va_parseConfig("LIBVA_FOOL_DECODE", NULL) == 0) {
-        fool_codec  |= VA_FOOL_FLAG_DECODE;
+        fool_ctx->fool_codec  |= VA_FOOL_FLAG_DECODE;
         va_infoMessage("LIBVA_FOOL_DECODE is on, dummy decode\n");
     }
+    if ((fool_ctx->fool_codec & VA_FOOL_FLAG_DECODE) &&
+        va_parseConfig("LIBVA_FOOL_DECODE_PATTERN", NULL) == 0) {
+        fool_ctx->decode_pattern = 1;
+        va_infoMessage("LIBVA_FOOL_DECODE_PATTERN is on, fill the decoded surfaces\n");
+    }
+    if ((fool_ctx->fool_codec & VA_FOOL_FLAG_DECODE) &&
+        va_parseConfig("LIBVA_FOOL_DECODE_DELAY", &env_value[0]) == 0) {
+        fool_ctx->decode_delay = strtoull(env_value, NULL, 0) * 1000;
+        va_infoMessage("LIBVA_FOOL_DECODE_DELAY is on, a 1920x1080 frame takes %s us\n",
+                       env_value);
+    }
     if (va_parseConfig("LIBVA_FOOL_ENCODE", &env_value[0]) == 0) {
-        fool_codec  |= VA_FOOL_FLAG_ENCODE;
-        fool_context[fool_index].fn_enc = strdup(env_value);
+        fool_ctx->fool_codec  |= VA_FOOL_FLAG_ENCODE;
+        fool_ctx->fn_enc = strdup(env_value);
         va_infoMessage("LIBVA_FOOL_ENCODE is on, load encode data from file with patten %s\n",
-                       fool_context[fool_index].fn_enc);
+                       fool_ctx->fn_enc);
+        va_FoolLoadFrames(&fool_ctx->frames_enc, fool_ctx->fn_enc);
     }
     if (va_parseConfig("LIBVA_FOOL_JPEG", &env_value[0]) == 0) {
-        fool_codec  |= VA_FOOL_FLAG_JPEG;
-        fool_context[fool_index].fn_jpg = strdup(env_value);
+        fool_ctx->fool_codec  |= VA_FOOL_FLAG_JPEG;
+        fool_ctx->fn_jpg = strdup(env_value);
         va_infoMessage("LIBVA_FOOL_JPEG is on, load encode data from file with patten %s\n",
-                       fool_context[fool_index].fn_jpg);
+                       fool_ctx->fn_jpg);
+        if (va_FoolMapFile(&fool_ctx->frames_jpg, fool_ctx->fn_jpg, &buf, &size) == 0)
+            va_FoolAddFrame(&fool_ctx->frames_jpg, buf, size);
     }
     
-    if (fool_codec)
-        fool_context[fool_index].dpy = dpy;
+    if (va_parseConfig("LIBVA_FOOL_BUFFER_LIMIT", &env_value[0]) == 0) {
+        fool_ctx->buffer_limit = strtoul(env_value, NULL, 0);
+        va_infoMessage("LIBVA_FOOL_BUFFER_LIMIT is on, fool buffers hold up to %lu bytes\n",
+                       (unsigned long)fool_ctx->buffer_limit);
+    }
+    fool_ctx->free_head = fool_ctx->free_tail = -1;
+
+    if (fool_ctx->fool_codec == 0) {
+        free(fool_ctx);
+        return;
+    }
+
+    if (va_HashInit(&fool_ctx->configs) != 0 || va_HashInit(&fool_ctx->contexts) != 0 ||
+        va_HashInit(&fool_ctx->surfaces) != 0) {
+        va_HashFini(&fool_ctx->configs, NULL);
+        va_HashFini(&fool_ctx->contexts, NULL);
+        va_FoolFreeFrames(&fool_ctx->frames_enc);
+        va_FoolFreeFrames(&fool_ctx->frames_jpg);
+        free(fool_ctx->fn_enc);
+        free(fool_ctx->fn_jpg);
+        free(fool_ctx);
+        return;
+    }
+
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_READER_NP);
+#endif
+    pthread_rwlock_init(&fool_ctx->lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    ((VADisplayContextP)dpy)->vafool = fool_ctx;
+
+    va_atomic_or(&fool_codec, fool_ctx->fool_codec);
 }
 
 
+static void va_FoolFreeState(struct va_hash_entry *entry)
+{
+    free(entry);
+}
+
 int va_FoolEnd(VADisplay dpy)
 {
+    struct fool_context *fool_ctx = FOOL_CTX(dpy);
     int i;
-    DPY2INDEX(dpy);
-
-    for (i = 0; i < VABufferTypeMax; i++) {/* free memory */
-        if (fool_context[idx].fool_buf[i])
-            free(fool_context[idx].fool_buf[i]);
-    }
-    if (fool_context[idx].segbuf_enc)
-        free(fool_context[idx].segbuf_enc);
-    if (fool_context[idx].segbuf_jpg)
-        free(fool_context[idx].segbuf_jpg);
-    if (fool_context[idx].fn_enc)
-        free(fool_context[idx].fn_enc);
-    if (fool_context[idx].fn_jpg)
-        free(fool_context[idx].fn_jpg);
+
+    if (fool_ctx == NULL)
+        return 0;
+
+    if (fool_ctx->buffer_created)
+        va_infoMessage("LIBVA_FOOL: %llu buffers created, peak %u buffers of %lu bytes, "
+                       "%lu bytes in the arena\n",
+                       fool_ctx->buffer_created, fool_ctx->buffer_peak,
+                       (unsigned long)fool_ctx->bytes_peak,
+                       (unsigned long)fool_ctx->arena.allocated);
+    if (fool_ctx->buffer_live)
+        va_errorMessage("LIBVA_FOOL: %u buffers of %lu bytes not destroyed\n",
+                        fool_ctx->buffer_live, (unsigned long)fool_ctx->bytes_live);
+
+    for (i = 0; i < fool_ctx->buffer_slots; i++) {
+        if (fool_ctx->buffers[i].data)
+            va_FoolArenaFree(&fool_ctx->arena, fool_ctx->buffers[i].data,
+                             fool_ctx->buffers[i].size_class);
+    }
+    free(fool_ctx->buffers);
+    va_FoolArenaFini(&fool_ctx->arena);
+    va_FoolFreeFrames(&fool_ctx->frames_enc);
+    va_FoolFreeFrames(&fool_ctx->frames_jpg);
+    if (fool_ctx->fn_enc)
+        free(fool_ctx->fn_enc);
+    if (fool_ctx->fn_jpg)
+        free(fool_ctx->fn_jpg);
+
+    va_HashFini(&fool_ctx->configs, va_FoolFreeState);
+    va_HashFini(&fool_ctx->contexts, va_FoolFreeState);
+    va_HashFini(&fool_ctx->surfaces, va_FoolFreeState);
     
-    memset(&fool_context[idx], 0, sizeof(struct _fool_context));
+    pthread_rwlock_destroy(&fool_ctx->lock);
+    free(fool_ctx);
+
+    ((VADisplayContextP)dpy)->vafool = NULL;
     
     return 0;
 }
 
 
+/* add key to the table, or update it, the driver may reuse the IDs */
+static struct fool_va_state *va_FoolAddState(struct va_hash *hash, unsigned int key,
+                                             VAEntrypoint entrypoint)
+{
+    struct fool_va_state *state;
+
+    state = (struct fool_va_state *)va_HashLookup(hash, key);
+    if (state == NULL) {
+        state = calloc(1, sizeof(struct fool_va_state));
+        if (state == NULL)
+            return NULL;
+        state->entry.key = key;
+        va_HashInsert(hash, &state->entry);
+    }
+    state->entrypoint = entrypoint;
+
+    return state;
+}
+
+
 int va_FoolCreateConfig(
         VADisplay dpy,
         VAProfile profile, 
@@ -180,27 +653,374 @@ int va_FoolCreateConfig(
         VAConfigID *config_id /* out */
 )
 {
-    DPY2INDEX(dpy);
+    int codec;
+    DPY2FOOLCTX(dpy);
+
+    pthread_rwlock_wrlock(&fool_ctx->lock);
 
-    fool_context[idx].entrypoint = entrypoint;
-    
     /*
-     * check fool_codec to align with current context
+     * check fool_codec to align with the entrypoint of the config
      * e.g. fool_codec = decode then for encode, the
      * vaBegin/vaRender/vaEnd also run into fool path
      * which is not desired
+     * Only called when the driver created *config_id.
      */
-    if (((fool_codec & VA_FOOL_FLAG_DECODE) && (entrypoint == VAEntrypointVLD)) ||
-        ((fool_codec & VA_FOOL_FLAG_ENCODE) && (entrypoint == VAEntrypointEncSlice)) ||
-        ((fool_codec & VA_FOOL_FLAG_JPEG) && (entrypoint == VAEntrypointEncPicture)))
-        ; /* the fool_codec is meaningful */
+    codec = fool_ctx->fool_codec;
+    if (((codec & VA_FOOL_FLAG_DECODE) && (entrypoint == VAEntrypointVLD)) ||
+        ((codec & VA_FOOL_FLAG_ENCODE) && (entrypoint == VAEntrypointEncSlice)) ||
+        ((codec & VA_FOOL_FLAG_JPEG) && (entrypoint == VAEntrypointEncPicture)))
+        va_FoolAddState(&fool_ctx->configs, *config_id, entrypoint);
     else
-        fool_codec = 0;
+        free(va_HashRemove(&fool_ctx->configs, *config_id));
+
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    return 0; /* driver continue */
+}
+
+
+int va_FoolDestroyConfig(
+    VADisplay dpy,
+    VAConfigID config_id
+)
+{
+    DPY2FOOLCTX(dpy);
+
+    pthread_rwlock_wrlock(&fool_ctx->lock);
+    free(va_HashRemove(&fool_ctx->configs, config_id));
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    return 0;
+}
+
+
+int va_FoolCreateContext(
+    VADisplay dpy,
+    VAConfigID config_id,
+    int picture_width,
+    int picture_height,
+    VAContextID *context /* out */
+)
+{
+    struct fool_va_state *config, *state;
+    DPY2FOOLCTX(dpy);
+
+    pthread_rwlock_wrlock(&fool_ctx->lock);
+
+    /* fool the context if its config is fooled, *context is valid as the driver created it */
+    config = (struct fool_va_state *)va_HashLookup(&fool_ctx->configs, config_id);
+    if (config) {
+        state = va_FoolAddState(&fool_ctx->contexts, *context, config->entrypoint);
+        if (state) {
+            state->width = picture_width;
+            state->height = picture_height;
+            state->render_target = VA_INVALID_SURFACE;
+            state->frame_num = 0;
+            state->busy_until = 0;
+        }
+    } else
+        free(va_HashRemove(&fool_ctx->contexts, *context));
+
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    return 0; /* driver continue */
+}
+
+
+int va_FoolDestroyContext(
+    VADisplay dpy,
+    VAContextID context
+)
+{
+    DPY2FOOLCTX(dpy);
+
+    pthread_rwlock_wrlock(&fool_ctx->lock);
+    free(va_HashRemove(&fool_ctx->contexts, context));
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    return 0;
+}
+
+
+int va_FoolDestroySurfaces(
+    VADisplay dpy,
+    VASurfaceID *surface_list,
+    int num_surfaces
+)
+{
+    int i;
+    DPY2FOOLCTX(dpy);
+
+    if (fool_ctx->decode_delay == 0)
+        return 0;
+
+    pthread_rwlock_wrlock(&fool_ctx->lock);
+    for (i = 0; i < num_surfaces; i++)
+        free(va_HashRemove(&fool_ctx->surfaces, surface_list[i]));
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    return 0;
+}
+
+
+int va_FoolBeginPicture(
+    VADisplay dpy,
+    VAContextID context,
+    VASurfaceID render_target
+)
+{
+    struct fool_va_state *state;
+    DPY2FOOLCTX(dpy);
+
+    pthread_rwlock_wrlock(&fool_ctx->lock);
+    state = (struct fool_va_state *)va_HashLookup(&fool_ctx->contexts, context);
+    if (state)
+        state->render_target = render_target;
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    return state != NULL; /* don't call into driver if fooled */
+}
+
+
+/* checkerboard of box pixels shifted by shift, 0xeb and 0x10 */
+static void va_FoolFillRow(unsigned char *row, int width, int box, int shift, int odd)
+{
+    int x = 0, run;
+
+    while (x < width) {
+        run = box - (x + shift) % box;
+        if (run > width - x)
+            run = width - x;
+        memset(row + x, ((((x + shift) / box) & 1) ^ odd) ? 0x10 : 0xeb, run);
+        x += run;
+    }
+}
+
+/*
+ * the synthetic content, a checkerboard moving up left by 4 pixels a
+ * frame, and the frame number in the 8x8 cells of the first rows, the
+ * most significant bit left, 0xeb for 1
+ */
+static void va_FoolFillSurface(VADisplay dpy, VASurfaceID surface,
+                               int width, int height, unsigned int frame_num)
+{
+    unsigned int fourcc, strides[3], offsets[3], buffer_name;
+    unsigned char *buffer = NULL, *y_plane, *row;
+    int shift = frame_num * 4, box = 32;
+    int x, y, cells;
+
+    if (vaLockSurface(dpy, surface, &fourcc,
+                      &strides[0], &strides[1], &strides[2],
+                      &offsets[0], &offsets[1], &offsets[2],
+                      &buffer_name, (void **)&buffer) != VA_STATUS_SUCCESS)
+        return;
+
+    if (buffer == NULL ||
+        (fourcc != VA_FOURCC_NV12 && fourcc != VA_FOURCC_IYUV &&
+         fourcc != VA_FOURCC('I', '4', '2', '0') && fourcc != VA_FOURCC_YV12)) {
+        vaUnlockSurface(dpy, surface);
+        return;
+    }
+
+    y_plane = buffer + offsets[0];
+    for (y = 0; y < height; y++)
+        va_FoolFillRow(y_plane + y * strides[0], width, box, shift, ((y + shift) / box) & 1);
+
+    cells = width / 8 < 32 ? width / 8 : 32;
+    for (y = 0; y < 8 && y < height; y++) {
+        row = y_plane + y * strides[0];
+        for (x = 0; x < cells; x++)
+            memset(row + x * 8, (frame_num >> (31 - x)) & 1 ? 0xeb : 0x10, 8);
+    }
+
+    /* grey, same for NV12 UV and the planar U/V rows */
+    for (y = 0; y < (height + 1) / 2; y++) {
+        if (fourcc == VA_FOURCC_NV12)
+            memset(buffer + offsets[1] + y * strides[1], 0x80, (width + 1) & ~1);
+        else {
+            memset(buffer + offsets[1] + y * strides[1], 0x80, (width + 1) / 2);
+            memset(buffer + offsets[2] + y * strides[2], 0x80, (width + 1) / 2);
+        }
+    }
+
+    vaUnlockSurface(dpy, surface);
+}
+
+
+int va_FoolEndPicture(
+    VADisplay dpy,
+    VAContextID context
+)
+{
+    struct fool_va_state *state;
+    struct fool_surface *surface;
+    VASurfaceID render_target;
+    int width, height, decode;
+    unsigned int frame_num;
+    uint64_t now;
+    DPY2FOOLCTX(dpy);
+
+    pthread_rwlock_wrlock(&fool_ctx->lock);
+
+    state = (struct fool_va_state *)va_HashLookup(&fool_ctx->contexts, context);
+    if (state == NULL) {
+        pthread_rwlock_unlock(&fool_ctx->lock);
+        return 0; /* not fooled, let driver go */
+    }
+
+    decode = (state->entrypoint == VAEntrypointVLD) &&
+        (state->render_target != VA_INVALID_SURFACE);
+    render_target = state->render_target;
+    width = state->width;
+    height = state->height;
+    frame_num = state->frame_num++;
+
+    /* the frames of a context are decoded one after the other */
+    if (decode && fool_ctx->decode_delay) {
+        now = va_LatencyTime();
+        if (state->busy_until < now)
+            state->busy_until = now;
+        state->busy_until += fool_ctx->decode_delay * width * height / (1920 * 1080);
+
+        surface = (struct fool_surface *)va_HashLookup(&fool_ctx->surfaces, render_target);
+        if (surface == NULL) {
+            surface = calloc(1, sizeof(struct fool_surface));
+            if (surface) {
+                surface->entry.key = render_target;
+                va_HashInsert(&fool_ctx->surfaces, &surface->entry);
+            }
+        }
+        if (surface)
+            surface->ready = state->busy_until;
+    }
+
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    /* the surface isn't of fool_ctx, fill it out of the lock */
+    if (decode && fool_ctx->decode_pattern)
+        va_FoolFillSurface(dpy, render_target, width, height, frame_num);
+
+    return 1; /* don't call into driver */
+}
+
+
+/* ns until the fool decode into render_target ends, 0 if it did */
+static uint64_t va_FoolSurfaceBusy(struct fool_context *fool_ctx, VASurfaceID render_target)
+{
+    struct fool_surface *surface;
+    uint64_t ready = 0, now;
+
+    pthread_rwlock_rdlock(&fool_ctx->lock);
+    surface = (struct fool_surface *)va_HashLookup(&fool_ctx->surfaces, render_target);
+    if (surface)
+        ready = surface->ready;
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    now = va_LatencyTime();
+
+    return ready > now ? ready - now : 0;
+}
+
+
+int va_FoolSyncSurface(
+    VADisplay dpy,
+    VASurfaceID render_target
+)
+{
+    struct timespec ts;
+    uint64_t busy;
+    DPY2FOOLCTX(dpy);
+
+    if (fool_ctx->decode_delay == 0)
+        return 0;
+
+    busy = va_FoolSurfaceBusy(fool_ctx, render_target);
+    if (busy) {
+        ts.tv_sec = busy / 1000000000ULL;
+        ts.tv_nsec = busy % 1000000000ULL;
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+            ;
+    }
 
     return 0; /* driver continue */
 }
 
 
+int va_FoolQuerySurfaceStatus(
+    VADisplay dpy,
+    VASurfaceID render_target,
+    VASurfaceStatus *status /* out */
+)
+{
+    DPY2FOOLCTX(dpy);
+
+    if (fool_ctx->decode_delay == 0 || va_FoolSurfaceBusy(fool_ctx, render_target) == 0)
+        return 0; /* let driver go */
+
+    *status = VASurfaceRendering;
+
+    return 1; /* don't call into driver */
+}
+
+
+/* the fool buffer of buf_id, NULL if it is not a live one */
+static struct fool_buffer *va_FoolLookupBuffer(struct fool_context *fool_ctx, VABufferID buf_id)
+{
+    unsigned int slot = buf_id & ~FOOL_BUFID_MASK;
+
+    if ((buf_id & FOOL_BUFID_MASK) != FOOL_BUFID_MAGIC ||
+        slot >= (unsigned int)fool_ctx->buffer_slots ||
+        fool_ctx->buffers[slot].data == NULL)
+        return NULL;
+
+    return &fool_ctx->buffers[slot];
+}
+
+/* a free slot, the oldest one, -1 if out of memory or IDs */
+static int va_FoolAllocSlot(struct fool_context *fool_ctx)
+{
+    struct fool_buffer *buffers;
+    int slot, slots, i;
+
+    if (fool_ctx->free_head == -1) {
+        slots = fool_ctx->buffer_slots ? fool_ctx->buffer_slots * 2 : 64;
+        if (slots > FOOL_BUFID_SLOTS)
+            slots = FOOL_BUFID_SLOTS;
+        if (slots == fool_ctx->buffer_slots)
+            return -1;
+        buffers = realloc(fool_ctx->buffers, slots * sizeof(*buffers));
+        if (buffers == NULL)
+            return -1;
+        memset(buffers + fool_ctx->buffer_slots, 0,
+               (slots - fool_ctx->buffer_slots) * sizeof(*buffers));
+        for (i = fool_ctx->buffer_slots; i < slots; i++)
+            buffers[i].next_free = i + 1;
+        buffers[slots - 1].next_free = -1;
+        fool_ctx->free_head = fool_ctx->buffer_slots;
+        fool_ctx->free_tail = slots - 1;
+        fool_ctx->buffers = buffers;
+        fool_ctx->buffer_slots = slots;
+    }
+
+    slot = fool_ctx->free_head;
+    fool_ctx->free_head = fool_ctx->buffers[slot].next_free;
+    if (fool_ctx->free_head == -1)
+        fool_ctx->free_tail = -1;
+
+    return slot;
+}
+
+static void va_FoolFreeSlot(struct fool_context *fool_ctx, int slot)
+{
+    fool_ctx->buffers[slot].next_free = -1;
+    if (fool_ctx->free_tail == -1)
+        fool_ctx->free_head = slot;
+    else
+        fool_ctx->buffers[fool_ctx->free_tail].next_free = slot;
+    fool_ctx->free_tail = slot;
+}
+
+
 VAStatus va_FoolCreateBuffer(
     VADisplay dpy,
     VAContextID context,	/* in */
@@ -208,123 +1028,168 @@ VAStatus va_FoolCreateBuffer(
     unsigned int size,		/* in */
     unsigned int num_elements,	/* in */
     void *data,			/* in */
-    VABufferID *buf_id		/* out */
+    VABufferID *buf_id,		/* out */
+    VAStatus *va_status		/* out */
 )
 {
-    unsigned int new_size = size * num_elements;
-    unsigned int old_size;
-    DPY2INDEX(dpy);
+    size_t new_size = (size_t)size * num_elements;
+    struct fool_va_state *state;
+    struct fool_buffer *buffer;
+    int slot, size_class;
+    DPY2FOOLCTX(dpy);
 
-    old_size = fool_context[idx].fool_buf_size[type] * fool_context[idx].fool_buf_element[type];
+    pthread_rwlock_wrlock(&fool_ctx->lock);
 
-    if (old_size < new_size)
-        fool_context[idx].fool_buf[type] = realloc(fool_context[idx].fool_buf[type], new_size);
-    
-    fool_context[idx].fool_buf_size[type] = size;
-    fool_context[idx].fool_buf_element[type] = num_elements;
-    fool_context[idx].fool_buf_count[type]++;
-    /* because we ignore the vaRenderPicture, 
-     * all buffers with same type share same real memory
-     * bufferID = (magic number) | type
-     */
-    *buf_id = FOOL_BUFID_MAGIC | type;
+    state = (struct fool_va_state *)va_HashLookup(&fool_ctx->contexts, context);
+    if (state == NULL) {
+        pthread_rwlock_unlock(&fool_ctx->lock);
+        return 0; /* not fooled, let driver go */
+    }
+
+    *va_status = VA_STATUS_ERROR_ALLOCATION_FAILED;
+    if ((num_elements && size > UINT_MAX / num_elements) ||
+        (fool_ctx->buffer_limit && fool_ctx->bytes_live + new_size > fool_ctx->buffer_limit)) {
+        pthread_rwlock_unlock(&fool_ctx->lock);
+        return 1;
+    }
+
+    /* the coded buffer holds the segment, the smallest class fits it */
+    size_class = va_FoolArenaClass(new_size);
+    slot = size_class < 0 ? -1 : va_FoolAllocSlot(fool_ctx);
+    if (slot == -1) {
+        pthread_rwlock_unlock(&fool_ctx->lock);
+        return 1;
+    }
+    buffer = &fool_ctx->buffers[slot];
+    buffer->data = va_FoolArenaAlloc(&fool_ctx->arena, size_class);
+    if (buffer->data == NULL) {
+        va_FoolFreeSlot(fool_ctx, slot);
+        pthread_rwlock_unlock(&fool_ctx->lock);
+        return 1;
+    }
+
+    if (data)
+        memcpy(buffer->data, data, new_size);
+    buffer->size = size;
+    buffer->num_elements = num_elements;
+    buffer->max_num_elements = num_elements;
+    buffer->type = type;
+    buffer->entrypoint = state->entrypoint;
+    buffer->size_class = size_class;
+
+    fool_ctx->buffer_created++;
+    fool_ctx->bytes_live += new_size;
+    if (fool_ctx->bytes_live > fool_ctx->bytes_peak)
+        fool_ctx->bytes_peak = fool_ctx->bytes_live;
+    if (++fool_ctx->buffer_live > fool_ctx->buffer_peak)
+        fool_ctx->buffer_peak = fool_ctx->buffer_live;
+
+    *buf_id = FOOL_BUFID_MAGIC | slot;
+    *va_status = VA_STATUS_SUCCESS;
+
+    pthread_rwlock_unlock(&fool_ctx->lock);
 
     return 1; /* don't call into driver */
 }
 
-VAStatus va_FoolBufferInfo(
+VAStatus va_FoolDestroyBuffer(
     VADisplay dpy,
     VABufferID buf_id,  /* in */
-    VABufferType *type, /* out */
-    unsigned int *size,         /* out */
-    unsigned int *num_elements /* out */
+    VAStatus *va_status /* out */
 )
 {
-    unsigned int magic = buf_id & FOOL_BUFID_MASK;
-    DPY2INDEX(dpy);
+    struct fool_buffer *buffer;
+    DPY2FOOLCTX(dpy);
 
-    if (magic != FOOL_BUFID_MAGIC)
+    if ((buf_id & FOOL_BUFID_MASK) != FOOL_BUFID_MAGIC)
         return 0;
 
-    *type = buf_id & 0xff;
-    *size = fool_context[idx].fool_buf_size[*type];
-    *num_elements = fool_context[idx].fool_buf_element[*type];;
-    
+    pthread_rwlock_wrlock(&fool_ctx->lock);
+
+    buffer = va_FoolLookupBuffer(fool_ctx, buf_id);
+    if (buffer) {
+        va_FoolArenaFree(&fool_ctx->arena, buffer->data, buffer->size_class);
+        buffer->data = NULL;
+        va_FoolFreeSlot(fool_ctx, buffer - fool_ctx->buffers);
+
+        fool_ctx->bytes_live -= (size_t)buffer->size * buffer->max_num_elements;
+        fool_ctx->buffer_live--;
+        *va_status = VA_STATUS_SUCCESS;
+    } else
+        *va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
     return 1; /* don't call into driver */
 }
 
-static int va_FoolFillCodedBufEnc(int idx)
+VAStatus va_FoolBufferSetNumElements(
+    VADisplay dpy,
+    VABufferID buf_id,          /* in */
+    unsigned int num_elements,  /* in */
+    VAStatus *va_status         /* out */
+)
 {
-    char file_name[1024];
-    struct stat file_stat;
-    VACodedBufferSegment *codedbuf;
-    int i, fd = -1;
+    struct fool_buffer *buffer;
+    DPY2FOOLCTX(dpy);
+
+    if ((buf_id & FOOL_BUFID_MASK) != FOOL_BUFID_MAGIC)
+        return 0;
 
-    /* try file_name.file_count, if fail, try file_name.file_count-- */
-    for (i=0; i<=1; i++) {
-        sprintf(file_name, "%s.%d",
-                fool_context[idx].fn_enc,
-                fool_context[idx].file_count);
+    pthread_rwlock_wrlock(&fool_ctx->lock);
 
-        if ((fd = open(file_name, O_RDONLY)) != -1) {
-            fstat(fd, &file_stat);
-            fool_context[idx].file_count++; /* open next file */
-            break;
-        }
-        
-        fool_context[idx].file_count--; /* fall back to previous file */
-        if (fool_context[idx].file_count < 0)
-            fool_context[idx].file_count = 0;
-    }
-    if (fd != -1) {
-        fool_context[idx].segbuf_enc = realloc(fool_context[idx].segbuf_enc, file_stat.st_size);
-        read(fd, fool_context[idx].segbuf_enc, file_stat.st_size);
-        close(fd);
+    buffer = va_FoolLookupBuffer(fool_ctx, buf_id);
+    if (buffer == NULL)
+        *va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+    else if (num_elements > buffer->max_num_elements)
+        *va_status = VA_STATUS_ERROR_INVALID_PARAMETER;
+    else {
+        buffer->num_elements = num_elements;
+        *va_status = VA_STATUS_SUCCESS;
     }
-    codedbuf = (VACodedBufferSegment *)fool_context[idx].fool_buf[VAEncCodedBufferType];
-    codedbuf->size = file_stat.st_size;
-    codedbuf->bit_offset = 0;
-    codedbuf->status = 0;
-    codedbuf->reserved = 0;
-    codedbuf->buf = fool_context[idx].segbuf_enc;
-    codedbuf->next = NULL;
 
-    return 0;
-}
+    pthread_rwlock_unlock(&fool_ctx->lock);
 
+    return 1; /* don't call into driver */
+}
 
-static int va_FoolFillCodedBufJPG(int idx)
+VAStatus va_FoolBufferInfo(
+    VADisplay dpy,
+    VABufferID buf_id,  /* in */
+    VABufferType *type, /* out */
+    unsigned int *size,         /* out */
+    unsigned int *num_elements, /* out */
+    VAStatus *va_status /* out */
+)
 {
-    struct stat file_stat;
-    VACodedBufferSegment *codedbuf;
-    int i, fd = -1;
+    struct fool_buffer *buffer;
+    DPY2FOOLCTX(dpy);
 
-    if ((fd = open(fool_context[idx].fn_jpg, O_RDONLY)) != -1)
-        fstat(fd, &file_stat);
-        
-    if (fd != -1) {
-        fool_context[idx].segbuf_jpg = realloc(fool_context[idx].segbuf_jpg, file_stat.st_size);
-        read(fd, fool_context[idx].segbuf_jpg, file_stat.st_size);
-        close(fd);
-    }
-    codedbuf = (VACodedBufferSegment *)fool_context[idx].fool_buf[VAEncCodedBufferType];
-    codedbuf->size = file_stat.st_size;
-    codedbuf->bit_offset = 0;
-    codedbuf->status = 0;
-    codedbuf->reserved = 0;
-    codedbuf->buf = fool_context[idx].segbuf_jpg;
-    codedbuf->next = NULL;
+    if ((buf_id & FOOL_BUFID_MASK) != FOOL_BUFID_MAGIC)
+        return 0;
 
-    return 0;
-}
+    pthread_rwlock_rdlock(&fool_ctx->lock);
+
+    buffer = va_FoolLookupBuffer(fool_ctx, buf_id);
+    if (buffer) {
+        *type = buffer->type;
+        *size = buffer->size;
+        *num_elements = buffer->num_elements;
+        *va_status = VA_STATUS_SUCCESS;
+    } else
+        *va_status = VA_STATUS_ERROR_INVALID_BUFFER;
 
+    pthread_rwlock_unlock(&fool_ctx->lock);
+    
+    return 1; /* don't call into driver */
+}
 
-static int va_FoolFillCodedBuf(int idx)
+static int va_FoolFillCodedBuf(struct fool_context *fool_ctx, struct fool_buffer *buffer)
 {
-    if (fool_context[idx].entrypoint == VAEntrypointEncSlice)
-        va_FoolFillCodedBufEnc(idx);
-    else if (fool_context[idx].entrypoint == VAEntrypointEncPicture)
-        va_FoolFillCodedBufJPG(idx);
+    if (buffer->entrypoint == VAEntrypointEncSlice)
+        va_FoolFillCodedBufFrames(buffer, &fool_ctx->frames_enc);
+    else if (buffer->entrypoint == VAEntrypointEncPicture)
+        va_FoolFillCodedBufFrames(buffer, &fool_ctx->frames_jpg);
         
     return 0;
 }
@@ -333,35 +1198,92 @@ static int va_FoolFillCodedBuf(int idx)
 VAStatus va_FoolMapBuffer(
     VADisplay dpy,
     VABufferID buf_id,	/* in */
-    void **pbuf 	/* out */
+    unsigned int flags,	/* in */
+    void **pbuf, 	/* out */
+    VAStatus *va_status	/* out */
 )
 {
-    unsigned int buftype = buf_id & 0xff;
-    unsigned int magic = buf_id & FOOL_BUFID_MASK;
-    DPY2INDEX(dpy);
+    struct fool_buffer *buffer;
+    int fill;
+    DPY2FOOLCTX(dpy);
 
-    if (magic != FOOL_BUFID_MAGIC)
+    if ((buf_id & FOOL_BUFID_MASK) != FOOL_BUFID_MAGIC)
         return 0;
 
-    /* buf_id is the buffer type */
-    *pbuf = fool_context[idx].fool_buf[buftype];
+    /* fill the fake segment buf of the coded buffer from the frames,
+     * no need to if the client is only going to write it
+     */
+    fill = (flags == VA_MAPBUFFER_FLAG_DEFAULT || (flags & VA_MAPBUFFER_FLAG_READ));
+
+    if (fill)
+        pthread_rwlock_wrlock(&fool_ctx->lock);
+    else
+        pthread_rwlock_rdlock(&fool_ctx->lock);
 
-    /* it is coded buffer, fill the fake segment buf from file */
-    if (*pbuf && (buftype == VAEncCodedBufferType))
-        va_FoolFillCodedBuf(idx);
+    buffer = va_FoolLookupBuffer(fool_ctx, buf_id);
+    if (buffer) {
+        if (fill && buffer->type == VAEncCodedBufferType)
+            va_FoolFillCodedBuf(fool_ctx, buffer);
+        *pbuf = buffer->data;
+        *va_status = VA_STATUS_SUCCESS;
+    } else
+        *va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+
+    pthread_rwlock_unlock(&fool_ctx->lock);
     
     return 1; /* don't call into driver */
 }
 
 VAStatus va_FoolUnmapBuffer(
         VADisplay dpy,
-        VABufferID buf_id	/* in */
+        VABufferID buf_id,	/* in */
+        VAStatus *va_status	/* out */
 )
 {
-    unsigned int magic = buf_id & FOOL_BUFID_MASK;
+    DPY2FOOLCTX(dpy);
 
-    if (magic != FOOL_BUFID_MAGIC)
+    if ((buf_id & FOOL_BUFID_MASK) != FOOL_BUFID_MAGIC)
         return 0;
 
+    pthread_rwlock_rdlock(&fool_ctx->lock);
+    *va_status = va_FoolLookupBuffer(fool_ctx, buf_id) ?
+        VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_BUFFER;
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
     return 1;
 }
+
+/*
+ * the buffers stay alive after it, as with the drivers the clients
+ * destroy them, only check that they are live fool buffers
+ */
+int va_FoolRenderPicture(
+    VADisplay dpy,
+    VAContextID context,
+    VABufferID *buffers,
+    int num_buffers,
+    VAStatus *va_status /* out */
+)
+{
+    int i;
+    DPY2FOOLCTX(dpy);
+
+    pthread_rwlock_rdlock(&fool_ctx->lock);
+
+    if (va_HashLookup(&fool_ctx->contexts, context) == NULL) {
+        pthread_rwlock_unlock(&fool_ctx->lock);
+        return 0; /* not fooled, let driver go */
+    }
+
+    *va_status = VA_STATUS_SUCCESS;
+    for (i = 0; i < num_buffers; i++) {
+        if (va_FoolLookupBuffer(fool_ctx, buffers[i]) == NULL) {
+            *va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+            break;
+        }
+    }
+
+    pthread_rwlock_unlock(&fool_ctx->lock);
+
+    return 1; /* don't call into driver */
+}
@@ -39,13 +39,21 @@ extern int fool_postp;
 #define VA_FOOL_FLAG_ENCODE  0x2
 #define VA_FOOL_FLAG_JPEG    0x4
 
+/*
+ * fool_codec only tells whether some display is fooled, the hooks
+ * check the state of dpy (the display of the calling entry-point):
+ * only the contexts whose entrypoint is fooled, and the fool buffers
+ * they created, skip the driver. The buffer hooks return the status
+ * of the entry-point in va_status
+ */
 #define VA_FOOL_FUNC(fool_func,...)            \
-    if (fool_codec) {                          \
+    if (va_atomic_load(&fool_codec)) {         \
         ret = fool_func(__VA_ARGS__);          \
     }
-#define VA_FOOL_RETURN()                       \
-    if (fool_codec) {                          \
-        return VA_STATUS_SUCCESS;              \
+/* the hooks which only keep track of the state, the driver always continues */
+#define VA_FOOL_HOOK(fool_func,...)            \
+    if (va_atomic_load(&fool_codec)) {         \
+        fool_func(__VA_ARGS__);                \
     }
 
 void va_FoolInit(VADisplay dpy);
@@ -60,6 +68,52 @@ int va_FoolCreateConfig(
         VAConfigID *config_id /* out */
 );
 
+int va_FoolDestroyConfig(
+        VADisplay dpy,
+        VAConfigID config_id
+);
+
+int va_FoolCreateContext(
+        VADisplay dpy,
+        VAConfigID config_id,
+        int picture_width,
+        int picture_height,
+        VAContextID *context /* out */
+);
+
+int va_FoolDestroyContext(
+        VADisplay dpy,
+        VAContextID context
+);
+
+int va_FoolDestroySurfaces(
+        VADisplay dpy,
+        VASurfaceID *surface_list,
+        int num_surfaces
+);
+
+int va_FoolBeginPicture(
+        VADisplay dpy,
+        VAContextID context,
+        VASurfaceID render_target
+);
+
+int va_FoolEndPicture(
+        VADisplay dpy,
+        VAContextID context
+);
+
+int va_FoolSyncSurface(
+        VADisplay dpy,
+        VASurfaceID render_target
+);
+
+int va_FoolQuerySurfaceStatus(
+        VADisplay dpy,
+        VASurfaceID render_target,
+        VASurfaceStatus *status /* out */
+);
+
 
 VAStatus va_FoolCreateBuffer(
     VADisplay dpy,
@@ -68,18 +122,35 @@ VAStatus va_FoolCreateBuffer(
     unsigned int size,		/* in */
     unsigned int num_elements,	/* in */
     void *data,			/* in */
-    VABufferID *buf_id		/* out */
+    VABufferID *buf_id,		/* out */
+    VAStatus *va_status		/* out */
+);
+
+VAStatus va_FoolDestroyBuffer(
+    VADisplay dpy,
+    VABufferID buf_id,  /* in */
+    VAStatus *va_status /* out */
+);
+
+VAStatus va_FoolBufferSetNumElements(
+    VADisplay dpy,
+    VABufferID buf_id,          /* in */
+    unsigned int num_elements,  /* in */
+    VAStatus *va_status         /* out */
 );
 
 VAStatus va_FoolMapBuffer (
     VADisplay dpy,
     VABufferID buf_id,	/* in */
-    void **pbuf 	/* out */
+    unsigned int flags,	/* in */
+    void **pbuf, 	/* out */
+    VAStatus *va_status	/* out */
 );
 
 VAStatus va_FoolUnmapBuffer(
         VADisplay dpy,
-        VABufferID buf_id	/* in */
+        VABufferID buf_id,	/* in */
+        VAStatus *va_status	/* out */
 );
 
 VAStatus va_FoolBufferInfo (
@@ -87,7 +158,16 @@ VAStatus va_FoolBufferInfo (
     VABufferID buf_id,  /* in */
     VABufferType *type, /* out */
     unsigned int *size,         /* out */
-    unsigned int *num_elements /* out */
+    unsigned int *num_elements, /* out */
+    VAStatus *va_status /* out */
+);
+
+int va_FoolRenderPicture(
+    VADisplay dpy,
+    VAContextID context,
+    VABufferID *buffers,
+    int num_buffers,
+    VAStatus *va_status /* out */
 );
     
     
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "va_hash.h"
+
+#include <stdlib.h>
+
+#define VA_HASH_INITIAL_BITS    4
+
+/*
+ * the drivers hand out IDs as a base plus a counter (e.g. 0x02000000 + n),
+ * Fibonacci hashing spreads the consecutive IDs over the buckets
+ */
+static inline unsigned int va_HashIndex(struct va_hash *hash, unsigned int key)
+{
+    return (key * 2654435761u) >> hash->shift;
+}
+
+int va_HashInit(struct va_hash *hash)
+{
+    hash->num_buckets = 1 << VA_HASH_INITIAL_BITS;
+    hash->shift = 32 - VA_HASH_INITIAL_BITS;
+    hash->num_entries = 0;
+    hash->buckets = calloc(hash->num_buckets, sizeof(*hash->buckets));
+
+    return hash->buckets ? 0 : -1;
+}
+
+void va_HashFini(struct va_hash *hash, void (*free_entry)(struct va_hash_entry *entry))
+{
+    struct va_hash_entry *entry, *next;
+    unsigned int i;
+
+    if (hash->buckets == NULL)
+        return;
+
+    for (i = 0; free_entry && i < hash->num_buckets; i++) {
+        for (entry = hash->buckets[i]; entry; entry = next) {
+            next = entry->next;
+            free_entry(entry);
+        }
+    }
+    free(hash->buckets);
+    hash->buckets = NULL;
+    hash->num_buckets = 0;
+    hash->num_entries = 0;
+}
+
+struct va_hash_entry *va_HashLookup(struct va_hash *hash, unsigned int key)
+{
+    struct va_hash_entry *entry;
+
+    if (hash->num_entries == 0)
+        return NULL;
+
+    for (entry = hash->buckets[va_HashIndex(hash, key)]; entry; entry = entry->next) {
+        if (entry->key == key)
+            return entry;
+    }
+    return NULL;
+}
+
+static void va_HashGrow(struct va_hash *hash)
+{
+    struct va_hash_entry **buckets, **old_buckets = hash->buckets;
+    struct va_hash_entry *entry, *next;
+    unsigned int i, index, old_num_buckets = hash->num_buckets;
+
+    /* if it fails, keep the current buckets, the chains only get longer */
+    buckets = calloc(old_num_buckets * 2, sizeof(*buckets));
+    if (buckets == NULL)
+        return;
+
+    hash->buckets = buckets;
+    hash->num_buckets = old_num_buckets * 2;
+    hash->shift--;
+
+    for (i = 0; i < old_num_buckets; i++) {
+        for (entry = old_buckets[i]; entry; entry = next) {
+            next = entry->next;
+            index = va_HashIndex(hash, entry->key);
+            entry->next = buckets[index];
+            buckets[index] = entry;
+        }
+    }
+    free(old_buckets);
+}
+
+void va_HashInsert(struct va_hash *hash, struct va_hash_entry *entry)
+{
+    unsigned int index;
+
+    if (hash->num_entries >= hash->num_buckets)
+        va_HashGrow(hash);
+
+    index = va_HashIndex(hash, entry->key);
+    entry->next = hash->buckets[index];
+    hash->buckets[index] = entry;
+    hash->num_entries++;
+}
+
+struct va_hash_entry *va_HashRemove(struct va_hash *hash, unsigned int key)
+{
+    struct va_hash_entry **prev, *entry;
+
+    if (hash->num_entries == 0)
+        return NULL;
+
+    for (prev = &hash->buckets[va_HashIndex(hash, key)]; (entry = *prev); prev = &entry->next) {
+        if (entry->key == key) {
+            *prev = entry->next;
+            hash->num_entries--;
+            return entry;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VA_HASH_H
+#define VA_HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Objects keyed by a VA ID (VAContextID, VAConfigID...), e.g. the per
+ * context state of trace and fool or the latency statistics. The entry
+ * is embedded in the object, the table doubles its buckets when it holds
+ * more entries than buckets so a lookup stays O(1) whatever the number
+ * of contexts.
+ * There is no locking, the callers serialize the accesses.
+ */
+struct va_hash_entry {
+    struct va_hash_entry *next;
+    unsigned int key;
+};
+
+struct va_hash {
+    struct va_hash_entry **buckets;
+    unsigned int num_buckets;   /* a power of 2 */
+    unsigned int shift;         /* 32 - log2(num_buckets) */
+    unsigned int num_entries;
+};
+
+/* returns 0, or -1 if out of memory */
+int va_HashInit(struct va_hash *hash);
+
+/* free_entry (may be NULL) is called on the entries left in the table */
+void va_HashFini(struct va_hash *hash, void (*free_entry)(struct va_hash_entry *entry));
+
+struct va_hash_entry *va_HashLookup(struct va_hash *hash, unsigned int key);
+
+/* entry->key must be set, and not already be in the table */
+void va_HashInsert(struct va_hash *hash, struct va_hash_entry *entry);
+
+/* returns the removed entry, NULL if key isn't in the table */
+struct va_hash_entry *va_HashRemove(struct va_hash *hash, unsigned int key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VA_HASH_H */
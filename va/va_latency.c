@@ -0,0 +1,650 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+#include "va_latency.h"
+#include "va_trace.h"
+#include "va_hash.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+/*
+ * Env. to profile the VA entry-points:
+ * .LIBVA_PROFILE=stat_file: time every VA call with CLOCK_MONOTONIC and keep
+ *                           a latency histogram per entry-point, for the
+ *                           display and for each context. The statistics of
+ *                           a context are appended to stat_file when it is
+ *                           destroyed, the ones of the display at
+ *                           vaTerminate. They can be read at any time with
+ *                           vaQueryLatencyStats
+ *
+ * The histograms are log-linear (HDR style): each power of two nanoseconds
+ * is split into LATENCY_SUB_BUCKETS linear buckets, so a reported percentile
+ * is within 1/LATENCY_SUB_BUCKETS of the real value at any magnitude.
+ * Recording doesn't take any lock: each thread records into its own shard
+ * of the histograms, found with pthread_getspecific and written only by that
+ * thread. The shards are merged when the statistics are queried or dumped.
+ * The lock is only taken by the merge, and the first time a thread records a
+ * call of the display, of a context or of an entry-point.
+ */
+
+/* VA_LATENCY_FLAG_xxx, the union of the settings of all the displays */
+int latency_flag = 0;
+
+#define LATENCY_SUB_BITS        4
+#define LATENCY_SUB_BUCKETS     (1 << LATENCY_SUB_BITS)
+#define LATENCY_MSB_MAX         39      /* 2^40ns, about 18 minutes */
+#define LATENCY_BUCKETS         ((LATENCY_MSB_MAX - LATENCY_SUB_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+struct latency_hist {
+    uint64_t count;             /* only set by the merge, the sum of the buckets */
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint32_t bucket[LATENCY_BUCKETS];
+};
+
+/* the histogram of an entry-point is allocated on its first call */
+struct latency_set {
+    struct latency_hist *hist[VA_LATENCY_MAX];
+};
+
+struct latency_context {
+    struct va_hash_entry entry; /* key is the VAContextID */
+    int destroyed;              /* left for the owner of the shard to free */
+    struct latency_set set;
+};
+
+/* the statistics recorded by one thread */
+struct latency_shard {
+    struct latency_shard *next;
+    int reclaim;                /* some contexts are destroyed */
+    struct latency_set display;
+    struct va_hash contexts;    /* struct latency_context by VAContextID */
+};
+
+struct va_latency {
+    char *stat_fn;
+    pthread_key_t shard_key;    /* the struct latency_shard of the calling thread */
+    pthread_mutex_t lock;       /* protects shards, and the tables and sets of the shards */
+    struct latency_shard *shards;
+};
+
+#define DPY2LATENCY(dpy)  ((struct va_latency *)(((VADisplayContextP)(dpy))->valatency))
+
+static const char *latency_name[VA_LATENCY_MAX] = {
+    "vaInitialize",
+    "vaTerminate",
+    "vaQueryConfigProfiles",
+    "vaQueryConfigEntrypoints",
+    "vaGetConfigAttributes",
+    "vaCreateConfig",
+    "vaDestroyConfig",
+    "vaQueryConfigAttributes",
+    "vaCreateSurfaces",
+    "vaDestroySurfaces",
+    "vaCreateContext",
+    "vaDestroyContext",
+    "vaCreateBuffer",
+    "vaBufferSetNumElements",
+    "vaMapBuffer",
+    "vaMapBuffer2",
+    "vaUnmapBuffer",
+    "vaDestroyBuffer",
+    "vaBufferInfo",
+    "vaBeginPicture",
+    "vaRenderPicture",
+    "vaEndPicture",
+    "vaSubmitPictures",
+    "vaSyncSurface",
+    "vaQuerySurfaceStatus",
+    "vaQuerySurfaceError",
+    "vaPutSurface",
+    "vaQueryImageFormats",
+    "vaCreateImage",
+    "vaDeriveImage",
+    "vaDestroyImage",
+    "vaSetImagePalette",
+    "vaGetImage",
+    "vaPutImage",
+    "vaQuerySubpictureFormats",
+    "vaCreateSubpicture",
+    "vaDestroySubpicture",
+    "vaSetSubpictureImage",
+    "vaSetSubpictureChromakey",
+    "vaSetSubpictureGlobalAlpha",
+    "vaAssociateSubpicture",
+    "vaDeassociateSubpicture",
+    "vaQueryDisplayAttributes",
+    "vaGetDisplayAttributes",
+    "vaSetDisplayAttributes",
+    "vaLockSurface",
+    "vaUnlockSurface",
+};
+
+/* Prototype declarations (functions defined in va.c) */
+
+void va_errorMessage(const char *msg, ...);
+void va_infoMessage(const char *msg, ...);
+
+int va_parseConfig(char *env, char *env_value);
+
+static void latency_set_free(struct latency_set *set)
+{
+    int i;
+
+    for (i = 0; i < VA_LATENCY_MAX; i++)
+        free(set->hist[i]);
+}
+
+static void latency_context_free(struct va_hash_entry *entry)
+{
+    struct latency_context *lctx = (struct latency_context *)entry;
+
+    latency_set_free(&lctx->set);
+    free(lctx);
+}
+
+void va_LatencyInit(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_latency *latency;
+    char env_value[1024];
+
+    if (va_parseConfig("LIBVA_PROFILE", &env_value[0]) != 0)
+        return;
+
+    latency = calloc(1, sizeof(struct va_latency));
+    if (latency == NULL || pthread_key_create(&latency->shard_key, NULL) != 0) {
+        va_errorMessage("LIBVA_PROFILE: failed to allocate the statistics\n");
+        free(latency);
+        return;
+    }
+
+    pthread_mutex_init(&latency->lock, NULL);
+    latency->stat_fn = strdup(env_value);
+
+    va_infoMessage("LIBVA_PROFILE is on, save latency statistics into %s\n", env_value);
+
+    pDisplayContext->valatency = latency;
+    va_atomic_or(&latency_flag, VA_LATENCY_FLAG_STATS);
+}
+
+uint64_t va_LatencyTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    /* never 0, which means "not timed" for VA_LATENCY_RECORD */
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec + 1;
+}
+
+static inline int latency_bucket(uint64_t ns)
+{
+    int msb;
+
+    if (ns < LATENCY_SUB_BUCKETS)
+        return (int)ns;
+
+    msb = 63 - __builtin_clzll(ns);
+    if (msb > LATENCY_MSB_MAX)
+        return LATENCY_BUCKETS - 1;
+
+    return (msb - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS +
+        (int)((ns >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+/* the middle of the range covered by a bucket */
+static uint64_t latency_bucket_value(int bucket)
+{
+    int group = bucket / LATENCY_SUB_BUCKETS;
+    int sub = bucket % LATENCY_SUB_BUCKETS;
+    uint64_t lower;
+
+    if (group == 0)
+        return sub;
+
+    lower = (uint64_t)(LATENCY_SUB_BUCKETS + sub) << (group - 1);
+
+    return lower + ((1ULL << (group - 1)) >> 1);
+}
+
+/*
+ * only the thread owning the shard writes the histogram, the atomic stores
+ * keep the merge running meanwhile from reading torn values
+ */
+static void latency_hist_add(struct latency_hist *hist, uint64_t ns)
+{
+    int i = latency_bucket(ns);
+
+    va_atomic_store(&hist->bucket[i], hist->bucket[i] + 1);
+    va_atomic_store(&hist->total_ns, hist->total_ns + ns);
+    if (ns < hist->min_ns)
+        va_atomic_store(&hist->min_ns, ns);
+    if (ns > hist->max_ns)
+        va_atomic_store(&hist->max_ns, ns);
+}
+
+/* the histogram of func in a set of the calling thread */
+static struct latency_hist *latency_hist_get(struct va_latency *latency, struct latency_set *set, int func)
+{
+    struct latency_hist *hist = set->hist[func];
+
+    if (hist)
+        return hist;
+
+    hist = calloc(1, sizeof(struct latency_hist));
+    if (hist == NULL) {
+        va_errorMessage("LIBVA_PROFILE: failed to allocate the statistics of %s\n", latency_name[func]);
+        return NULL;
+    }
+    hist->min_ns = UINT64_MAX;
+
+    pthread_mutex_lock(&latency->lock);
+    set->hist[func] = hist;
+    pthread_mutex_unlock(&latency->lock);
+
+    return hist;
+}
+
+/* the shard of the calling thread, created on its first call */
+static struct latency_shard *latency_shard_get(struct va_latency *latency)
+{
+    struct latency_shard *shard = pthread_getspecific(latency->shard_key);
+
+    if (shard)
+        return shard;
+
+    shard = calloc(1, sizeof(struct latency_shard));
+    if (shard == NULL || va_HashInit(&shard->contexts) != 0) {
+        va_errorMessage("LIBVA_PROFILE: failed to allocate the statistics of the thread\n");
+        free(shard);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&latency->lock);
+    shard->next = latency->shards;
+    latency->shards = shard;
+    pthread_mutex_unlock(&latency->lock);
+
+    pthread_setspecific(latency->shard_key, shard);
+
+    return shard;
+}
+
+/* free the contexts destroyed by other threads, called by the owner of the shard */
+static void latency_shard_reclaim(struct va_latency *latency, struct latency_shard *shard)
+{
+    struct va_hash_entry *entry, *next;
+    unsigned int i;
+
+    pthread_mutex_lock(&latency->lock);
+    va_atomic_store(&shard->reclaim, 0);
+    for (i = 0; i < shard->contexts.num_buckets; i++) {
+        for (entry = shard->contexts.buckets[i]; entry; entry = next) {
+            next = entry->next;
+            if (((struct latency_context *)entry)->destroyed) {
+                va_HashRemove(&shard->contexts, entry->key);
+                latency_context_free(entry);
+            }
+        }
+    }
+    pthread_mutex_unlock(&latency->lock);
+}
+
+/* the statistics of a context in the shard of the calling thread */
+static struct latency_context *latency_context_get(
+    struct va_latency *latency,
+    struct latency_shard *shard,
+    VAContextID context
+)
+{
+    struct latency_context *lctx;
+
+    lctx = (struct latency_context *)va_HashLookup(&shard->contexts, context);
+    if (lctx)
+        return lctx;
+
+    lctx = calloc(1, sizeof(struct latency_context));
+    if (lctx == NULL) {
+        va_errorMessage("LIBVA_PROFILE: failed to allocate the statistics of context 0x%08x\n",
+                        context);
+        return NULL;
+    }
+    lctx->entry.key = context;
+
+    pthread_mutex_lock(&latency->lock);
+    va_HashInsert(&shard->contexts, &lctx->entry);
+    pthread_mutex_unlock(&latency->lock);
+
+    return lctx;
+}
+
+void va_LatencyRecord(
+    VADisplay dpy,
+    VAContextID context,
+    int func,
+    uint64_t start
+)
+{
+    struct va_latency *latency = DPY2LATENCY(dpy);
+    struct latency_shard *shard;
+    struct latency_context *lctx;
+    struct latency_hist *hist;
+    uint64_t end = va_LatencyTime();
+    uint64_t ns = end - start;
+
+    if (va_atomic_load(&latency_flag) & VA_LATENCY_FLAG_TIMELINE)
+        va_TraceTimelineCall(dpy, context, latency_name[func], start, end);
+
+    if (latency == NULL)
+        return;
+
+    shard = latency_shard_get(latency);
+    if (shard == NULL)
+        return;
+
+    if (va_atomic_load(&shard->reclaim))
+        latency_shard_reclaim(latency, shard);
+
+    hist = latency_hist_get(latency, &shard->display, func);
+    if (hist)
+        latency_hist_add(hist, ns);
+
+    if (context == VA_INVALID_ID)
+        return;
+
+    lctx = latency_context_get(latency, shard, context);
+    if (lctx == NULL)
+        return;
+
+    hist = latency_hist_get(latency, &lctx->set, func);
+    if (hist)
+        latency_hist_add(hist, ns);
+}
+
+static uint64_t latency_percentile(struct latency_hist *hist, uint64_t count, int percent)
+{
+    uint64_t target = (count * percent + 99) / 100;
+    uint64_t sum = 0;
+    uint64_t value;
+    int i;
+
+    if (target == 0)
+        target = 1;
+
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        sum += hist->bucket[i];
+        if (sum >= target)
+            break;
+    }
+
+    value = latency_bucket_value(i < LATENCY_BUCKETS ? i : LATENCY_BUCKETS - 1);
+    if (value < hist->min_ns)
+        value = hist->min_ns;
+    if (value > hist->max_ns)
+        value = hist->max_ns;
+
+    return value;
+}
+
+static void latency_stats(struct latency_hist *hist, int func, VALatencyStats *stats)
+{
+    uint64_t count = hist->count;
+
+    stats->function = latency_name[func];
+    stats->count = count;
+    stats->total_ns = hist->total_ns;
+    stats->min_ns = hist->min_ns;
+    stats->max_ns = hist->max_ns;
+    stats->p50_ns = latency_percentile(hist, count, 50);
+    stats->p90_ns = latency_percentile(hist, count, 90);
+    stats->p99_ns = latency_percentile(hist, count, 99);
+}
+
+static void latency_hist_merge(struct latency_hist *sum, struct latency_hist *hist)
+{
+    uint64_t min_ns = va_atomic_load(&hist->min_ns);
+    uint64_t max_ns = va_atomic_load(&hist->max_ns);
+    int i;
+
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        uint32_t count = va_atomic_load(&hist->bucket[i]);
+
+        sum->bucket[i] += count;
+        sum->count += count;
+    }
+    sum->total_ns += va_atomic_load(&hist->total_ns);
+    if (min_ns < sum->min_ns)
+        sum->min_ns = min_ns;
+    if (max_ns > sum->max_ns)
+        sum->max_ns = max_ns;
+}
+
+/*
+ * sum the histograms of func recorded by all the threads, for the display
+ * or for a context, with latency->lock held; returns the number of calls
+ */
+static uint64_t latency_merge(
+    struct va_latency *latency,
+    VAContextID context,
+    int func,
+    struct latency_hist *sum
+)
+{
+    struct latency_shard *shard;
+    struct latency_context *lctx;
+    struct latency_set *set;
+
+    memset(sum, 0, sizeof(*sum));
+    sum->min_ns = UINT64_MAX;
+
+    for (shard = latency->shards; shard; shard = shard->next) {
+        if (context == VA_INVALID_ID)
+            set = &shard->display;
+        else {
+            lctx = (struct latency_context *)va_HashLookup(&shard->contexts, context);
+            if (lctx == NULL || lctx->destroyed)
+                continue;
+            set = &lctx->set;
+        }
+        if (set->hist[func])
+            latency_hist_merge(sum, set->hist[func]);
+    }
+
+    return sum->count;
+}
+
+VAStatus va_LatencyQuery(
+    VADisplay dpy,
+    VAContextID context,
+    VALatencyStats *stats_list,	/* out */
+    int *num_stats		/* in/out */
+)
+{
+    struct va_latency *latency = DPY2LATENCY(dpy);
+    struct latency_hist sum;
+    int i, num = 0;
+
+    if (latency == NULL) {
+        *num_stats = 0;
+        return VA_STATUS_ERROR_UNIMPLEMENTED;
+    }
+
+    pthread_mutex_lock(&latency->lock);
+    for (i = 0; i < VA_LATENCY_MAX && num < *num_stats; i++) {
+        if (latency_merge(latency, context, i, &sum) == 0)
+            continue;
+        latency_stats(&sum, i, &stats_list[num]);
+        num++;
+    }
+    pthread_mutex_unlock(&latency->lock);
+
+    *num_stats = num;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* with latency->lock held */
+static void latency_dump_set(FILE *fp, struct va_latency *latency, VAContextID context)
+{
+    struct latency_hist sum;
+    VALatencyStats stats;
+    int i;
+
+    fprintf(fp, "%-28s %10s %10s %10s %10s %10s %10s %10s\n",
+            "function", "count", "avg(us)", "min(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    for (i = 0; i < VA_LATENCY_MAX; i++) {
+        if (latency_merge(latency, context, i, &sum) == 0)
+            continue;
+        latency_stats(&sum, i, &stats);
+        fprintf(fp, "%-28s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                stats.function, stats.count,
+                stats.total_ns / 1000.0 / stats.count,
+                stats.min_ns / 1000.0, stats.p50_ns / 1000.0,
+                stats.p90_ns / 1000.0, stats.p99_ns / 1000.0,
+                stats.max_ns / 1000.0);
+    }
+}
+
+static void latency_dump_context(FILE *fp, struct va_latency *latency, VAContextID context)
+{
+    fprintf(fp, "==========latency of context 0x%08x\n", context);
+    latency_dump_set(fp, latency, context);
+}
+
+/*
+ * drop the statistics of a context from all the shards, with latency->lock
+ * held: the entry of the shard of the calling thread is freed, the other
+ * ones are left for their owner which may still be reading them
+ */
+static void latency_context_drop(struct va_latency *latency, struct latency_shard *self, VAContextID context)
+{
+    struct latency_shard *shard;
+    struct latency_context *lctx;
+
+    for (shard = latency->shards; shard; shard = shard->next) {
+        lctx = (struct latency_context *)va_HashLookup(&shard->contexts, context);
+        if (lctx == NULL)
+            continue;
+        if (shard == self) {
+            va_HashRemove(&shard->contexts, context);
+            latency_context_free(&lctx->entry);
+        } else {
+            lctx->destroyed = 1;
+            va_atomic_store(&shard->reclaim, 1);
+        }
+    }
+}
+
+/* append the statistics of the context to stat_file and drop them */
+void va_LatencyDestroyContext(VADisplay dpy, VAContextID context)
+{
+    struct va_latency *latency = DPY2LATENCY(dpy);
+    struct latency_shard *shard;
+    struct latency_context *lctx;
+    FILE *fp;
+
+    if (latency == NULL)
+        return;
+
+    pthread_mutex_lock(&latency->lock);
+
+    for (shard = latency->shards; shard; shard = shard->next) {
+        lctx = (struct latency_context *)va_HashLookup(&shard->contexts, context);
+        if (lctx && !lctx->destroyed)
+            break;
+    }
+
+    if (shard) {
+        fp = fopen(latency->stat_fn, "a");
+        if (fp) {
+            latency_dump_context(fp, latency, context);
+            fclose(fp);
+        } else
+            va_errorMessage("Open file %s failed (%s)\n", latency->stat_fn, strerror(errno));
+
+        latency_context_drop(latency, pthread_getspecific(latency->shard_key), context);
+    }
+
+    pthread_mutex_unlock(&latency->lock);
+}
+
+void va_LatencyEnd(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_latency *latency = DPY2LATENCY(dpy);
+    struct latency_shard *shard, *next;
+    struct va_hash_entry *entry;
+    unsigned int i;
+    FILE *fp;
+
+    if (latency == NULL)
+        return;
+
+    pthread_mutex_lock(&latency->lock);
+
+    fp = fopen(latency->stat_fn, "a");
+    if (fp) {
+        fprintf(fp, "==========latency of display %p\n", dpy);
+        latency_dump_set(fp, latency, VA_INVALID_ID);
+        /* the contexts the application didn't destroy, once for all the shards */
+        for (shard = latency->shards; shard; shard = shard->next) {
+            for (i = 0; i < shard->contexts.num_buckets; i++) {
+                for (entry = shard->contexts.buckets[i]; entry; entry = entry->next) {
+                    if (((struct latency_context *)entry)->destroyed)
+                        continue;
+                    latency_dump_context(fp, latency, entry->key);
+                    latency_context_drop(latency, NULL, entry->key);
+                }
+            }
+        }
+        fclose(fp);
+    } else
+        va_errorMessage("Open file %s failed (%s)\n", latency->stat_fn, strerror(errno));
+
+    pthread_mutex_unlock(&latency->lock);
+
+    for (shard = latency->shards; shard; shard = next) {
+        next = shard->next;
+        va_HashFini(&shard->contexts, latency_context_free);
+        latency_set_free(&shard->display);
+        free(shard);
+    }
+    pthread_key_delete(latency->shard_key);
+    pthread_mutex_destroy(&latency->lock);
+    free(latency->stat_fn);
+    free(latency);
+
+    pDisplayContext->valatency = NULL;
+}
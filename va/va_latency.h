@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VA_LATENCY_H
+#define VA_LATENCY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int latency_flag;
+
+#define VA_LATENCY_FLAG_STATS       0x1 /* LIBVA_PROFILE */
+#define VA_LATENCY_FLAG_TIMELINE    0x2 /* LIBVA_TRACE_TIMELINE */
+
+/* one histogram per timed entry-point */
+enum {
+    VA_LATENCY_Initialize = 0,
+    VA_LATENCY_Terminate,
+    VA_LATENCY_QueryConfigProfiles,
+    VA_LATENCY_QueryConfigEntrypoints,
+    VA_LATENCY_GetConfigAttributes,
+    VA_LATENCY_CreateConfig,
+    VA_LATENCY_DestroyConfig,
+    VA_LATENCY_QueryConfigAttributes,
+    VA_LATENCY_CreateSurfaces,
+    VA_LATENCY_DestroySurfaces,
+    VA_LATENCY_CreateContext,
+    VA_LATENCY_DestroyContext,
+    VA_LATENCY_CreateBuffer,
+    VA_LATENCY_BufferSetNumElements,
+    VA_LATENCY_MapBuffer,
+    VA_LATENCY_MapBuffer2,
+    VA_LATENCY_UnmapBuffer,
+    VA_LATENCY_DestroyBuffer,
+    VA_LATENCY_BufferInfo,
+    VA_LATENCY_BeginPicture,
+    VA_LATENCY_RenderPicture,
+    VA_LATENCY_EndPicture,
+    VA_LATENCY_SubmitPictures,
+    VA_LATENCY_SyncSurface,
+    VA_LATENCY_QuerySurfaceStatus,
+    VA_LATENCY_QuerySurfaceError,
+    VA_LATENCY_PutSurface,
+    VA_LATENCY_QueryImageFormats,
+    VA_LATENCY_CreateImage,
+    VA_LATENCY_DeriveImage,
+    VA_LATENCY_DestroyImage,
+    VA_LATENCY_SetImagePalette,
+    VA_LATENCY_GetImage,
+    VA_LATENCY_PutImage,
+    VA_LATENCY_QuerySubpictureFormats,
+    VA_LATENCY_CreateSubpicture,
+    VA_LATENCY_DestroySubpicture,
+    VA_LATENCY_SetSubpictureImage,
+    VA_LATENCY_SetSubpictureChromakey,
+    VA_LATENCY_SetSubpictureGlobalAlpha,
+    VA_LATENCY_AssociateSubpicture,
+    VA_LATENCY_DeassociateSubpicture,
+    VA_LATENCY_QueryDisplayAttributes,
+    VA_LATENCY_GetDisplayAttributes,
+    VA_LATENCY_SetDisplayAttributes,
+    VA_LATENCY_LockSurface,
+    VA_LATENCY_UnlockSurface,
+    VA_LATENCY_MAX
+};
+
+/*
+ * VA_LATENCY_START() must be the last declaration of the entry-point, the
+ * timestamp is only taken when LIBVA_PROFILE or LIBVA_TRACE_TIMELINE is on.
+ * VA_LATENCY_RECORD() accounts the time spent since VA_LATENCY_START() to
+ * the display and, if context is not VA_INVALID_ID, to that context, and
+ * saves the call into the trace timeline.
+ */
+#define VA_LATENCY_START()                                              \
+    uint64_t va_latency_start = va_atomic_load(&latency_flag) ? va_LatencyTime() : 0
+#define VA_LATENCY_RECORD(dpy, context, func)                           \
+    if (va_latency_start) {                                             \
+        va_LatencyRecord(dpy, context, VA_LATENCY_##func, va_latency_start); \
+    }
+
+void va_LatencyInit(VADisplay dpy);
+void va_LatencyEnd(VADisplay dpy);
+
+void va_LatencyDestroyContext(VADisplay dpy, VAContextID context);
+
+uint64_t va_LatencyTime(void);
+
+void va_LatencyRecord(
+    VADisplay dpy,
+    VAContextID context,
+    int func,
+    uint64_t start
+);
+
+VAStatus va_LatencyQuery(
+    VADisplay dpy,
+    VAContextID context,
+    VALatencyStats *stats_list,	/* out */
+    int *num_stats		/* in/out */
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VA_LATENCY_H */
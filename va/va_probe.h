@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * SystemTap SDT (USDT) probes of the provider "libva", for stap, bpftrace,
+ * perf probe... A probe is a nop until a tool attaches to it, and isn't
+ * built without <sys/sdt.h>. e.g. with bpftrace:
+ *
+ *   usdt:/usr/lib/libva.so:libva:SyncSurface_entry { @t[tid] = nsecs; }
+ *   usdt:/usr/lib/libva.so:libva:SyncSurface_return { @ns = hist(nsecs - @t[tid]); }
+ *
+ * va.c has, with the display first:
+ *  <entry-point>_entry   the arguments, IDs and sizes
+ *  <entry-point>_return  the VAStatus and the created IDs, on every exit of
+ *                        a call which had the _entry probe
+ *  driver_entry          the entry-point name, before the call into the driver
+ *  driver_return         the entry-point name and the VAStatus of the driver
+ *  open_driver_entry     the driver name
+ *  open_driver_try       each driver path tried
+ *  open_driver_return    the VAStatus
+ */
+
+#ifndef VA_PROBE_H
+#define VA_PROBE_H
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define VA_PROBE_NARGS(...)     VA_PROBE_NARGS_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define VA_PROBE_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define VA_PROBE_CAT(a, b)      VA_PROBE_CAT_(a, b)
+#define VA_PROBE_CAT_(a, b)     a##b
+
+/* 1 to 8 arguments, integers or pointers */
+#define VA_PROBE(name, ...)                                             \
+    VA_PROBE_CAT(STAP_PROBE, VA_PROBE_NARGS(__VA_ARGS__))(libva, name, __VA_ARGS__)
+#else
+#define VA_PROBE(name, ...)
+#endif
+
+#endif /* VA_PROBE_H */
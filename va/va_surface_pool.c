@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * The released surfaces are kept in a FIFO, so that acquire hands out the
+ * surface which was submitted the longest time ago, the one most likely
+ * to be idle already. The pool lock only protects the FIFO and the list
+ * of the surfaces: creating a surface (vaCreateSurfaces) and waiting for
+ * the driver (vaSyncSurface/vaQuerySurfaceStatus) are done without it, so
+ * threads only contend for a few instructions.
+ */
+struct _VASurfacePool {
+    VADisplay dpy;
+    int width;
+    int height;
+    int format;
+    int max_surfaces;
+
+    pthread_mutex_t lock;
+    pthread_cond_t released; /* signaled when a surface goes back to the FIFO */
+
+    int num_surfaces;           /* surfaces created so far */
+    int num_pending;            /* surfaces being created, without the lock */
+    VASurfaceID *surfaces;      /* all of them, max_surfaces entries */
+
+    VASurfaceID *free_list;     /* FIFO of released surfaces, max_surfaces entries */
+    int free_head;
+    int free_count;
+};
+
+#define CHECK_DISPLAY(dpy) if( !vaDisplayIsValid(dpy) ) { return VA_STATUS_ERROR_INVALID_DISPLAY; }
+
+/* the surface isn't read or written by the hardware any more */
+#define SURFACE_IDLE(status) (((status) & (VASurfaceRendering | VASurfaceDisplaying)) == 0)
+
+static void pool_push_tail(VASurfacePool pool, VASurfaceID surface)
+{
+    int i = (pool->free_head + pool->free_count) % pool->max_surfaces;
+
+    pool->free_list[i] = surface;
+    pool->free_count++;
+}
+
+static void pool_push_head(VASurfacePool pool, VASurfaceID surface)
+{
+    pool->free_head = (pool->free_head + pool->max_surfaces - 1) % pool->max_surfaces;
+    pool->free_list[pool->free_head] = surface;
+    pool->free_count++;
+}
+
+static VASurfaceID pool_pop_head(VASurfacePool pool)
+{
+    VASurfaceID surface = pool->free_list[pool->free_head];
+
+    pool->free_head = (pool->free_head + 1) % pool->max_surfaces;
+    pool->free_count--;
+
+    return surface;
+}
+
+static int pool_can_grow(VASurfacePool pool)
+{
+    return pool->num_surfaces + pool->num_pending < pool->max_surfaces;
+}
+
+/*
+ * create one more surface: its slot is reserved with the lock held, the
+ * surface is created without it, then added to the list. Must be called
+ * with the lock held, returns with the lock released
+ */
+static VAStatus pool_grow(VASurfacePool pool, VASurfaceID *surface)
+{
+    VAStatus va_status;
+
+    pool->num_pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    va_status = vaCreateSurfaces(pool->dpy, pool->width, pool->height, pool->format, 1, surface);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->num_pending--;
+    if (va_status == VA_STATUS_SUCCESS)
+        pool->surfaces[pool->num_surfaces++] = *surface;
+    else
+        pthread_cond_signal(&pool->released); /* a waiting thread can have the slot */
+    pthread_mutex_unlock(&pool->lock);
+
+    return va_status;
+}
+
+VAStatus vaCreateSurfacePool (
+    VADisplay dpy,
+    int width,
+    int height,
+    int format,
+    int min_surfaces,
+    int max_surfaces,
+    VASurfacePool *pool		/* out */
+)
+{
+    VASurfacePool new_pool;
+    VAStatus va_status;
+    int i;
+
+    CHECK_DISPLAY(dpy);
+
+    if (min_surfaces < 0 || max_surfaces <= 0 || min_surfaces > max_surfaces || pool == NULL)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    new_pool = calloc(1, sizeof(*new_pool));
+    if (new_pool == NULL)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    new_pool->surfaces = calloc(max_surfaces, sizeof(VASurfaceID));
+    new_pool->free_list = calloc(max_surfaces, sizeof(VASurfaceID));
+    if (new_pool->surfaces == NULL || new_pool->free_list == NULL) {
+        free(new_pool->surfaces);
+        free(new_pool->free_list);
+        free(new_pool);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    new_pool->dpy = dpy;
+    new_pool->width = width;
+    new_pool->height = height;
+    new_pool->format = format;
+    new_pool->max_surfaces = max_surfaces;
+    pthread_mutex_init(&new_pool->lock, NULL);
+    pthread_cond_init(&new_pool->released, NULL);
+
+    if (min_surfaces > 0) {
+        va_status = vaCreateSurfaces(dpy, width, height, format, min_surfaces, new_pool->surfaces);
+        if (va_status != VA_STATUS_SUCCESS) {
+            vaDestroySurfacePool(dpy, new_pool);
+            return va_status;
+        }
+        new_pool->num_surfaces = min_surfaces;
+        for (i = 0; i < min_surfaces; i++)
+            pool_push_tail(new_pool, new_pool->surfaces[i]);
+    }
+
+    *pool = new_pool;
+
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaDestroySurfacePool (
+    VADisplay dpy,
+    VASurfacePool pool
+)
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    CHECK_DISPLAY(dpy);
+
+    if (pool == NULL)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    if (pool->num_surfaces > 0)
+        va_status = vaDestroySurfaces(dpy, pool->surfaces, pool->num_surfaces);
+
+    pthread_cond_destroy(&pool->released);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->free_list);
+    free(pool->surfaces);
+    free(pool);
+
+    return va_status;
+}
+
+VAStatus vaQuerySurfacePool (
+    VADisplay dpy,
+    VASurfacePool pool,
+    VASurfaceID *surfaces,	/* out */
+    int *num_surfaces		/* out */
+)
+{
+    CHECK_DISPLAY(dpy);
+
+    if (pool == NULL || num_surfaces == NULL)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&pool->lock);
+    if (surfaces)
+        memcpy(surfaces, pool->surfaces, pool->num_surfaces * sizeof(VASurfaceID));
+    *num_surfaces = pool->num_surfaces;
+    pthread_mutex_unlock(&pool->lock);
+
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaAcquireSurfaceFromPool (
+    VADisplay dpy,
+    VASurfacePool pool,
+    unsigned int flags,
+    VASurfaceID *surface	/* out */
+)
+{
+    VASurfaceStatus status;
+    VASurfaceID candidate;
+    VAStatus va_status;
+
+    CHECK_DISPLAY(dpy);
+
+    if (pool == NULL || surface == NULL)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->free_count == 0) {
+        if (pool_can_grow(pool))
+            return pool_grow(pool, surface);
+
+        if (flags & VA_SURFACE_POOL_NO_WAIT) {
+            pthread_mutex_unlock(&pool->lock);
+            return VA_STATUS_ERROR_SURFACE_BUSY;
+        }
+
+        pthread_cond_wait(&pool->released, &pool->lock);
+    }
+    candidate = pool_pop_head(pool);
+    pthread_mutex_unlock(&pool->lock);
+
+    status = 0;
+    va_status = vaQuerySurfaceStatus(dpy, candidate, &status);
+    if (va_status == VA_STATUS_SUCCESS && SURFACE_IDLE(status)) {
+        *surface = candidate;
+        return VA_STATUS_SUCCESS;
+    }
+
+    /*
+     * The oldest surface is still busy, so are the more recent ones:
+     * rather create a new one than wait, if allowed
+     */
+    pthread_mutex_lock(&pool->lock);
+    if (pool_can_grow(pool) || (flags & VA_SURFACE_POOL_NO_WAIT)) {
+        pool_push_head(pool, candidate);
+        pthread_cond_signal(&pool->released);
+        if (pool_can_grow(pool))
+            return pool_grow(pool, surface);
+        pthread_mutex_unlock(&pool->lock);
+        return VA_STATUS_ERROR_SURFACE_BUSY;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    /* let the driver wait for the completion of the pending work */
+    va_status = vaSyncSurface(dpy, candidate);
+    if (va_status != VA_STATUS_SUCCESS) {
+        vaReleaseSurfaceToPool(dpy, pool, candidate);
+        return va_status;
+    }
+    *surface = candidate;
+
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaReleaseSurfaceToPool (
+    VADisplay dpy,
+    VASurfacePool pool,
+    VASurfaceID surface
+)
+{
+    int i;
+
+    CHECK_DISPLAY(dpy);
+
+    if (pool == NULL)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (i = 0; i < pool->num_surfaces; i++)
+        if (pool->surfaces[i] == surface)
+            break;
+    if (i == pool->num_surfaces) {
+        pthread_mutex_unlock(&pool->lock);
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+
+    /* released twice */
+    for (i = 0; i < pool->free_count; i++)
+        if (pool->free_list[(pool->free_head + i) % pool->max_surfaces] == surface)
+            break;
+    if (i < pool->free_count) {
+        pthread_mutex_unlock(&pool->lock);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    pool_push_tail(pool, surface);
+    pthread_cond_signal(&pool->released);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return VA_STATUS_SUCCESS;
+}
@@ -23,9 +23,14 @@
  */
 
 #define _GNU_SOURCE 1
+#include "sysdeps.h"
 #include "va.h"
 #include "va_backend.h"
 #include "va_trace.h"
+#include "va_latency.h"
+#include "va_hash.h"
+#include "va_crc.h"
+#include "va_trace_format.h"
 
 #include <assert.h>
 #include <stdarg.h>
@@ -39,70 +44,327 @@
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
 
 /*
  * Env. to debug some issue, e.g. the decode/encode issue in a video conference scenerio:
  * .LIBVA_TRACE=log_file: general VA parameters saved into log_file
- * .LIBVA_TRACE_BUFDATA: dump VA buffer data into log_file (if not set, just calculate a checksum)
+ * .LIBVA_TRACE_BUFDATA: dump VA buffer data into log_file (if not set, just calculate a CRC-32C)
  * .LIBVA_TRACE_CODEDBUF=coded_clip_file: save the coded clip into file coded_clip_file
  * .LIBVA_TRACE_SURFACE=yuv_file: save surface YUV into file yuv_file. Use file name to determine
- *                                decode/encode or jpeg surfaces
- * .LIBVA_TRACE_LOGSIZE=numeric number: truncate the log_file or coded_clip_file, or decoded_yuv_file
- *                                      when the size is bigger than the number
+ *                                decode/encode or jpeg surfaces. The planes are saved without
+ *                                their padding: NV12, I420 and YV12 as such, YUY2/UYVY/RGBA/BGRA/AYUV
+ *                                packed, only the luma of the other formats
+ * .LIBVA_TRACE_SURFACE_LZ4: compress each surface of yuv_file into a LZ4 frame, "lz4 -d"
+ *                          decompresses the file (if libva is built with LZ4)
+ * .LIBVA_TRACE_LOGSIZE=numeric number: rotate the log_file or coded_clip_file, or decoded_yuv_file
+ *                                      when the size is bigger than the number: file goes to
+ *                                      file.1, file.1 to file.2... The log_file rotates at the
+ *                                      start of a frame, coded_clip_file at a new sequence and
+ *                                      decoded_yuv_file between two surfaces
+ * .LIBVA_TRACE_LOGFILES=numeric number: rotated files kept, 1 if not set, 0 doesn't rotate
+ *                                      the files
+ * .LIBVA_TRACE_LOGCOMPRESS: gzip the rotated files in the background, into file.1.gz...
+ * .LIBVA_TRACE_FRAMEHASH=hash_file: save a line per decoded frame into hash_file, the frame
+ *                                  number, the size and the CRC-32C of each plane
+ * .LIBVA_TRACE_FRAMEHASH_GOLDEN=hash_file: compare the lines of the decoded frames with
+ *                                  a hash_file of a good run, in the order the frames are
+ *                                  decoded, and report the first frame which differs
+ * .LIBVA_TRACE_BINARY: save compact binary records into log_file instead of text, log_file is
+ *                      a ring of LIBVA_TRACE_LOGSIZE bytes (16M if not set) mapped in memory,
+ *                      the oldest records are overwritten. Use va_trace_decode to get the text
+ * .LIBVA_TRACE_CAPTURE: save binary records into log_file as LIBVA_TRACE_BINARY, but keep all
+ *                       of them with the whole content of the buffers. test/replay/va_replay
+ *                       submits the captured decode again to a driver
+ * .LIBVA_TRACE_ASYNC=block|drop|sample: write the log, surface and coded buffer files from a
+ *                                      thread, the entry-points only queue the data. When the
+ *                                      queue is full, wait for room (block) or drop the data (drop),
+ *                                      sample also keeps one surface/codedbuf of 8 once it is half full.
+ *                                      A write bigger than half the queue grows it (block) or is dropped
+ * .LIBVA_TRACE_ASYNC_SIZE=numeric number: size of the queue in bytes, 32M if not set
+ * .LIBVA_TRACE_FRAME_INTERVAL=numeric number N: only trace one frame of N of each context
+ * .LIBVA_TRACE_FRAME_RANGE=first-last: only trace the frames first to last of each context,
+ *                                     "first-" traces up to the end
+ * .LIBVA_TRACE_TRIGGER=signal:number|file:file_name: only trace in time windows, a window
+ *                                     opens when the process gets the signal (e.g. signal:12
+ *                                     for SIGUSR2) or when the file is touched
+ * .LIBVA_TRACE_WINDOW=numeric number: length of the windows of LIBVA_TRACE_TRIGGER in seconds,
+ *                                     10 if not set. 0 makes each trigger switch tracing on/off
+ * The frames left out by the three settings above only cost a check of the frame counter,
+ * vaSyncSurface/vaQuerySurfaceXXX/vaPutSurface/vaMapBuffer follow the last picture started
+ * on the display
+ * .LIBVA_TRACE_TIMELINE=json_file: save the calls into json_file in the Chrome trace event
+ *                                 format (chrome://tracing, Perfetto), one slice per call,
+ *                                 flow arrows from the vaEndPicture of a surface to its
+ *                                 vaSyncSurface and vaPutSurface, and the frames in flight of
+ *                                 each context. The timeline isn't sampled
  */
 
 /* global settings */
 
-/* LIBVA_TRACE */
+/* LIBVA_TRACE, the union of the flags of all the displays */
 int trace_flag = 0;
 
+/* displays traced so far, to name the files */
+static int trace_display_count = 0;
+
+/* LIBVA_TRACE_TRIGGER=signal:xxx, signals received so far */
+static int trace_signal_count[NSIG];
+/* the displays using the handler of each signal, and the handler it replaced */
+static pthread_mutex_t trace_signal_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_signal_users[NSIG];
+static struct sigaction trace_signal_old_action[NSIG];
+
+#define TRACE_WINDOW_DEFAULT    10 /* seconds */
+#define TRACE_TRIGGER_POLL      1000000000ULL /* stat() the trigger file every second */
+#define TRACE_WINDOW_ALWAYS     UINT64_MAX /* trace_window_end when switched on */
+
+/* trace_context.trace_sampling */
+#define TRACE_SAMPLE_INTERVAL   0x1
+#define TRACE_SAMPLE_RANGE      0x2
+#define TRACE_SAMPLE_TRIGGER    0x4
+
+#define TRACE_RING_DEFAULT_SIZE (16 << 20)
+#define TRACE_RING_MIN_SIZE     (64 << 10)
+
+/* LIBVA_TRACE_TIMELINE, events longer than this are dropped */
+#define TRACE_TIMELINE_EVENT_SIZE 512
+
+/* LIBVA_TRACE_ASYNC */
+#define TRACE_QUEUE_DEFAULT_SIZE (32 << 20)
+#define TRACE_QUEUE_MIN_SIZE    (1 << 20)
+#define TRACE_QUEUE_ALIGN(x)    (((x) + 15) & ~(uint64_t)15)
+#define TRACE_QUEUE_SAMPLE      8 /* sample policy keeps 1 bulky write of 8 */
+
+enum {
+    TRACE_QUEUE_BLOCK = 0,
+    TRACE_QUEUE_DROP,
+    TRACE_QUEUE_SAMPLE_BULKY,
+};
+
+/* trace_queue_entry.flags */
+#define TRACE_WRITE_ROTATE      0x1 /* rotate fp, the data is its file name */
+#define TRACE_WRITE_BULKY       0x2 /* surface or coded buffer, subject to sampling */
+
 /* LIBVA_TRACE_LOGSIZE */
-static unsigned int trace_logsize = 0xffffffff; /* truncate the log when the size is bigger than it */
+struct trace_rotate {
+    unsigned int files;         /* LIBVA_TRACE_LOGFILES, rotated files kept */
+    int compress;               /* LIBVA_TRACE_LOGCOMPRESS */
+    pid_t compress_pid;         /* gzip of the last rotated file */
+};
 
-#define TRACE_CONTEXT_MAX 4
-/* per context settings */
-static struct _trace_context {
-    VADisplay dpy; /* should use context as the key */
+/*
+ * Single producer queue, the hooks run under the trace lock of the display.
+ * head and tail only grow, the entries are at head % size and never wrap,
+ * an entry with a NULL fp pads the end of the buffer.
+ */
+struct trace_queue_entry {
+    FILE *fp;
+    uint32_t size;              /* of the entry, padding included */
+    uint16_t flags;             /* TRACE_WRITE_xxx */
+    uint16_t padding;           /* bytes after the data */
+};
+
+struct trace_queue {
+    unsigned char *data;
+    uint64_t size;
+    uint64_t head;              /* written by the hooks */
+    uint64_t tail;              /* written by the writer thread */
+    int policy;                 /* TRACE_QUEUE_xxx */
+    struct trace_rotate *rotate; /* of the display, used by the writer thread */
+
+    pthread_t writer;
+    pthread_mutex_t lock;       /* only to sleep, the entries are lock-free */
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int writer_waiting;
+    int producer_waiting;
+    int quit;
+
+    /* owned by the producer */
+    uint64_t alloc_size;        /* of the allocated entry and the padding before it */
+    unsigned int sample_count;
+    uint64_t dropped;           /* entries */
+    uint64_t dropped_bytes;
+};
+
+/* per display settings */
+struct trace_context {
+    /*
+     * the trace hooks call back into libva (e.g. vaSyncSurface/vaMapBuffer2)
+     * which are traced too, hence a recursive mutex
+     */
+    pthread_mutex_t lock;
+
+    int trace_flag; /* LIBVA_TRACE_xxx for this display */
+
+    /* LIBVA_TRACE_LOGSIZE */
+    unsigned int trace_logsize; /* rotate the files when the size is bigger than it */
+    struct trace_rotate trace_rotate;
     
     /* LIBVA_TRACE */
     FILE *trace_fp_log; /* save the log into a file */
     char *trace_log_fn; /* file name */
-    
+    uint64_t trace_log_size; /* bytes written since the last rotation */
+
+    /* LIBVA_TRACE_BINARY */
+    struct trace_ring_header *trace_ring; /* the mapped log file, NULL in text mode */
+    unsigned char *trace_ring_data; /* the records */
+    size_t trace_ring_mapsize;
+
+    /* LIBVA_TRACE_CAPTURE */
+    FILE *trace_fp_capture; /* the log file */
+    uint64_t trace_capture_records;
+    uint64_t trace_capture_lost; /* dropped by LIBVA_TRACE_ASYNC */
+    unsigned char *trace_capture_buf; /* the record being written, if not in the queue */
+    size_t trace_capture_buf_size;
+    size_t trace_capture_pending; /* bytes of trace_capture_buf to write */
+    int trace_capture_queued; /* the record being written is in the queue */
+
+    int trace_binary; /* LIBVA_TRACE_BINARY or _CAPTURE, records instead of text */
+
+    /* LIBVA_TRACE_ASYNC */
+    struct trace_queue *trace_queue; /* NULL if the files are written directly */
+
     /* LIBVA_TRACE_CODEDBUF */
     FILE *trace_fp_codedbuf; /* save the encode result into a file */
     char *trace_codedbuf_fn; /* file name */
+    uint64_t trace_codedbuf_size; /* bytes written since the last rotation */
     
     /* LIBVA_TRACE_SURFACE */
     FILE *trace_fp_surface; /* save the surface YUV into a file */
     char *trace_surface_fn; /* file name */
+    uint64_t trace_surface_size; /* bytes written since the last rotation */
+    int trace_surface_lz4; /* LIBVA_TRACE_SURFACE_LZ4 */
+    unsigned char *trace_lz4_buf; /* the surface, then its LZ4 frame */
+    size_t trace_lz4_buf_size;
+
+    /* LIBVA_TRACE_FRAMEHASH/_GOLDEN */
+    FILE *trace_fp_framehash; /* save the frame hashes into a file */
+    char *trace_framehash_fn; /* file name */
+    FILE *trace_fp_golden; /* compare the frame hashes with a file */
+    char *trace_golden_fn; /* file name */
+    unsigned int trace_golden_frames; /* compared so far */
+    unsigned int trace_golden_mismatches;
+    unsigned int trace_golden_first; /* line of the first mismatch */
+
+    /* LIBVA_TRACE_TIMELINE */
+    FILE *trace_fp_timeline; /* save the trace events into a file */
+    char *trace_timeline_fn; /* file name */
+    int trace_timeline_index; /* of the display, for the process name */
+    pid_t trace_pid;
+    uint64_t trace_flow_id; /* of the last vaEndPicture */
+    struct va_hash trace_surfaces; /* struct trace_timeline_surface by VASurfaceID */
+
+    /* LIBVA_TRACE_FRAME_INTERVAL/RANGE, LIBVA_TRACE_TRIGGER */
+    int trace_sampling; /* TRACE_SAMPLE_xxx, 0 traces all the frames */
+    unsigned int trace_frame_interval;
+    unsigned int trace_frame_first;
+    unsigned int trace_frame_last;
+    int trace_trigger_signal;
+    int trace_trigger_count; /* trace_signal_count[] seen */
+    char *trace_trigger_fn;
+    time_t trace_trigger_mtime; /* of trace_trigger_fn when it was seen */
+    uint64_t trace_trigger_poll; /* time of the next stat() of trace_trigger_fn */
+    uint64_t trace_window_ns; /* LIBVA_TRACE_WINDOW */
+    uint64_t trace_window_end; /* 0 if closed */
+    int trace_frame_skip; /* the last picture of the display isn't traced */
+
+    VAContextID  trace_context; /* last created context, for vaBufferInfo */
+
+    struct va_hash trace_configs; /* struct trace_va_config by VAConfigID */
+    struct va_hash trace_contexts; /* struct trace_va_context by VAContextID */
+};
+
+/* per config settings */
+struct trace_va_config {
+    struct va_hash_entry entry; /* keyed by the VAConfigID */
+
+    VAProfile trace_profile;
+    VAEntrypoint trace_entrypoint;
+};
+
+/*
+ * per context settings, the display may run several decode/encode
+ * sessions at once, the hooks look the state up by their context
+ */
+struct trace_va_context {
+    struct va_hash_entry entry; /* keyed by the VAContextID */
 
-    VAContextID  trace_context; /* current context */
-    
     VASurfaceID  trace_rendertarget; /* current render target */
-    VAProfile trace_profile; /* current profile for buffers */
-    VAEntrypoint trace_entrypoint; /* current entrypoint */
+    VAProfile trace_profile; /* profile for buffers */
+    VAEntrypoint trace_entrypoint; /* entrypoint of its config */
     VABufferID trace_codedbuf;
     
     unsigned int trace_frame_no; /* current frame NO */
     unsigned int trace_slice_no; /* current slice NO */
     unsigned int trace_slice_size; /* current slice buffer size */
 
-    unsigned int trace_frame_width; /* current frame width */
-    unsigned int trace_frame_height; /* current frame height */
+    unsigned int trace_frame_width; /* frame width */
+    unsigned int trace_frame_height; /* frame height */
     unsigned int trace_sequence_start; /* get a new sequence for encoding or not */
-} trace_context[TRACE_CONTEXT_MAX]; /* trace five context at the same time */
+    int trace_frame_skip; /* the current picture isn't traced */
+    int trace_in_flight; /* frames ended but not synced yet, LIBVA_TRACE_TIMELINE */
+};
+
+/* LIBVA_TRACE_TIMELINE, the last picture of a surface */
+struct trace_timeline_surface {
+    struct va_hash_entry entry; /* keyed by the VASurfaceID */
+
+    uint64_t flow_id; /* 0 once the surface is put */
+    VAContextID context;
+    int in_flight; /* not synced yet */
+};
+
+/* not a VAProfile, a context whose config wasn't traced */
+#define TRACE_PROFILE_UNKNOWN   ((VAProfile)-1)
 
-#define DPY2INDEX(dpy)                                  \
-    int idx;                                            \
+#define TRACE_CTX(dpy) ((struct trace_context *)((VADisplayContextP)dpy)->vatrace)
+
+#define DPY2TRACECTX(dpy)                               \
+    struct trace_context *trace_ctx = TRACE_CTX(dpy);   \
                                                         \
-    for (idx = 0; idx < TRACE_CONTEXT_MAX; idx++)       \
-        if (trace_context[idx].dpy == dpy)              \
-            break;                                      \
+    if (trace_ctx == NULL)                              \
+        return;
+
+/* also va_ctx, the state of context in the display */
+#define DPY2TRACE_VACTX(dpy, context)                                   \
+    DPY2TRACECTX(dpy);                                                  \
+    struct trace_va_context *va_ctx = trace_va_context_get(trace_ctx, context); \
+                                                                        \
+    if (va_ctx == NULL)                                                 \
+        return;
+
+/* for the hooks out of the pictures, they follow the last picture call of the display */
+#define DPY2TRACECTX_SAMPLED(dpy)                       \
+    DPY2TRACECTX(dpy);                                  \
                                                         \
-    if (idx == TRACE_CONTEXT_MAX)                       \
+    if (trace_ctx->trace_frame_skip)                    \
         return;
 
-#define TRACE_FUNCNAME(idx)    va_TraceMsg(idx, "==========%s\n", __func__); 
+#define TRACE_FUNCNAME(trace_ctx)    va_TraceMsg(trace_ctx, "==========%s\n", __func__);
+
+/*
+ * binary mode: save the arguments of the hook into the ring, the text is
+ * only produced offline by va_TraceDecode()
+ */
+#define TRACE_RECORD(trace_ctx, call, data, data_size, ...)             \
+    if ((trace_ctx)->trace_binary) {                                    \
+        uint32_t record_args[TRACE_RECORD_ARGS] = { __VA_ARGS__ };      \
+        trace_record_write(trace_ctx, TRACE_CALL_##call, 0, record_args, data, data_size); \
+    }
 
 /* Prototype declarations (functions defined in va.c) */
 
@@ -149,60 +411,1009 @@ do {                                                    \
              suffix);                                   \
 } while (0)
 
+static int trace_va_state_init(struct trace_context *trace_ctx)
+{
+    if (va_HashInit(&trace_ctx->trace_configs) != 0)
+        return -1;
+    if (va_HashInit(&trace_ctx->trace_contexts) != 0) {
+        va_HashFini(&trace_ctx->trace_configs, NULL);
+        return -1;
+    }
+    if (va_HashInit(&trace_ctx->trace_surfaces) != 0) {
+        va_HashFini(&trace_ctx->trace_contexts, NULL);
+        va_HashFini(&trace_ctx->trace_configs, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+static void trace_va_state_free(struct va_hash_entry *entry)
+{
+    free(entry);
+}
+
+static void trace_va_state_fini(struct trace_context *trace_ctx)
+{
+    va_HashFini(&trace_ctx->trace_configs, trace_va_state_free);
+    va_HashFini(&trace_ctx->trace_contexts, trace_va_state_free);
+    va_HashFini(&trace_ctx->trace_surfaces, trace_va_state_free);
+}
+
+static struct trace_va_context *trace_va_context_create(
+    struct trace_context *trace_ctx,
+    VAContextID context
+)
+{
+    struct trace_va_context *va_ctx = calloc(1, sizeof(struct trace_va_context));
+
+    if (va_ctx == NULL)
+        return NULL;
+
+    va_ctx->entry.key = context;
+    va_ctx->trace_rendertarget = VA_INVALID_ID;
+    va_ctx->trace_profile = TRACE_PROFILE_UNKNOWN;
+    va_ctx->trace_codedbuf = VA_INVALID_ID;
+    va_HashInsert(&trace_ctx->trace_contexts, &va_ctx->entry);
+
+    return va_ctx;
+}
+
+/*
+ * the state of context, created if the context is unknown (e.g. its
+ * vaCreateContext record was overwritten in the binary log)
+ */
+static struct trace_va_context *trace_va_context_get(
+    struct trace_context *trace_ctx,
+    VAContextID context
+)
+{
+    struct va_hash_entry *entry = va_HashLookup(&trace_ctx->trace_contexts, context);
+
+    if (entry)
+        return (struct trace_va_context *)entry;
+
+    return trace_va_context_create(trace_ctx, context);
+}
+
+static int trace_ring_open(struct trace_context *trace_ctx, const char *fn, uint64_t ring_size)
+{
+    struct trace_ring_header *ring;
+    size_t mapsize;
+    void *map;
+    int fd;
+
+    ring_size &= ~7ULL;
+    if (ring_size < TRACE_RING_MIN_SIZE)
+        ring_size = TRACE_RING_MIN_SIZE;
+    mapsize = sizeof(struct trace_ring_header) + ring_size;
+
+    fd = open(fn, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    if (ftruncate(fd, mapsize) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    ring = map;
+    memcpy(ring->magic, TRACE_RING_MAGIC, sizeof(TRACE_RING_MAGIC));
+    ring->version = TRACE_RING_VERSION;
+    ring->header_size = sizeof(struct trace_ring_header);
+    ring->ring_size = ring_size;
+
+    trace_ctx->trace_ring = ring;
+    trace_ctx->trace_ring_data = (unsigned char *)map + ring->header_size;
+    trace_ctx->trace_ring_mapsize = mapsize;
+
+    return 0;
+}
+
+static void trace_ring_close(struct trace_context *trace_ctx)
+{
+    /* the file is consistent as long as the mapping, no msync needed */
+    munmap(trace_ctx->trace_ring, trace_ctx->trace_ring_mapsize);
+    trace_ctx->trace_ring = NULL;
+}
+
+/* drop the oldest records until size bytes are free after the head */
+static void trace_ring_reserve(struct trace_context *trace_ctx, uint64_t size)
+{
+    struct trace_ring_header *ring = trace_ctx->trace_ring;
+
+    while (ring->ring_size - ring->used < size) {
+        struct trace_record *oldest = (struct trace_record *)(trace_ctx->trace_ring_data + ring->tail);
+
+        if (oldest->call != TRACE_CALL_PAD)
+            ring->overwritten++;
+
+        ring->used -= oldest->size;
+        ring->tail += oldest->size;
+        if (ring->tail == ring->ring_size)
+            ring->tail = 0;
+    }
+}
+
+static void trace_ring_commit(struct trace_context *trace_ctx, uint64_t size)
+{
+    struct trace_ring_header *ring = trace_ctx->trace_ring;
+
+    ring->head += size;
+    if (ring->head == ring->ring_size)
+        ring->head = 0;
+    ring->used += size;
+}
+
+/*
+ * Write a record with its header filled, return where its data_size bytes
+ * of data go; data_size is reduced if it doesn't fit into a quarter of the
+ * ring. Called with the trace lock held.
+ */
+static void *trace_ring_alloc(
+    struct trace_context *trace_ctx,
+    int call,
+    int flags,
+    const uint32_t *args,
+    unsigned int *data_size
+)
+{
+    struct trace_ring_header *ring = trace_ctx->trace_ring;
+    uint64_t max_data = ring->ring_size / 4 - sizeof(struct trace_record);
+    struct trace_record *record;
+    uint64_t size;
+
+    if (*data_size > max_data) {
+        *data_size = max_data;
+        flags |= TRACE_RECORD_TRUNCATED;
+    }
+    size = TRACE_RECORD_ALIGN(sizeof(struct trace_record) + *data_size);
+
+    /* records don't wrap, fill the end of the ring and restart at 0 */
+    if (ring->head + size > ring->ring_size) {
+        uint64_t pad = ring->ring_size - ring->head;
+
+        trace_ring_reserve(trace_ctx, pad);
+        /* pad may be smaller than a record, only size and call are valid */
+        record = (struct trace_record *)(trace_ctx->trace_ring_data + ring->head);
+        record->size = pad;
+        record->call = TRACE_CALL_PAD;
+        trace_ring_commit(trace_ctx, pad);
+    }
+
+    trace_ring_reserve(trace_ctx, size);
+    record = (struct trace_record *)(trace_ctx->trace_ring_data + ring->head);
+    record->size = size;
+    record->call = call;
+    record->flags = flags;
+    record->timestamp = va_LatencyTime();
+    memcpy(record->args, args, sizeof(record->args));
+    record->data_size = *data_size;
+    record->reserved = 0;
+    trace_ring_commit(trace_ctx, size);
+
+    ring->records++;
+
+    return record + 1;
+}
+
+static void trace_rotate_wait(struct trace_rotate *rotate);
+static void trace_rotate_reap(struct trace_rotate *rotate);
+static void trace_file_rotate(struct trace_rotate *rotate, FILE *fp, const char *fn);
+
+static void *trace_queue_writer(void *arg)
+{
+    struct trace_queue *queue = arg;
+    FILE *written[4]; /* to flush once the queue is empty */
+    int i, num_written = 0;
+
+    for (;;) {
+        uint64_t head = va_atomic_load_acquire(&queue->head);
+
+        while (queue->tail != head) {
+            struct trace_queue_entry *entry = (struct trace_queue_entry *)(queue->data + queue->tail % queue->size);
+
+            if (entry->fp && (entry->flags & TRACE_WRITE_ROTATE))
+                trace_file_rotate(queue->rotate, entry->fp, (const char *)(entry + 1));
+            else if (entry->fp) {
+                fwrite(entry + 1, entry->size - entry->padding - sizeof(*entry), 1, entry->fp);
+
+                for (i = 0; i < num_written; i++)
+                    if (written[i] == entry->fp)
+                        break;
+                if (i == num_written) {
+                    if (num_written == 4)
+                        fflush(written[--num_written]);
+                    written[num_written++] = entry->fp;
+                }
+            }
+            va_atomic_store_release(&queue->tail, queue->tail + entry->size);
+
+            va_atomic_fence();
+            if (va_atomic_load(&queue->producer_waiting)) {
+                pthread_mutex_lock(&queue->lock);
+                pthread_cond_signal(&queue->not_full);
+                pthread_mutex_unlock(&queue->lock);
+            }
+        }
+
+        for (i = 0; i < num_written; i++)
+            fflush(written[i]);
+        num_written = 0;
+
+        /* the rotations are done here, so is the reaping of their gzip */
+        trace_rotate_reap(queue->rotate);
+
+        pthread_mutex_lock(&queue->lock);
+        va_atomic_store(&queue->writer_waiting, 1);
+        va_atomic_fence();
+        if (queue->tail == va_atomic_load_acquire(&queue->head)) {
+            if (queue->quit) {
+                pthread_mutex_unlock(&queue->lock);
+                break;
+            }
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        va_atomic_store(&queue->writer_waiting, 0);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    return NULL;
+}
+
+static struct trace_queue *trace_queue_start(const char *policy, uint64_t size, struct trace_rotate *rotate)
+{
+    struct trace_queue *queue;
+
+    queue = calloc(1, sizeof(struct trace_queue));
+    if (queue == NULL)
+        return NULL;
+
+    size = TRACE_QUEUE_ALIGN(size);
+    if (size < TRACE_QUEUE_MIN_SIZE)
+        size = TRACE_QUEUE_MIN_SIZE;
+    queue->data = malloc(size);
+    if (queue->data == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->size = size;
+    queue->rotate = rotate;
+
+    if (strcmp(policy, "drop") == 0)
+        queue->policy = TRACE_QUEUE_DROP;
+    else if (strcmp(policy, "sample") == 0)
+        queue->policy = TRACE_QUEUE_SAMPLE_BULKY;
+    else
+        queue->policy = TRACE_QUEUE_BLOCK;
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+
+    if (pthread_create(&queue->writer, NULL, trace_queue_writer, queue) != 0) {
+        pthread_cond_destroy(&queue->not_full);
+        pthread_cond_destroy(&queue->not_empty);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue->data);
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+/* write all the queued data and stop the writer thread */
+static void trace_queue_stop(struct trace_queue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->quit = 1;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+
+    pthread_join(queue->writer, NULL);
+
+    if (queue->dropped)
+        va_infoMessage("LIBVA_TRACE_ASYNC dropped %llu writes (%llu bytes)\n",
+                       (unsigned long long)queue->dropped,
+                       (unsigned long long)queue->dropped_bytes);
+
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->data);
+    free(queue);
+}
+
+/* block policy: wait for the writer thread until room bytes are free */
+static void trace_queue_wait(struct trace_queue *queue, uint64_t room)
+{
+    uint64_t used = queue->head - va_atomic_load_acquire(&queue->tail);
+
+    while (queue->size - used < room) {
+        pthread_mutex_lock(&queue->lock);
+        va_atomic_store(&queue->producer_waiting, 1);
+        va_atomic_fence();
+        used = queue->head - va_atomic_load_acquire(&queue->tail);
+        if (queue->size - used < room)
+            pthread_cond_wait(&queue->not_full, &queue->lock);
+        va_atomic_store(&queue->producer_waiting, 0);
+        pthread_mutex_unlock(&queue->lock);
+
+        used = queue->head - va_atomic_load_acquire(&queue->tail);
+    }
+}
+
+/*
+ * block policy, for an entry bigger than half the queue: let the writer
+ * thread empty the queue and replace the buffer by one twice the entry.
+ * The writer only reads the buffer after the next commit.
+ */
+static int trace_queue_grow(struct trace_queue *queue, uint64_t entry_size)
+{
+    uint64_t size = queue->size;
+    unsigned char *data;
+
+    while (size < 2 * entry_size)
+        size *= 2;
+
+    data = malloc(size);
+    if (data == NULL)
+        return -1;
+
+    trace_queue_wait(queue, queue->size);
+    free(queue->data);
+    queue->data = data;
+    queue->size = size;
+
+    return 0;
+}
+
+/*
+ * Return where the size bytes to write into fp go, or NULL if they are
+ * dropped; trace_queue_commit() hands them to the writer thread.
+ * Called with the trace lock held.
+ */
+static void *trace_queue_alloc(struct trace_queue *queue, FILE *fp, size_t size, int flags)
+{
+    uint64_t entry_size = TRACE_QUEUE_ALIGN(sizeof(struct trace_queue_entry) + size);
+    uint64_t offset, used, pad = 0;
+    struct trace_queue_entry *entry;
+
+    if (entry_size > queue->size / 2 &&
+        (queue->policy != TRACE_QUEUE_BLOCK || trace_queue_grow(queue, entry_size) != 0))
+        goto drop;
+
+    offset = queue->head % queue->size;
+    if (offset + entry_size > queue->size)
+        pad = queue->size - offset;
+
+    used = queue->head - va_atomic_load_acquire(&queue->tail);
+
+    if (queue->policy == TRACE_QUEUE_SAMPLE_BULKY && (flags & TRACE_WRITE_BULKY) &&
+        used > queue->size / 2 && (queue->sample_count++ % TRACE_QUEUE_SAMPLE) != 0)
+        goto drop;
+
+    if (queue->size - used < pad + entry_size) {
+        if (queue->policy != TRACE_QUEUE_BLOCK)
+            goto drop;
+        trace_queue_wait(queue, pad + entry_size);
+    }
+
+    if (pad) {
+        entry = (struct trace_queue_entry *)(queue->data + offset);
+        entry->fp = NULL;
+        entry->size = pad;
+        entry->flags = 0;
+        entry->padding = 0;
+        offset = 0;
+    }
+
+    entry = (struct trace_queue_entry *)(queue->data + offset);
+    entry->fp = fp;
+    entry->size = entry_size;
+    entry->flags = flags;
+    entry->padding = entry_size - sizeof(*entry) - size;
+    queue->alloc_size = pad + entry_size;
+
+    return entry + 1;
+
+drop:
+    queue->dropped++;
+    queue->dropped_bytes += size;
+    return NULL;
+}
+
+static void trace_queue_commit(struct trace_queue *queue)
+{
+    va_atomic_store_release(&queue->head, queue->head + queue->alloc_size);
+
+    va_atomic_fence();
+    if (va_atomic_load(&queue->writer_waiting)) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_signal(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+static void trace_queue_write(struct trace_queue *queue, FILE *fp, const void *ptr, size_t size, int flags)
+{
+    void *p = trace_queue_alloc(queue, fp, size, flags);
+
+    if (p) {
+        memcpy(p, ptr, size);
+        trace_queue_commit(queue);
+    }
+}
+
+static int trace_capture_open(struct trace_context *trace_ctx, const char *fn)
+{
+    struct trace_ring_header header;
+    FILE *fp = fopen(fn, "w+");
+
+    if (fp == NULL)
+        return -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_CAPTURE_MAGIC, sizeof(TRACE_CAPTURE_MAGIC));
+    header.version = TRACE_RING_VERSION;
+    header.header_size = sizeof(header);
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        return -1;
+    }
+
+    trace_ctx->trace_fp_capture = fp;
+    return 0;
+}
+
+/* after the writer thread is stopped */
+static void trace_capture_close(struct trace_context *trace_ctx)
+{
+    struct trace_ring_header header;
+    FILE *fp = trace_ctx->trace_fp_capture;
+
+    /* the number of records, for va_TraceDecode() */
+    fflush(fp);
+    if (pread(fileno(fp), &header, sizeof(header), 0) == sizeof(header)) {
+        header.records = trace_ctx->trace_capture_records;
+        header.overwritten = trace_ctx->trace_capture_lost;
+        pwrite(fileno(fp), &header, sizeof(header), 0);
+    }
+    fclose(fp);
+
+    if (trace_ctx->trace_capture_lost)
+        va_errorMessage("LIBVA_TRACE_CAPTURE lost %llu records, the capture is incomplete\n",
+                        (unsigned long long)trace_ctx->trace_capture_lost);
+
+    free(trace_ctx->trace_capture_buf);
+    trace_ctx->trace_fp_capture = NULL;
+}
+
+/*
+ * Start a record into the ring or the capture, return where its data_size
+ * bytes of data go (data_size is reduced if they don't fit into the ring).
+ * trace_record_commit() ends it. Called with the trace lock held.
+ */
+static void *trace_record_alloc(
+    struct trace_context *trace_ctx,
+    int call,
+    int flags,
+    const uint32_t *args,
+    unsigned int *data_size
+)
+{
+    struct trace_record *record = NULL;
+    uint64_t size;
+
+    if (trace_ctx->trace_ring)
+        return trace_ring_alloc(trace_ctx, call, flags, args, data_size);
+
+    size = TRACE_RECORD_ALIGN(sizeof(struct trace_record) + *data_size);
+
+    trace_ctx->trace_capture_queued = 0;
+    trace_ctx->trace_capture_pending = 0;
+    if (trace_ctx->trace_queue) {
+        record = trace_queue_alloc(trace_ctx->trace_queue, trace_ctx->trace_fp_capture, size, 0);
+        if (record)
+            trace_ctx->trace_capture_queued = 1;
+        else
+            trace_ctx->trace_capture_lost++;
+    }
+
+    /* not queued, or dropped, still give room for the data */
+    if (record == NULL) {
+        if (trace_ctx->trace_capture_buf_size < size) {
+            void *tmp = realloc(trace_ctx->trace_capture_buf, size);
+
+            if (tmp == NULL) {
+                /* write nothing, the data goes into what is left */
+                trace_ctx->trace_capture_lost++;
+                *data_size = trace_ctx->trace_capture_buf_size > sizeof(*record) ?
+                    trace_ctx->trace_capture_buf_size - sizeof(*record) : 0;
+                return trace_ctx->trace_capture_buf + sizeof(*record);
+            }
+            trace_ctx->trace_capture_buf = tmp;
+            trace_ctx->trace_capture_buf_size = size;
+        }
+        record = (struct trace_record *)trace_ctx->trace_capture_buf;
+        if (trace_ctx->trace_queue == NULL)
+            trace_ctx->trace_capture_pending = size;
+    }
+
+    record->size = size;
+    record->call = call;
+    record->flags = flags;
+    record->timestamp = va_LatencyTime();
+    memcpy(record->args, args, sizeof(record->args));
+    record->data_size = *data_size;
+    record->reserved = 0;
+    /* no garbage in the file */
+    memset((unsigned char *)(record + 1) + *data_size, 0, size - sizeof(*record) - *data_size);
+
+    return record + 1;
+}
+
+static void trace_record_commit(struct trace_context *trace_ctx)
+{
+    if (trace_ctx->trace_ring)
+        return;
+
+    if (trace_ctx->trace_capture_queued) {
+        trace_queue_commit(trace_ctx->trace_queue);
+        trace_ctx->trace_capture_records++;
+    } else if (trace_ctx->trace_capture_pending) {
+        if (fwrite(trace_ctx->trace_capture_buf, trace_ctx->trace_capture_pending, 1,
+                   trace_ctx->trace_fp_capture) == 1)
+            trace_ctx->trace_capture_records++;
+        else
+            trace_ctx->trace_capture_lost++;
+    }
+    trace_ctx->trace_capture_queued = 0;
+    trace_ctx->trace_capture_pending = 0;
+}
+
+static void trace_record_write(
+    struct trace_context *trace_ctx,
+    int call,
+    int flags,
+    const uint32_t *args,
+    const void *data,
+    unsigned int data_size
+)
+{
+    void *p = trace_record_alloc(trace_ctx, call, flags, args, &data_size);
+
+    if (data && data_size)
+        memcpy(p, data, data_size);
+    trace_record_commit(trace_ctx);
+}
+
+/*
+ * LIBVA_TRACE_TIMELINE: one event of the JSON array, fields are the
+ * fields after the common ones, e.g. ",\"dur\":1.000"
+ */
+static void trace_timeline_event(
+    struct trace_context *trace_ctx,
+    const char *name,
+    char phase,
+    uint64_t ts,
+    const char *fields,
+    ...
+)
+{
+    char buf[TRACE_TIMELINE_EVENT_SIZE];
+    va_list args;
+    int len, n;
+
+    len = snprintf(buf, sizeof(buf),
+                   "{\"name\":\"%s\",\"cat\":\"va\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%ld",
+                   name, phase, (unsigned long long)(ts / 1000), (unsigned int)(ts % 1000),
+                   (int)trace_ctx->trace_pid, (long)syscall(SYS_gettid));
+    if (len < 0 || len >= sizeof(buf))
+        return;
+
+    va_start(args, fields);
+    n = vsnprintf(buf + len, sizeof(buf) - len, fields, args);
+    va_end(args);
+    if (n < 0 || len + n + 3 >= sizeof(buf))
+        return;
+    len += n;
+    memcpy(buf + len, "},\n", 3);
+    len += 3;
+
+    if (trace_ctx->trace_queue)
+        trace_queue_write(trace_ctx->trace_queue, trace_ctx->trace_fp_timeline, buf, len, 0);
+    else
+        fwrite(buf, len, 1, trace_ctx->trace_fp_timeline);
+}
+
+static void trace_timeline_in_flight(
+    struct trace_context *trace_ctx,
+    VAContextID context,
+    int delta,
+    uint64_t ts
+)
+{
+    struct trace_va_context *va_ctx;
+
+    va_ctx = (struct trace_va_context *)va_HashLookup(&trace_ctx->trace_contexts, context);
+    if (va_ctx == NULL)
+        return;
+
+    va_ctx->trace_in_flight += delta;
+    trace_timeline_event(trace_ctx, "frames in flight", 'C', ts,
+                         ",\"args\":{\"0x%08x\":%d}", context, va_ctx->trace_in_flight);
+}
+
+/* vaEndPicture started a picture on surface, start its flow */
+static void trace_timeline_end_picture(
+    struct trace_context *trace_ctx,
+    VAContextID context,
+    VASurfaceID surface
+)
+{
+    struct trace_timeline_surface *tl_surface;
+    uint64_t now = va_LatencyTime();
+
+    tl_surface = (struct trace_timeline_surface *)va_HashLookup(&trace_ctx->trace_surfaces, surface);
+    if (tl_surface == NULL) {
+        tl_surface = calloc(1, sizeof(struct trace_timeline_surface));
+        if (tl_surface == NULL)
+            return;
+        tl_surface->entry.key = surface;
+        va_HashInsert(&trace_ctx->trace_surfaces, &tl_surface->entry);
+    }
+
+    /* the previous picture of the surface was never synced, don't count it twice */
+    if (tl_surface->in_flight)
+        trace_timeline_in_flight(trace_ctx, tl_surface->context, -1, now);
+
+    tl_surface->flow_id = ++trace_ctx->trace_flow_id;
+    tl_surface->context = context;
+    tl_surface->in_flight = 1;
+
+    trace_timeline_event(trace_ctx, "frame", 's', now,
+                         ",\"id\":%llu,\"args\":{\"surface\":\"0x%08x\"}",
+                         (unsigned long long)tl_surface->flow_id, surface);
+    trace_timeline_in_flight(trace_ctx, context, 1, now);
+}
+
+/* vaSyncSurface (put == 0) or vaPutSurface (put == 1) of surface, continue its flow */
+static void trace_timeline_surface(
+    struct trace_context *trace_ctx,
+    VASurfaceID surface,
+    int put
+)
+{
+    struct trace_timeline_surface *tl_surface;
+    uint64_t now;
+
+    tl_surface = (struct trace_timeline_surface *)va_HashLookup(&trace_ctx->trace_surfaces, surface);
+    if (tl_surface == NULL || tl_surface->flow_id == 0)
+        return;
+
+    now = va_LatencyTime();
+    if (put)
+        trace_timeline_event(trace_ctx, "frame", 'f', now, ",\"id\":%llu,\"bp\":\"e\"",
+                             (unsigned long long)tl_surface->flow_id);
+    else
+        trace_timeline_event(trace_ctx, "frame", 't', now, ",\"id\":%llu",
+                             (unsigned long long)tl_surface->flow_id);
+
+    /* vaPutSurface waits for the surface too */
+    if (tl_surface->in_flight) {
+        tl_surface->in_flight = 0;
+        trace_timeline_in_flight(trace_ctx, tl_surface->context, -1, now);
+    }
+    if (put)
+        tl_surface->flow_id = 0;
+}
+
+void va_TraceTimelineCall(
+    VADisplay dpy,
+    VAContextID context,
+    const char *name,
+    uint64_t start,
+    uint64_t end
+)
+{
+    uint64_t dur = end - start;
+    DPY2TRACECTX(dpy);
+
+    if (!(trace_ctx->trace_flag & VA_TRACE_FLAG_TIMELINE))
+        return;
+
+    pthread_mutex_lock(&trace_ctx->lock);
+    if (context != VA_INVALID_ID)
+        trace_timeline_event(trace_ctx, name, 'X', start,
+                             ",\"dur\":%llu.%03u,\"args\":{\"context\":\"0x%08x\"}",
+                             (unsigned long long)(dur / 1000), (unsigned int)(dur % 1000), context);
+    else
+        trace_timeline_event(trace_ctx, name, 'X', start, ",\"dur\":%llu.%03u",
+                             (unsigned long long)(dur / 1000), (unsigned int)(dur % 1000));
+    pthread_mutex_unlock(&trace_ctx->lock);
+}
+
+static void trace_signal_handler(int sig)
+{
+    va_atomic_add(&trace_signal_count[sig], 1);
+}
+
+/*
+ * LIBVA_TRACE_TRIGGER=signal:number, don't replace a handler of the
+ * application; trace_signal_uninstall() restores the default one when the
+ * last display using it is terminated
+ */
+static int trace_signal_install(int sig)
+{
+    struct sigaction action, old_action;
+    int ret = -1;
+
+    if (sig <= 0 || sig >= NSIG)
+        return -1;
+
+    pthread_mutex_lock(&trace_signal_lock);
+    if (trace_signal_users[sig]) {
+        /* another display installed it */
+        trace_signal_users[sig]++;
+        ret = 0;
+    } else if (sigaction(sig, NULL, &old_action) == 0 &&
+               old_action.sa_handler == SIG_DFL && !(old_action.sa_flags & SA_SIGINFO)) {
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = trace_signal_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+
+        ret = sigaction(sig, &action, NULL);
+        if (ret == 0) {
+            trace_signal_old_action[sig] = old_action;
+            trace_signal_users[sig] = 1;
+        }
+    }
+    pthread_mutex_unlock(&trace_signal_lock);
+
+    return ret;
+}
+
+static void trace_signal_uninstall(int sig)
+{
+    pthread_mutex_lock(&trace_signal_lock);
+    if (--trace_signal_users[sig] == 0)
+        sigaction(sig, &trace_signal_old_action[sig], NULL);
+    pthread_mutex_unlock(&trace_signal_lock);
+}
+
+static void trace_sampling_init(struct trace_context *trace_ctx)
+{
+    char env_value[1024];
+    struct stat buf;
+
+    if (va_parseConfig("LIBVA_TRACE_FRAME_INTERVAL", &env_value[0]) == 0) {
+        trace_ctx->trace_frame_interval = strtoul(env_value, NULL, 0);
+        if (trace_ctx->trace_frame_interval > 1) {
+            trace_ctx->trace_sampling |= TRACE_SAMPLE_INTERVAL;
+            va_infoMessage("LIBVA_TRACE_FRAME_INTERVAL is on, trace one frame of %u\n",
+                           trace_ctx->trace_frame_interval);
+        }
+    }
+
+    if (va_parseConfig("LIBVA_TRACE_FRAME_RANGE", &env_value[0]) == 0) {
+        char *end;
+
+        trace_ctx->trace_frame_first = strtoul(env_value, &end, 0);
+        trace_ctx->trace_frame_last = UINT_MAX;
+        if (*end == '-' && *(end + 1) != '\0')
+            trace_ctx->trace_frame_last = strtoul(end + 1, NULL, 0);
+        if (end != env_value && *end == '-' &&
+            trace_ctx->trace_frame_first <= trace_ctx->trace_frame_last) {
+            trace_ctx->trace_sampling |= TRACE_SAMPLE_RANGE;
+            va_infoMessage("LIBVA_TRACE_FRAME_RANGE is on, trace the frames %u to %u\n",
+                           trace_ctx->trace_frame_first, trace_ctx->trace_frame_last);
+        } else
+            va_errorMessage("LIBVA_TRACE_FRAME_RANGE: invalid range %s\n", env_value);
+    }
+
+    if (va_parseConfig("LIBVA_TRACE_TRIGGER", &env_value[0]) == 0) {
+        unsigned int window = TRACE_WINDOW_DEFAULT;
+        char window_value[1024];
+
+        if (va_parseConfig("LIBVA_TRACE_WINDOW", &window_value[0]) == 0)
+            window = strtoul(window_value, NULL, 0);
+        trace_ctx->trace_window_ns = window * 1000000000ULL;
+
+        if (strncmp(env_value, "signal:", 7) == 0) {
+            int sig = atoi(env_value + 7);
+
+            if (trace_signal_install(sig) == 0) {
+                trace_ctx->trace_trigger_signal = sig;
+                trace_ctx->trace_trigger_count = va_atomic_load(&trace_signal_count[sig]);
+                trace_ctx->trace_sampling |= TRACE_SAMPLE_TRIGGER;
+            } else
+                va_errorMessage("LIBVA_TRACE_TRIGGER: can't catch the signal %d\n", sig);
+        } else if (strncmp(env_value, "file:", 5) == 0 && env_value[5] != '\0') {
+            trace_ctx->trace_trigger_fn = strdup(env_value + 5);
+            if (trace_ctx->trace_trigger_fn) {
+                /* only a touch after now opens a window */
+                if (stat(trace_ctx->trace_trigger_fn, &buf) == 0)
+                    trace_ctx->trace_trigger_mtime = buf.st_mtime;
+                trace_ctx->trace_sampling |= TRACE_SAMPLE_TRIGGER;
+            }
+        } else
+            va_errorMessage("LIBVA_TRACE_TRIGGER: unknown trigger %s\n", env_value);
+
+        if (trace_ctx->trace_sampling & TRACE_SAMPLE_TRIGGER)
+            va_infoMessage("LIBVA_TRACE_TRIGGER is on, trace %u seconds after %s\n",
+                           window, env_value);
+    }
+}
+
+/* LIBVA_TRACE_TRIGGER fired, open a window, or switch tracing on/off */
+static void trace_window_trigger(struct trace_context *trace_ctx, uint64_t now)
+{
+    if (trace_ctx->trace_window_ns == 0)
+        trace_ctx->trace_window_end = trace_ctx->trace_window_end ? 0 : TRACE_WINDOW_ALWAYS;
+    else
+        trace_ctx->trace_window_end = now + trace_ctx->trace_window_ns;
+
+    va_TraceMsg(trace_ctx, "==========trace window %s\n", trace_ctx->trace_window_end ? "opened" : "closed");
+}
+
+static int trace_window_open(struct trace_context *trace_ctx)
+{
+    uint64_t now = 0;
+    struct stat buf;
+    int count;
+
+    if (trace_ctx->trace_trigger_signal) {
+        count = va_atomic_load(&trace_signal_count[trace_ctx->trace_trigger_signal]);
+        if (count != trace_ctx->trace_trigger_count) {
+            trace_ctx->trace_trigger_count = count;
+            now = va_LatencyTime();
+            trace_window_trigger(trace_ctx, now);
+        }
+    }
+
+    if (trace_ctx->trace_trigger_fn) {
+        now = va_LatencyTime();
+        if (now >= trace_ctx->trace_trigger_poll) {
+            trace_ctx->trace_trigger_poll = now + TRACE_TRIGGER_POLL;
+            if (stat(trace_ctx->trace_trigger_fn, &buf) == 0 &&
+                buf.st_mtime != trace_ctx->trace_trigger_mtime) {
+                trace_ctx->trace_trigger_mtime = buf.st_mtime;
+                trace_window_trigger(trace_ctx, now);
+            }
+        }
+    }
+
+    if (trace_ctx->trace_window_end == 0)
+        return 0;
+    if (trace_ctx->trace_window_end == TRACE_WINDOW_ALWAYS)
+        return 1;
+
+    if (now == 0)
+        now = va_LatencyTime();
+    if (now < trace_ctx->trace_window_end)
+        return 1;
+
+    trace_ctx->trace_window_end = 0;
+    va_TraceMsg(trace_ctx, "==========trace window closed\n");
+    return 0;
+}
+
+/* whether to trace the frame frame_no of a context */
+static int trace_frame_sampled(struct trace_context *trace_ctx, unsigned int frame_no)
+{
+    if (trace_ctx->trace_sampling == 0)
+        return 1;
+
+    if ((trace_ctx->trace_sampling & TRACE_SAMPLE_INTERVAL) &&
+        (frame_no % trace_ctx->trace_frame_interval) != 0)
+        return 0;
+
+    if ((trace_ctx->trace_sampling & TRACE_SAMPLE_RANGE) &&
+        (frame_no < trace_ctx->trace_frame_first || frame_no > trace_ctx->trace_frame_last))
+        return 0;
+
+    if (trace_ctx->trace_sampling & TRACE_SAMPLE_TRIGGER)
+        return trace_window_open(trace_ctx);
+
+    return 1;
+}
+
 void va_TraceInit(VADisplay dpy)
 {
     char env_value[1024];
     unsigned short suffix = 0xffff & ((unsigned int)time(NULL));
-    int trace_index = 0;
+    int trace_index;
+    struct trace_context *trace_ctx;
+    pthread_mutexattr_t attr;
     FILE *tmp;    
     
-    for (trace_index = 0; trace_index < TRACE_CONTEXT_MAX; trace_index++)
-        if (trace_context[trace_index].dpy == 0)
-            break;
-
-    if (trace_index == TRACE_CONTEXT_MAX)
+    trace_ctx = calloc(1, sizeof(struct trace_context));
+    if (trace_ctx == NULL)
+        return;
+    if (trace_va_state_init(trace_ctx) != 0) {
+        free(trace_ctx);
         return;
-
-    memset(&trace_context[trace_index], 0, sizeof(struct _trace_context));
-    if (va_parseConfig("LIBVA_TRACE", &env_value[0]) == 0) {
-        FILE_NAME_SUFFIX(env_value);
-        trace_context[trace_index].trace_log_fn = strdup(env_value);
-        
-        tmp = fopen(env_value, "w");
-        if (tmp) {
-            trace_context[trace_index].trace_fp_log = tmp;
-            va_infoMessage("LIBVA_TRACE is on, save log into %s\n", trace_context[trace_index].trace_log_fn);
-            trace_flag = VA_TRACE_FLAG_LOG;
-        } else
-            va_errorMessage("Open file %s failed (%s)\n", env_value, strerror(errno));
     }
 
-    /* may re-get the global settings for multiple context */
+    /* number the files of each display */
+    trace_index = va_atomic_add(&trace_display_count, 1);
+
+    trace_ctx->trace_logsize = 0xffffffff;
     if (va_parseConfig("LIBVA_TRACE_LOGSIZE", &env_value[0]) == 0) {
-        trace_logsize = atoi(env_value);
-        va_infoMessage("LIBVA_TRACE_LOGSIZE is on, size is %d\n", trace_logsize);
+        trace_ctx->trace_logsize = atoi(env_value);
+        va_infoMessage("LIBVA_TRACE_LOGSIZE is on, size is %d\n", trace_ctx->trace_logsize);
+    }
+
+    trace_ctx->trace_rotate.files = 1;
+    if (va_parseConfig("LIBVA_TRACE_LOGFILES", &env_value[0]) == 0)
+        trace_ctx->trace_rotate.files = atoi(env_value);
+    if (va_parseConfig("LIBVA_TRACE_LOGCOMPRESS", NULL) == 0 && trace_ctx->trace_rotate.files) {
+        trace_ctx->trace_rotate.compress = 1;
+        va_infoMessage("LIBVA_TRACE_LOGCOMPRESS is on, gzip the rotated files\n");
     }
 
-    if ((trace_flag & VA_TRACE_FLAG_LOG) && (va_parseConfig("LIBVA_TRACE_BUFDATA", NULL) == 0)) {
-        trace_flag |= VA_TRACE_FLAG_BUFDATA;
+    if (va_parseConfig("LIBVA_TRACE", &env_value[0]) == 0) {
+        FILE_NAME_SUFFIX(env_value);
+        trace_ctx->trace_log_fn = strdup(env_value);
+
+        if (va_parseConfig("LIBVA_TRACE_CAPTURE", NULL) == 0) {
+            if (trace_capture_open(trace_ctx, env_value) == 0) {
+                va_infoMessage("LIBVA_TRACE_CAPTURE is on, save the capture into %s\n",
+                               trace_ctx->trace_log_fn);
+                trace_ctx->trace_flag = VA_TRACE_FLAG_LOG;
+                trace_ctx->trace_binary = 1;
+            } else
+                va_errorMessage("Open file %s failed (%s)\n", env_value, strerror(errno));
+        } else if (va_parseConfig("LIBVA_TRACE_BINARY", NULL) == 0) {
+            uint64_t ring_size = TRACE_RING_DEFAULT_SIZE;
+
+            if (trace_ctx->trace_logsize != 0xffffffff)
+                ring_size = trace_ctx->trace_logsize;
+            if (trace_ring_open(trace_ctx, env_value, ring_size) == 0) {
+                va_infoMessage("LIBVA_TRACE_BINARY is on, save binary log into %s\n",
+                               trace_ctx->trace_log_fn);
+                trace_ctx->trace_flag = VA_TRACE_FLAG_LOG;
+                trace_ctx->trace_binary = 1;
+            } else
+                va_errorMessage("Open file %s failed (%s)\n", env_value, strerror(errno));
+        } else {
+            tmp = fopen(env_value, "w");
+            if (tmp) {
+                trace_ctx->trace_fp_log = tmp;
+                va_infoMessage("LIBVA_TRACE is on, save log into %s\n", trace_ctx->trace_log_fn);
+                trace_ctx->trace_flag = VA_TRACE_FLAG_LOG;
+            } else
+                va_errorMessage("Open file %s failed (%s)\n", env_value, strerror(errno));
+        }
+    }
+
+    if ((trace_ctx->trace_flag & VA_TRACE_FLAG_LOG) && (va_parseConfig("LIBVA_TRACE_BUFDATA", NULL) == 0)) {
+        trace_ctx->trace_flag |= VA_TRACE_FLAG_BUFDATA;
         va_infoMessage("LIBVA_TRACE_BUFDATA is on, dump buffer into log file\n");
     }
 
     /* per-context setting */
     if (va_parseConfig("LIBVA_TRACE_CODEDBUF", &env_value[0]) == 0) {
         FILE_NAME_SUFFIX(env_value);
-        trace_context[trace_index].trace_codedbuf_fn = strdup(env_value);
+        trace_ctx->trace_codedbuf_fn = strdup(env_value);
         va_infoMessage("LIBVA_TRACE_CODEDBUF is on, save codedbuf into log file %s\n",
-                       trace_context[trace_index].trace_codedbuf_fn);
-        trace_flag |= VA_TRACE_FLAG_CODEDBUF;
+                       trace_ctx->trace_codedbuf_fn);
+        trace_ctx->trace_flag |= VA_TRACE_FLAG_CODEDBUF;
     }
 
     if (va_parseConfig("LIBVA_TRACE_SURFACE", &env_value[0]) == 0) {
         FILE_NAME_SUFFIX(env_value);
-        trace_context[trace_index].trace_surface_fn = strdup(env_value);
+        trace_ctx->trace_surface_fn = strdup(env_value);
         
         va_infoMessage("LIBVA_TRACE_SURFACE is on, save surface into %s\n",
-                       trace_context[trace_index].trace_surface_fn);
+                       trace_ctx->trace_surface_fn);
 
         /* for surface data dump, it is time-consume, and may
          * cause some side-effect, so only trace the needed surfaces
@@ -211,199 +1422,745 @@ void va_TraceInit(VADisplay dpy)
          * if no dec/enc in file name, set both
          */
         if (strstr(env_value, "dec"))
-            trace_flag |= VA_TRACE_FLAG_SURFACE_DECODE;
+            trace_ctx->trace_flag |= VA_TRACE_FLAG_SURFACE_DECODE;
         if (strstr(env_value, "enc"))
-            trace_flag |= VA_TRACE_FLAG_SURFACE_ENCODE;
+            trace_ctx->trace_flag |= VA_TRACE_FLAG_SURFACE_ENCODE;
         if (strstr(env_value, "jpeg") || strstr(env_value, "jpg"))
-            trace_flag |= VA_TRACE_FLAG_SURFACE_JPEG;
+            trace_ctx->trace_flag |= VA_TRACE_FLAG_SURFACE_JPEG;
+
+        if (va_parseConfig("LIBVA_TRACE_SURFACE_LZ4", NULL) == 0) {
+#ifdef HAVE_LZ4
+            trace_ctx->trace_surface_lz4 = 1;
+            va_infoMessage("LIBVA_TRACE_SURFACE_LZ4 is on, compress the surfaces with LZ4\n");
+#else
+            va_errorMessage("LIBVA_TRACE_SURFACE_LZ4: libva is built without LZ4\n");
+#endif
+        }
+    }
+
+    if (va_parseConfig("LIBVA_TRACE_FRAMEHASH", &env_value[0]) == 0) {
+        FILE_NAME_SUFFIX(env_value);
+        tmp = fopen(env_value, "w");
+        if (tmp) {
+            trace_ctx->trace_fp_framehash = tmp;
+            trace_ctx->trace_framehash_fn = strdup(env_value);
+            va_infoMessage("LIBVA_TRACE_FRAMEHASH is on, save frame hashes into %s\n",
+                           trace_ctx->trace_framehash_fn);
+            trace_ctx->trace_flag |= VA_TRACE_FLAG_FRAMEHASH;
+        } else
+            va_errorMessage("Open file %s failed (%s)\n", env_value, strerror(errno));
+    }
+
+    /* no suffix, it is an input */
+    if (va_parseConfig("LIBVA_TRACE_FRAMEHASH_GOLDEN", &env_value[0]) == 0) {
+        tmp = fopen(env_value, "r");
+        if (tmp) {
+            trace_ctx->trace_fp_golden = tmp;
+            trace_ctx->trace_golden_fn = strdup(env_value);
+            va_infoMessage("LIBVA_TRACE_FRAMEHASH_GOLDEN is on, compare frame hashes with %s\n",
+                           trace_ctx->trace_golden_fn);
+            trace_ctx->trace_flag |= VA_TRACE_FLAG_FRAMEHASH;
+        } else
+            va_errorMessage("Open file %s failed (%s)\n", env_value, strerror(errno));
+    }
+
+    if (va_parseConfig("LIBVA_TRACE_TIMELINE", &env_value[0]) == 0) {
+        FILE_NAME_SUFFIX(env_value);
+        tmp = fopen(env_value, "w");
+        if (tmp) {
+            trace_ctx->trace_fp_timeline = tmp;
+            trace_ctx->trace_timeline_fn = strdup(env_value);
+            trace_ctx->trace_timeline_index = trace_index;
+            trace_ctx->trace_pid = getpid();
+            fputs("[\n", tmp);
+            va_infoMessage("LIBVA_TRACE_TIMELINE is on, save trace events into %s\n",
+                           trace_ctx->trace_timeline_fn);
+            trace_ctx->trace_flag |= VA_TRACE_FLAG_TIMELINE;
+        } else
+            va_errorMessage("Open file %s failed (%s)\n", env_value, strerror(errno));
+    }
+
+    if (trace_ctx->trace_flag == 0) {
+        free(trace_ctx->trace_log_fn);
+        free(trace_ctx->trace_codedbuf_fn);
+        free(trace_ctx->trace_surface_fn);
+        trace_va_state_fini(trace_ctx);
+        free(trace_ctx);
+        return;
     }
 
-    trace_context[trace_index].dpy = dpy;
+    trace_sampling_init(trace_ctx);
+
+    if (va_parseConfig("LIBVA_TRACE_ASYNC", &env_value[0]) == 0) {
+        uint64_t queue_size = TRACE_QUEUE_DEFAULT_SIZE;
+        char size_value[1024];
+
+        if (va_parseConfig("LIBVA_TRACE_ASYNC_SIZE", &size_value[0]) == 0)
+            queue_size = strtoull(size_value, NULL, 0);
+
+        trace_ctx->trace_queue = trace_queue_start(env_value, queue_size, &trace_ctx->trace_rotate);
+        if (trace_ctx->trace_queue)
+            va_infoMessage("LIBVA_TRACE_ASYNC is on, write the trace files from a thread\n");
+        else
+            va_errorMessage("LIBVA_TRACE_ASYNC: failed to start the writer thread\n");
+    }
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&trace_ctx->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    ((VADisplayContextP)dpy)->vatrace = trace_ctx;
+
+    va_atomic_or(&trace_flag, trace_ctx->trace_flag);
+    /* the calls are timed by VA_LATENCY_START/RECORD */
+    if (trace_ctx->trace_flag & VA_TRACE_FLAG_TIMELINE)
+        va_atomic_or(&latency_flag, VA_LATENCY_FLAG_TIMELINE);
 }
 
 
 void va_TraceEnd(VADisplay dpy)
 {
-    DPY2INDEX(dpy);
-    
-    if (trace_context[idx].trace_fp_log)
-        fclose(trace_context[idx].trace_fp_log);
-    
-    if (trace_context[idx].trace_fp_codedbuf)
-        fclose(trace_context[idx].trace_fp_codedbuf);
+    char golden[128];
+    DPY2TRACECTX(dpy);
+
+    /* before closing the files it writes */
+    if (trace_ctx->trace_queue)
+        trace_queue_stop(trace_ctx->trace_queue);
+
+    if (trace_ctx->trace_fp_log)
+        fclose(trace_ctx->trace_fp_log);
+
+    if (trace_ctx->trace_ring)
+        trace_ring_close(trace_ctx);
+
+    if (trace_ctx->trace_fp_capture)
+        trace_capture_close(trace_ctx);
+
+    if (trace_ctx->trace_fp_codedbuf)
+        fclose(trace_ctx->trace_fp_codedbuf);
     
-    if (trace_context[idx].trace_fp_surface)
-        fclose(trace_context[idx].trace_fp_surface);
+    if (trace_ctx->trace_fp_surface)
+        fclose(trace_ctx->trace_fp_surface);
+
+    if (trace_ctx->trace_fp_framehash)
+        fclose(trace_ctx->trace_fp_framehash);
+
+    if (trace_ctx->trace_fp_golden) {
+        /* the golden file has more frames */
+        if (fgets(golden, sizeof(golden), trace_ctx->trace_fp_golden) &&
+            trace_ctx->trace_golden_mismatches++ == 0)
+            trace_ctx->trace_golden_first = trace_ctx->trace_golden_frames + 1;
+
+        if (trace_ctx->trace_golden_mismatches)
+            va_errorMessage("LIBVA_TRACE_FRAMEHASH_GOLDEN: %u frames differ from %s, "
+                            "the first at line %u\n", trace_ctx->trace_golden_mismatches,
+                            trace_ctx->trace_golden_fn, trace_ctx->trace_golden_first);
+        else
+            va_infoMessage("LIBVA_TRACE_FRAMEHASH_GOLDEN: the %u frames match %s\n",
+                           trace_ctx->trace_golden_frames, trace_ctx->trace_golden_fn);
+        fclose(trace_ctx->trace_fp_golden);
+    }
+
+    /* name the process and close the JSON array */
+    /* the rotated files are complete */
+    trace_rotate_wait(&trace_ctx->trace_rotate);
+
+    if (trace_ctx->trace_fp_timeline) {
+        fprintf(trace_ctx->trace_fp_timeline,
+                "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"args\":{\"name\":\"libva display %d\"}}\n]\n",
+                (int)trace_ctx->trace_pid, trace_ctx->trace_timeline_index);
+        fclose(trace_ctx->trace_fp_timeline);
+    }
 
-    if (trace_context[idx].trace_log_fn)
-        free(trace_context[idx].trace_log_fn);
+    if (trace_ctx->trace_log_fn)
+        free(trace_ctx->trace_log_fn);
     
-    if (trace_context[idx].trace_codedbuf_fn)
-        free(trace_context[idx].trace_codedbuf_fn);
+    if (trace_ctx->trace_codedbuf_fn)
+        free(trace_ctx->trace_codedbuf_fn);
     
-    if (trace_context[idx].trace_surface_fn)
-        free(trace_context[idx].trace_surface_fn);
+    if (trace_ctx->trace_surface_fn)
+        free(trace_ctx->trace_surface_fn);
+
+    if (trace_ctx->trace_lz4_buf)
+        free(trace_ctx->trace_lz4_buf);
+
+    if (trace_ctx->trace_framehash_fn)
+        free(trace_ctx->trace_framehash_fn);
+
+    if (trace_ctx->trace_golden_fn)
+        free(trace_ctx->trace_golden_fn);
+
+    if (trace_ctx->trace_timeline_fn)
+        free(trace_ctx->trace_timeline_fn);
+
+    if (trace_ctx->trace_trigger_fn)
+        free(trace_ctx->trace_trigger_fn);
+
+    if (trace_ctx->trace_trigger_signal)
+        trace_signal_uninstall(trace_ctx->trace_trigger_signal);
     
-    memset(&trace_context[idx], 0, sizeof(struct _trace_context));
+    trace_va_state_fini(trace_ctx);
+
+    pthread_mutex_destroy(&trace_ctx->lock);
+    free(trace_ctx);
+
+    ((VADisplayContextP)dpy)->vatrace = NULL;
 }
 
+void va_TraceLock(VADisplay dpy)
+{
+    DPY2TRACECTX(dpy);
+
+    pthread_mutex_lock(&trace_ctx->lock);
+}
 
-static unsigned int file_size(FILE *fp)
+void va_TraceUnlock(VADisplay dpy)
 {
-    struct stat buf;
+    DPY2TRACECTX(dpy);
+
+    pthread_mutex_unlock(&trace_ctx->lock);
+}
 
-    fstat(fileno(fp), &buf);
 
-    return buf.st_size;
+/* wait for the gzip of the last rotation */
+static void trace_rotate_wait(struct trace_rotate *rotate)
+{
+    if (rotate->compress_pid > 0)
+        waitpid(rotate->compress_pid, NULL, 0);
+    rotate->compress_pid = 0;
 }
 
+/* don't leave the gzip of the last rotation a zombie until the next one */
+static void trace_rotate_reap(struct trace_rotate *rotate)
+{
+    if (rotate->compress_pid > 0 && waitpid(rotate->compress_pid, NULL, WNOHANG) != 0)
+        rotate->compress_pid = 0;
+}
 
-static void truncate_file(FILE *fp)
+/*
+ * fn goes to fn.1, fn.1 to fn.2... up to the LIBVA_TRACE_LOGFILES kept,
+ * then fp writes into a new fn. The FILE stays the same, the writes
+ * still queued for it go into the new file. Called by the writer thread
+ * with LIBVA_TRACE_ASYNC, else with the trace lock held.
+ */
+static void trace_file_rotate(struct trace_rotate *rotate, FILE *fp, const char *fn)
 {
-    ftruncate(fileno(fp), 0);
+    char from[PATH_MAX], to[PATH_MAX];
+    unsigned int i;
+    int fd;
+
+    fflush(fp);
+
+    /* gzip removes fn.1 once compressed, the next one must not be there yet */
+    trace_rotate_wait(rotate);
+
+    for (i = rotate->files - 1; i > 0; i--) {
+        snprintf(from, sizeof(from), "%s.%u", fn, i);
+        snprintf(to, sizeof(to), "%s.%u", fn, i + 1);
+        rename(from, to);
+        snprintf(from, sizeof(from), "%s.%u.gz", fn, i);
+        snprintf(to, sizeof(to), "%s.%u.gz", fn, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", fn);
+    if (rename(fn, to) != 0)
+        return;
+
+    /* keep writing into fn.1 if fn can't be created again */
+    fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return;
+    dup2(fd, fileno(fp));
+    close(fd);
     rewind(fp);
+
+    if (rotate->compress) {
+        char *argv[] = { "gzip", "-f", to, NULL };
+        extern char **environ;
+
+        if (posix_spawnp(&rotate->compress_pid, "gzip", NULL, NULL, argv, environ) != 0)
+            rotate->compress_pid = 0;
+    }
+}
+
+/*
+ * At a frame or sequence boundary of fp: rotate it if the bytes written
+ * since the last rotation reached LIBVA_TRACE_LOGSIZE
+ */
+static void trace_file_boundary(struct trace_context *trace_ctx, FILE *fp, const char *fn, uint64_t *size)
+{
+    /* the writer thread owns compress_pid with LIBVA_TRACE_ASYNC */
+    if (trace_ctx->trace_queue == NULL)
+        trace_rotate_reap(&trace_ctx->trace_rotate);
+
+    if (fp == NULL || *size < trace_ctx->trace_logsize || trace_ctx->trace_rotate.files == 0)
+        return;
+
+    if (trace_ctx->trace_queue) {
+        /* after what is queued for fp, try again at the next boundary if dropped */
+        size_t len = strlen(fn) + 1;
+        void *p = trace_queue_alloc(trace_ctx->trace_queue, fp, len, TRACE_WRITE_ROTATE);
+
+        if (p == NULL)
+            return;
+        memcpy(p, fn, len);
+        trace_queue_commit(trace_ctx->trace_queue);
+    } else
+        trace_file_rotate(&trace_ctx->trace_rotate, fp, fn);
+
+    *size = 0;
 }
 
-void va_TraceMsg(int idx, const char *msg, ...)
+void va_TraceMsg(struct trace_context *trace_ctx, const char *msg, ...)
 {
     va_list args;
 
-    if (!(trace_flag & VA_TRACE_FLAG_LOG))
+    /* no text in binary mode */
+    if (!(trace_ctx->trace_flag & VA_TRACE_FLAG_LOG) || trace_ctx->trace_fp_log == NULL)
         return;
 
-    if (file_size(trace_context[idx].trace_fp_log) >= trace_logsize)
-        truncate_file(trace_context[idx].trace_fp_log);
+    /* only format the text, the writer thread flushes when it is idle */
+    if (trace_ctx->trace_queue) {
+        char buf[512], *p = buf;
+        int len;
+
+        if (msg == NULL)
+            return;
+
+        va_start(args, msg);
+        len = vsnprintf(buf, sizeof(buf), msg, args);
+        va_end(args);
+        if (len < 0)
+            return;
+        if (len >= sizeof(buf)) {
+            p = malloc(len + 1);
+            if (p == NULL)
+                return;
+            va_start(args, msg);
+            vsnprintf(p, len + 1, msg, args);
+            va_end(args);
+        }
+
+        trace_queue_write(trace_ctx->trace_queue, trace_ctx->trace_fp_log, p, len, 0);
+        trace_ctx->trace_log_size += len;
+        if (p != buf)
+            free(p);
+        return;
+    }
+
     if (msg)  {
+        int len;
+
         va_start(args, msg);
-        vfprintf(trace_context[idx].trace_fp_log, msg, args);
+        len = vfprintf(trace_ctx->trace_fp_log, msg, args);
         va_end(args);
+        if (len > 0)
+            trace_ctx->trace_log_size += len;
     } else
-        fflush(trace_context[idx].trace_fp_log);
+        fflush(trace_ctx->trace_fp_log);
 }
 
-void va_TraceCodedBuf(VADisplay dpy)
+static void va_TraceCodedBuf(VADisplay dpy, struct trace_va_context *va_ctx)
 {
     VACodedBufferSegment *buf_list = NULL;
     VAStatus va_status;
-    unsigned char check_sum = 0;
-    DPY2INDEX(dpy);
+    uint32_t crc = 0;
+    DPY2TRACECTX(dpy);
     
-    /* can only truncate at a sequence boudary */
-    if (((file_size(trace_context[idx].trace_fp_log) >= trace_logsize))
-        && trace_context[idx].trace_sequence_start) {
-        va_TraceMsg(idx, "==========truncate file %s\n", trace_context[idx].trace_codedbuf_fn);
-        truncate_file(trace_context[idx].trace_fp_log);
+    /* can only rotate at a sequence boudary */
+    if (trace_ctx->trace_fp_codedbuf && va_ctx->trace_sequence_start &&
+        trace_ctx->trace_codedbuf_size >= trace_ctx->trace_logsize) {
+        va_TraceMsg(trace_ctx, "==========rotate file %s\n", trace_ctx->trace_codedbuf_fn);
+        trace_file_boundary(trace_ctx, trace_ctx->trace_fp_codedbuf, trace_ctx->trace_codedbuf_fn,
+                            &trace_ctx->trace_codedbuf_size);
     }
-    
 
-    trace_context[idx].trace_sequence_start = 0; /* only truncate coded file when meet next new sequence */
+    va_ctx->trace_sequence_start = 0; /* only rotate coded file when meet next new sequence */
     
-    va_status = vaMapBuffer(dpy, trace_context[idx].trace_codedbuf, (void **)(&buf_list));
+    va_status = vaMapBuffer2(dpy, va_ctx->trace_codedbuf, VA_MAPBUFFER_FLAG_READ, (void **)(&buf_list));
     if (va_status != VA_STATUS_SUCCESS)
         return;
 
-    va_TraceMsg(idx, "==========dump codedbuf into file %s\n", trace_context[idx].trace_codedbuf_fn);
+    va_TraceMsg(trace_ctx, "==========dump codedbuf into file %s\n", trace_ctx->trace_codedbuf_fn);
     
     while (buf_list != NULL) {
-        unsigned int i;
-        
-        va_TraceMsg(idx, "\tsize = %d\n", buf_list->size);
-        if (trace_context[idx].trace_fp_log)
-            fwrite(buf_list->buf, buf_list->size, 1, trace_context[idx].trace_fp_codedbuf);
+        va_TraceMsg(trace_ctx, "\tsize = %d\n", buf_list->size);
+        if (trace_ctx->trace_fp_codedbuf && trace_ctx->trace_queue)
+            trace_queue_write(trace_ctx->trace_queue, trace_ctx->trace_fp_codedbuf,
+                              buf_list->buf, buf_list->size, TRACE_WRITE_BULKY);
+        else if (trace_ctx->trace_fp_codedbuf)
+            fwrite(buf_list->buf, buf_list->size, 1, trace_ctx->trace_fp_codedbuf);
+        trace_ctx->trace_codedbuf_size += buf_list->size;
 
-        for (i=0; i<buf_list->size; i++)
-            check_sum ^= *((unsigned char *)buf_list->buf + i);
+        crc = va_Crc32c(crc, buf_list->buf, buf_list->size);
 
         buf_list = buf_list->next;
     }
-    vaUnmapBuffer(dpy,trace_context[idx].trace_codedbuf);
+    vaUnmapBuffer(dpy,va_ctx->trace_codedbuf);
     
-    va_TraceMsg(idx, "\tchecksum = 0x%02x\n", check_sum);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tcrc32c = 0x%08x\n", crc);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
-void va_TraceSurface(VADisplay dpy)
+/* a plane of a locked surface, width is in bytes */
+struct trace_surface_plane {
+    unsigned char *data;
+    unsigned int stride;
+    unsigned int width;
+    unsigned int height;
+};
+
+#define TRACE_SURFACE_MAX_PLANES 3
+#define TRACE_SURFACE_IOV       256 /* rows per writev() */
+#define TRACE_FOURCC_I420       VA_FOURCC('I', '4', '2', '0')
+
+static void trace_surface_plane(
+    struct trace_surface_plane *plane,
+    unsigned char *data,
+    unsigned int stride,
+    unsigned int width,
+    unsigned int height
+)
+{
+    plane->data = data;
+    plane->stride = stride;
+    plane->width = width;
+    plane->height = height;
+}
+
+/*
+ * the planes of a width x height surface in the order of the file format
+ * of fourcc (e.g. Y, V then U for YV12), only the luma if it isn't known
+ */
+static int trace_surface_planes(
+    struct trace_surface_plane *planes,
+    unsigned int fourcc,
+    unsigned char *buffer,
+    unsigned int width,
+    unsigned int height,
+    const unsigned int *strides, /* Y, U, V */
+    const unsigned int *offsets
+)
+{
+    unsigned char *y = buffer + offsets[0];
+    unsigned char *u = buffer + offsets[1];
+    unsigned char *v = buffer + offsets[2];
+    unsigned int chroma_width = (width + 1) / 2;
+    unsigned int chroma_height = (height + 1) / 2;
+
+    switch (fourcc) {
+    case VA_FOURCC_NV12:
+        trace_surface_plane(&planes[0], y, strides[0], width, height);
+        trace_surface_plane(&planes[1], u, strides[1], chroma_width * 2, chroma_height);
+        return 2;
+    case VA_FOURCC_IYUV:
+    case TRACE_FOURCC_I420:
+        trace_surface_plane(&planes[0], y, strides[0], width, height);
+        trace_surface_plane(&planes[1], u, strides[1], chroma_width, chroma_height);
+        trace_surface_plane(&planes[2], v, strides[2], chroma_width, chroma_height);
+        return 3;
+    case VA_FOURCC_YV12:
+        trace_surface_plane(&planes[0], y, strides[0], width, height);
+        trace_surface_plane(&planes[1], v, strides[2], chroma_width, chroma_height);
+        trace_surface_plane(&planes[2], u, strides[1], chroma_width, chroma_height);
+        return 3;
+    case VA_FOURCC_YUY2:
+    case VA_FOURCC_UYVY:
+        trace_surface_plane(&planes[0], y, strides[0], chroma_width * 4, height);
+        return 1;
+    case VA_FOURCC_RGBA:
+    case VA_FOURCC_BGRA:
+    case VA_FOURCC_AYUV:
+        trace_surface_plane(&planes[0], y, strides[0], width * 4, height);
+        return 1;
+    default:
+        trace_surface_plane(&planes[0], y, strides[0], width, height);
+        return 1;
+    }
+}
+
+static uint32_t trace_surface_crc(const struct trace_surface_plane *plane)
+{
+    uint32_t crc = 0;
+    unsigned int i;
+
+    if (plane->stride == plane->width)
+        return va_Crc32c(0, plane->data, plane->width * plane->height);
+
+    for (i = 0; i < plane->height; i++)
+        crc = va_Crc32c(crc, plane->data + i * plane->stride, plane->width);
+
+    return crc;
+}
+
+/* copy the rows of the planes at dst, without their padding */
+static unsigned char *trace_surface_copy(
+    unsigned char *dst,
+    const struct trace_surface_plane *planes,
+    int num_planes
+)
+{
+    unsigned int j;
+    int i;
+
+    for (i = 0; i < num_planes; i++) {
+        if (planes[i].stride == planes[i].width) {
+            memcpy(dst, planes[i].data, planes[i].width * planes[i].height);
+            dst += planes[i].width * planes[i].height;
+            continue;
+        }
+        for (j = 0; j < planes[i].height; j++) {
+            memcpy(dst, planes[i].data + j * planes[i].stride, planes[i].width);
+            dst += planes[i].width;
+        }
+    }
+
+    return dst;
+}
+
+static int trace_writev(int fd, struct iovec *iov, int num)
+{
+    ssize_t written;
+
+    while (num > 0) {
+        written = writev(fd, iov, num);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (num > 0 && written >= (ssize_t)iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            num--;
+        }
+        if (num > 0) {
+            iov->iov_base = (unsigned char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
+
+/* write the rows of the planes into fd, TRACE_SURFACE_IOV rows per system call */
+static int trace_surface_writev(int fd, const struct trace_surface_plane *planes, int num_planes)
+{
+    struct iovec iov[TRACE_SURFACE_IOV];
+    unsigned int rows, row_size, j;
+    int i, n = 0;
+
+    for (i = 0; i < num_planes; i++) {
+        rows = planes[i].height;
+        row_size = planes[i].width;
+        if (planes[i].stride == planes[i].width) {
+            row_size *= rows;
+            rows = 1;
+        }
+
+        for (j = 0; j < rows; j++) {
+            iov[n].iov_base = planes[i].data + j * planes[i].stride;
+            iov[n].iov_len = row_size;
+            if (++n == TRACE_SURFACE_IOV) {
+                if (trace_writev(fd, iov, n) != 0)
+                    return -1;
+                n = 0;
+            }
+        }
+    }
+
+    return n ? trace_writev(fd, iov, n) : 0;
+}
+
+#ifdef HAVE_LZ4
+/* LIBVA_TRACE_SURFACE_LZ4, save the surface as a LZ4 frame */
+static void trace_surface_lz4(
+    struct trace_context *trace_ctx,
+    FILE *fp,
+    const struct trace_surface_plane *planes,
+    int num_planes,
+    size_t size
+)
+{
+    LZ4F_preferences_t prefs;
+    size_t bound, lz4_size;
+    unsigned char *src, *dst;
+
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.frameInfo.contentSize = size;
+    bound = LZ4F_compressFrameBound(size, &prefs);
+
+    if (trace_ctx->trace_lz4_buf_size < size + bound) {
+        unsigned char *tmp = realloc(trace_ctx->trace_lz4_buf, size + bound);
+
+        if (tmp == NULL) {
+            va_TraceMsg(trace_ctx, "Error:no memory to compress the surface\n");
+            return;
+        }
+        trace_ctx->trace_lz4_buf = tmp;
+        trace_ctx->trace_lz4_buf_size = size + bound;
+    }
+    src = trace_ctx->trace_lz4_buf;
+    dst = src + size;
+
+    trace_surface_copy(src, planes, num_planes);
+    lz4_size = LZ4F_compressFrame(dst, bound, src, size, &prefs);
+    if (LZ4F_isError(lz4_size)) {
+        va_TraceMsg(trace_ctx, "Error:LZ4F_compressFrame failed (%s)\n", LZ4F_getErrorName(lz4_size));
+        return;
+    }
+    va_TraceMsg(trace_ctx, "\tlz4 size = %u\n", (unsigned int)lz4_size);
+
+    if (trace_ctx->trace_queue)
+        trace_queue_write(trace_ctx->trace_queue, fp, dst, lz4_size, TRACE_WRITE_BULKY);
+    else
+        fwrite(dst, lz4_size, 1, fp);
+    trace_ctx->trace_surface_size += lz4_size;
+}
+#endif
+
+/* LIBVA_TRACE_FRAMEHASH/_GOLDEN, save or check the hashes of the frame of va_ctx */
+static void va_TraceFrameHash(
+    struct trace_context *trace_ctx,
+    struct trace_va_context *va_ctx,
+    uint32_t *crc,
+    int num_planes
+)
+{
+    char line[128], golden[128];
+    int len, i;
+
+    len = snprintf(line, sizeof(line), "%u %ux%u", va_ctx->trace_frame_no,
+                   va_ctx->trace_frame_width, va_ctx->trace_frame_height);
+    for (i = 0; i < num_planes; i++)
+        len += snprintf(line + len, sizeof(line) - len, " %08x", crc[i]);
+    len += snprintf(line + len, sizeof(line) - len, "\n");
+
+    if (trace_ctx->trace_fp_framehash && trace_ctx->trace_queue)
+        trace_queue_write(trace_ctx->trace_queue, trace_ctx->trace_fp_framehash, line, len, 0);
+    else if (trace_ctx->trace_fp_framehash)
+        fwrite(line, len, 1, trace_ctx->trace_fp_framehash);
+
+    if (trace_ctx->trace_fp_golden == NULL)
+        return;
+
+    trace_ctx->trace_golden_frames++;
+    if (fgets(golden, sizeof(golden), trace_ctx->trace_fp_golden) && strcmp(golden, line) == 0)
+        return;
+
+    if (trace_ctx->trace_golden_mismatches++ == 0) {
+        trace_ctx->trace_golden_first = trace_ctx->trace_golden_frames;
+        va_errorMessage("LIBVA_TRACE_FRAMEHASH_GOLDEN: frame %u of context 0x%08x differs "
+                        "from line %u of %s\n", va_ctx->trace_frame_no, va_ctx->entry.key,
+                        trace_ctx->trace_golden_frames, trace_ctx->trace_golden_fn);
+    }
+    va_TraceMsg(trace_ctx, "==========frame differs from line %u of %s\n",
+                trace_ctx->trace_golden_frames, trace_ctx->trace_golden_fn);
+}
+
+/* dump the render target of va_ctx into the surface file, and hash its planes */
+static void va_TraceSurface(VADisplay dpy, struct trace_va_context *va_ctx, int dump, int hash)
 {
-    unsigned int i, j;
     unsigned int fourcc; /* following are output argument */
-    unsigned int luma_stride;
-    unsigned int chroma_u_stride;
-    unsigned int chroma_v_stride;
-    unsigned int luma_offset;
-    unsigned int chroma_u_offset;
-    unsigned int chroma_v_offset;
+    unsigned int strides[3]; /* luma, chroma_u, chroma_v */
+    unsigned int offsets[3];
     unsigned int buffer_name;
     void *buffer = NULL;
-    unsigned char *Y_data, *UV_data, *tmp;
+    struct trace_surface_plane planes[TRACE_SURFACE_MAX_PLANES];
+    uint32_t crc[TRACE_SURFACE_MAX_PLANES];
+    unsigned char *dst;
+    size_t size = 0;
     VAStatus va_status;
-    unsigned char check_sum = 0;
-    DPY2INDEX(dpy);
-
-    va_TraceMsg(idx, "==========dump surface data in file %s\n", trace_context[idx].trace_surface_fn);
-
-    if ((file_size(trace_context[idx].trace_fp_surface) >= trace_logsize)) {
-        va_TraceMsg(idx, "==========truncate file %s\n", trace_context[idx].trace_surface_fn);
-        truncate_file(trace_context[idx].trace_fp_surface);
+    int num_planes, i;
+    FILE *fp;
+    DPY2TRACECTX(dpy);
+
+    fp = dump ? trace_ctx->trace_fp_surface : NULL;
+    if (fp)
+        va_TraceMsg(trace_ctx, "==========dump surface data in file %s\n", trace_ctx->trace_surface_fn);
+    else
+        va_TraceMsg(trace_ctx, "==========hash surface data\n");
+
+    /* between two surfaces */
+    if (fp && trace_ctx->trace_surface_size >= trace_ctx->trace_logsize) {
+        va_TraceMsg(trace_ctx, "==========rotate file %s\n", trace_ctx->trace_surface_fn);
+        trace_file_boundary(trace_ctx, fp, trace_ctx->trace_surface_fn, &trace_ctx->trace_surface_size);
     }
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 
     va_status = vaLockSurface(
         dpy,
-        trace_context[idx].trace_rendertarget,
+        va_ctx->trace_rendertarget,
         &fourcc,
-        &luma_stride, &chroma_u_stride, &chroma_v_stride,
-        &luma_offset, &chroma_u_offset, &chroma_v_offset,
+        &strides[0], &strides[1], &strides[2],
+        &offsets[0], &offsets[1], &offsets[2],
         &buffer_name, &buffer);
 
     if (va_status != VA_STATUS_SUCCESS) {
-        va_TraceMsg(idx, "Error:vaLockSurface failed\n");
+        va_TraceMsg(trace_ctx, "Error:vaLockSurface failed\n");
         return;
     }
 
-    va_TraceMsg(idx, "\tfourcc = 0x%08x\n", fourcc);
-    va_TraceMsg(idx, "\twidth = %d\n", trace_context[idx].trace_frame_width);
-    va_TraceMsg(idx, "\theight = %d\n", trace_context[idx].trace_frame_height);
-    va_TraceMsg(idx, "\tluma_stride = %d\n", luma_stride);
-    va_TraceMsg(idx, "\tchroma_u_stride = %d\n", chroma_u_stride);
-    va_TraceMsg(idx, "\tchroma_v_stride = %d\n", chroma_v_stride);
-    va_TraceMsg(idx, "\tluma_offset = %d\n", luma_offset);
-    va_TraceMsg(idx, "\tchroma_u_offset = %d\n", chroma_u_offset);
-    va_TraceMsg(idx, "\tchroma_v_offset = %d\n", chroma_v_offset);
+    va_TraceMsg(trace_ctx, "\tfourcc = 0x%08x\n", fourcc);
+    va_TraceMsg(trace_ctx, "\twidth = %d\n", va_ctx->trace_frame_width);
+    va_TraceMsg(trace_ctx, "\theight = %d\n", va_ctx->trace_frame_height);
+    va_TraceMsg(trace_ctx, "\tluma_stride = %d\n", strides[0]);
+    va_TraceMsg(trace_ctx, "\tchroma_u_stride = %d\n", strides[1]);
+    va_TraceMsg(trace_ctx, "\tchroma_v_stride = %d\n", strides[2]);
+    va_TraceMsg(trace_ctx, "\tluma_offset = %d\n", offsets[0]);
+    va_TraceMsg(trace_ctx, "\tchroma_u_offset = %d\n", offsets[1]);
+    va_TraceMsg(trace_ctx, "\tchroma_v_offset = %d\n", offsets[2]);
 
     if (buffer == NULL) {
-        va_TraceMsg(idx, "Error:vaLockSurface return NULL buffer\n");
-        va_TraceMsg(idx, NULL);
+        va_TraceMsg(trace_ctx, "Error:vaLockSurface return NULL buffer\n");
+        va_TraceMsg(trace_ctx, NULL);
 
-        vaUnlockSurface(dpy, trace_context[idx].trace_rendertarget);
+        vaUnlockSurface(dpy, va_ctx->trace_rendertarget);
         return;
     }
-    va_TraceMsg(idx, "\tbuffer location = 0x%08x\n", buffer);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tbuffer location = 0x%08x\n", buffer);
+    va_TraceMsg(trace_ctx, NULL);
+
+    num_planes = trace_surface_planes(planes, fourcc, buffer, va_ctx->trace_frame_width,
+                                      va_ctx->trace_frame_height, strides, offsets);
+    for (i = 0; i < num_planes; i++) {
+        crc[i] = trace_surface_crc(&planes[i]);
+        size += planes[i].width * planes[i].height;
+    }
 
-    Y_data = (unsigned char*)buffer;
-    UV_data = (unsigned char*)buffer + chroma_u_offset;
-
-    tmp = Y_data;
-    for (i=0; i<trace_context[idx].trace_frame_height; i++) {
-        if (trace_context[idx].trace_fp_surface)
-            fwrite(tmp, trace_context[idx].trace_frame_width, 1, trace_context[idx].trace_fp_surface);
-        
-        tmp = Y_data + i * luma_stride;
-    }
-    tmp = UV_data;
-    if (fourcc == VA_FOURCC_NV12) {
-        for (i=0; i<trace_context[idx].trace_frame_height/2; i++) {
-            if (trace_context[idx].trace_fp_surface)
-                fwrite(tmp, trace_context[idx].trace_frame_width, 1, trace_context[idx].trace_fp_surface);
-            
-            tmp = UV_data + i * chroma_u_stride;
+#ifdef HAVE_LZ4
+    if (fp && trace_ctx->trace_surface_lz4)
+        trace_surface_lz4(trace_ctx, fp, planes, num_planes, size);
+    else
+#endif
+    if (fp && trace_ctx->trace_queue) {
+        /* copy the surface into the queue, the writer thread saves it */
+        dst = trace_queue_alloc(trace_ctx->trace_queue, fp, size, TRACE_WRITE_BULKY);
+        if (dst) {
+            trace_surface_copy(dst, planes, num_planes);
+            trace_queue_commit(trace_ctx->trace_queue);
         }
+        trace_ctx->trace_surface_size += size;
+    } else if (fp) {
+        /* straight from the surface, the stream of fp is never used */
+        if (trace_surface_writev(fileno(fp), planes, num_planes) != 0)
+            va_TraceMsg(trace_ctx, "Error:failed to write the surface (%s)\n", strerror(errno));
+        trace_ctx->trace_surface_size += size;
     }
 
-    vaUnlockSurface(dpy, trace_context[idx].trace_rendertarget);
+    vaUnlockSurface(dpy, va_ctx->trace_rendertarget);
 
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tcrc32c =");
+    for (i = 0; i < num_planes; i++)
+        va_TraceMsg(trace_ctx, " 0x%08x", crc[i]);
+    va_TraceMsg(trace_ctx, "\n");
+    if (hash)
+        va_TraceFrameHash(trace_ctx, va_ctx, crc, num_planes);
+
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
@@ -413,16 +2170,18 @@ void va_TraceInitialize (
     int *minor_version      /* out */
 )
 {
-    DPY2INDEX(dpy);    
-    TRACE_FUNCNAME(idx);
+    DPY2TRACECTX(dpy);    
+    TRACE_RECORD(trace_ctx, Initialize, NULL, 0, 0);
+    TRACE_FUNCNAME(trace_ctx);
 }
 
 void va_TraceTerminate (
     VADisplay dpy
 )
 {
-    DPY2INDEX(dpy);    
-    TRACE_FUNCNAME(idx);
+    DPY2TRACECTX(dpy);    
+    TRACE_RECORD(trace_ctx, Terminate, NULL, 0, 0);
+    TRACE_FUNCNAME(trace_ctx);
 }
 
 
@@ -437,53 +2196,76 @@ void va_TraceCreateConfig(
 {
     int i;
     int encode, decode, jpeg;
-    DPY2INDEX(dpy);
+    struct trace_va_config *config;
+    DPY2TRACECTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    TRACE_RECORD(trace_ctx, CreateConfig, attrib_list, num_attribs * sizeof(VAConfigAttrib),
+                 profile, entrypoint, num_attribs, *config_id);
+    TRACE_FUNCNAME(trace_ctx);
     
-    va_TraceMsg(idx, "\tprofile = %d\n", profile);
-    va_TraceMsg(idx, "\tentrypoint = %d\n", entrypoint);
-    va_TraceMsg(idx, "\tnum_attribs = %d\n", num_attribs);
+    va_TraceMsg(trace_ctx, "\tprofile = %d\n", profile);
+    va_TraceMsg(trace_ctx, "\tentrypoint = %d\n", entrypoint);
+    va_TraceMsg(trace_ctx, "\tnum_attribs = %d\n", num_attribs);
     for (i = 0; i < num_attribs; i++) {
-        va_TraceMsg(idx, "\t\tattrib_list[%d].type = 0x%08x\n", i, attrib_list[i].type);
-        va_TraceMsg(idx, "\t\tattrib_list[%d].value = 0x%08x\n", i, attrib_list[i].value);
-    }
-    va_TraceMsg(idx, NULL);
-
-    trace_context[idx].trace_profile = profile;
-    trace_context[idx].trace_entrypoint = entrypoint;
-
-    /* avoid to create so many empty files */
-    encode = (trace_context[idx].trace_entrypoint == VAEntrypointEncSlice);
-    decode = (trace_context[idx].trace_entrypoint == VAEntrypointVLD);
-    jpeg = (trace_context[idx].trace_entrypoint == VAEntrypointEncPicture);
-    if ((encode && (trace_flag & VA_TRACE_FLAG_SURFACE_ENCODE)) ||
-        (decode && (trace_flag & VA_TRACE_FLAG_SURFACE_DECODE)) ||
-        (jpeg && (trace_flag & VA_TRACE_FLAG_SURFACE_JPEG))) {
-        FILE *tmp = fopen(trace_context[idx].trace_surface_fn, "w");
+        va_TraceMsg(trace_ctx, "\t\tattrib_list[%d].type = 0x%08x\n", i, attrib_list[i].type);
+        va_TraceMsg(trace_ctx, "\t\tattrib_list[%d].value = 0x%08x\n", i, attrib_list[i].value);
+    }
+    va_TraceMsg(trace_ctx, NULL);
+
+    /*
+     * for the contexts created with it, the driver may reuse the ID; only
+     * called when the driver created *config_id
+     */
+    config = (struct trace_va_config *)va_HashLookup(&trace_ctx->trace_configs, *config_id);
+    if (config == NULL) {
+        config = calloc(1, sizeof(struct trace_va_config));
+        if (config) {
+            config->entry.key = *config_id;
+            va_HashInsert(&trace_ctx->trace_configs, &config->entry);
+        }
+    }
+    if (config) {
+        config->trace_profile = profile;
+        config->trace_entrypoint = entrypoint;
+    }
+
+    /*
+     * avoid to create so many empty files, and open them only once, the
+     * contexts of the other configs may be writing into them
+     */
+    encode = (entrypoint == VAEntrypointEncSlice);
+    decode = (entrypoint == VAEntrypointVLD);
+    jpeg = (entrypoint == VAEntrypointEncPicture);
+    if (trace_ctx->trace_fp_surface)
+        ; /* already open */
+    else if ((encode && (trace_ctx->trace_flag & VA_TRACE_FLAG_SURFACE_ENCODE)) ||
+        (decode && (trace_ctx->trace_flag & VA_TRACE_FLAG_SURFACE_DECODE)) ||
+        (jpeg && (trace_ctx->trace_flag & VA_TRACE_FLAG_SURFACE_JPEG))) {
+        FILE *tmp = fopen(trace_ctx->trace_surface_fn, "w");
         
         if (tmp)
-            trace_context[idx].trace_fp_surface = tmp;
+            trace_ctx->trace_fp_surface = tmp;
         else {
             va_errorMessage("Open file %s failed (%s)\n",
-                            trace_context[idx].trace_surface_fn,
+                            trace_ctx->trace_surface_fn,
                             strerror(errno));
-            trace_context[idx].trace_fp_surface = NULL;
-            trace_flag &= ~(VA_TRACE_FLAG_SURFACE);
+            trace_ctx->trace_fp_surface = NULL;
+            trace_ctx->trace_flag &= ~(VA_TRACE_FLAG_SURFACE);
         }
     }
 
-    if (encode && (trace_flag & VA_TRACE_FLAG_CODEDBUF)) {
-        FILE *tmp = fopen(trace_context[idx].trace_codedbuf_fn, "w");
+    if (encode && (trace_ctx->trace_flag & VA_TRACE_FLAG_CODEDBUF) &&
+        trace_ctx->trace_fp_codedbuf == NULL) {
+        FILE *tmp = fopen(trace_ctx->trace_codedbuf_fn, "w");
         
         if (tmp)
-            trace_context[idx].trace_fp_codedbuf = tmp;
+            trace_ctx->trace_fp_codedbuf = tmp;
         else {
             va_errorMessage("Open file %s failed (%s)\n",
-                            trace_context[idx].trace_codedbuf_fn,
+                            trace_ctx->trace_codedbuf_fn,
                             strerror(errno));
-            trace_context[idx].trace_fp_codedbuf = NULL;
-            trace_flag &= ~VA_TRACE_FLAG_CODEDBUF;
+            trace_ctx->trace_fp_codedbuf = NULL;
+            trace_ctx->trace_flag &= ~VA_TRACE_FLAG_CODEDBUF;
         }
     }
 }
@@ -499,19 +2281,21 @@ void va_TraceCreateSurface(
 )
 {
     int i;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    TRACE_RECORD(trace_ctx, CreateSurface, surfaces, num_surfaces * sizeof(VASurfaceID),
+                 width, height, format, num_surfaces);
+    TRACE_FUNCNAME(trace_ctx);
     
-    va_TraceMsg(idx, "\twidth = %d\n", width);
-    va_TraceMsg(idx, "\theight = %d\n", height);
-    va_TraceMsg(idx, "\tformat = %d\n", format);
-    va_TraceMsg(idx, "\tnum_surfaces = %d\n", num_surfaces);
+    va_TraceMsg(trace_ctx, "\twidth = %d\n", width);
+    va_TraceMsg(trace_ctx, "\theight = %d\n", height);
+    va_TraceMsg(trace_ctx, "\tformat = %d\n", format);
+    va_TraceMsg(trace_ctx, "\tnum_surfaces = %d\n", num_surfaces);
 
     for (i = 0; i < num_surfaces; i++)
-        va_TraceMsg(idx, "\t\tsurfaces[%d] = 0x%08x\n", i, surfaces[i]);
+        va_TraceMsg(trace_ctx, "\t\tsurfaces[%d] = 0x%08x\n", i, surfaces[i]);
 
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
@@ -527,26 +2311,111 @@ void va_TraceCreateContext(
 )
 {
     int i;
-    DPY2INDEX(dpy);
+    struct trace_va_config *config;
+    struct trace_va_context *va_ctx;
+    DPY2TRACECTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    TRACE_RECORD(trace_ctx, CreateContext, render_targets, num_render_targets * sizeof(VASurfaceID),
+                 config_id, picture_width, picture_height, flag, num_render_targets, *context);
+    TRACE_FUNCNAME(trace_ctx);
     
-    va_TraceMsg(idx, "\twidth = %d\n", picture_width);
-    va_TraceMsg(idx, "\theight = %d\n", picture_height);
-    va_TraceMsg(idx, "\tflag = 0x%08x\n", flag);
-    va_TraceMsg(idx, "\tnum_render_targets = %d\n", num_render_targets);
+    va_TraceMsg(trace_ctx, "\twidth = %d\n", picture_width);
+    va_TraceMsg(trace_ctx, "\theight = %d\n", picture_height);
+    va_TraceMsg(trace_ctx, "\tflag = 0x%08x\n", flag);
+    va_TraceMsg(trace_ctx, "\tnum_render_targets = %d\n", num_render_targets);
     for (i=0; i<num_render_targets; i++)
-        va_TraceMsg(idx, "\t\trender_targets[%d] = 0x%08x\n", i, render_targets[i]);
-    va_TraceMsg(idx, "\tcontext = 0x%08x\n", *context);
-    va_TraceMsg(idx, NULL);
+        va_TraceMsg(trace_ctx, "\t\trender_targets[%d] = 0x%08x\n", i, render_targets[i]);
+    va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", *context);
+    va_TraceMsg(trace_ctx, NULL);
+
+    trace_ctx->trace_context = *context;
+
+    /*
+     * a new context, or the driver reuses the ID of a destroyed one; only
+     * called when the driver created *context
+     */
+    free(va_HashRemove(&trace_ctx->trace_contexts, *context));
+    va_ctx = trace_va_context_create(trace_ctx, *context);
+    if (va_ctx == NULL)
+        return;
+
+    config = (struct trace_va_config *)va_HashLookup(&trace_ctx->trace_configs, config_id);
+    if (config) {
+        va_ctx->trace_profile = config->trace_profile;
+        va_ctx->trace_entrypoint = config->trace_entrypoint;
+    }
+
+    va_ctx->trace_frame_width = picture_width;
+    va_ctx->trace_frame_height = picture_height;
+}
+
+
+void va_TraceDestroyConfig(
+    VADisplay dpy,
+    VAConfigID config_id
+)
+{
+    DPY2TRACECTX(dpy);
+
+    TRACE_RECORD(trace_ctx, DestroyConfig, NULL, 0, config_id);
+    TRACE_FUNCNAME(trace_ctx);
+
+    va_TraceMsg(trace_ctx, "\tconfig = 0x%08x\n", config_id);
+    va_TraceMsg(trace_ctx, NULL);
+
+    free(va_HashRemove(&trace_ctx->trace_configs, config_id));
+}
+
+
+void va_TraceDestroySurfaces(
+    VADisplay dpy,
+    VASurfaceID *surface_list,
+    int num_surfaces
+)
+{
+    int i;
+    DPY2TRACECTX(dpy);
+
+    TRACE_RECORD(trace_ctx, DestroySurfaces, surface_list, num_surfaces * sizeof(VASurfaceID),
+                 num_surfaces);
+    TRACE_FUNCNAME(trace_ctx);
+
+    va_TraceMsg(trace_ctx, "\tnum_surfaces = %d\n", num_surfaces);
+    for (i = 0; i < num_surfaces; i++)
+        va_TraceMsg(trace_ctx, "\t\tsurfaces[%d] = 0x%08x\n", i, surface_list[i]);
+    va_TraceMsg(trace_ctx, NULL);
+}
+
+
+void va_TraceDestroyContext(
+    VADisplay dpy,
+    VAContextID context
+)
+{
+    DPY2TRACECTX(dpy);
+
+    TRACE_RECORD(trace_ctx, DestroyContext, NULL, 0, context);
+    TRACE_FUNCNAME(trace_ctx);
+
+    va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
+    va_TraceMsg(trace_ctx, NULL);
+
+    free(va_HashRemove(&trace_ctx->trace_contexts, context));
+}
+
 
-    trace_context[idx].trace_context = *context;
+void va_TraceDestroyBuffer(
+    VADisplay dpy,
+    VABufferID buf_id
+)
+{
+    DPY2TRACECTX(dpy);
 
-    trace_context[idx].trace_frame_no = 0;
-    trace_context[idx].trace_slice_no = 0;
+    TRACE_RECORD(trace_ctx, DestroyBuffer, NULL, 0, buf_id);
+    TRACE_FUNCNAME(trace_ctx);
 
-    trace_context[idx].trace_frame_width = picture_width;
-    trace_context[idx].trace_frame_height = picture_height;
+    va_TraceMsg(trace_ctx, "\tbuf_id = 0x%08x\n", buf_id);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
@@ -573,6 +2442,57 @@ static char * buffer_type_to_string(int type)
     }
 }
 
+static void va_TraceCodedBufSegments(
+    struct trace_context *trace_ctx,
+    VACodedBufferSegment *buf_list
+)
+{
+    int i = 0;
+
+    while (buf_list != NULL) {
+        va_TraceMsg(trace_ctx, "\tCodedbuf[%d] =\n", i++);
+        
+        va_TraceMsg(trace_ctx, "\t   size = %d\n", buf_list->size);
+        va_TraceMsg(trace_ctx, "\t   bit_offset = %d\n", buf_list->bit_offset);
+        va_TraceMsg(trace_ctx, "\t   status = 0x%08x\n", buf_list->status);
+        va_TraceMsg(trace_ctx, "\t   reserved = 0x%08x\n", buf_list->reserved);
+        va_TraceMsg(trace_ctx, "\t   buf = 0x%08x\n", buf_list->buf);
+
+        buf_list = buf_list->next;
+    }
+    va_TraceMsg(trace_ctx, NULL);
+}
+
+/* binary mode, save the segment headers, not the coded data */
+static void va_TraceCodedBufSegmentsRecord(
+    struct trace_context *trace_ctx,
+    VABufferID buf_id,
+    VACodedBufferSegment *buf_list
+)
+{
+    VACodedBufferSegment *p;
+    struct trace_coded_segment *segment;
+    uint32_t args[TRACE_RECORD_ARGS] = { buf_id };
+    unsigned int num_segments = 0, data_size;
+
+    for (p = buf_list; p != NULL; p = p->next)
+        num_segments++;
+    args[1] = num_segments;
+
+    data_size = num_segments * sizeof(struct trace_coded_segment);
+    segment = trace_record_alloc(trace_ctx, TRACE_CALL_MapBuffer, 0, args, &data_size);
+    for (p = buf_list; p != NULL && data_size >= sizeof(*segment); p = p->next) {
+        segment->size = p->size;
+        segment->bit_offset = p->bit_offset;
+        segment->status = p->status;
+        segment->reserved = p->reserved;
+        segment->buf = (uintptr_t)p->buf;
+        segment++;
+        data_size -= sizeof(*segment);
+    }
+    trace_record_commit(trace_ctx);
+}
+
 void va_TraceMapBuffer (
     VADisplay dpy,
     VABufferID buf_id,    /* in */
@@ -583,36 +2503,25 @@ void va_TraceMapBuffer (
     unsigned int size;
     unsigned int num_elements;
     
-    VACodedBufferSegment *buf_list;
-    int i = 0;
-    
-    DPY2INDEX(dpy);
+    DPY2TRACECTX_SAMPLED(dpy);
 
-    vaBufferInfo(dpy, trace_context[idx].trace_context, buf_id, &type, &size, &num_elements);    
+    if (vaBufferInfo(dpy, trace_ctx->trace_context, buf_id, &type, &size, &num_elements) != VA_STATUS_SUCCESS)
+        return;
     /*
-      va_TraceMsg(idx, "\tbuf_id=0x%x\n", buf_id);
-      va_TraceMsg(idx, "\tbuf_type=%s\n", buffer_type_to_string(type));
-      va_TraceMsg(idx, "\tbuf_size=%s\n", size);
-      va_TraceMsg(idx, "\tbuf_elements=%s\n", &num_elements);
+      va_TraceMsg(trace_ctx, "\tbuf_id=0x%x\n", buf_id);
+      va_TraceMsg(trace_ctx, "\tbuf_type=%s\n", buffer_type_to_string(type));
+      va_TraceMsg(trace_ctx, "\tbuf_size=%s\n", size);
+      va_TraceMsg(trace_ctx, "\tbuf_elements=%s\n", &num_elements);
     */
     
     /* only trace CodedBuffer */
     if (type != VAEncCodedBufferType)
         return;
-    
-    buf_list = (VACodedBufferSegment *)(*pbuf);
-    while (buf_list != NULL) {
-        va_TraceMsg(idx, "\tCodedbuf[%d] =\n", i++);
-        
-        va_TraceMsg(idx, "\t   size = %d\n", buf_list->size);
-        va_TraceMsg(idx, "\t   bit_offset = %d\n", buf_list->bit_offset);
-        va_TraceMsg(idx, "\t   status = 0x%08x\n", buf_list->status);
-        va_TraceMsg(idx, "\t   reserved = 0x%08x\n", buf_list->reserved);
-        va_TraceMsg(idx, "\t   buf = 0x%08x\n", buf_list->buf);
 
-        buf_list = buf_list->next;
-    }
-    va_TraceMsg(idx, NULL);
+    if (trace_ctx->trace_binary)
+        va_TraceCodedBufSegmentsRecord(trace_ctx, buf_id, (VACodedBufferSegment *)(*pbuf));
+    else
+        va_TraceCodedBufSegments(trace_ctx, (VACodedBufferSegment *)(*pbuf));
 }
 
 static void va_TraceVABuffers(
@@ -627,25 +2536,20 @@ static void va_TraceVABuffers(
 {
     unsigned int i;
     unsigned char *p = pbuf;
-    unsigned char  check_sum = 0;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
     
-    va_TraceMsg(idx, "%s\n",  buffer_type_to_string(type));
-
-    for (i=0; i<size; i++) {
-        unsigned char value =  p[i];
-            
-        if ((trace_flag & VA_TRACE_FLAG_BUFDATA) && ((i%16) == 0))
-            va_TraceMsg(idx, "\n0x%08x:", i);
-
-        if (trace_flag & VA_TRACE_FLAG_BUFDATA)
-            va_TraceMsg(idx, " %02x", value);
+    va_TraceMsg(trace_ctx, "%s\n",  buffer_type_to_string(type));
 
-        check_sum ^= value;
+    if (trace_ctx->trace_flag & VA_TRACE_FLAG_BUFDATA) {
+        for (i=0; i<size; i++) {
+            if ((i%16) == 0)
+                va_TraceMsg(trace_ctx, "\n0x%08x:", i);
+            va_TraceMsg(trace_ctx, " %02x", p[i]);
+        }
     }
 
-    va_TraceMsg(idx, "\tchecksum = 0x%02x\n", check_sum & 0xff);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tcrc32c = 0x%08x\n", va_Crc32c(0, p, size));
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -661,30 +2565,30 @@ static void va_TraceVAPictureParameterBufferMPEG2(
     void *data)
 {
     VAPictureParameterBufferMPEG2 *p=(VAPictureParameterBufferMPEG2 *)data;
-    DPY2INDEX(dpy);
-
-    va_TraceMsg(idx,"VAPictureParameterBufferMPEG2\n");
-
-    va_TraceMsg(idx,"\thorizontal size= %d\n", p->horizontal_size);
-    va_TraceMsg(idx,"\tvertical size= %d\n", p->vertical_size);
-    va_TraceMsg(idx,"\tforward reference picture= %d\n", p->forward_reference_picture);
-    va_TraceMsg(idx,"\tbackward reference picture= %d\n", p->backward_reference_picture);
-    va_TraceMsg(idx,"\tpicture coding type= %d\n", p->picture_coding_type);
-    va_TraceMsg(idx,"\tf mode= %d\n", p->f_code);
-
-    va_TraceMsg(idx,"\tpicture coding extension = %d\n", p->picture_coding_extension.value);
-    va_TraceMsg(idx,"\tintra_dc_precision= %d\n", p->picture_coding_extension.bits.intra_dc_precision);
-    va_TraceMsg(idx,"\tpicture_structure= %d\n", p->picture_coding_extension.bits.picture_structure);
-    va_TraceMsg(idx,"\ttop_field_first= %d\n", p->picture_coding_extension.bits.top_field_first);
-    va_TraceMsg(idx,"\tframe_pred_frame_dct= %d\n", p->picture_coding_extension.bits.frame_pred_frame_dct);
-    va_TraceMsg(idx,"\tconcealment_motion_vectors= %d\n", p->picture_coding_extension.bits.concealment_motion_vectors);
-    va_TraceMsg(idx,"\tq_scale_type= %d\n", p->picture_coding_extension.bits.q_scale_type);
-    va_TraceMsg(idx,"\tintra_vlc_format= %d\n", p->picture_coding_extension.bits.intra_vlc_format);
-    va_TraceMsg(idx,"\talternate_scan= %d\n", p->picture_coding_extension.bits.alternate_scan);
-    va_TraceMsg(idx,"\trepeat_first_field= %d\n", p->picture_coding_extension.bits.repeat_first_field);
-    va_TraceMsg(idx,"\tprogressive_frame= %d\n", p->picture_coding_extension.bits.progressive_frame);
-    va_TraceMsg(idx,"\tis_first_field= %d\n", p->picture_coding_extension.bits.is_first_field);
-    va_TraceMsg(idx, NULL);
+    DPY2TRACECTX(dpy);
+
+    va_TraceMsg(trace_ctx,"VAPictureParameterBufferMPEG2\n");
+
+    va_TraceMsg(trace_ctx,"\thorizontal size= %d\n", p->horizontal_size);
+    va_TraceMsg(trace_ctx,"\tvertical size= %d\n", p->vertical_size);
+    va_TraceMsg(trace_ctx,"\tforward reference picture= %d\n", p->forward_reference_picture);
+    va_TraceMsg(trace_ctx,"\tbackward reference picture= %d\n", p->backward_reference_picture);
+    va_TraceMsg(trace_ctx,"\tpicture coding type= %d\n", p->picture_coding_type);
+    va_TraceMsg(trace_ctx,"\tf mode= %d\n", p->f_code);
+
+    va_TraceMsg(trace_ctx,"\tpicture coding extension = %d\n", p->picture_coding_extension.value);
+    va_TraceMsg(trace_ctx,"\tintra_dc_precision= %d\n", p->picture_coding_extension.bits.intra_dc_precision);
+    va_TraceMsg(trace_ctx,"\tpicture_structure= %d\n", p->picture_coding_extension.bits.picture_structure);
+    va_TraceMsg(trace_ctx,"\ttop_field_first= %d\n", p->picture_coding_extension.bits.top_field_first);
+    va_TraceMsg(trace_ctx,"\tframe_pred_frame_dct= %d\n", p->picture_coding_extension.bits.frame_pred_frame_dct);
+    va_TraceMsg(trace_ctx,"\tconcealment_motion_vectors= %d\n", p->picture_coding_extension.bits.concealment_motion_vectors);
+    va_TraceMsg(trace_ctx,"\tq_scale_type= %d\n", p->picture_coding_extension.bits.q_scale_type);
+    va_TraceMsg(trace_ctx,"\tintra_vlc_format= %d\n", p->picture_coding_extension.bits.intra_vlc_format);
+    va_TraceMsg(trace_ctx,"\talternate_scan= %d\n", p->picture_coding_extension.bits.alternate_scan);
+    va_TraceMsg(trace_ctx,"\trepeat_first_field= %d\n", p->picture_coding_extension.bits.repeat_first_field);
+    va_TraceMsg(trace_ctx,"\tprogressive_frame= %d\n", p->picture_coding_extension.bits.progressive_frame);
+    va_TraceMsg(trace_ctx,"\tis_first_field= %d\n", p->picture_coding_extension.bits.is_first_field);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -700,19 +2604,19 @@ static void va_TraceVAIQMatrixBufferMPEG2(
     void *data)
 {
     VAIQMatrixBufferMPEG2 *p=(VAIQMatrixBufferMPEG2 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    va_TraceMsg(idx,"VAIQMatrixBufferMPEG2\n");
+    va_TraceMsg(trace_ctx,"VAIQMatrixBufferMPEG2\n");
 
-    va_TraceMsg(idx,"\tload_intra_quantiser_matrix = %d\n", p->load_intra_quantiser_matrix);
-    va_TraceMsg(idx,"\tload_non_intra_quantiser_matrix = %d\n", p->load_non_intra_quantiser_matrix);
-    va_TraceMsg(idx,"\tload_chroma_intra_quantiser_matrix = %d\n", p->load_chroma_intra_quantiser_matrix);
-    va_TraceMsg(idx,"\tload_chroma_non_intra_quantiser_matrix = %d\n", p->load_chroma_non_intra_quantiser_matrix);
-    va_TraceMsg(idx,"\tintra_quantiser_matrix = %d\n", p->intra_quantiser_matrix);
-    va_TraceMsg(idx,"\tnon_intra_quantiser_matrix = %d\n", p->non_intra_quantiser_matrix);
-    va_TraceMsg(idx,"\tchroma_intra_quantiser_matrix = %d\n", p->chroma_intra_quantiser_matrix);
-    va_TraceMsg(idx,"\tchroma_non_intra_quantiser_matrix = %d\n", p->chroma_non_intra_quantiser_matrix);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx,"\tload_intra_quantiser_matrix = %d\n", p->load_intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx,"\tload_non_intra_quantiser_matrix = %d\n", p->load_non_intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx,"\tload_chroma_intra_quantiser_matrix = %d\n", p->load_chroma_intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx,"\tload_chroma_non_intra_quantiser_matrix = %d\n", p->load_chroma_non_intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx,"\tintra_quantiser_matrix = %d\n", p->intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx,"\tnon_intra_quantiser_matrix = %d\n", p->non_intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx,"\tchroma_intra_quantiser_matrix = %d\n", p->chroma_intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx,"\tchroma_non_intra_quantiser_matrix = %d\n", p->chroma_non_intra_quantiser_matrix);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -729,23 +2633,23 @@ static void va_TraceVASliceParameterBufferMPEG2(
 {
     VASliceParameterBufferMPEG2 *p=(VASliceParameterBufferMPEG2 *)data;
 
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
 
-    trace_context[idx].trace_slice_no++;
+    va_ctx->trace_slice_no++;
     
-    trace_context[idx].trace_slice_size = p->slice_data_size;
+    va_ctx->trace_slice_size = p->slice_data_size;
 
-    va_TraceMsg(idx,"VASliceParameterBufferMPEG2\n");
+    va_TraceMsg(trace_ctx,"VASliceParameterBufferMPEG2\n");
 
-    va_TraceMsg(idx,"\tslice_data_size = %d\n", p->slice_data_size);
-    va_TraceMsg(idx,"\tslice_data_offset = %d\n", p->slice_data_offset);
-    va_TraceMsg(idx,"\tslice_data_flag = %d\n", p->slice_data_flag);
-    va_TraceMsg(idx,"\tmacroblock_offset = %d\n", p->macroblock_offset);
-    va_TraceMsg(idx,"\tslice_horizontal_position = %d\n", p->slice_horizontal_position);
-    va_TraceMsg(idx,"\tslice_vertical_position = %d\n", p->slice_vertical_position);
-    va_TraceMsg(idx,"\tquantiser_scale_code = %d\n", p->quantiser_scale_code);
-    va_TraceMsg(idx,"\tintra_slice_flag = %d\n", p->intra_slice_flag);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx,"\tslice_data_size = %d\n", p->slice_data_size);
+    va_TraceMsg(trace_ctx,"\tslice_data_offset = %d\n", p->slice_data_offset);
+    va_TraceMsg(trace_ctx,"\tslice_data_flag = %d\n", p->slice_data_flag);
+    va_TraceMsg(trace_ctx,"\tmacroblock_offset = %d\n", p->macroblock_offset);
+    va_TraceMsg(trace_ctx,"\tslice_horizontal_position = %d\n", p->slice_horizontal_position);
+    va_TraceMsg(trace_ctx,"\tslice_vertical_position = %d\n", p->slice_vertical_position);
+    va_TraceMsg(trace_ctx,"\tquantiser_scale_code = %d\n", p->quantiser_scale_code);
+    va_TraceMsg(trace_ctx,"\tintra_slice_flag = %d\n", p->intra_slice_flag);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -763,49 +2667,49 @@ static void va_TraceVAPictureParameterBufferMPEG4(
     int i;
     VAPictureParameterBufferMPEG4 *p=(VAPictureParameterBufferMPEG4 *)data;
     
-    DPY2INDEX(dpy);
-
-    va_TraceMsg(idx,"*VAPictureParameterBufferMPEG4\n");
-    va_TraceMsg(idx,"\tvop_width = %d\n", p->vop_width);
-    va_TraceMsg(idx,"\tvop_height = %d\n", p->vop_height);
-    va_TraceMsg(idx,"\tforward_reference_picture = %d\n", p->forward_reference_picture);
-    va_TraceMsg(idx,"\tbackward_reference_picture = %d\n", p->backward_reference_picture);
-    va_TraceMsg(idx,"\tvol_fields value = %d\n", p->vol_fields.value);
-    va_TraceMsg(idx,"\tshort_video_header= %d\n", p->vol_fields.bits.short_video_header);
-    va_TraceMsg(idx,"\tchroma_format= %d\n", p->vol_fields.bits.chroma_format);
-    va_TraceMsg(idx,"\tinterlaced= %d\n", p->vol_fields.bits.interlaced);
-    va_TraceMsg(idx,"\tobmc_disable= %d\n", p->vol_fields.bits.obmc_disable);
-    va_TraceMsg(idx,"\tsprite_enable= %d\n", p->vol_fields.bits.sprite_enable);
-    va_TraceMsg(idx,"\tsprite_warping_accuracy= %d\n", p->vol_fields.bits.sprite_warping_accuracy);
-    va_TraceMsg(idx,"\tquant_type= %d\n", p->vol_fields.bits.quant_type);
-    va_TraceMsg(idx,"\tquarter_sample= %d\n", p->vol_fields.bits.quarter_sample);
-    va_TraceMsg(idx,"\tdata_partitioned= %d\n", p->vol_fields.bits.data_partitioned);
-    va_TraceMsg(idx,"\treversible_vlc= %d\n", p->vol_fields.bits.reversible_vlc);
-    va_TraceMsg(idx,"\tresync_marker_disable= %d\n", p->vol_fields.bits.resync_marker_disable);
-    va_TraceMsg(idx,"\tno_of_sprite_warping_points = %d\n", p->no_of_sprite_warping_points);
-    va_TraceMsg(idx,"\tsprite_trajectory_du =");
+    DPY2TRACECTX(dpy);
+
+    va_TraceMsg(trace_ctx,"*VAPictureParameterBufferMPEG4\n");
+    va_TraceMsg(trace_ctx,"\tvop_width = %d\n", p->vop_width);
+    va_TraceMsg(trace_ctx,"\tvop_height = %d\n", p->vop_height);
+    va_TraceMsg(trace_ctx,"\tforward_reference_picture = %d\n", p->forward_reference_picture);
+    va_TraceMsg(trace_ctx,"\tbackward_reference_picture = %d\n", p->backward_reference_picture);
+    va_TraceMsg(trace_ctx,"\tvol_fields value = %d\n", p->vol_fields.value);
+    va_TraceMsg(trace_ctx,"\tshort_video_header= %d\n", p->vol_fields.bits.short_video_header);
+    va_TraceMsg(trace_ctx,"\tchroma_format= %d\n", p->vol_fields.bits.chroma_format);
+    va_TraceMsg(trace_ctx,"\tinterlaced= %d\n", p->vol_fields.bits.interlaced);
+    va_TraceMsg(trace_ctx,"\tobmc_disable= %d\n", p->vol_fields.bits.obmc_disable);
+    va_TraceMsg(trace_ctx,"\tsprite_enable= %d\n", p->vol_fields.bits.sprite_enable);
+    va_TraceMsg(trace_ctx,"\tsprite_warping_accuracy= %d\n", p->vol_fields.bits.sprite_warping_accuracy);
+    va_TraceMsg(trace_ctx,"\tquant_type= %d\n", p->vol_fields.bits.quant_type);
+    va_TraceMsg(trace_ctx,"\tquarter_sample= %d\n", p->vol_fields.bits.quarter_sample);
+    va_TraceMsg(trace_ctx,"\tdata_partitioned= %d\n", p->vol_fields.bits.data_partitioned);
+    va_TraceMsg(trace_ctx,"\treversible_vlc= %d\n", p->vol_fields.bits.reversible_vlc);
+    va_TraceMsg(trace_ctx,"\tresync_marker_disable= %d\n", p->vol_fields.bits.resync_marker_disable);
+    va_TraceMsg(trace_ctx,"\tno_of_sprite_warping_points = %d\n", p->no_of_sprite_warping_points);
+    va_TraceMsg(trace_ctx,"\tsprite_trajectory_du =");
     for(i=0;i<3;i++)
-        va_TraceMsg(idx,"\t%d", p->sprite_trajectory_du[i]);
+        va_TraceMsg(trace_ctx,"\t%d", p->sprite_trajectory_du[i]);
 
-    va_TraceMsg(idx,"\n");
-    va_TraceMsg(idx,"\tsprite_trajectory_dv =");
+    va_TraceMsg(trace_ctx,"\n");
+    va_TraceMsg(trace_ctx,"\tsprite_trajectory_dv =");
     for(i=0;i<3;i++)
-        va_TraceMsg(idx,"\t%d", p->sprite_trajectory_dv[i]);
-    va_TraceMsg(idx,"\n");
-    va_TraceMsg(idx,"\tvop_fields value = %d\n", p->vop_fields.value);
-    va_TraceMsg(idx,"\tvop_coding_type= %d\n", p->vop_fields.bits.vop_coding_type);
-    va_TraceMsg(idx,"\tbackward_reference_vop_coding_type= %d\n", p->vop_fields.bits.backward_reference_vop_coding_type);
-    va_TraceMsg(idx,"\tvop_rounding_type= %d\n", p->vop_fields.bits.vop_rounding_type);
-    va_TraceMsg(idx,"\tintra_dc_vlc_thr= %d\n", p->vop_fields.bits.intra_dc_vlc_thr);
-    va_TraceMsg(idx,"\ttop_field_first= %d\n", p->vop_fields.bits.top_field_first);
-    va_TraceMsg(idx,"\talternate_vertical_scan_flag= %d\n", p->vop_fields.bits.alternate_vertical_scan_flag);
-    va_TraceMsg(idx,"\tvop_fcode_forward = %d\n", p->vop_fcode_forward);
-    va_TraceMsg(idx,"\tvop_fcode_backward = %d\n", p->vop_fcode_backward);
-    va_TraceMsg(idx,"\tnum_gobs_in_vop = %d\n", p->num_gobs_in_vop);
-    va_TraceMsg(idx,"\tnum_macroblocks_in_gob = %d\n", p->num_macroblocks_in_gob);
-    va_TraceMsg(idx,"\tTRB = %d\n", p->TRB);
-    va_TraceMsg(idx,"\tTRD = %d\n", p->TRD);
-    va_TraceMsg(idx, NULL);
+        va_TraceMsg(trace_ctx,"\t%d", p->sprite_trajectory_dv[i]);
+    va_TraceMsg(trace_ctx,"\n");
+    va_TraceMsg(trace_ctx,"\tvop_fields value = %d\n", p->vop_fields.value);
+    va_TraceMsg(trace_ctx,"\tvop_coding_type= %d\n", p->vop_fields.bits.vop_coding_type);
+    va_TraceMsg(trace_ctx,"\tbackward_reference_vop_coding_type= %d\n", p->vop_fields.bits.backward_reference_vop_coding_type);
+    va_TraceMsg(trace_ctx,"\tvop_rounding_type= %d\n", p->vop_fields.bits.vop_rounding_type);
+    va_TraceMsg(trace_ctx,"\tintra_dc_vlc_thr= %d\n", p->vop_fields.bits.intra_dc_vlc_thr);
+    va_TraceMsg(trace_ctx,"\ttop_field_first= %d\n", p->vop_fields.bits.top_field_first);
+    va_TraceMsg(trace_ctx,"\talternate_vertical_scan_flag= %d\n", p->vop_fields.bits.alternate_vertical_scan_flag);
+    va_TraceMsg(trace_ctx,"\tvop_fcode_forward = %d\n", p->vop_fcode_forward);
+    va_TraceMsg(trace_ctx,"\tvop_fcode_backward = %d\n", p->vop_fcode_backward);
+    va_TraceMsg(trace_ctx,"\tnum_gobs_in_vop = %d\n", p->num_gobs_in_vop);
+    va_TraceMsg(trace_ctx,"\tnum_macroblocks_in_gob = %d\n", p->num_macroblocks_in_gob);
+    va_TraceMsg(trace_ctx,"\tTRB = %d\n", p->TRB);
+    va_TraceMsg(trace_ctx,"\tTRD = %d\n", p->TRD);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -822,20 +2726,20 @@ static void va_TraceVAIQMatrixBufferMPEG4(
 {
     int i;
     VAIQMatrixBufferMPEG4 *p=(VAIQMatrixBufferMPEG4 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    va_TraceMsg(idx,"VAIQMatrixBufferMPEG4\n");
+    va_TraceMsg(trace_ctx,"VAIQMatrixBufferMPEG4\n");
 
-    va_TraceMsg(idx,"\tload_intra_quant_mat = %d\n", p->load_intra_quant_mat);
-    va_TraceMsg(idx,"\tload_non_intra_quant_mat = %d\n", p->load_non_intra_quant_mat);
-    va_TraceMsg(idx,"\tintra_quant_mat =\n");
+    va_TraceMsg(trace_ctx,"\tload_intra_quant_mat = %d\n", p->load_intra_quant_mat);
+    va_TraceMsg(trace_ctx,"\tload_non_intra_quant_mat = %d\n", p->load_non_intra_quant_mat);
+    va_TraceMsg(trace_ctx,"\tintra_quant_mat =\n");
     for(i=0;i<64;i++)
-        va_TraceMsg(idx,"\t\t%d\n", p->intra_quant_mat[i]);
+        va_TraceMsg(trace_ctx,"\t\t%d\n", p->intra_quant_mat[i]);
 
-    va_TraceMsg(idx,"\tnon_intra_quant_mat =\n");
+    va_TraceMsg(trace_ctx,"\tnon_intra_quant_mat =\n");
     for(i=0;i<64;i++)
-        va_TraceMsg(idx,"\t\t%d\n", p->non_intra_quant_mat[i]);
-    va_TraceMsg(idx, NULL);
+        va_TraceMsg(trace_ctx,"\t\t%d\n", p->non_intra_quant_mat[i]);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -850,25 +2754,25 @@ static void va_TraceVAEncSequenceParameterBufferMPEG4(
     void *data)
 {
     VAEncSequenceParameterBufferMPEG4 *p = (VAEncSequenceParameterBufferMPEG4 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
-    va_TraceMsg(idx, "VAEncSequenceParameterBufferMPEG4\n");
+    va_TraceMsg(trace_ctx, "VAEncSequenceParameterBufferMPEG4\n");
     
-    va_TraceMsg(idx, "\tprofile_and_level_indication = %d\n", p->profile_and_level_indication);
-    va_TraceMsg(idx, "\tintra_period = %d\n", p->intra_period);
-    va_TraceMsg(idx, "\tvideo_object_layer_width = %d\n", p->video_object_layer_width);
-    va_TraceMsg(idx, "\tvideo_object_layer_height = %d\n", p->video_object_layer_height);
-    va_TraceMsg(idx, "\tvop_time_increment_resolution = %d\n", p->vop_time_increment_resolution);
-    va_TraceMsg(idx, "\tfixed_vop_rate = %d\n", p->fixed_vop_rate);
-    va_TraceMsg(idx, "\tfixed_vop_time_increment = %d\n", p->fixed_vop_time_increment);
-    va_TraceMsg(idx, "\tbits_per_second = %d\n", p->bits_per_second);
-    va_TraceMsg(idx, "\tframe_rate = %d\n", p->frame_rate);
-    va_TraceMsg(idx, "\tinitial_qp = %d\n", p->initial_qp);
-    va_TraceMsg(idx, "\tmin_qp = %d\n", p->min_qp);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tprofile_and_level_indication = %d\n", p->profile_and_level_indication);
+    va_TraceMsg(trace_ctx, "\tintra_period = %d\n", p->intra_period);
+    va_TraceMsg(trace_ctx, "\tvideo_object_layer_width = %d\n", p->video_object_layer_width);
+    va_TraceMsg(trace_ctx, "\tvideo_object_layer_height = %d\n", p->video_object_layer_height);
+    va_TraceMsg(trace_ctx, "\tvop_time_increment_resolution = %d\n", p->vop_time_increment_resolution);
+    va_TraceMsg(trace_ctx, "\tfixed_vop_rate = %d\n", p->fixed_vop_rate);
+    va_TraceMsg(trace_ctx, "\tfixed_vop_time_increment = %d\n", p->fixed_vop_time_increment);
+    va_TraceMsg(trace_ctx, "\tbits_per_second = %d\n", p->bits_per_second);
+    va_TraceMsg(trace_ctx, "\tframe_rate = %d\n", p->frame_rate);
+    va_TraceMsg(trace_ctx, "\tinitial_qp = %d\n", p->initial_qp);
+    va_TraceMsg(trace_ctx, "\tmin_qp = %d\n", p->min_qp);
+    va_TraceMsg(trace_ctx, NULL);
 
     /* start a new sequce, coded log file can be truncated */
-    trace_context[idx].trace_sequence_start = 1;
+    va_ctx->trace_sequence_start = 1;
 
     return;
 }
@@ -883,20 +2787,20 @@ static void va_TraceVAEncPictureParameterBufferMPEG4(
     void *data)
 {
     VAEncPictureParameterBufferMPEG4 *p = (VAEncPictureParameterBufferMPEG4 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
-    va_TraceMsg(idx, "VAEncPictureParameterBufferMPEG4\n");
-    va_TraceMsg(idx, "\treference_picture = 0x%08x\n", p->reference_picture);
-    va_TraceMsg(idx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
-    va_TraceMsg(idx, "\tcoded_buf = %08x\n", p->coded_buf);
-    va_TraceMsg(idx, "\tpicture_width = %d\n", p->picture_width);
-    va_TraceMsg(idx, "\tpicture_height = %d\n", p->picture_height);
-    va_TraceMsg(idx, "\tmodulo_time_base = %d\n", p->modulo_time_base);
-    va_TraceMsg(idx, "\tvop_time_increment = %d\n", p->vop_time_increment);
-    va_TraceMsg(idx, "\tpicture_type = %d\n", p->picture_type);
-    va_TraceMsg(idx, NULL);
-
-    trace_context[idx].trace_codedbuf =  p->coded_buf;
+    va_TraceMsg(trace_ctx, "VAEncPictureParameterBufferMPEG4\n");
+    va_TraceMsg(trace_ctx, "\treference_picture = 0x%08x\n", p->reference_picture);
+    va_TraceMsg(trace_ctx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
+    va_TraceMsg(trace_ctx, "\tcoded_buf = %08x\n", p->coded_buf);
+    va_TraceMsg(trace_ctx, "\tpicture_width = %d\n", p->picture_width);
+    va_TraceMsg(trace_ctx, "\tpicture_height = %d\n", p->picture_height);
+    va_TraceMsg(trace_ctx, "\tmodulo_time_base = %d\n", p->modulo_time_base);
+    va_TraceMsg(trace_ctx, "\tvop_time_increment = %d\n", p->vop_time_increment);
+    va_TraceMsg(trace_ctx, "\tpicture_type = %d\n", p->picture_type);
+    va_TraceMsg(trace_ctx, NULL);
+
+    va_ctx->trace_codedbuf =  p->coded_buf;
     
     return;
 }
@@ -913,34 +2817,34 @@ static void va_TraceVASliceParameterBufferMPEG4(
 {
     VASliceParameterBufferMPEG4 *p=(VASliceParameterBufferMPEG4 *)data;
     
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
 
-    trace_context[idx].trace_slice_no++;
+    va_ctx->trace_slice_no++;
 
-    trace_context[idx].trace_slice_size = p->slice_data_size;
+    va_ctx->trace_slice_size = p->slice_data_size;
 
-    va_TraceMsg(idx,"VASliceParameterBufferMPEG4\n");
+    va_TraceMsg(trace_ctx,"VASliceParameterBufferMPEG4\n");
 
-    va_TraceMsg(idx,"\tslice_data_size = %d\n", p->slice_data_size);
-    va_TraceMsg(idx,"\tslice_data_offset = %d\n", p->slice_data_offset);
-    va_TraceMsg(idx,"\tslice_data_flag = %d\n", p->slice_data_flag);
-    va_TraceMsg(idx,"\tmacroblock_offset = %d\n", p->macroblock_offset);
-    va_TraceMsg(idx,"\tmacroblock_number = %d\n", p->macroblock_number);
-    va_TraceMsg(idx,"\tquant_scale = %d\n", p->quant_scale);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx,"\tslice_data_size = %d\n", p->slice_data_size);
+    va_TraceMsg(trace_ctx,"\tslice_data_offset = %d\n", p->slice_data_offset);
+    va_TraceMsg(trace_ctx,"\tslice_data_flag = %d\n", p->slice_data_flag);
+    va_TraceMsg(trace_ctx,"\tmacroblock_offset = %d\n", p->macroblock_offset);
+    va_TraceMsg(trace_ctx,"\tmacroblock_number = %d\n", p->macroblock_number);
+    va_TraceMsg(trace_ctx,"\tquant_scale = %d\n", p->quant_scale);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
 
 
 static inline void va_TraceFlagIfNotZero(
-    int idx,            /* in */
+    struct trace_context *trace_ctx, /* in */
     const char *name,   /* in */
     unsigned int flag   /* in */
 )
 {
     if (flag != 0) {
-        va_TraceMsg(idx, "%s = %x\n", name, flag);
+        va_TraceMsg(trace_ctx, "%s = %x\n", name, flag);
     }
 }
 
@@ -957,62 +2861,62 @@ static void va_TraceVAPictureParameterBufferH264(
     int i;
     VAPictureParameterBufferH264 *p = (VAPictureParameterBufferH264*)data;
     
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    va_TraceMsg(idx, "VAPictureParameterBufferH264\n");
+    va_TraceMsg(trace_ctx, "VAPictureParameterBufferH264\n");
 
-    va_TraceMsg(idx, "\tCurrPic.picture_id = 0x%08x\n", p->CurrPic.picture_id);
-    va_TraceMsg(idx, "\tCurrPic.frame_idx = %d\n", p->CurrPic.frame_idx);
-    va_TraceMsg(idx, "\tCurrPic.flags = %d\n", p->CurrPic.flags);
-    va_TraceMsg(idx, "\tCurrPic.TopFieldOrderCnt = %d\n", p->CurrPic.TopFieldOrderCnt);
-    va_TraceMsg(idx, "\tCurrPic.BottomFieldOrderCnt = %d\n", p->CurrPic.BottomFieldOrderCnt);
+    va_TraceMsg(trace_ctx, "\tCurrPic.picture_id = 0x%08x\n", p->CurrPic.picture_id);
+    va_TraceMsg(trace_ctx, "\tCurrPic.frame_idx = %d\n", p->CurrPic.frame_idx);
+    va_TraceMsg(trace_ctx, "\tCurrPic.flags = %d\n", p->CurrPic.flags);
+    va_TraceMsg(trace_ctx, "\tCurrPic.TopFieldOrderCnt = %d\n", p->CurrPic.TopFieldOrderCnt);
+    va_TraceMsg(trace_ctx, "\tCurrPic.BottomFieldOrderCnt = %d\n", p->CurrPic.BottomFieldOrderCnt);
 
-    va_TraceMsg(idx, "\tReferenceFrames (TopFieldOrderCnt-BottomFieldOrderCnt-picture_id-frame_idx:\n");
+    va_TraceMsg(trace_ctx, "\tReferenceFrames (TopFieldOrderCnt-BottomFieldOrderCnt-picture_id-frame_idx:\n");
     for (i = 0; i < 16; i++)
     {
         if (p->ReferenceFrames[i].flags != VA_PICTURE_H264_INVALID) {
-            va_TraceMsg(idx, "\t\t%d-%d-0x%08x-%d\n",
+            va_TraceMsg(trace_ctx, "\t\t%d-%d-0x%08x-%d\n",
                         p->ReferenceFrames[i].TopFieldOrderCnt,
                         p->ReferenceFrames[i].BottomFieldOrderCnt,
                         p->ReferenceFrames[i].picture_id,
                         p->ReferenceFrames[i].frame_idx);
         } else
-            va_TraceMsg(idx, "\t\tinv-inv-inv-inv\n");
+            va_TraceMsg(trace_ctx, "\t\tinv-inv-inv-inv\n");
     }
-    va_TraceMsg(idx, "\n");
+    va_TraceMsg(trace_ctx, "\n");
     
-    va_TraceMsg(idx, "\tpicture_width_in_mbs_minus1 = %d\n", p->picture_width_in_mbs_minus1);
-    va_TraceMsg(idx, "\tpicture_height_in_mbs_minus1 = %d\n", p->picture_height_in_mbs_minus1);
-    va_TraceMsg(idx, "\tbit_depth_luma_minus8 = %d\n", p->bit_depth_luma_minus8);
-    va_TraceMsg(idx, "\tbit_depth_chroma_minus8 = %d\n", p->bit_depth_chroma_minus8);
-    va_TraceMsg(idx, "\tnum_ref_frames = %d\n", p->num_ref_frames);
-    va_TraceMsg(idx, "\tseq fields = %d\n", p->seq_fields.value);
-    va_TraceMsg(idx, "\tchroma_format_idc = %d\n", p->seq_fields.bits.chroma_format_idc);
-    va_TraceMsg(idx, "\tresidual_colour_transform_flag = %d\n", p->seq_fields.bits.residual_colour_transform_flag);
-    va_TraceMsg(idx, "\tframe_mbs_only_flag = %d\n", p->seq_fields.bits.frame_mbs_only_flag);
-    va_TraceMsg(idx, "\tmb_adaptive_frame_field_flag = %d\n", p->seq_fields.bits.mb_adaptive_frame_field_flag);
-    va_TraceMsg(idx, "\tdirect_8x8_inference_flag = %d\n", p->seq_fields.bits.direct_8x8_inference_flag);
-    va_TraceMsg(idx, "\tMinLumaBiPredSize8x8 = %d\n", p->seq_fields.bits.MinLumaBiPredSize8x8);
-    va_TraceMsg(idx, "\tnum_slice_groups_minus1 = %d\n", p->num_slice_groups_minus1);
-    va_TraceMsg(idx, "\tslice_group_map_type = %d\n", p->slice_group_map_type);
-    va_TraceMsg(idx, "\tslice_group_change_rate_minus1 = %d\n", p->slice_group_change_rate_minus1);
-    va_TraceMsg(idx, "\tpic_init_qp_minus26 = %d\n", p->pic_init_qp_minus26);
-    va_TraceMsg(idx, "\tpic_init_qs_minus26 = %d\n", p->pic_init_qs_minus26);
-    va_TraceMsg(idx, "\tchroma_qp_index_offset = %d\n", p->chroma_qp_index_offset);
-    va_TraceMsg(idx, "\tsecond_chroma_qp_index_offset = %d\n", p->second_chroma_qp_index_offset);
-    va_TraceMsg(idx, "\tpic_fields = 0x%03x\n", p->pic_fields.value);
-    va_TraceFlagIfNotZero(idx, "\t\tentropy_coding_mode_flag", p->pic_fields.bits.entropy_coding_mode_flag);
-    va_TraceFlagIfNotZero(idx, "\t\tweighted_pred_flag", p->pic_fields.bits.weighted_pred_flag);
-    va_TraceFlagIfNotZero(idx, "\t\tweighted_bipred_idc", p->pic_fields.bits.weighted_bipred_idc);
-    va_TraceFlagIfNotZero(idx, "\t\ttransform_8x8_mode_flag", p->pic_fields.bits.transform_8x8_mode_flag);
-    va_TraceFlagIfNotZero(idx, "\t\tfield_pic_flag", p->pic_fields.bits.field_pic_flag);
-    va_TraceFlagIfNotZero(idx, "\t\tconstrained_intra_pred_flag", p->pic_fields.bits.constrained_intra_pred_flag);
-    va_TraceFlagIfNotZero(idx, "\t\tpic_order_present_flag", p->pic_fields.bits.pic_order_present_flag);
-    va_TraceFlagIfNotZero(idx, "\t\tdeblocking_filter_control_present_flag", p->pic_fields.bits.deblocking_filter_control_present_flag);
-    va_TraceFlagIfNotZero(idx, "\t\tredundant_pic_cnt_present_flag", p->pic_fields.bits.redundant_pic_cnt_present_flag);
-    va_TraceFlagIfNotZero(idx, "\t\treference_pic_flag", p->pic_fields.bits.reference_pic_flag);
-    va_TraceMsg(idx, "\tframe_num = %d\n", p->frame_num);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tpicture_width_in_mbs_minus1 = %d\n", p->picture_width_in_mbs_minus1);
+    va_TraceMsg(trace_ctx, "\tpicture_height_in_mbs_minus1 = %d\n", p->picture_height_in_mbs_minus1);
+    va_TraceMsg(trace_ctx, "\tbit_depth_luma_minus8 = %d\n", p->bit_depth_luma_minus8);
+    va_TraceMsg(trace_ctx, "\tbit_depth_chroma_minus8 = %d\n", p->bit_depth_chroma_minus8);
+    va_TraceMsg(trace_ctx, "\tnum_ref_frames = %d\n", p->num_ref_frames);
+    va_TraceMsg(trace_ctx, "\tseq fields = %d\n", p->seq_fields.value);
+    va_TraceMsg(trace_ctx, "\tchroma_format_idc = %d\n", p->seq_fields.bits.chroma_format_idc);
+    va_TraceMsg(trace_ctx, "\tresidual_colour_transform_flag = %d\n", p->seq_fields.bits.residual_colour_transform_flag);
+    va_TraceMsg(trace_ctx, "\tframe_mbs_only_flag = %d\n", p->seq_fields.bits.frame_mbs_only_flag);
+    va_TraceMsg(trace_ctx, "\tmb_adaptive_frame_field_flag = %d\n", p->seq_fields.bits.mb_adaptive_frame_field_flag);
+    va_TraceMsg(trace_ctx, "\tdirect_8x8_inference_flag = %d\n", p->seq_fields.bits.direct_8x8_inference_flag);
+    va_TraceMsg(trace_ctx, "\tMinLumaBiPredSize8x8 = %d\n", p->seq_fields.bits.MinLumaBiPredSize8x8);
+    va_TraceMsg(trace_ctx, "\tnum_slice_groups_minus1 = %d\n", p->num_slice_groups_minus1);
+    va_TraceMsg(trace_ctx, "\tslice_group_map_type = %d\n", p->slice_group_map_type);
+    va_TraceMsg(trace_ctx, "\tslice_group_change_rate_minus1 = %d\n", p->slice_group_change_rate_minus1);
+    va_TraceMsg(trace_ctx, "\tpic_init_qp_minus26 = %d\n", p->pic_init_qp_minus26);
+    va_TraceMsg(trace_ctx, "\tpic_init_qs_minus26 = %d\n", p->pic_init_qs_minus26);
+    va_TraceMsg(trace_ctx, "\tchroma_qp_index_offset = %d\n", p->chroma_qp_index_offset);
+    va_TraceMsg(trace_ctx, "\tsecond_chroma_qp_index_offset = %d\n", p->second_chroma_qp_index_offset);
+    va_TraceMsg(trace_ctx, "\tpic_fields = 0x%03x\n", p->pic_fields.value);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tentropy_coding_mode_flag", p->pic_fields.bits.entropy_coding_mode_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tweighted_pred_flag", p->pic_fields.bits.weighted_pred_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tweighted_bipred_idc", p->pic_fields.bits.weighted_bipred_idc);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\ttransform_8x8_mode_flag", p->pic_fields.bits.transform_8x8_mode_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tfield_pic_flag", p->pic_fields.bits.field_pic_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tconstrained_intra_pred_flag", p->pic_fields.bits.constrained_intra_pred_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tpic_order_present_flag", p->pic_fields.bits.pic_order_present_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tdeblocking_filter_control_present_flag", p->pic_fields.bits.deblocking_filter_control_present_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\tredundant_pic_cnt_present_flag", p->pic_fields.bits.redundant_pic_cnt_present_flag);
+    va_TraceFlagIfNotZero(trace_ctx, "\t\treference_pic_flag", p->pic_fields.bits.reference_pic_flag);
+    va_TraceMsg(trace_ctx, "\tframe_num = %d\n", p->frame_num);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -1028,80 +2932,80 @@ static void va_TraceVASliceParameterBufferH264(
 {
     int i;
     VASliceParameterBufferH264* p = (VASliceParameterBufferH264*)data;
-    DPY2INDEX(dpy);
-
-    trace_context[idx].trace_slice_no++;
-    trace_context[idx].trace_slice_size = p->slice_data_size;
-
-    va_TraceMsg(idx, "VASliceParameterBufferH264\n");
-    va_TraceMsg(idx, "\tslice_data_size = %d\n", p->slice_data_size);
-    va_TraceMsg(idx, "\tslice_data_offset = %d\n", p->slice_data_offset);
-    va_TraceMsg(idx, "\tslice_data_flag = %d\n", p->slice_data_flag);
-    va_TraceMsg(idx, "\tslice_data_bit_offset = %d\n", p->slice_data_bit_offset);
-    va_TraceMsg(idx, "\tfirst_mb_in_slice = %d\n", p->first_mb_in_slice);
-    va_TraceMsg(idx, "\tslice_type = %d\n", p->slice_type);
-    va_TraceMsg(idx, "\tdirect_spatial_mv_pred_flag = %d\n", p->direct_spatial_mv_pred_flag);
-    va_TraceMsg(idx, "\tnum_ref_idx_l0_active_minus1 = %d\n", p->num_ref_idx_l0_active_minus1);
-    va_TraceMsg(idx, "\tnum_ref_idx_l1_active_minus1 = %d\n", p->num_ref_idx_l1_active_minus1);
-    va_TraceMsg(idx, "\tcabac_init_idc = %d\n", p->cabac_init_idc);
-    va_TraceMsg(idx, "\tslice_qp_delta = %d\n", p->slice_qp_delta);
-    va_TraceMsg(idx, "\tdisable_deblocking_filter_idc = %d\n", p->disable_deblocking_filter_idc);
-    va_TraceMsg(idx, "\tslice_alpha_c0_offset_div2 = %d\n", p->slice_alpha_c0_offset_div2);
-    va_TraceMsg(idx, "\tslice_beta_offset_div2 = %d\n", p->slice_beta_offset_div2);
+    DPY2TRACE_VACTX(dpy, context);
+
+    va_ctx->trace_slice_no++;
+    va_ctx->trace_slice_size = p->slice_data_size;
+
+    va_TraceMsg(trace_ctx, "VASliceParameterBufferH264\n");
+    va_TraceMsg(trace_ctx, "\tslice_data_size = %d\n", p->slice_data_size);
+    va_TraceMsg(trace_ctx, "\tslice_data_offset = %d\n", p->slice_data_offset);
+    va_TraceMsg(trace_ctx, "\tslice_data_flag = %d\n", p->slice_data_flag);
+    va_TraceMsg(trace_ctx, "\tslice_data_bit_offset = %d\n", p->slice_data_bit_offset);
+    va_TraceMsg(trace_ctx, "\tfirst_mb_in_slice = %d\n", p->first_mb_in_slice);
+    va_TraceMsg(trace_ctx, "\tslice_type = %d\n", p->slice_type);
+    va_TraceMsg(trace_ctx, "\tdirect_spatial_mv_pred_flag = %d\n", p->direct_spatial_mv_pred_flag);
+    va_TraceMsg(trace_ctx, "\tnum_ref_idx_l0_active_minus1 = %d\n", p->num_ref_idx_l0_active_minus1);
+    va_TraceMsg(trace_ctx, "\tnum_ref_idx_l1_active_minus1 = %d\n", p->num_ref_idx_l1_active_minus1);
+    va_TraceMsg(trace_ctx, "\tcabac_init_idc = %d\n", p->cabac_init_idc);
+    va_TraceMsg(trace_ctx, "\tslice_qp_delta = %d\n", p->slice_qp_delta);
+    va_TraceMsg(trace_ctx, "\tdisable_deblocking_filter_idc = %d\n", p->disable_deblocking_filter_idc);
+    va_TraceMsg(trace_ctx, "\tslice_alpha_c0_offset_div2 = %d\n", p->slice_alpha_c0_offset_div2);
+    va_TraceMsg(trace_ctx, "\tslice_beta_offset_div2 = %d\n", p->slice_beta_offset_div2);
 
     if (p->slice_type == 0 || p->slice_type == 1) {
-        va_TraceMsg(idx, "\tRefPicList0 =");
+        va_TraceMsg(trace_ctx, "\tRefPicList0 =");
         for (i = 0; i < p->num_ref_idx_l0_active_minus1 + 1; i++) {
-            va_TraceMsg(idx, "%d-%d-0x%08x-%d\n", p->RefPicList0[i].TopFieldOrderCnt, p->RefPicList0[i].BottomFieldOrderCnt, p->RefPicList0[i].picture_id, p->RefPicList0[i].frame_idx);
+            va_TraceMsg(trace_ctx, "%d-%d-0x%08x-%d\n", p->RefPicList0[i].TopFieldOrderCnt, p->RefPicList0[i].BottomFieldOrderCnt, p->RefPicList0[i].picture_id, p->RefPicList0[i].frame_idx);
         }
         if (p->slice_type == 1) {
-            va_TraceMsg(idx, "\tRefPicList1 =");
+            va_TraceMsg(trace_ctx, "\tRefPicList1 =");
             for (i = 0; i < p->num_ref_idx_l1_active_minus1 + 1; i++)
             {
-                va_TraceMsg(idx, "%d-%d-0x%08x-%d\n", p->RefPicList1[i].TopFieldOrderCnt, p->RefPicList1[i].BottomFieldOrderCnt, p->RefPicList1[i].picture_id, p->RefPicList1[i].frame_idx);
+                va_TraceMsg(trace_ctx, "%d-%d-0x%08x-%d\n", p->RefPicList1[i].TopFieldOrderCnt, p->RefPicList1[i].BottomFieldOrderCnt, p->RefPicList1[i].picture_id, p->RefPicList1[i].frame_idx);
             }
         }
     }
     
-    va_TraceMsg(idx, "\tluma_log2_weight_denom = %d\n", p->luma_log2_weight_denom);
-    va_TraceMsg(idx, "\tchroma_log2_weight_denom = %d\n", p->chroma_log2_weight_denom);
-    va_TraceMsg(idx, "\tluma_weight_l0_flag = %d\n", p->luma_weight_l0_flag);
+    va_TraceMsg(trace_ctx, "\tluma_log2_weight_denom = %d\n", p->luma_log2_weight_denom);
+    va_TraceMsg(trace_ctx, "\tchroma_log2_weight_denom = %d\n", p->chroma_log2_weight_denom);
+    va_TraceMsg(trace_ctx, "\tluma_weight_l0_flag = %d\n", p->luma_weight_l0_flag);
     if (p->luma_weight_l0_flag) {
         for (i = 0; i <=  p->num_ref_idx_l0_active_minus1; i++) {
-            va_TraceMsg(idx, "\t%d ", p->luma_weight_l0[i]);
-            va_TraceMsg(idx, "\t%d ", p->luma_offset_l0[i]);
+            va_TraceMsg(trace_ctx, "\t%d ", p->luma_weight_l0[i]);
+            va_TraceMsg(trace_ctx, "\t%d ", p->luma_offset_l0[i]);
         }
     }
 
-    va_TraceMsg(idx, "\tchroma_weight_l0_flag = %d\n", p->chroma_weight_l0_flag);
+    va_TraceMsg(trace_ctx, "\tchroma_weight_l0_flag = %d\n", p->chroma_weight_l0_flag);
     if (p->chroma_weight_l0_flag) {
         for (i = 0; i <= p->num_ref_idx_l0_active_minus1; i++) {
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_weight_l0[i][0]);
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_offset_l0[i][0]);
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_weight_l0[i][1]);
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_offset_l0[i][1]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_weight_l0[i][0]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_offset_l0[i][0]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_weight_l0[i][1]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_offset_l0[i][1]);
         }
     }
     
-    va_TraceMsg(idx, "\tluma_weight_l1_flag = %d\n", p->luma_weight_l1_flag);
+    va_TraceMsg(trace_ctx, "\tluma_weight_l1_flag = %d\n", p->luma_weight_l1_flag);
     if (p->luma_weight_l1_flag) {
         for (i = 0; i <=  p->num_ref_idx_l1_active_minus1; i++) {
-            va_TraceMsg(idx, "\t\t%d ", p->luma_weight_l1[i]);
-            va_TraceMsg(idx, "\t\t%d ", p->luma_offset_l1[i]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->luma_weight_l1[i]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->luma_offset_l1[i]);
         }
     }
     
-    va_TraceMsg(idx, "\tchroma_weight_l1_flag = %d\n", p->chroma_weight_l1_flag);
+    va_TraceMsg(trace_ctx, "\tchroma_weight_l1_flag = %d\n", p->chroma_weight_l1_flag);
     if (p->chroma_weight_l1_flag) {
         for (i = 0; i <= p->num_ref_idx_l1_active_minus1; i++) {
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_weight_l1[i][0]);
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_offset_l1[i][0]);
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_weight_l1[i][1]);
-            va_TraceMsg(idx, "\t\t%d ", p->chroma_offset_l1[i][1]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_weight_l1[i][0]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_offset_l1[i][0]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_weight_l1[i][1]);
+            va_TraceMsg(trace_ctx, "\t\t%d ", p->chroma_offset_l1[i][1]);
         }
-        va_TraceMsg(idx, "\n");
+        va_TraceMsg(trace_ctx, "\n");
     }
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 static void va_TraceVAIQMatrixBufferH264(
@@ -1117,29 +3021,29 @@ static void va_TraceVAIQMatrixBufferH264(
     int i, j;    
     VAIQMatrixBufferH264* p = (VAIQMatrixBufferH264* )data;
 
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    va_TraceMsg(idx, "VAIQMatrixBufferH264\n");
+    va_TraceMsg(trace_ctx, "VAIQMatrixBufferH264\n");
 
-    va_TraceMsg(idx, "\tScalingList4x4[6][16]=\n");
+    va_TraceMsg(trace_ctx, "\tScalingList4x4[6][16]=\n");
     for (i = 0; i < 6; i++) {
         for (j = 0; j < 16; j++) {
-            va_TraceMsg(idx, "\t%d\t", p->ScalingList4x4[i][j]);
+            va_TraceMsg(trace_ctx, "\t%d\t", p->ScalingList4x4[i][j]);
             if ((j + 1) % 8 == 0)
-                va_TraceMsg(idx, "\n");
+                va_TraceMsg(trace_ctx, "\n");
         }
     }
 
-    va_TraceMsg(idx, "\tScalingList8x8[2][64]=\n");
+    va_TraceMsg(trace_ctx, "\tScalingList8x8[2][64]=\n");
     for (i = 0; i < 2; i++) {
         for (j = 0; j < 64; j++) {
-            va_TraceMsg(idx, "\t%d", p->ScalingList8x8[i][j]);
+            va_TraceMsg(trace_ctx, "\t%d", p->ScalingList8x8[i][j]);
             if ((j + 1) % 8 == 0)
-                va_TraceMsg(idx, "\n");
+                va_TraceMsg(trace_ctx, "\n");
         }
     }
 
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 static void va_TraceVAEncSequenceParameterBufferH264(
@@ -1152,27 +3056,27 @@ static void va_TraceVAEncSequenceParameterBufferH264(
     void *data)
 {
     VAEncSequenceParameterBufferH264 *p = (VAEncSequenceParameterBufferH264 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
-    va_TraceMsg(idx, "VAEncSequenceParameterBufferH264\n");
+    va_TraceMsg(trace_ctx, "VAEncSequenceParameterBufferH264\n");
     
-    va_TraceMsg(idx, "\tseq_parameter_set_id = %d\n", p->seq_parameter_set_id);
-    va_TraceMsg(idx, "\tlevel_idc = %d\n", p->level_idc);
-    va_TraceMsg(idx, "\tintra_period = %d\n", p->intra_period);
-    va_TraceMsg(idx, "\tintra_idr_period = %d\n", p->intra_idr_period);
-    va_TraceMsg(idx, "\tmax_num_ref_frames = %d\n", p->max_num_ref_frames);
-    va_TraceMsg(idx, "\tpicture_width_in_mbs = %d\n", p->picture_width_in_mbs);
-    va_TraceMsg(idx, "\tpicture_height_in_mbs = %d\n", p->picture_height_in_mbs);
-    va_TraceMsg(idx, "\tbits_per_second = %d\n", p->bits_per_second);
-    va_TraceMsg(idx, "\tframe_rate = %d\n", p->frame_rate);
-    va_TraceMsg(idx, "\tinitial_qp = %d\n", p->initial_qp);
-    va_TraceMsg(idx, "\tmin_qp = %d\n", p->min_qp);
-    va_TraceMsg(idx, "\tbasic_unit_size = %d\n", p->basic_unit_size);
-    va_TraceMsg(idx, "\tvui_flag = %d\n", p->vui_flag);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tseq_parameter_set_id = %d\n", p->seq_parameter_set_id);
+    va_TraceMsg(trace_ctx, "\tlevel_idc = %d\n", p->level_idc);
+    va_TraceMsg(trace_ctx, "\tintra_period = %d\n", p->intra_period);
+    va_TraceMsg(trace_ctx, "\tintra_idr_period = %d\n", p->intra_idr_period);
+    va_TraceMsg(trace_ctx, "\tmax_num_ref_frames = %d\n", p->max_num_ref_frames);
+    va_TraceMsg(trace_ctx, "\tpicture_width_in_mbs = %d\n", p->picture_width_in_mbs);
+    va_TraceMsg(trace_ctx, "\tpicture_height_in_mbs = %d\n", p->picture_height_in_mbs);
+    va_TraceMsg(trace_ctx, "\tbits_per_second = %d\n", p->bits_per_second);
+    va_TraceMsg(trace_ctx, "\tframe_rate = %d\n", p->frame_rate);
+    va_TraceMsg(trace_ctx, "\tinitial_qp = %d\n", p->initial_qp);
+    va_TraceMsg(trace_ctx, "\tmin_qp = %d\n", p->min_qp);
+    va_TraceMsg(trace_ctx, "\tbasic_unit_size = %d\n", p->basic_unit_size);
+    va_TraceMsg(trace_ctx, "\tvui_flag = %d\n", p->vui_flag);
+    va_TraceMsg(trace_ctx, NULL);
 
     /* start a new sequce, coded log file can be truncated */
-    trace_context[idx].trace_sequence_start = 1;
+    va_ctx->trace_sequence_start = 1;
 
     return;
 }
@@ -1187,18 +3091,18 @@ static void va_TraceVAEncPictureParameterBufferH264(
     void *data)
 {
     VAEncPictureParameterBufferH264 *p = (VAEncPictureParameterBufferH264 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
-    va_TraceMsg(idx, "VAEncPictureParameterBufferH264\n");
-    va_TraceMsg(idx, "\treference_picture = 0x%08x\n", p->reference_picture);
-    va_TraceMsg(idx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
-    va_TraceMsg(idx, "\tcoded_buf = %08x\n", p->coded_buf);
-    va_TraceMsg(idx, "\tpicture_width = %d\n", p->picture_width);
-    va_TraceMsg(idx, "\tpicture_height = %d\n", p->picture_height);
-    va_TraceMsg(idx, "\tlast_picture = 0x%08x\n", p->last_picture);
-    va_TraceMsg(idx, NULL);
-
-    trace_context[idx].trace_codedbuf =  p->coded_buf;
+    va_TraceMsg(trace_ctx, "VAEncPictureParameterBufferH264\n");
+    va_TraceMsg(trace_ctx, "\treference_picture = 0x%08x\n", p->reference_picture);
+    va_TraceMsg(trace_ctx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
+    va_TraceMsg(trace_ctx, "\tcoded_buf = %08x\n", p->coded_buf);
+    va_TraceMsg(trace_ctx, "\tpicture_width = %d\n", p->picture_width);
+    va_TraceMsg(trace_ctx, "\tpicture_height = %d\n", p->picture_height);
+    va_TraceMsg(trace_ctx, "\tlast_picture = 0x%08x\n", p->last_picture);
+    va_TraceMsg(trace_ctx, NULL);
+
+    va_ctx->trace_codedbuf =  p->coded_buf;
     
     return;
 }
@@ -1214,17 +3118,17 @@ static void va_TraceVAEncSliceParameterBuffer(
     void *data)
 {
     VAEncSliceParameterBuffer* p = (VAEncSliceParameterBuffer*)data;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
     
-    va_TraceMsg(idx, "VAEncSliceParameterBuffer\n");
+    va_TraceMsg(trace_ctx, "VAEncSliceParameterBuffer\n");
     
-    va_TraceMsg(idx, "\tstart_row_number = %d\n", p->start_row_number);
-    va_TraceMsg(idx, "\tslice_height = %d\n", p->slice_height);
-    va_TraceMsg(idx, "\tslice_flags.is_intra = %d\n", p->slice_flags.bits.is_intra);
-    va_TraceMsg(idx, "\tslice_flags.disable_deblocking_filter_idc = %d\n", p->slice_flags.bits.disable_deblocking_filter_idc);
-    va_TraceMsg(idx, "\tslice_flags.uses_long_term_ref = %d\n", p->slice_flags.bits.uses_long_term_ref);
-    va_TraceMsg(idx, "\tslice_flags.is_long_term_ref = %d\n", p->slice_flags.bits.is_long_term_ref);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tstart_row_number = %d\n", p->start_row_number);
+    va_TraceMsg(trace_ctx, "\tslice_height = %d\n", p->slice_height);
+    va_TraceMsg(trace_ctx, "\tslice_flags.is_intra = %d\n", p->slice_flags.bits.is_intra);
+    va_TraceMsg(trace_ctx, "\tslice_flags.disable_deblocking_filter_idc = %d\n", p->slice_flags.bits.disable_deblocking_filter_idc);
+    va_TraceMsg(trace_ctx, "\tslice_flags.uses_long_term_ref = %d\n", p->slice_flags.bits.uses_long_term_ref);
+    va_TraceMsg(trace_ctx, "\tslice_flags.is_long_term_ref = %d\n", p->slice_flags.bits.is_long_term_ref);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -1239,14 +3143,14 @@ static void va_TraceVAEncMiscParameterBuffer(
     void *data)
 {
     VAEncMiscParameterBuffer* tmp = (VAEncMiscParameterBuffer*)data;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
     
     switch (tmp->type) {
     case VAEncMiscParameterTypeFrameRate:
     {
         VAEncMiscParameterFrameRate *p = (VAEncMiscParameterFrameRate *)tmp->data;
-        va_TraceMsg(idx, "VAEncMiscParameterFrameRate\n");
-        va_TraceMsg(idx, "\tframerate = %d\n", p->framerate);
+        va_TraceMsg(trace_ctx, "VAEncMiscParameterFrameRate\n");
+        va_TraceMsg(trace_ctx, "\tframerate = %d\n", p->framerate);
         
         break;
     }
@@ -1254,36 +3158,36 @@ static void va_TraceVAEncMiscParameterBuffer(
     {
         VAEncMiscParameterRateControl *p = (VAEncMiscParameterRateControl *)tmp->data;
 
-        va_TraceMsg(idx, "VAEncMiscParameterRateControl\n");
-        va_TraceMsg(idx, "\tbits_per_second = %d\n", p->bits_per_second);
-        va_TraceMsg(idx, "\twindow_size = %d\n", p->window_size);
-        va_TraceMsg(idx, "\tinitial_qp = %d\n", p->initial_qp);
-        va_TraceMsg(idx, "\tmin_qp = %d\n", p->min_qp);
+        va_TraceMsg(trace_ctx, "VAEncMiscParameterRateControl\n");
+        va_TraceMsg(trace_ctx, "\tbits_per_second = %d\n", p->bits_per_second);
+        va_TraceMsg(trace_ctx, "\twindow_size = %d\n", p->window_size);
+        va_TraceMsg(trace_ctx, "\tinitial_qp = %d\n", p->initial_qp);
+        va_TraceMsg(trace_ctx, "\tmin_qp = %d\n", p->min_qp);
         break;
     }
     case VAEncMiscParameterTypeMaxSliceSize:
     {
         VAEncMiscParameterMaxSliceSize *p = (VAEncMiscParameterMaxSliceSize *)tmp->data;
         
-        va_TraceMsg(idx, "VAEncMiscParameterTypeMaxSliceSize\n");
-        va_TraceMsg(idx, "\tmax_slice_size = %d\n", p->max_slice_size);
+        va_TraceMsg(trace_ctx, "VAEncMiscParameterTypeMaxSliceSize\n");
+        va_TraceMsg(trace_ctx, "\tmax_slice_size = %d\n", p->max_slice_size);
         break;
     }
     case VAEncMiscParameterTypeAIR:
     {
         VAEncMiscParameterAIR *p = (VAEncMiscParameterAIR *)tmp->data;
         
-        va_TraceMsg(idx, "VAEncMiscParameterAIR\n");
-        va_TraceMsg(idx, "\tair_num_mbs = %d\n", p->air_num_mbs);
-        va_TraceMsg(idx, "\tair_threshold = %d\n", p->air_threshold);
-        va_TraceMsg(idx, "\tair_auto = %d\n", p->air_auto);
+        va_TraceMsg(trace_ctx, "VAEncMiscParameterAIR\n");
+        va_TraceMsg(trace_ctx, "\tair_num_mbs = %d\n", p->air_num_mbs);
+        va_TraceMsg(trace_ctx, "\tair_threshold = %d\n", p->air_threshold);
+        va_TraceMsg(trace_ctx, "\tair_auto = %d\n", p->air_auto);
         break;
     }
     default:
-        va_TraceMsg(idx, "invalid VAEncMiscParameterBuffer type = %d\n", tmp->type);
+        va_TraceMsg(trace_ctx, "invalid VAEncMiscParameterBuffer type = %d\n", tmp->type);
         break;
     }
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 
     return;
 }
@@ -1300,98 +3204,98 @@ static void va_TraceVAPictureParameterBufferVC1(
 )
 {
     VAPictureParameterBufferVC1* p = (VAPictureParameterBufferVC1*)data;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
     
-    va_TraceMsg(idx, "VAPictureParameterBufferVC1\n");
+    va_TraceMsg(trace_ctx, "VAPictureParameterBufferVC1\n");
     
-    va_TraceMsg(idx, "\tforward_reference_picture = 0x%08x\n", p->forward_reference_picture);
-    va_TraceMsg(idx, "\tbackward_reference_picture = 0x%08x\n", p->backward_reference_picture);
-    va_TraceMsg(idx, "\tinloop_decoded_picture = 0x%08x\n", p->inloop_decoded_picture);
+    va_TraceMsg(trace_ctx, "\tforward_reference_picture = 0x%08x\n", p->forward_reference_picture);
+    va_TraceMsg(trace_ctx, "\tbackward_reference_picture = 0x%08x\n", p->backward_reference_picture);
+    va_TraceMsg(trace_ctx, "\tinloop_decoded_picture = 0x%08x\n", p->inloop_decoded_picture);
     
-    va_TraceMsg(idx, "\tpulldown = %d\n", p->sequence_fields.bits.pulldown);
-    va_TraceMsg(idx, "\tinterlace = %d\n", p->sequence_fields.bits.interlace);
-    va_TraceMsg(idx, "\ttfcntrflag = %d\n", p->sequence_fields.bits.tfcntrflag);
-    va_TraceMsg(idx, "\tfinterpflag = %d\n", p->sequence_fields.bits.finterpflag);
-    va_TraceMsg(idx, "\tpsf = %d\n", p->sequence_fields.bits.psf);
-    va_TraceMsg(idx, "\tmultires = %d\n", p->sequence_fields.bits.multires);
-    va_TraceMsg(idx, "\toverlap = %d\n", p->sequence_fields.bits.overlap);
-    va_TraceMsg(idx, "\tsyncmarker = %d\n", p->sequence_fields.bits.syncmarker);
-    va_TraceMsg(idx, "\trangered = %d\n", p->sequence_fields.bits.rangered);
-    va_TraceMsg(idx, "\tmax_b_frames = %d\n", p->sequence_fields.bits.max_b_frames);
-    va_TraceMsg(idx, "\tprofile = %d\n", p->sequence_fields.bits.profile);
-    va_TraceMsg(idx, "\tcoded_width = %d\n", p->coded_width);
-    va_TraceMsg(idx, "\tcoded_height = %d\n", p->coded_height);
-    va_TraceMsg(idx, "\tclosed_entry = %d\n", p->entrypoint_fields.bits.closed_entry);
-    va_TraceMsg(idx, "\tbroken_link = %d\n", p->entrypoint_fields.bits.broken_link);
-    va_TraceMsg(idx, "\tclosed_entry = %d\n", p->entrypoint_fields.bits.closed_entry);
-    va_TraceMsg(idx, "\tpanscan_flag = %d\n", p->entrypoint_fields.bits.panscan_flag);
-    va_TraceMsg(idx, "\tloopfilter = %d\n", p->entrypoint_fields.bits.loopfilter);
-    va_TraceMsg(idx, "\tconditional_overlap_flag = %d\n", p->conditional_overlap_flag);
-    va_TraceMsg(idx, "\tfast_uvmc_flag = %d\n", p->fast_uvmc_flag);
-    va_TraceMsg(idx, "\trange_mapping_luma_flag = %d\n", p->range_mapping_fields.bits.luma_flag);
-    va_TraceMsg(idx, "\trange_mapping_luma = %d\n", p->range_mapping_fields.bits.luma);
-    va_TraceMsg(idx, "\trange_mapping_chroma_flag = %d\n", p->range_mapping_fields.bits.chroma_flag);
-    va_TraceMsg(idx, "\trange_mapping_chroma = %d\n", p->range_mapping_fields.bits.chroma);
-    va_TraceMsg(idx, "\tb_picture_fraction = %d\n", p->b_picture_fraction);
-    va_TraceMsg(idx, "\tcbp_table = %d\n", p->cbp_table);
-    va_TraceMsg(idx, "\tmb_mode_table = %d\n", p->mb_mode_table);
-    va_TraceMsg(idx, "\trange_reduction_frame = %d\n", p->range_reduction_frame);
-    va_TraceMsg(idx, "\trounding_control = %d\n", p->rounding_control);
-    va_TraceMsg(idx, "\tpost_processing = %d\n", p->post_processing);
-    va_TraceMsg(idx, "\tpicture_resolution_index = %d\n", p->picture_resolution_index);
-    va_TraceMsg(idx, "\tluma_scale = %d\n", p->luma_scale);
-    va_TraceMsg(idx, "\tluma_shift = %d\n", p->luma_shift);
-    va_TraceMsg(idx, "\tpicture_type = %d\n", p->picture_fields.bits.picture_type);
-    va_TraceMsg(idx, "\tframe_coding_mode = %d\n", p->picture_fields.bits.frame_coding_mode);
-    va_TraceMsg(idx, "\ttop_field_first = %d\n", p->picture_fields.bits.top_field_first);
-    va_TraceMsg(idx, "\tis_first_field = %d\n", p->picture_fields.bits.is_first_field);
-    va_TraceMsg(idx, "\tintensity_compensation = %d\n", p->picture_fields.bits.intensity_compensation);
-    va_TraceMsg(idx, "\tmv_type_mb = %d\n", p->raw_coding.flags.mv_type_mb);
-    va_TraceMsg(idx, "\tdirect_mb = %d\n", p->raw_coding.flags.direct_mb);
-    va_TraceMsg(idx, "\tskip_mb = %d\n", p->raw_coding.flags.skip_mb);
-    va_TraceMsg(idx, "\tfield_tx = %d\n", p->raw_coding.flags.field_tx);
-    va_TraceMsg(idx, "\tforward_mb = %d\n", p->raw_coding.flags.forward_mb);
-    va_TraceMsg(idx, "\tac_pred = %d\n", p->raw_coding.flags.ac_pred);
-    va_TraceMsg(idx, "\toverflags = %d\n", p->raw_coding.flags.overflags);
-    va_TraceMsg(idx, "\tbp_mv_type_mb = %d\n", p->bitplane_present.flags.bp_mv_type_mb);
-    va_TraceMsg(idx, "\tbp_direct_mb = %d\n", p->bitplane_present.flags.bp_direct_mb);
-    va_TraceMsg(idx, "\tbp_skip_mb = %d\n", p->bitplane_present.flags.bp_skip_mb);
-    va_TraceMsg(idx, "\tbp_field_tx = %d\n", p->bitplane_present.flags.bp_field_tx);
-    va_TraceMsg(idx, "\tbp_forward_mb = %d\n", p->bitplane_present.flags.bp_forward_mb);
-    va_TraceMsg(idx, "\tbp_ac_pred = %d\n", p->bitplane_present.flags.bp_ac_pred);
-    va_TraceMsg(idx, "\tbp_overflags = %d\n", p->bitplane_present.flags.bp_overflags);
-    va_TraceMsg(idx, "\treference_distance_flag = %d\n", p->reference_fields.bits.reference_distance_flag);
-    va_TraceMsg(idx, "\treference_distance = %d\n", p->reference_fields.bits.reference_distance);
-    va_TraceMsg(idx, "\tnum_reference_pictures = %d\n", p->reference_fields.bits.num_reference_pictures);
-    va_TraceMsg(idx, "\treference_field_pic_indicator = %d\n", p->reference_fields.bits.reference_field_pic_indicator);
-    va_TraceMsg(idx, "\tmv_mode = %d\n", p->mv_fields.bits.mv_mode);
-    va_TraceMsg(idx, "\tmv_mode2 = %d\n", p->mv_fields.bits.mv_mode2);
-    va_TraceMsg(idx, "\tmv_table = %d\n", p->mv_fields.bits.mv_table);
-    va_TraceMsg(idx, "\ttwo_mv_block_pattern_table = %d\n", p->mv_fields.bits.two_mv_block_pattern_table);
-    va_TraceMsg(idx, "\tfour_mv_switch = %d\n", p->mv_fields.bits.four_mv_switch);
-    va_TraceMsg(idx, "\tfour_mv_block_pattern_table = %d\n", p->mv_fields.bits.four_mv_block_pattern_table);
-    va_TraceMsg(idx, "\textended_mv_flag = %d\n", p->mv_fields.bits.extended_mv_flag);
-    va_TraceMsg(idx, "\textended_mv_range = %d\n", p->mv_fields.bits.extended_mv_range);
-    va_TraceMsg(idx, "\textended_dmv_flag = %d\n", p->mv_fields.bits.extended_dmv_flag);
-    va_TraceMsg(idx, "\textended_dmv_range = %d\n", p->mv_fields.bits.extended_dmv_range);
-    va_TraceMsg(idx, "\tdquant = %d\n", p->pic_quantizer_fields.bits.dquant);
-    va_TraceMsg(idx, "\tquantizer = %d\n", p->pic_quantizer_fields.bits.quantizer);
-    va_TraceMsg(idx, "\thalf_qp = %d\n", p->pic_quantizer_fields.bits.half_qp);
-    va_TraceMsg(idx, "\tpic_quantizer_scale = %d\n", p->pic_quantizer_fields.bits.pic_quantizer_scale);
-    va_TraceMsg(idx, "\tpic_quantizer_type = %d\n", p->pic_quantizer_fields.bits.pic_quantizer_type);
-    va_TraceMsg(idx, "\tdq_frame = %d\n", p->pic_quantizer_fields.bits.dq_frame);
-    va_TraceMsg(idx, "\tdq_profile = %d\n", p->pic_quantizer_fields.bits.dq_profile);
-    va_TraceMsg(idx, "\tdq_sb_edge = %d\n", p->pic_quantizer_fields.bits.dq_sb_edge);
-    va_TraceMsg(idx, "\tdq_db_edge = %d\n", p->pic_quantizer_fields.bits.dq_db_edge);
-    va_TraceMsg(idx, "\tdq_binary_level = %d\n", p->pic_quantizer_fields.bits.dq_binary_level);
-    va_TraceMsg(idx, "\talt_pic_quantizer = %d\n", p->pic_quantizer_fields.bits.alt_pic_quantizer);
-    va_TraceMsg(idx, "\tvariable_sized_transform_flag = %d\n", p->transform_fields.bits.variable_sized_transform_flag);
-    va_TraceMsg(idx, "\tmb_level_transform_type_flag = %d\n", p->transform_fields.bits.mb_level_transform_type_flag);
-    va_TraceMsg(idx, "\tframe_level_transform_type = %d\n", p->transform_fields.bits.frame_level_transform_type);
-    va_TraceMsg(idx, "\ttransform_ac_codingset_idx1 = %d\n", p->transform_fields.bits.transform_ac_codingset_idx1);
-    va_TraceMsg(idx, "\ttransform_ac_codingset_idx2 = %d\n", p->transform_fields.bits.transform_ac_codingset_idx2);
-    va_TraceMsg(idx, "\tintra_transform_dc_table = %d\n", p->transform_fields.bits.intra_transform_dc_table);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tpulldown = %d\n", p->sequence_fields.bits.pulldown);
+    va_TraceMsg(trace_ctx, "\tinterlace = %d\n", p->sequence_fields.bits.interlace);
+    va_TraceMsg(trace_ctx, "\ttfcntrflag = %d\n", p->sequence_fields.bits.tfcntrflag);
+    va_TraceMsg(trace_ctx, "\tfinterpflag = %d\n", p->sequence_fields.bits.finterpflag);
+    va_TraceMsg(trace_ctx, "\tpsf = %d\n", p->sequence_fields.bits.psf);
+    va_TraceMsg(trace_ctx, "\tmultires = %d\n", p->sequence_fields.bits.multires);
+    va_TraceMsg(trace_ctx, "\toverlap = %d\n", p->sequence_fields.bits.overlap);
+    va_TraceMsg(trace_ctx, "\tsyncmarker = %d\n", p->sequence_fields.bits.syncmarker);
+    va_TraceMsg(trace_ctx, "\trangered = %d\n", p->sequence_fields.bits.rangered);
+    va_TraceMsg(trace_ctx, "\tmax_b_frames = %d\n", p->sequence_fields.bits.max_b_frames);
+    va_TraceMsg(trace_ctx, "\tprofile = %d\n", p->sequence_fields.bits.profile);
+    va_TraceMsg(trace_ctx, "\tcoded_width = %d\n", p->coded_width);
+    va_TraceMsg(trace_ctx, "\tcoded_height = %d\n", p->coded_height);
+    va_TraceMsg(trace_ctx, "\tclosed_entry = %d\n", p->entrypoint_fields.bits.closed_entry);
+    va_TraceMsg(trace_ctx, "\tbroken_link = %d\n", p->entrypoint_fields.bits.broken_link);
+    va_TraceMsg(trace_ctx, "\tclosed_entry = %d\n", p->entrypoint_fields.bits.closed_entry);
+    va_TraceMsg(trace_ctx, "\tpanscan_flag = %d\n", p->entrypoint_fields.bits.panscan_flag);
+    va_TraceMsg(trace_ctx, "\tloopfilter = %d\n", p->entrypoint_fields.bits.loopfilter);
+    va_TraceMsg(trace_ctx, "\tconditional_overlap_flag = %d\n", p->conditional_overlap_flag);
+    va_TraceMsg(trace_ctx, "\tfast_uvmc_flag = %d\n", p->fast_uvmc_flag);
+    va_TraceMsg(trace_ctx, "\trange_mapping_luma_flag = %d\n", p->range_mapping_fields.bits.luma_flag);
+    va_TraceMsg(trace_ctx, "\trange_mapping_luma = %d\n", p->range_mapping_fields.bits.luma);
+    va_TraceMsg(trace_ctx, "\trange_mapping_chroma_flag = %d\n", p->range_mapping_fields.bits.chroma_flag);
+    va_TraceMsg(trace_ctx, "\trange_mapping_chroma = %d\n", p->range_mapping_fields.bits.chroma);
+    va_TraceMsg(trace_ctx, "\tb_picture_fraction = %d\n", p->b_picture_fraction);
+    va_TraceMsg(trace_ctx, "\tcbp_table = %d\n", p->cbp_table);
+    va_TraceMsg(trace_ctx, "\tmb_mode_table = %d\n", p->mb_mode_table);
+    va_TraceMsg(trace_ctx, "\trange_reduction_frame = %d\n", p->range_reduction_frame);
+    va_TraceMsg(trace_ctx, "\trounding_control = %d\n", p->rounding_control);
+    va_TraceMsg(trace_ctx, "\tpost_processing = %d\n", p->post_processing);
+    va_TraceMsg(trace_ctx, "\tpicture_resolution_index = %d\n", p->picture_resolution_index);
+    va_TraceMsg(trace_ctx, "\tluma_scale = %d\n", p->luma_scale);
+    va_TraceMsg(trace_ctx, "\tluma_shift = %d\n", p->luma_shift);
+    va_TraceMsg(trace_ctx, "\tpicture_type = %d\n", p->picture_fields.bits.picture_type);
+    va_TraceMsg(trace_ctx, "\tframe_coding_mode = %d\n", p->picture_fields.bits.frame_coding_mode);
+    va_TraceMsg(trace_ctx, "\ttop_field_first = %d\n", p->picture_fields.bits.top_field_first);
+    va_TraceMsg(trace_ctx, "\tis_first_field = %d\n", p->picture_fields.bits.is_first_field);
+    va_TraceMsg(trace_ctx, "\tintensity_compensation = %d\n", p->picture_fields.bits.intensity_compensation);
+    va_TraceMsg(trace_ctx, "\tmv_type_mb = %d\n", p->raw_coding.flags.mv_type_mb);
+    va_TraceMsg(trace_ctx, "\tdirect_mb = %d\n", p->raw_coding.flags.direct_mb);
+    va_TraceMsg(trace_ctx, "\tskip_mb = %d\n", p->raw_coding.flags.skip_mb);
+    va_TraceMsg(trace_ctx, "\tfield_tx = %d\n", p->raw_coding.flags.field_tx);
+    va_TraceMsg(trace_ctx, "\tforward_mb = %d\n", p->raw_coding.flags.forward_mb);
+    va_TraceMsg(trace_ctx, "\tac_pred = %d\n", p->raw_coding.flags.ac_pred);
+    va_TraceMsg(trace_ctx, "\toverflags = %d\n", p->raw_coding.flags.overflags);
+    va_TraceMsg(trace_ctx, "\tbp_mv_type_mb = %d\n", p->bitplane_present.flags.bp_mv_type_mb);
+    va_TraceMsg(trace_ctx, "\tbp_direct_mb = %d\n", p->bitplane_present.flags.bp_direct_mb);
+    va_TraceMsg(trace_ctx, "\tbp_skip_mb = %d\n", p->bitplane_present.flags.bp_skip_mb);
+    va_TraceMsg(trace_ctx, "\tbp_field_tx = %d\n", p->bitplane_present.flags.bp_field_tx);
+    va_TraceMsg(trace_ctx, "\tbp_forward_mb = %d\n", p->bitplane_present.flags.bp_forward_mb);
+    va_TraceMsg(trace_ctx, "\tbp_ac_pred = %d\n", p->bitplane_present.flags.bp_ac_pred);
+    va_TraceMsg(trace_ctx, "\tbp_overflags = %d\n", p->bitplane_present.flags.bp_overflags);
+    va_TraceMsg(trace_ctx, "\treference_distance_flag = %d\n", p->reference_fields.bits.reference_distance_flag);
+    va_TraceMsg(trace_ctx, "\treference_distance = %d\n", p->reference_fields.bits.reference_distance);
+    va_TraceMsg(trace_ctx, "\tnum_reference_pictures = %d\n", p->reference_fields.bits.num_reference_pictures);
+    va_TraceMsg(trace_ctx, "\treference_field_pic_indicator = %d\n", p->reference_fields.bits.reference_field_pic_indicator);
+    va_TraceMsg(trace_ctx, "\tmv_mode = %d\n", p->mv_fields.bits.mv_mode);
+    va_TraceMsg(trace_ctx, "\tmv_mode2 = %d\n", p->mv_fields.bits.mv_mode2);
+    va_TraceMsg(trace_ctx, "\tmv_table = %d\n", p->mv_fields.bits.mv_table);
+    va_TraceMsg(trace_ctx, "\ttwo_mv_block_pattern_table = %d\n", p->mv_fields.bits.two_mv_block_pattern_table);
+    va_TraceMsg(trace_ctx, "\tfour_mv_switch = %d\n", p->mv_fields.bits.four_mv_switch);
+    va_TraceMsg(trace_ctx, "\tfour_mv_block_pattern_table = %d\n", p->mv_fields.bits.four_mv_block_pattern_table);
+    va_TraceMsg(trace_ctx, "\textended_mv_flag = %d\n", p->mv_fields.bits.extended_mv_flag);
+    va_TraceMsg(trace_ctx, "\textended_mv_range = %d\n", p->mv_fields.bits.extended_mv_range);
+    va_TraceMsg(trace_ctx, "\textended_dmv_flag = %d\n", p->mv_fields.bits.extended_dmv_flag);
+    va_TraceMsg(trace_ctx, "\textended_dmv_range = %d\n", p->mv_fields.bits.extended_dmv_range);
+    va_TraceMsg(trace_ctx, "\tdquant = %d\n", p->pic_quantizer_fields.bits.dquant);
+    va_TraceMsg(trace_ctx, "\tquantizer = %d\n", p->pic_quantizer_fields.bits.quantizer);
+    va_TraceMsg(trace_ctx, "\thalf_qp = %d\n", p->pic_quantizer_fields.bits.half_qp);
+    va_TraceMsg(trace_ctx, "\tpic_quantizer_scale = %d\n", p->pic_quantizer_fields.bits.pic_quantizer_scale);
+    va_TraceMsg(trace_ctx, "\tpic_quantizer_type = %d\n", p->pic_quantizer_fields.bits.pic_quantizer_type);
+    va_TraceMsg(trace_ctx, "\tdq_frame = %d\n", p->pic_quantizer_fields.bits.dq_frame);
+    va_TraceMsg(trace_ctx, "\tdq_profile = %d\n", p->pic_quantizer_fields.bits.dq_profile);
+    va_TraceMsg(trace_ctx, "\tdq_sb_edge = %d\n", p->pic_quantizer_fields.bits.dq_sb_edge);
+    va_TraceMsg(trace_ctx, "\tdq_db_edge = %d\n", p->pic_quantizer_fields.bits.dq_db_edge);
+    va_TraceMsg(trace_ctx, "\tdq_binary_level = %d\n", p->pic_quantizer_fields.bits.dq_binary_level);
+    va_TraceMsg(trace_ctx, "\talt_pic_quantizer = %d\n", p->pic_quantizer_fields.bits.alt_pic_quantizer);
+    va_TraceMsg(trace_ctx, "\tvariable_sized_transform_flag = %d\n", p->transform_fields.bits.variable_sized_transform_flag);
+    va_TraceMsg(trace_ctx, "\tmb_level_transform_type_flag = %d\n", p->transform_fields.bits.mb_level_transform_type_flag);
+    va_TraceMsg(trace_ctx, "\tframe_level_transform_type = %d\n", p->transform_fields.bits.frame_level_transform_type);
+    va_TraceMsg(trace_ctx, "\ttransform_ac_codingset_idx1 = %d\n", p->transform_fields.bits.transform_ac_codingset_idx1);
+    va_TraceMsg(trace_ctx, "\ttransform_ac_codingset_idx2 = %d\n", p->transform_fields.bits.transform_ac_codingset_idx2);
+    va_TraceMsg(trace_ctx, "\tintra_transform_dc_table = %d\n", p->transform_fields.bits.intra_transform_dc_table);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 static void va_TraceVASliceParameterBufferVC1(
@@ -1405,18 +3309,18 @@ static void va_TraceVASliceParameterBufferVC1(
 )
 {
     VASliceParameterBufferVC1 *p = (VASliceParameterBufferVC1*)data;
-    DPY2INDEX(dpy);
-
-    trace_context[idx].trace_slice_no++;
-    trace_context[idx].trace_slice_size = p->slice_data_size;
-
-    va_TraceMsg(idx, "VASliceParameterBufferVC1\n");
-    va_TraceMsg(idx, "\tslice_data_size = %d\n", p->slice_data_size);
-    va_TraceMsg(idx, "\tslice_data_offset = %d\n", p->slice_data_offset);
-    va_TraceMsg(idx, "\tslice_data_flag = %d\n", p->slice_data_flag);
-    va_TraceMsg(idx, "\tmacroblock_offset = %d\n", p->macroblock_offset);
-    va_TraceMsg(idx, "\tslice_vertical_position = %d\n", p->slice_vertical_position);
-    va_TraceMsg(idx, NULL);
+    DPY2TRACE_VACTX(dpy, context);
+
+    va_ctx->trace_slice_no++;
+    va_ctx->trace_slice_size = p->slice_data_size;
+
+    va_TraceMsg(trace_ctx, "VASliceParameterBufferVC1\n");
+    va_TraceMsg(trace_ctx, "\tslice_data_size = %d\n", p->slice_data_size);
+    va_TraceMsg(trace_ctx, "\tslice_data_offset = %d\n", p->slice_data_offset);
+    va_TraceMsg(trace_ctx, "\tslice_data_flag = %d\n", p->slice_data_flag);
+    va_TraceMsg(trace_ctx, "\tmacroblock_offset = %d\n", p->macroblock_offset);
+    va_TraceMsg(trace_ctx, "\tslice_vertical_position = %d\n", p->slice_vertical_position);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 void va_TraceBeginPicture(
@@ -1425,19 +3329,31 @@ void va_TraceBeginPicture(
     VASurfaceID render_target
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
+
+    /* the log of a frame isn't split */
+    trace_file_boundary(trace_ctx, trace_ctx->trace_fp_log, trace_ctx->trace_log_fn,
+                        &trace_ctx->trace_log_size);
 
-    TRACE_FUNCNAME(idx);
+    /* the rest of the picture, and the hooks until the next one, follow */
+    va_ctx->trace_frame_skip = !trace_frame_sampled(trace_ctx, va_ctx->trace_frame_no);
+    trace_ctx->trace_frame_skip = va_ctx->trace_frame_skip;
 
-    va_TraceMsg(idx, "\tcontext = 0x%08x\n", context);
-    va_TraceMsg(idx, "\trender_targets = 0x%08x\n", render_target);
-    va_TraceMsg(idx, "\tframe_count  = #%d\n", trace_context[idx].trace_frame_no);
-    va_TraceMsg(idx, NULL);
+    if (!va_ctx->trace_frame_skip) {
+        TRACE_RECORD(trace_ctx, BeginPicture, NULL, 0, context, render_target,
+                     va_ctx->trace_frame_no);
+        TRACE_FUNCNAME(trace_ctx);
 
-    trace_context[idx].trace_rendertarget = render_target; /* for surface data dump after vaEndPicture */
+        va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
+        va_TraceMsg(trace_ctx, "\trender_targets = 0x%08x\n", render_target);
+        va_TraceMsg(trace_ctx, "\tframe_count  = #%d\n", va_ctx->trace_frame_no);
+        va_TraceMsg(trace_ctx, NULL);
+    }
+
+    va_ctx->trace_rendertarget = render_target; /* for surface data dump after vaEndPicture */
 
-    trace_context[idx].trace_frame_no++;
-    trace_context[idx].trace_slice_no = 0;
+    va_ctx->trace_frame_no++;
+    va_ctx->trace_slice_no = 0;
 }
 
 static void va_TraceMPEG2Buf(
@@ -1510,19 +3426,19 @@ static void va_TraceVAEncSequenceParameterBufferH263(
     void *data)
 {
     VAEncSequenceParameterBufferH263 *p = (VAEncSequenceParameterBufferH263 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
-    va_TraceMsg(idx, "VAEncSequenceParameterBufferH263\n");
+    va_TraceMsg(trace_ctx, "VAEncSequenceParameterBufferH263\n");
     
-    va_TraceMsg(idx, "\tintra_period = %d\n", p->intra_period);
-    va_TraceMsg(idx, "\tbits_per_second = %d\n", p->bits_per_second);
-    va_TraceMsg(idx, "\tframe_rate = %d\n", p->frame_rate);
-    va_TraceMsg(idx, "\tinitial_qp = %d\n", p->initial_qp);
-    va_TraceMsg(idx, "\tmin_qp = %d\n", p->min_qp);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tintra_period = %d\n", p->intra_period);
+    va_TraceMsg(trace_ctx, "\tbits_per_second = %d\n", p->bits_per_second);
+    va_TraceMsg(trace_ctx, "\tframe_rate = %d\n", p->frame_rate);
+    va_TraceMsg(trace_ctx, "\tinitial_qp = %d\n", p->initial_qp);
+    va_TraceMsg(trace_ctx, "\tmin_qp = %d\n", p->min_qp);
+    va_TraceMsg(trace_ctx, NULL);
 
     /* start a new sequce, coded log file can be truncated */
-    trace_context[idx].trace_sequence_start = 1;
+    va_ctx->trace_sequence_start = 1;
 
     return;
 }
@@ -1538,18 +3454,18 @@ static void va_TraceVAEncPictureParameterBufferH263(
     void *data)
 {
     VAEncPictureParameterBufferH263 *p = (VAEncPictureParameterBufferH263 *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
-    va_TraceMsg(idx, "VAEncPictureParameterBufferH263\n");
-    va_TraceMsg(idx, "\treference_picture = 0x%08x\n", p->reference_picture);
-    va_TraceMsg(idx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
-    va_TraceMsg(idx, "\tcoded_buf = %08x\n", p->coded_buf);
-    va_TraceMsg(idx, "\tpicture_width = %d\n", p->picture_width);
-    va_TraceMsg(idx, "\tpicture_height = %d\n", p->picture_height);
-    va_TraceMsg(idx, "\tpicture_type = 0x%08x\n", p->picture_type);
-    va_TraceMsg(idx, NULL);
-
-    trace_context[idx].trace_codedbuf =  p->coded_buf;
+    va_TraceMsg(trace_ctx, "VAEncPictureParameterBufferH263\n");
+    va_TraceMsg(trace_ctx, "\treference_picture = 0x%08x\n", p->reference_picture);
+    va_TraceMsg(trace_ctx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
+    va_TraceMsg(trace_ctx, "\tcoded_buf = %08x\n", p->coded_buf);
+    va_TraceMsg(trace_ctx, "\tpicture_width = %d\n", p->picture_width);
+    va_TraceMsg(trace_ctx, "\tpicture_height = %d\n", p->picture_height);
+    va_TraceMsg(trace_ctx, "\tpicture_type = 0x%08x\n", p->picture_type);
+    va_TraceMsg(trace_ctx, NULL);
+
+    va_ctx->trace_codedbuf =  p->coded_buf;
     
     return;
 }
@@ -1564,16 +3480,16 @@ static void va_TraceVAEncPictureParameterBufferJPEG(
     void *data)
 {
     VAEncPictureParameterBufferJPEG *p = (VAEncPictureParameterBufferJPEG *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
-    va_TraceMsg(idx, "VAEncPictureParameterBufferJPEG\n");
-    va_TraceMsg(idx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
-    va_TraceMsg(idx, "\tcoded_buf = %08x\n", p->coded_buf);
-    va_TraceMsg(idx, "\tpicture_width = %d\n", p->picture_width);
-    va_TraceMsg(idx, "\tpicture_height = %d\n", p->picture_height);
-    va_TraceMsg(idx, NULL);
-
-    trace_context[idx].trace_codedbuf =  p->coded_buf;
+    va_TraceMsg(trace_ctx, "VAEncPictureParameterBufferJPEG\n");
+    va_TraceMsg(trace_ctx, "\treconstructed_picture = 0x%08x\n", p->reconstructed_picture);
+    va_TraceMsg(trace_ctx, "\tcoded_buf = %08x\n", p->coded_buf);
+    va_TraceMsg(trace_ctx, "\tpicture_width = %d\n", p->picture_width);
+    va_TraceMsg(trace_ctx, "\tpicture_height = %d\n", p->picture_height);
+    va_TraceMsg(trace_ctx, NULL);
+
+    va_ctx->trace_codedbuf =  p->coded_buf;
     
     return;
 }
@@ -1588,31 +3504,31 @@ static void va_TraceVAEncQMatrixBufferJPEG(
     void *data)
 {
     VAQMatrixBufferJPEG *p = (VAQMatrixBufferJPEG *)data;
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
     
-    va_TraceMsg(idx, "VAQMatrixBufferJPEG\n");
-    va_TraceMsg(idx, "\tload_lum_quantiser_matrix = %d", p->load_lum_quantiser_matrix);
+    va_TraceMsg(trace_ctx, "VAQMatrixBufferJPEG\n");
+    va_TraceMsg(trace_ctx, "\tload_lum_quantiser_matrix = %d", p->load_lum_quantiser_matrix);
     if (p->load_lum_quantiser_matrix) {
         int i;
         for (i = 0; i < 64; i++) {
             if ((i % 8) == 0)
-                va_TraceMsg(idx, "\n\t");
-            va_TraceMsg(idx, "\t0x%02x", p->lum_quantiser_matrix[i]);
+                va_TraceMsg(trace_ctx, "\n\t");
+            va_TraceMsg(trace_ctx, "\t0x%02x", p->lum_quantiser_matrix[i]);
         }
-        va_TraceMsg(idx, "\n");
+        va_TraceMsg(trace_ctx, "\n");
     }
-    va_TraceMsg(idx, "\tload_chroma_quantiser_matrix = %08x\n", p->load_chroma_quantiser_matrix);
+    va_TraceMsg(trace_ctx, "\tload_chroma_quantiser_matrix = %08x\n", p->load_chroma_quantiser_matrix);
     if (p->load_chroma_quantiser_matrix) {
         int i;
         for (i = 0; i < 64; i++) {
             if ((i % 8) == 0)
-                va_TraceMsg(idx, "\n\t");
-            va_TraceMsg(idx, "\t0x%02x", p->chroma_quantiser_matrix[i]);
+                va_TraceMsg(trace_ctx, "\n\t");
+            va_TraceMsg(trace_ctx, "\t0x%02x", p->chroma_quantiser_matrix[i]);
         }
-        va_TraceMsg(idx, "\n");
+        va_TraceMsg(trace_ctx, "\n");
     }
     
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
     
     return;
 }
@@ -1787,7 +3703,7 @@ static void va_TraceH264Buf(
     void *pbuf
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
     
     switch (type) {
     case VAPictureParameterBufferType:
@@ -1806,7 +3722,7 @@ static void va_TraceH264Buf(
         va_TraceVASliceParameterBufferH264(dpy, context, buffer, type, size, num_elements, pbuf);
         break;
     case VASliceDataBufferType:
-        va_TraceVABuffers(dpy, context, buffer, type, trace_context[idx].trace_slice_size, num_elements, pbuf);
+        va_TraceVABuffers(dpy, context, buffer, type, va_ctx->trace_slice_size, num_elements, pbuf);
         break;
     case VAMacroblockParameterBufferType:
         va_TraceVABuffers(dpy, context, buffer, type, size, num_elements, pbuf);        
@@ -1858,7 +3774,7 @@ static void va_TraceVC1Buf(
     void *pbuf
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
 
     switch (type) {
     case VAPictureParameterBufferType:
@@ -1876,7 +3792,7 @@ static void va_TraceVC1Buf(
         va_TraceVASliceParameterBufferVC1(dpy, context, buffer, type, size, num_elements, pbuf);
         break;
     case VASliceDataBufferType:
-        va_TraceVABuffers(dpy, context, buffer, type, trace_context[idx].trace_slice_size, num_elements, pbuf);
+        va_TraceVABuffers(dpy, context, buffer, type, va_ctx->trace_slice_size, num_elements, pbuf);
         break;
     case VAMacroblockParameterBufferType:
         va_TraceVABuffers(dpy, context, buffer, type, size, num_elements, pbuf);
@@ -1908,6 +3824,116 @@ static void va_TraceVC1Buf(
     }
 }
 
+/* pretty print one buffer of vaRenderPicture according to the profile */
+static void va_TraceRenderBuffer(
+    VADisplay dpy,
+    VAContextID context,
+    VABufferID buffer,
+    VABufferType type,
+    unsigned int size,
+    unsigned int num_elements,
+    unsigned char *pbuf
+)
+{
+    unsigned int j;
+    DPY2TRACE_VACTX(dpy, context);
+
+    switch (va_ctx->trace_profile) {
+    case VAProfileMPEG2Simple:
+    case VAProfileMPEG2Main:
+        for (j=0; j<num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\t---------------------------\n", j);
+            va_TraceMsg(trace_ctx, "\telement[%d] = ", j);
+            va_TraceMPEG2Buf(dpy, context, buffer, type, size, num_elements, pbuf + size*j);
+        }
+        break;
+    case VAProfileMPEG4Simple:
+    case VAProfileMPEG4AdvancedSimple:
+    case VAProfileMPEG4Main:
+        for (j=0; j<num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\t---------------------------\n", j);
+            va_TraceMsg(trace_ctx, "\telement[%d] = ", j);
+            va_TraceMPEG4Buf(dpy, context, buffer, type, size, num_elements, pbuf + size*j);
+        }
+        break;
+    case VAProfileH264Baseline:
+    case VAProfileH264Main:
+    case VAProfileH264High:
+    case VAProfileH264ConstrainedBaseline:
+        for (j=0; j<num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\t---------------------------\n", j);
+            va_TraceMsg(trace_ctx, "\telement[%d] = ", j);
+            
+            va_TraceH264Buf(dpy, context, buffer, type, size, num_elements, pbuf + size*j);
+        }
+        break;
+    case VAProfileVC1Simple:
+    case VAProfileVC1Main:
+    case VAProfileVC1Advanced:
+        for (j=0; j<num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\t---------------------------\n", j);
+            va_TraceMsg(trace_ctx, "\telement[%d] = ", j);
+            
+            va_TraceVC1Buf(dpy, context, buffer, type, size, num_elements, pbuf + size*j);
+        }
+        break;
+    case VAProfileH263Baseline:
+        for (j=0; j<num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\t---------------------------\n", j);
+            va_TraceMsg(trace_ctx, "\telement[%d] = ", j);
+            
+            va_TraceH263Buf(dpy, context, buffer, type, size, num_elements, pbuf + size*j);
+        }
+        break;
+    case VAProfileJPEGBaseline:
+        for (j=0; j<num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\t---------------------------\n", j);
+            va_TraceMsg(trace_ctx, "\telement[%d] = ", j);
+            
+            va_TraceJPEGBuf(dpy, context, buffer, type, size, num_elements, pbuf + size*j);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* binary mode, save the buffers as they are */
+static void va_TraceRenderPictureRecord(
+    VADisplay dpy,
+    VAContextID context,
+    VABufferID *buffers,
+    int num_buffers
+)
+{
+    VABufferType type;
+    unsigned int size;
+    unsigned int num_elements;
+    int i;
+    DPY2TRACECTX(dpy);
+
+    TRACE_RECORD(trace_ctx, RenderPicture, NULL, 0, context, num_buffers);
+    for (i = 0; i < num_buffers; i++) {
+        uint32_t args[TRACE_RECORD_ARGS] = { context, i, buffers[i] };
+        unsigned char *pbuf;
+
+        if (vaBufferInfo(dpy, context, buffers[i], &type, &size, &num_elements) != VA_STATUS_SUCCESS) {
+            trace_record_write(trace_ctx, TRACE_CALL_Buffer, TRACE_RECORD_NO_INFO, args, NULL, 0);
+            continue;
+        }
+
+        args[3] = type;
+        args[4] = size;
+        args[5] = num_elements;
+        if (vaMapBuffer2(dpy, buffers[i], VA_MAPBUFFER_FLAG_READ, (void **)&pbuf) != VA_STATUS_SUCCESS) {
+            trace_record_write(trace_ctx, TRACE_CALL_Buffer, TRACE_RECORD_NO_DATA, args, NULL, 0);
+            continue;
+        }
+        trace_record_write(trace_ctx, TRACE_CALL_Buffer, 0, args, pbuf, size * num_elements);
+        vaUnmapBuffer(dpy, buffers[i]);
+    }
+}
+
 void va_TraceRenderPicture(
     VADisplay dpy,
     VAContextID context,
@@ -1919,90 +3945,44 @@ void va_TraceRenderPicture(
     unsigned int size;
     unsigned int num_elements;
     int i;
-    DPY2INDEX(dpy);
+    DPY2TRACE_VACTX(dpy, context);
 
-    TRACE_FUNCNAME(idx);
+    trace_ctx->trace_frame_skip = va_ctx->trace_frame_skip;
+    if (va_ctx->trace_frame_skip)
+        return;
+
+    if (trace_ctx->trace_binary) {
+        va_TraceRenderPictureRecord(dpy, context, buffers, num_buffers);
+        return;
+    }
+
+    TRACE_FUNCNAME(trace_ctx);
     
-    va_TraceMsg(idx, "\tcontext = 0x%08x\n", context);
-    va_TraceMsg(idx, "\tnum_buffers = %d\n", num_buffers);
+    va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
+    va_TraceMsg(trace_ctx, "\tnum_buffers = %d\n", num_buffers);
     for (i = 0; i < num_buffers; i++) {
         unsigned char *pbuf;
-        unsigned int j;
         
-        /* get buffer type information */
-        vaBufferInfo(dpy, context, buffers[i], &type, &size, &num_elements);
-
-        va_TraceMsg(idx, "\t---------------------------\n");
-        va_TraceMsg(idx, "\tbuffers[%d] = 0x%08x\n", i, buffers[i]);
-        va_TraceMsg(idx, "\t  type = %s\n", buffer_type_to_string(type));
-        va_TraceMsg(idx, "\t  size = %d\n", size);
-        va_TraceMsg(idx, "\t  num_elements = %d\n", num_elements);
-
-        vaMapBuffer(dpy, buffers[i], (void **)&pbuf);
-
-        switch (trace_context[idx].trace_profile) {
-        case VAProfileMPEG2Simple:
-        case VAProfileMPEG2Main:
-            for (j=0; j<num_elements; j++) {
-                va_TraceMsg(idx, "\t---------------------------\n", j);
-                va_TraceMsg(idx, "\telement[%d] = ", j);
-                va_TraceMPEG2Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size*j);
-            }
-            break;
-        case VAProfileMPEG4Simple:
-        case VAProfileMPEG4AdvancedSimple:
-        case VAProfileMPEG4Main:
-            for (j=0; j<num_elements; j++) {
-                va_TraceMsg(idx, "\t---------------------------\n", j);
-                va_TraceMsg(idx, "\telement[%d] = ", j);
-                va_TraceMPEG4Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size*j);
-            }
-            break;
-        case VAProfileH264Baseline:
-        case VAProfileH264Main:
-        case VAProfileH264High:
-        case VAProfileH264ConstrainedBaseline:
-            for (j=0; j<num_elements; j++) {
-                va_TraceMsg(idx, "\t---------------------------\n", j);
-                va_TraceMsg(idx, "\telement[%d] = ", j);
-                
-                va_TraceH264Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size*j);
-            }
-            break;
-        case VAProfileVC1Simple:
-        case VAProfileVC1Main:
-        case VAProfileVC1Advanced:
-            for (j=0; j<num_elements; j++) {
-                va_TraceMsg(idx, "\t---------------------------\n", j);
-                va_TraceMsg(idx, "\telement[%d] = ", j);
-                
-                va_TraceVC1Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size*j);
-            }
-            break;
-        case VAProfileH263Baseline:
-            for (j=0; j<num_elements; j++) {
-                va_TraceMsg(idx, "\t---------------------------\n", j);
-                va_TraceMsg(idx, "\telement[%d] = ", j);
-                
-                va_TraceH263Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size*j);
-            }
-            break;
-        case VAProfileJPEGBaseline:
-            for (j=0; j<num_elements; j++) {
-                va_TraceMsg(idx, "\t---------------------------\n", j);
-                va_TraceMsg(idx, "\telement[%d] = ", j);
-                
-                va_TraceJPEGBuf(dpy, context, buffers[i], type, size, num_elements, pbuf + size*j);
-            }
-            break;
-        default:
-            break;
-        }
+        va_TraceMsg(trace_ctx, "\t---------------------------\n");
+        va_TraceMsg(trace_ctx, "\tbuffers[%d] = 0x%08x\n", i, buffers[i]);
+
+        /* get buffer type information, the content can't be parsed without it */
+        if (vaBufferInfo(dpy, context, buffers[i], &type, &size, &num_elements) != VA_STATUS_SUCCESS)
+            continue;
+
+        va_TraceMsg(trace_ctx, "\t  type = %s\n", buffer_type_to_string(type));
+        va_TraceMsg(trace_ctx, "\t  size = %d\n", size);
+        va_TraceMsg(trace_ctx, "\t  num_elements = %d\n", num_elements);
+
+        if (vaMapBuffer2(dpy, buffers[i], VA_MAPBUFFER_FLAG_READ, (void **)&pbuf) != VA_STATUS_SUCCESS)
+            continue;
+
+        va_TraceRenderBuffer(dpy, context, buffers[i], type, size, num_elements, pbuf);
 
         vaUnmapBuffer(dpy, buffers[i]);
     }
 
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 void va_TraceEndPicture(
@@ -2011,41 +3991,51 @@ void va_TraceEndPicture(
     int endpic_done
 )
 {
-    int encode, decode, jpeg;
-    DPY2INDEX(dpy);
+    int encode, decode, jpeg, hash;
+    DPY2TRACE_VACTX(dpy, context);
 
-    TRACE_FUNCNAME(idx);
+    if ((trace_ctx->trace_flag & VA_TRACE_FLAG_TIMELINE) && endpic_done == 1)
+        trace_timeline_end_picture(trace_ctx, context, va_ctx->trace_rendertarget);
+
+    trace_ctx->trace_frame_skip = va_ctx->trace_frame_skip;
+    if (va_ctx->trace_frame_skip)
+        return;
+
+    TRACE_RECORD(trace_ctx, EndPicture, NULL, 0, context, endpic_done, va_ctx->trace_rendertarget);
+    TRACE_FUNCNAME(trace_ctx);
 
     if (endpic_done == 0) {
-        va_TraceMsg(idx, "\tcontext = 0x%08x\n", context);
-        va_TraceMsg(idx, "\trender_targets = 0x%08x\n", trace_context[idx].trace_rendertarget);
+        va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
+        va_TraceMsg(trace_ctx, "\trender_targets = 0x%08x\n", va_ctx->trace_rendertarget);
     }
 
-    encode = (trace_context[idx].trace_entrypoint == VAEntrypointEncSlice) &&
-        (trace_flag & VA_TRACE_FLAG_SURFACE_ENCODE);
-    decode = (trace_context[idx].trace_entrypoint == VAEntrypointVLD) &&
-        (trace_flag & VA_TRACE_FLAG_SURFACE_DECODE);
-    jpeg = (trace_context[idx].trace_entrypoint == VAEntrypointEncPicture) &&
-        (trace_flag & VA_TRACE_FLAG_SURFACE_JPEG);
+    encode = (va_ctx->trace_entrypoint == VAEntrypointEncSlice) &&
+        (trace_ctx->trace_flag & VA_TRACE_FLAG_SURFACE_ENCODE);
+    decode = (va_ctx->trace_entrypoint == VAEntrypointVLD) &&
+        (trace_ctx->trace_flag & VA_TRACE_FLAG_SURFACE_DECODE);
+    jpeg = (va_ctx->trace_entrypoint == VAEntrypointEncPicture) &&
+        (trace_ctx->trace_flag & VA_TRACE_FLAG_SURFACE_JPEG);
+    hash = (va_ctx->trace_entrypoint == VAEntrypointVLD) &&
+        (trace_ctx->trace_flag & VA_TRACE_FLAG_FRAMEHASH);
     
     /* want to trace encode source surface, do it before vaEndPicture */
     if ((encode || jpeg) && (endpic_done == 0))
-        va_TraceSurface(dpy);
+        va_TraceSurface(dpy, va_ctx, 1, 0);
     
     /* want to trace encoode codedbuf, do it after vaEndPicture */
     if ((encode || jpeg) && (endpic_done == 1)) {
         /* force the pipleline finish rendering */
-        vaSyncSurface(dpy, trace_context[idx].trace_rendertarget);
-        va_TraceCodedBuf(dpy);
+        vaSyncSurface(dpy, va_ctx->trace_rendertarget);
+        va_TraceCodedBuf(dpy, va_ctx);
     }
 
     /* want to trace decode dest surface, do it after vaEndPicture */
-    if (decode && (endpic_done == 1)) {
+    if ((decode || hash) && (endpic_done == 1)) {
         /* force the pipleline finish rendering */
-        vaSyncSurface(dpy, trace_context[idx].trace_rendertarget);
-        va_TraceSurface(dpy);
+        vaSyncSurface(dpy, va_ctx->trace_rendertarget);
+        va_TraceSurface(dpy, va_ctx, decode, hash);
     }
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 void va_TraceSyncSurface(
@@ -2053,12 +4043,19 @@ void va_TraceSyncSurface(
     VASurfaceID render_target
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
+
+    if (trace_ctx->trace_flag & VA_TRACE_FLAG_TIMELINE)
+        trace_timeline_surface(trace_ctx, render_target, 0);
 
-    TRACE_FUNCNAME(idx);
+    if (!(trace_ctx->trace_flag & VA_TRACE_FLAG_LOG) || trace_ctx->trace_frame_skip)
+        return;
+
+    TRACE_RECORD(trace_ctx, SyncSurface, NULL, 0, render_target);
+    TRACE_FUNCNAME(trace_ctx);
 
-    va_TraceMsg(idx, "\trender_target = 0x%08x\n", render_target);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\trender_target = 0x%08x\n", render_target);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
@@ -2068,13 +4065,14 @@ void va_TraceQuerySurfaceStatus(
     VASurfaceStatus *status    /* out */
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACECTX_SAMPLED(dpy);
 
-    TRACE_FUNCNAME(idx);
+    TRACE_RECORD(trace_ctx, QuerySurfaceStatus, NULL, 0, render_target, *status);
+    TRACE_FUNCNAME(trace_ctx);
 
-    va_TraceMsg(idx, "\trender_target = 0x%08x\n", render_target);
-    va_TraceMsg(idx, "\tstatus = 0x%08x\n", *status);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\trender_target = 0x%08x\n", render_target);
+    va_TraceMsg(trace_ctx, "\tstatus = 0x%08x\n", *status);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
@@ -2085,21 +4083,36 @@ void va_TraceQuerySurfaceError(
     void **error_info       /*out*/
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACECTX_SAMPLED(dpy);
+
+    if (trace_ctx->trace_binary) {
+        VASurfaceDecodeMBErrors *p = NULL;
+        unsigned int num_errors = 0;
+
+        /* the error records, with the terminating one */
+        if (error_status == VA_STATUS_ERROR_DECODING_ERROR) {
+            p = *error_info;
+            while (p[num_errors++].status != -1)
+                ;
+        }
+        TRACE_RECORD(trace_ctx, QuerySurfaceError, p, num_errors * sizeof(VASurfaceDecodeMBErrors),
+                     surface, error_status);
+        return;
+    }
 
-    TRACE_FUNCNAME(idx);
-    va_TraceMsg(idx, "\tsurface = 0x%08x\n", surface);
-    va_TraceMsg(idx, "\terror_status = 0x%08x\n", error_status);
+    TRACE_FUNCNAME(trace_ctx);
+    va_TraceMsg(trace_ctx, "\tsurface = 0x%08x\n", surface);
+    va_TraceMsg(trace_ctx, "\terror_status = 0x%08x\n", error_status);
     if (error_status == VA_STATUS_ERROR_DECODING_ERROR) {
         VASurfaceDecodeMBErrors *p = *error_info;
         while (p->status != -1) {
-            va_TraceMsg(idx, "\t\tstatus = %d\n", p->status);
-            va_TraceMsg(idx, "\t\tstart_mb = %d\n", p->start_mb);
-            va_TraceMsg(idx, "\t\tend_mb = %d\n", p->end_mb);
+            va_TraceMsg(trace_ctx, "\t\tstatus = %d\n", p->status);
+            va_TraceMsg(trace_ctx, "\t\tstart_mb = %d\n", p->start_mb);
+            va_TraceMsg(trace_ctx, "\t\tend_mb = %d\n", p->end_mb);
             p++; /* next error record */
         }
     }
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 void va_TraceMaxNumDisplayAttributes (
@@ -2107,12 +4120,13 @@ void va_TraceMaxNumDisplayAttributes (
     int number
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    TRACE_RECORD(trace_ctx, MaxNumDisplayAttributes, NULL, 0, number);
+    TRACE_FUNCNAME(trace_ctx);
     
-    va_TraceMsg(idx, "\tmax_display_attributes = %d\n", number);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tmax_display_attributes = %d\n", number);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 void va_TraceQueryDisplayAttributes (
@@ -2123,19 +4137,22 @@ void va_TraceQueryDisplayAttributes (
 {
     int i;
     
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
+
+    TRACE_RECORD(trace_ctx, QueryDisplayAttributes, attr_list, *num_attributes * sizeof(VADisplayAttribute),
+                 *num_attributes);
     
-    va_TraceMsg(idx, "\tnum_attributes = %d\n", *num_attributes);
+    va_TraceMsg(trace_ctx, "\tnum_attributes = %d\n", *num_attributes);
 
     for (i=0; i<*num_attributes; i++) {
-        va_TraceMsg(idx, "\tattr_list[%d] =\n");
-        va_TraceMsg(idx, "\t  typ = 0x%08x\n", attr_list[i].type);
-        va_TraceMsg(idx, "\t  min_value = %d\n", attr_list[i].min_value);
-        va_TraceMsg(idx, "\t  max_value = %d\n", attr_list[i].max_value);
-        va_TraceMsg(idx, "\t  value = %d\n", attr_list[i].value);
-        va_TraceMsg(idx, "\t  flags = %d\n", attr_list[i].flags);
+        va_TraceMsg(trace_ctx, "\tattr_list[%d] =\n");
+        va_TraceMsg(trace_ctx, "\t  typ = 0x%08x\n", attr_list[i].type);
+        va_TraceMsg(trace_ctx, "\t  min_value = %d\n", attr_list[i].min_value);
+        va_TraceMsg(trace_ctx, "\t  max_value = %d\n", attr_list[i].max_value);
+        va_TraceMsg(trace_ctx, "\t  value = %d\n", attr_list[i].value);
+        va_TraceMsg(trace_ctx, "\t  flags = %d\n", attr_list[i].flags);
     }
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
@@ -2147,18 +4164,18 @@ static void va_TraceDisplayAttributes (
 {
     int i;
     
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
     
-    va_TraceMsg(idx, "\tnum_attributes = %d\n", num_attributes);
+    va_TraceMsg(trace_ctx, "\tnum_attributes = %d\n", num_attributes);
     for (i=0; i<num_attributes; i++) {
-        va_TraceMsg(idx, "\tattr_list[%d] =\n");
-        va_TraceMsg(idx, "\t  typ = 0x%08x\n", attr_list[i].type);
-        va_TraceMsg(idx, "\t  min_value = %d\n", attr_list[i].min_value);
-        va_TraceMsg(idx, "\t  max_value = %d\n", attr_list[i].max_value);
-        va_TraceMsg(idx, "\t  value = %d\n", attr_list[i].value);
-        va_TraceMsg(idx, "\t  flags = %d\n", attr_list[i].flags);
+        va_TraceMsg(trace_ctx, "\tattr_list[%d] =\n");
+        va_TraceMsg(trace_ctx, "\t  typ = 0x%08x\n", attr_list[i].type);
+        va_TraceMsg(trace_ctx, "\t  min_value = %d\n", attr_list[i].min_value);
+        va_TraceMsg(trace_ctx, "\t  max_value = %d\n", attr_list[i].max_value);
+        va_TraceMsg(trace_ctx, "\t  value = %d\n", attr_list[i].value);
+        va_TraceMsg(trace_ctx, "\t  flags = %d\n", attr_list[i].flags);
     }
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, NULL);
 }
 
 
@@ -2168,9 +4185,11 @@ void va_TraceGetDisplayAttributes (
     int num_attributes
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    TRACE_RECORD(trace_ctx, GetDisplayAttributes, attr_list, num_attributes * sizeof(VADisplayAttribute),
+                 num_attributes);
+    TRACE_FUNCNAME(trace_ctx);
 
     va_TraceDisplayAttributes (dpy, attr_list, num_attributes);
 }
@@ -2181,9 +4200,11 @@ void va_TraceSetDisplayAttributes (
     int num_attributes
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    TRACE_RECORD(trace_ctx, SetDisplayAttributes, attr_list, num_attributes * sizeof(VADisplayAttribute),
+                 num_attributes);
+    TRACE_FUNCNAME(trace_ctx);
 
     va_TraceDisplayAttributes (dpy, attr_list, num_attributes);
 }
@@ -2206,22 +4227,328 @@ void va_TracePutSurface (
     unsigned int flags /* de-interlacing flags */
 )
 {
-    DPY2INDEX(dpy);
+    DPY2TRACECTX(dpy);
+
+    if (trace_ctx->trace_flag & VA_TRACE_FLAG_TIMELINE)
+        trace_timeline_surface(trace_ctx, surface, 1);
+
+    if (trace_ctx->trace_frame_skip)
+        return;
+
+    if (trace_ctx->trace_binary) {
+        struct trace_put_surface args;
+
+        args.draw = (uintptr_t)draw;
+        args.cliprects = (uintptr_t)cliprects;
+        args.srcx = srcx;
+        args.srcy = srcy;
+        args.srcw = srcw;
+        args.srch = srch;
+        args.destx = destx;
+        args.desty = desty;
+        args.destw = destw;
+        args.desth = desth;
+        args.number_cliprects = number_cliprects;
+        args.flags = flags;
+        TRACE_RECORD(trace_ctx, PutSurface, &args, sizeof(args), surface);
+        return;
+    }
 
-    TRACE_FUNCNAME(idx);
+    TRACE_FUNCNAME(trace_ctx);
     
-    va_TraceMsg(idx, "\tsurface = 0x%08x\n", surface);
-    va_TraceMsg(idx, "\tdraw = 0x%08x\n", draw);
-    va_TraceMsg(idx, "\tsrcx = %d\n", srcx);
-    va_TraceMsg(idx, "\tsrcy = %d\n", srcy);
-    va_TraceMsg(idx, "\tsrcw = %d\n", srcw);
-    va_TraceMsg(idx, "\tsrch = %d\n", srch);
-    va_TraceMsg(idx, "\tdestx = %d\n", destx);
-    va_TraceMsg(idx, "\tdesty = %d\n", desty);
-    va_TraceMsg(idx, "\tdestw = %d\n", destw);
-    va_TraceMsg(idx, "\tdesth = %d\n", desth);
-    va_TraceMsg(idx, "\tcliprects = 0x%08x\n", cliprects);
-    va_TraceMsg(idx, "\tnumber_cliprects = %d\n", number_cliprects);
-    va_TraceMsg(idx, "\tflags = 0x%08x\n", flags);
-    va_TraceMsg(idx, NULL);
+    va_TraceMsg(trace_ctx, "\tsurface = 0x%08x\n", surface);
+    va_TraceMsg(trace_ctx, "\tdraw = 0x%08x\n", draw);
+    va_TraceMsg(trace_ctx, "\tsrcx = %d\n", srcx);
+    va_TraceMsg(trace_ctx, "\tsrcy = %d\n", srcy);
+    va_TraceMsg(trace_ctx, "\tsrcw = %d\n", srcw);
+    va_TraceMsg(trace_ctx, "\tsrch = %d\n", srch);
+    va_TraceMsg(trace_ctx, "\tdestx = %d\n", destx);
+    va_TraceMsg(trace_ctx, "\tdesty = %d\n", desty);
+    va_TraceMsg(trace_ctx, "\tdestw = %d\n", destw);
+    va_TraceMsg(trace_ctx, "\tdesth = %d\n", desth);
+    va_TraceMsg(trace_ctx, "\tcliprects = 0x%08x\n", cliprects);
+    va_TraceMsg(trace_ctx, "\tnumber_cliprects = %d\n", number_cliprects);
+    va_TraceMsg(trace_ctx, "\tflags = 0x%08x\n", flags);
+    va_TraceMsg(trace_ctx, NULL);
+}
+
+
+/* number of complete items of the record data, at most num */
+static unsigned int trace_record_num(const struct trace_record *record, unsigned int num, size_t size)
+{
+    if (num > record->data_size / size)
+        num = record->data_size / size;
+
+    return num;
+}
+
+/* call the hook of a binary record with the decode context to print it */
+static void va_TraceReplay(
+    VADisplay dpy,
+    const struct trace_record *record,
+    void *data
+)
+{
+    const uint32_t *args = record->args;
+    DPY2TRACECTX(dpy);
+
+    switch (record->call) {
+    case TRACE_CALL_Initialize:
+        va_TraceInitialize(dpy, NULL, NULL);
+        break;
+    case TRACE_CALL_Terminate:
+        va_TraceTerminate(dpy);
+        break;
+    case TRACE_CALL_CreateConfig: {
+        VAConfigID config_id = args[3];
+
+        va_TraceCreateConfig(dpy, args[0], args[1], data,
+                             trace_record_num(record, args[2], sizeof(VAConfigAttrib)),
+                             &config_id);
+        break;
+    }
+    case TRACE_CALL_CreateSurface:
+        va_TraceCreateSurface(dpy, args[0], args[1], args[2],
+                              trace_record_num(record, args[3], sizeof(VASurfaceID)),
+                              data);
+        break;
+    case TRACE_CALL_CreateContext: {
+        VAContextID context = args[5];
+
+        va_TraceCreateContext(dpy, args[0], args[1], args[2], args[3], data,
+                              trace_record_num(record, args[4], sizeof(VASurfaceID)),
+                              &context);
+        break;
+    }
+    case TRACE_CALL_MapBuffer: {
+        struct trace_coded_segment *segment = data;
+        VACodedBufferSegment *buf_list;
+        unsigned int i, num_segments;
+
+        num_segments = trace_record_num(record, args[1], sizeof(struct trace_coded_segment));
+        buf_list = calloc(num_segments + 1, sizeof(VACodedBufferSegment));
+        if (buf_list == NULL)
+            break;
+        for (i = 0; i < num_segments; i++) {
+            buf_list[i].size = segment[i].size;
+            buf_list[i].bit_offset = segment[i].bit_offset;
+            buf_list[i].status = segment[i].status;
+            buf_list[i].reserved = segment[i].reserved;
+            buf_list[i].buf = (void *)(uintptr_t)segment[i].buf;
+            buf_list[i].next = (i + 1 < num_segments) ? &buf_list[i + 1] : NULL;
+        }
+        va_TraceCodedBufSegments(trace_ctx, num_segments ? buf_list : NULL);
+        free(buf_list);
+        break;
+    }
+    case TRACE_CALL_BeginPicture: {
+        struct trace_va_context *va_ctx = trace_va_context_get(trace_ctx, args[0]);
+
+        /* the frames may be sampled */
+        if (va_ctx)
+            va_ctx->trace_frame_no = args[2];
+        va_TraceBeginPicture(dpy, args[0], args[1]);
+        break;
+    }
+    case TRACE_CALL_RenderPicture:
+        /* the buffers follow as TRACE_CALL_Buffer records */
+        va_TraceMsg(trace_ctx, "==========%s\n", "va_TraceRenderPicture");
+        va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", args[0]);
+        va_TraceMsg(trace_ctx, "\tnum_buffers = %d\n", args[1]);
+        break;
+    case TRACE_CALL_Buffer:
+        va_TraceMsg(trace_ctx, "\t---------------------------\n");
+        va_TraceMsg(trace_ctx, "\tbuffers[%d] = 0x%08x\n", args[1], args[2]);
+        if (record->flags & TRACE_RECORD_NO_INFO)
+            break;
+
+        va_TraceMsg(trace_ctx, "\t  type = %s\n", buffer_type_to_string(args[3]));
+        va_TraceMsg(trace_ctx, "\t  size = %d\n", args[4]);
+        va_TraceMsg(trace_ctx, "\t  num_elements = %d\n", args[5]);
+        if (record->flags & TRACE_RECORD_NO_DATA)
+            break;
+
+        if (record->flags & TRACE_RECORD_TRUNCATED) {
+            va_TraceMsg(trace_ctx, "\t  content truncated, only %d bytes in the log\n", record->data_size);
+            break;
+        }
+        va_TraceRenderBuffer(dpy, args[0], args[2], args[3], args[4], args[5], data);
+        break;
+    case TRACE_CALL_EndPicture: {
+        struct trace_va_context *va_ctx = trace_va_context_get(trace_ctx, args[0]);
+
+        if (va_ctx)
+            va_ctx->trace_rendertarget = args[2];
+        va_TraceEndPicture(dpy, args[0], args[1]);
+        break;
+    }
+    case TRACE_CALL_SyncSurface:
+        va_TraceSyncSurface(dpy, args[0]);
+        break;
+    case TRACE_CALL_QuerySurfaceStatus: {
+        VASurfaceStatus status = args[1];
+
+        va_TraceQuerySurfaceStatus(dpy, args[0], &status);
+        break;
+    }
+    case TRACE_CALL_QuerySurfaceError: {
+        VASurfaceDecodeMBErrors *errors;
+        unsigned int num_errors;
+        void *error_info;
+
+        /* terminate the error records again, the last ones may be truncated */
+        num_errors = trace_record_num(record, record->data_size, sizeof(VASurfaceDecodeMBErrors));
+        errors = calloc(num_errors + 1, sizeof(VASurfaceDecodeMBErrors));
+        if (errors == NULL)
+            break;
+        memcpy(errors, data, num_errors * sizeof(VASurfaceDecodeMBErrors));
+        errors[num_errors].status = -1;
+        error_info = errors;
+        va_TraceQuerySurfaceError(dpy, args[0], args[1], &error_info);
+        free(errors);
+        break;
+    }
+    case TRACE_CALL_MaxNumDisplayAttributes:
+        va_TraceMaxNumDisplayAttributes(dpy, args[0]);
+        break;
+    case TRACE_CALL_QueryDisplayAttributes: {
+        int num_attributes = trace_record_num(record, args[0], sizeof(VADisplayAttribute));
+
+        va_TraceQueryDisplayAttributes(dpy, data, &num_attributes);
+        break;
+    }
+    case TRACE_CALL_GetDisplayAttributes:
+        va_TraceGetDisplayAttributes(dpy, data,
+                                     trace_record_num(record, args[0], sizeof(VADisplayAttribute)));
+        break;
+    case TRACE_CALL_SetDisplayAttributes:
+        va_TraceSetDisplayAttributes(dpy, data,
+                                     trace_record_num(record, args[0], sizeof(VADisplayAttribute)));
+        break;
+    case TRACE_CALL_PutSurface: {
+        struct trace_put_surface *p = data;
+
+        if (record->data_size < sizeof(*p))
+            break;
+        va_TracePutSurface(dpy, args[0], (void *)(uintptr_t)p->draw,
+                           p->srcx, p->srcy, p->srcw, p->srch,
+                           p->destx, p->desty, p->destw, p->desth,
+                           (VARectangle *)(uintptr_t)p->cliprects,
+                           p->number_cliprects, p->flags);
+        break;
+    }
+    case TRACE_CALL_DestroyConfig:
+        va_TraceDestroyConfig(dpy, args[0]);
+        break;
+    case TRACE_CALL_DestroySurfaces:
+        va_TraceDestroySurfaces(dpy, data, trace_record_num(record, args[0], sizeof(VASurfaceID)));
+        break;
+    case TRACE_CALL_DestroyContext:
+        va_TraceDestroyContext(dpy, args[0]);
+        break;
+    case TRACE_CALL_DestroyBuffer:
+        va_TraceDestroyBuffer(dpy, args[0]);
+        break;
+    default:
+        /* from a newer libva */
+        break;
+    }
+}
+
+int va_TraceDecode(const char *fn, FILE *out, int flags)
+{
+    struct VADisplayContext display_ctx;
+    struct trace_context decode_ctx;
+    struct trace_ring_header *ring;
+    unsigned char *data;
+    struct stat buf;
+    uint64_t offset, left, ring_size;
+    void *map;
+    int fd, ret = 0;
+
+    fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &buf) != 0 || buf.st_size < sizeof(struct trace_ring_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* private and writable, the hooks don't take const pointers */
+    map = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    ring = map;
+    if (memcmp(ring->magic, TRACE_CAPTURE_MAGIC, sizeof(TRACE_CAPTURE_MAGIC)) == 0 &&
+        ring->version == TRACE_RING_VERSION &&
+        ring->header_size <= (uint64_t)buf.st_size) {
+        /* a capture, the records go up to the end of the file */
+        ring_size = buf.st_size - ring->header_size;
+        offset = 0;
+        left = ring_size;
+    } else if (memcmp(ring->magic, TRACE_RING_MAGIC, sizeof(TRACE_RING_MAGIC)) == 0 &&
+               ring->version == TRACE_RING_VERSION &&
+               ring->header_size + ring->ring_size <= (uint64_t)buf.st_size &&
+               ring->tail < ring->ring_size &&
+               ring->used <= ring->ring_size) {
+        ring_size = ring->ring_size;
+        offset = ring->tail;
+        left = ring->used;
+    } else {
+        munmap(map, buf.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    data = (unsigned char *)map + ring->header_size;
+
+    /* the hooks print into out, as if LIBVA_TRACE was set */
+    memset(&display_ctx, 0, sizeof(display_ctx));
+    memset(&decode_ctx, 0, sizeof(decode_ctx));
+    decode_ctx.trace_flag = VA_TRACE_FLAG_LOG | (flags & VA_TRACE_FLAG_BUFDATA);
+    decode_ctx.trace_logsize = 0xffffffff;
+    decode_ctx.trace_fp_log = out;
+    if (trace_va_state_init(&decode_ctx) != 0) {
+        munmap(map, buf.st_size);
+        errno = ENOMEM;
+        return -1;
+    }
+    display_ctx.vatrace = &decode_ctx;
+
+    if (ring->overwritten)
+        va_TraceMsg(&decode_ctx, "==========%llu %s records were %s\n",
+                    (unsigned long long)ring->overwritten,
+                    ring->ring_size ? "older" : "captured",
+                    ring->ring_size ? "overwritten" : "lost");
+
+    while (left > 0) {
+        struct trace_record *record = (struct trace_record *)(data + offset);
+
+        if (record->size < 8 || (record->size & 7) || record->size > left ||
+            offset + record->size > ring_size ||
+            (record->call != TRACE_CALL_PAD &&
+             (record->size < sizeof(*record) ||
+              sizeof(*record) + record->data_size > record->size))) {
+            errno = EINVAL;
+            ret = -1;
+            break;
+        }
+
+        if (record->call != TRACE_CALL_PAD)
+            va_TraceReplay(&display_ctx, record, record + 1);
+
+        offset += record->size;
+        if (offset == ring_size)
+            offset = 0;
+        left -= record->size;
+    }
+    fflush(out);
+
+    trace_va_state_fini(&decode_ctx);
+    munmap(map, buf.st_size);
+
+    return ret;
 }
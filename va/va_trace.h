@@ -25,6 +25,9 @@
 #ifndef VA_TRACE_H
 #define VA_TRACE_H
 
+#include <stdio.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,24 +43,51 @@ extern int trace_flag;
 #define VA_TRACE_FLAG_SURFACE         (VA_TRACE_FLAG_SURFACE_DECODE | \
                                        VA_TRACE_FLAG_SURFACE_ENCODE | \
                                        VA_TRACE_FLAG_SURFACE_JPEG)
+#define VA_TRACE_FLAG_TIMELINE        0x40
+#define VA_TRACE_FLAG_FRAMEHASH       0x80
 
+/*
+ * trace_flag only tells whether some display is traced, the hooks
+ * check the flags of dpy (the display of the calling entry-point) and
+ * run under its trace lock
+ */
 #define VA_TRACE_FUNC(trace_func,...)           \
-    if (trace_flag) {                           \
+    if (va_atomic_load(&trace_flag)) {          \
+        va_TraceLock(dpy);                      \
         trace_func(__VA_ARGS__);                \
+        va_TraceUnlock(dpy);                    \
     }
 #define VA_TRACE_LOG(trace_func,...)            \
-    if (trace_flag & VA_TRACE_FLAG_LOG) {            \
-        trace_func(__VA_ARGS__);                \
-    }
-#define VA_TRACE_SURFACE(trace_func,...)        \
-    if (trace_flag & (VA_TRACE_FLAG_SURFACE | VA_TRACE_FLAG_CODEDBUF)) {  \
+    if (va_atomic_load(&trace_flag) & VA_TRACE_FLAG_LOG) { \
+        va_TraceLock(dpy);                      \
         trace_func(__VA_ARGS__);                \
+        va_TraceUnlock(dpy);                    \
     }
 
+struct trace_context;
+
 void va_TraceInit(VADisplay dpy);
 void va_TraceEnd(VADisplay dpy);
 
-void va_TraceMsg(int idx, const char *msg, ...);
+void va_TraceLock(VADisplay dpy);
+void va_TraceUnlock(VADisplay dpy);
+
+void va_TraceMsg(struct trace_context *trace_ctx, const char *msg, ...);
+
+/* LIBVA_TRACE_TIMELINE, called by VA_LATENCY_RECORD() for every timed call */
+void va_TraceTimelineCall(
+    VADisplay dpy,
+    VAContextID context,
+    const char *name,
+    uint64_t start,     /* CLOCK_MONOTONIC, in ns */
+    uint64_t end
+);
+
+/*
+ * write the text of the LIBVA_TRACE_BINARY log fn into out, flags can be
+ * VA_TRACE_FLAG_BUFDATA to dump the buffers, return 0 or -1 and errno
+ */
+int va_TraceDecode(const char *fn, FILE *out, int flags);
 
 void va_TraceInitialize (
     VADisplay dpy,
@@ -99,6 +129,27 @@ void va_TraceCreateContext(
 );
 
 
+void va_TraceDestroyConfig(
+    VADisplay dpy,
+    VAConfigID config_id
+);
+
+void va_TraceDestroySurfaces(
+    VADisplay dpy,
+    VASurfaceID *surface_list,
+    int num_surfaces
+);
+
+void va_TraceDestroyContext(
+    VADisplay dpy,
+    VAContextID context
+);
+
+void va_TraceDestroyBuffer(
+    VADisplay dpy,
+    VABufferID buf_id
+);
+
 void va_TraceMapBuffer (
     VADisplay dpy,
     VABufferID buf_id,	/* in */
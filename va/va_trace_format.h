@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2013 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The records of LIBVA_TRACE_BINARY and LIBVA_TRACE_CAPTURE, written by
+ * va_trace.c, read by va_TraceDecode() and test/replay/va_replay
+ */
+
+#ifndef VA_TRACE_FORMAT_H
+#define VA_TRACE_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * LIBVA_TRACE_BINARY file layout: a struct trace_ring_header followed by
+ * ring_size bytes of records. The records start with a fixed-size struct
+ * trace_record, the raw data (e.g. the buffer content) follows, the total
+ * is padded to 8 bytes. A record never wraps around the end of the ring,
+ * a TRACE_CALL_PAD record fills the end instead. Everything is in the
+ * byte order of the traced host.
+ *
+ * LIBVA_TRACE_CAPTURE files have the same header with TRACE_CAPTURE_MAGIC
+ * and a ring_size of 0, the records follow up to the end of the file in
+ * the order of the calls, nothing is overwritten nor truncated.
+ */
+#define TRACE_RING_MAGIC        "VATRACE"
+#define TRACE_CAPTURE_MAGIC     "VACAPTR"
+#define TRACE_RING_VERSION      1
+
+struct trace_ring_header {
+    char magic[8];              /* TRACE_RING_MAGIC */
+    uint32_t version;           /* TRACE_RING_VERSION */
+    uint32_t header_size;       /* offset of the ring in the file */
+    uint64_t ring_size;         /* 0 in a capture */
+    uint64_t head;              /* offset of the next record */
+    uint64_t tail;              /* offset of the oldest record */
+    uint64_t used;              /* bytes from tail to head */
+    uint64_t records;           /* records written */
+    uint64_t overwritten;       /* records lost to make room for new ones */
+};
+
+#define TRACE_RECORD_ARGS       6
+#define TRACE_RECORD_ALIGN(x)   (((x) + 7) & ~7ULL)
+
+/* trace_record.flags */
+#define TRACE_RECORD_TRUNCATED  0x1 /* the data didn't fit into the ring */
+#define TRACE_RECORD_NO_INFO    0x2 /* vaBufferInfo failed */
+#define TRACE_RECORD_NO_DATA    0x4 /* vaMapBuffer2 failed */
+
+struct trace_record {
+    uint32_t size;              /* of the whole record, padding included */
+    uint16_t call;              /* TRACE_CALL_xxx */
+    uint16_t flags;             /* TRACE_RECORD_xxx */
+    uint64_t timestamp;         /* CLOCK_MONOTONIC, in ns */
+    uint32_t args[TRACE_RECORD_ARGS]; /* handles and scalar arguments */
+    uint32_t data_size;         /* bytes of data following the record */
+    uint32_t reserved;
+};
+
+/* trace_record.call, and the meaning of args[] and of the data */
+enum {
+    TRACE_CALL_PAD = 0,         /* skip to the start of the ring */
+    TRACE_CALL_Initialize,
+    TRACE_CALL_Terminate,
+    TRACE_CALL_CreateConfig,    /* profile, entrypoint, num_attribs, config_id; attrib_list */
+    TRACE_CALL_CreateSurface,   /* width, height, format, num_surfaces; surfaces */
+    TRACE_CALL_CreateContext,   /* config_id, width, height, flag, num_render_targets,
+                                 * context; render_targets */
+    TRACE_CALL_MapBuffer,       /* buf_id, num_segments; struct trace_coded_segment[] */
+    TRACE_CALL_BeginPicture,    /* context, render_target, frame_no */
+    TRACE_CALL_RenderPicture,   /* context, num_buffers, a TRACE_CALL_Buffer follows per buffer */
+    TRACE_CALL_Buffer,          /* context, index, buffer, type, size, num_elements; content */
+    TRACE_CALL_EndPicture,      /* context, endpic_done, render_target */
+    TRACE_CALL_SyncSurface,     /* render_target */
+    TRACE_CALL_QuerySurfaceStatus, /* render_target, status */
+    TRACE_CALL_QuerySurfaceError,  /* surface, error_status; VASurfaceDecodeMBErrors[] */
+    TRACE_CALL_MaxNumDisplayAttributes, /* number */
+    TRACE_CALL_QueryDisplayAttributes,  /* num_attributes; attr_list */
+    TRACE_CALL_GetDisplayAttributes,    /* num_attributes; attr_list */
+    TRACE_CALL_SetDisplayAttributes,    /* num_attributes; attr_list */
+    TRACE_CALL_PutSurface,      /* surface; struct trace_put_surface */
+    TRACE_CALL_DestroyConfig,   /* config_id */
+    TRACE_CALL_DestroySurfaces, /* num_surfaces; surfaces */
+    TRACE_CALL_DestroyContext,  /* context */
+    TRACE_CALL_DestroyBuffer,   /* buf_id */
+    TRACE_CALL_MAX
+};
+
+struct trace_coded_segment {
+    uint32_t size;
+    uint32_t bit_offset;
+    uint32_t status;
+    uint32_t reserved;
+    uint64_t buf;
+};
+
+struct trace_put_surface {
+    uint64_t draw;
+    uint64_t cliprects;
+    int16_t srcx, srcy;
+    uint16_t srcw, srch;
+    int16_t destx, desty;
+    uint16_t destw, desth;
+    uint32_t number_cliprects;
+    uint32_t flags;
+};
+
+#endif /* VA_TRACE_FORMAT_H */
@@ -22,8 +22,10 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include "va_dricommon.h"
+#include <pthread.h>
 
-// X error trap
+// X error trap, the handler is process-wide so one display at a time
+static pthread_mutex_t x11_error_lock = PTHREAD_MUTEX_INITIALIZER;
 static int x11_error_code = 0;
 static int (*old_error_handler)(Display *, XErrorEvent *);
 
@@ -37,6 +39,7 @@ error_handler(Display *dpy, XErrorEvent *error)
 static void 
 x11_trap_errors(void)
 {
+    pthread_mutex_lock(&x11_error_lock);
     x11_error_code    = 0;
     old_error_handler = XSetErrorHandler(error_handler);
 }
@@ -44,8 +47,12 @@ x11_trap_errors(void)
 static int 
 x11_untrap_errors(void)
 {
+    int error_code;
+
     XSetErrorHandler(old_error_handler);
-    return x11_error_code;
+    error_code = x11_error_code;
+    pthread_mutex_unlock(&x11_error_lock);
+    return error_code;
 }
 
 static int 
@@ -28,6 +28,7 @@
 #include "va_backend.h"
 #include "va_trace.h"
 #include "va_fool.h"
+#include "va_latency.h"
 #include "va_x11.h"
 #include "va_dri2.h"
 #include "va_dricommon.h"
@@ -231,8 +232,10 @@ VAStatus vaPutSurface (
 )
 {
   VADriverContextP ctx;
+  VAStatus va_status;
+  VA_LATENCY_START();
 
-  if (fool_postp)
+  if (va_atomic_load(&fool_postp))
       return VA_STATUS_SUCCESS;
 
   CHECK_DISPLAY(dpy);
@@ -242,7 +245,11 @@ VAStatus vaPutSurface (
                 destx, desty, destw, desth,
            cliprects, number_cliprects, flags );
   
-  return ctx->vtable->vaPutSurface( ctx, surface, (void *)draw, srcx, srcy, srcw, srch,
-                                   destx, desty, destw, desth,
-                                   cliprects, number_cliprects, flags );
+  va_status = ctx->vtable->vaPutSurface( ctx, surface, (void *)draw, srcx, srcy, srcw, srch,
+                                        destx, desty, destw, desth,
+                                        cliprects, number_cliprects, flags );
+
+  VA_LATENCY_RECORD(dpy, VA_INVALID_ID, PutSurface);
+
+  return va_status;
 }